@@ -5,9 +5,17 @@
 
 /*
  * Contiguous, indexable chunk of memory.
+ *
+ * The items sit in the middle of the buffer, starting at `head`, with
+ * room to grow on both sides, so pushing at either end is amortized
+ * O(1). The buffer grows (to a power of two) only when the items don't
+ * fit. Both the array and its buffer are allocated through the collector,
+ * which scans them, so an array of Value pointers keeps the values alive
+ * for as long as the array itself is reachable.
  */
 typedef struct array {
     char *p;
+    size_t head;
     size_t size;
     size_t capacity;
     size_t bytes;
@@ -25,6 +33,7 @@ void *array_at(Array *a, size_t i);
 #define array_typed_at(a,i,t) ((t*) array_at(a, i))
 void array_push_back(Array *a, const void *value, size_t n);
 void array_push_front(Array *a, const void *value, size_t n);
+/* the popped item stays valid until the next push */
 void *array_pop_back(Array *a);
 #define array_typed_pop_back(a,t) ((t*) array_pop_back(a))
 void *array_pop_front(Array *a);
@@ -0,0 +1,80 @@
+/*
+ * btree.h
+ *
+ * Persistent B-trees, for sorted sets and maps. Nodes hold up to
+ * BTREE_MAX entries in order, so a lookup among n keys takes about
+ * log16(n) node visits with a binary search in each, and ordered
+ * iteration walks the entries where they lie. Updates copy the path from
+ * the root to the changed node (splitting, borrowing or merging on the
+ * way) and share every other node with the tree they came from.
+ *
+ * Keys are ordered by a callback that may fail, like the comparisons of
+ * sort_indices(). Sets store NULL values.
+ */
+
+#ifndef __BTREE_H__
+#define __BTREE_H__
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BTREE_MAX 31
+#define BTREE_MIN (BTREE_MAX / 2)
+/* every node but the root has more than BTREE_MIN children, which
+ * bounds the height of any tree that fits in memory */
+#define BTREE_MAX_DEPTH 16
+
+/* cmp(a, b) is negative, zero or positive as a orders before, with or
+ * after b, and BTREE_ERROR on errors */
+typedef int (*BTreeCmp)(const void *a, const void *b);
+#define BTREE_ERROR INT_MIN
+
+typedef struct BTreeEntry {
+    void *key;
+    void *value;
+} BTreeEntry;
+
+typedef struct BTreeNode {
+    unsigned n;
+    bool leaf;
+    /* n entries and, unless this is a leaf, the n + 1 children right
+     * after them, see btree_children() */
+    BTreeEntry entries[];
+} BTreeNode;
+
+#define btree_children(node) ((const BTreeNode **) ((node)->entries + (node)->n))
+
+typedef struct BTree {
+    const BTreeNode *root;  /* NULL if empty */
+    size_t size;
+    BTreeCmp cmp;
+    unsigned long hash;     /* see value_hash(), 0 until needed */
+} BTree;
+
+typedef struct BTreeIter {
+    /* the path to the next entry, which is entries[pos] of the top node */
+    const BTreeNode *nodes[BTREE_MAX_DEPTH];
+    unsigned pos[BTREE_MAX_DEPTH];
+    int depth;
+} BTreeIter;
+
+const BTree *btree_new(BTreeCmp cmp);
+/* 1 with the entry of key in *entry if it is in t, 0 if not and -1 on
+ * errors */
+int btree_get(const BTree *t, const void *key, const BTreeEntry **entry);
+/* t with key mapped to value or without key, t itself if that doesn't
+ * change it and NULL on errors */
+const BTree *btree_insert(const BTree *t, void *key, void *value);
+const BTree *btree_remove(const BTree *t, const void *key);
+/* the entries with the least and greatest keys, NULL if t is empty */
+const BTreeEntry *btree_first(const BTree *t);
+const BTreeEntry *btree_last(const BTree *t);
+
+/* ascending from the least key that doesn't order before from (or from
+ * the least key if from is NULL); false on errors */
+bool btree_iter_init(BTreeIter *it, const BTree *t, const void *from);
+/* the next entry, NULL at the end */
+const BTreeEntry *btree_iter_next(BTreeIter *it);
+
+#endif /* !__BTREE_H__ */
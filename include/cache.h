@@ -0,0 +1,56 @@
+/*
+ * cache.h
+ *
+ * A hash table that remembers the order in which its entries were used,
+ * for memoize and lru-cache. Bounded caches evict the least recently
+ * used entry to make room for a new one, unbounded caches only grow.
+ *
+ * Callers hash the keys themselves and pass an equality callback, which
+ * may call back into the interpreter and fail, like the comparisons of
+ * sort_indices(). Entries live in one array and link up by position, so
+ * the collector sees a few flat buffers, however long the chains get.
+ */
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stddef.h>
+
+/* eq(a, b) is 1 if the keys are equal, 0 if not and -1 on errors */
+typedef int (*CacheEq)(const void *a, const void *b);
+
+typedef struct CacheEntry {
+    void *key;
+    void *value;
+    unsigned long hash;
+    size_t newer;  /* positions in the entries, CACHE_NONE at either end */
+    size_t older;
+} CacheEntry;
+
+#define CACHE_NONE ((size_t) -1)
+
+typedef struct Cache {
+    CacheEntry *entries;
+    size_t *slots;       /* open addressing, entry position + 1 or 0 if free */
+    size_t n_slots;      /* a power of two, at least twice the size */
+    size_t size;
+    size_t allocated;
+    size_t capacity;     /* 0 for unbounded caches */
+    size_t newest;
+    size_t oldest;
+    size_t hits;
+    size_t misses;
+    CacheEq eq;
+} Cache;
+
+Cache *cache_new(size_t capacity, CacheEq eq);
+
+/* 1 and the cached value in *value if key is cached, which makes it the
+ * most recently used entry; 0 if it is not and -1 on errors. Counts
+ * hits and misses. */
+int cache_get(Cache *c, const void *key, unsigned long hash, void **value);
+/* caches value under key, replacing the value of an equal key or making
+ * room by evicting the least recently used entry; -1 on errors */
+int cache_put(Cache *c, void *key, unsigned long hash, void *value);
+
+#endif /* !__CACHE_H__ */
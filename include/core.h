@@ -14,35 +14,115 @@ extern CoreFn core_fns[];
 Value *core_add(const Value *args);
 Value *core_apply(const Value *args);
 Value *core_assert(const Value *args);
+Value *core_assoc(const Value *args);
+Value *core_cache_get(const Value *args);
+Value *core_cache_put(const Value *args);
+Value *core_cache_stats(const Value *args);
+Value *core_close(const Value *args);
+Value *core_comp(const Value *args);
 Value *core_concat(const Value *args);
+Value *core_conj(const Value *args);
 Value *core_cons(const Value *args);
+Value *core_contains(const Value *args);
 Value *core_count(const Value *args);
+Value *core_disj(const Value *args);
+Value *core_dissoc(const Value *args);
 Value *core_div(const Value *args);
+Value *core_dot(const Value *args);
+Value *core_drop(const Value *args);
 Value *core_eq(const Value *args);
+Value *core_f64_vector(const Value *args);
+Value *core_filter(const Value *args);
 Value *core_first(const Value *args);
+Value *core_flush(const Value *args);
+Value *core_gc(const Value *args);
+Value *core_gc_stats(const Value *args);
 Value *core_geq(const Value *args);
+Value *core_get(const Value *args);
 Value *core_gt(const Value *args);
+Value *core_hash(const Value *args);
+Value *core_hash_set(const Value *args);
+Value *core_heap_histogram(const Value *args);
+Value *core_i64_vector(const Value *args);
+Value *core_index_of(const Value *args);
+Value *core_into(const Value *args);
 Value *core_is_empty(const Value *args);
 Value *core_is_false(const Value *args);
 Value *core_is_list(const Value *args);
 Value *core_is_nil(const Value *args);
 Value *core_is_symbol(const Value *args);
 Value *core_is_true(const Value *args);
+Value *core_iterate(const Value *args);
+Value *core_keep(const Value *args);
+Value *core_last(const Value *args);
 Value *core_leq(const Value *args);
+Value *core_line_seq(const Value *args);
 Value *core_list(const Value *args);
+Value *core_lru_cache(const Value *args);
 Value *core_lt(const Value *args);
 Value *core_map(const Value *args);
+Value *core_mat_add(const Value *args);
+Value *core_mat_col(const Value *args);
+Value *core_mat_cols(const Value *args);
+Value *core_mat_ediv(const Value *args);
+Value *core_mat_emul(const Value *args);
+Value *core_mat_mul(const Value *args);
+Value *core_mat_ref(const Value *args);
+Value *core_mat_row(const Value *args);
+Value *core_mat_rows(const Value *args);
+Value *core_mat_shape(const Value *args);
+Value *core_mat_sub(const Value *args);
+Value *core_matrix(const Value *args);
+Value *core_max(const Value *args);
+Value *core_memoize(const Value *args);
+Value *core_min(const Value *args);
+Value *core_mmap_file(const Value *args);
 Value *core_mul(const Value *args);
 Value *core_nth(const Value *args);
+Value *core_open(const Value *args);
 Value *core_pr(const Value *args);
 Value *core_pr_str(const Value *args);
 Value *core_prn(const Value *args);
+Value *core_range(const Value *args);
+Value *core_read_bytes(const Value *args);
+Value *core_read_json(const Value *args);
+Value *core_read_json_file(const Value *args);
+Value *core_read_line(const Value *args);
+Value *core_reduce(const Value *args);
+Value *core_remove(const Value *args);
 Value *core_rest(const Value *args);
+Value *core_seq(const Value *args);
+Value *core_sequence(const Value *args);
 Value *core_slurp(const Value *args);
+Value *core_sort(const Value *args);
+Value *core_sort_by(const Value *args);
+Value *core_sorted_map(const Value *args);
+Value *core_sorted_set(const Value *args);
+Value *core_spit(const Value *args);
 Value *core_str(const Value *args);
 Value *core_sub(const Value *args);
+Value *core_subs(const Value *args);
+Value *core_subseq(const Value *args);
+Value *core_sum(const Value *args);
 Value *core_symbol(const Value *args);
+Value *core_take(const Value *args);
+Value *core_take_while(const Value *args);
 Value *core_throw(const Value *args);
+Value *core_transduce(const Value *args);
+Value *core_transpose(const Value *args);
+Value *core_vec_add(const Value *args);
+Value *core_vec_div(const Value *args);
+Value *core_vec_eq(const Value *args);
+Value *core_vec_geq(const Value *args);
+Value *core_vec_gt(const Value *args);
+Value *core_vec_leq(const Value *args);
+Value *core_vec_lt(const Value *args);
+Value *core_vec_mul(const Value *args);
+Value *core_vec_scale(const Value *args);
+Value *core_vec_sub(const Value *args);
+Value *core_write(const Value *args);
+Value *core_write_json(const Value *args);
+Value *core_write_json_file(const Value *args);
 
 /* utility functions */
 bool is_truthy(const Value *v);
@@ -7,6 +7,10 @@
 #ifndef __DJB2_H__
 #define __DJB2_H__
 
+#include <stddef.h>
+
 unsigned long djb2(char *str);
+/* same hash, for len bytes that need not be NUL-terminated */
+unsigned long djb2_n(const char *str, size_t len);
 
 #endif /* !__DJB2_H__ */
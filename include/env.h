@@ -17,5 +17,8 @@ void env_delete(Environment *env);
 void env_set(Environment *env, char *symbol, const struct Value *value);
 struct Value *env_get(Environment *env, char *symbol);
 bool env_contains(Environment *env, char *symbol);
+/* same, keyed by a symbol value whose hash is cached across lookups */
+void env_set_symbol(Environment *env, const struct Value *symbol, const struct Value *value);
+struct Value *env_get_symbol(Environment *env, const struct Value *symbol);
 
 #endif /* !__ENV_H__ */
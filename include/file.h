@@ -0,0 +1,73 @@
+/*
+ * file.h
+ *
+ * File handles for streaming I/O. Reads go through a large buffer of
+ * their own (the stdio buffer is turned off), so a file is processed in
+ * constant memory no matter how big it is; writes go through a block
+ * buffered printer, which writes large chunks straight through.
+ *
+ * Handles are plain malloc'd memory owned by a file value, which closes
+ * them when it is collected. Files still open at exit are flushed.
+ *
+ * Large inputs can also be mapped into memory as a whole; they then cost
+ * address space, and pages the kernel can drop, rather than heap.
+ */
+
+#ifndef __FILE_H__
+#define __FILE_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "printer.h"
+#include "value.h"
+
+#define FILE_BUFSIZE (1 << 20)
+/* slurp maps files at least this big instead of reading them */
+#define FILE_MAP_THRESHOLD (1 << 20)
+
+typedef enum {
+    FILE_READ,
+    FILE_WRITE,
+    FILE_APPEND
+} FileMode;
+
+extern const char *file_mode_names[];
+
+typedef struct File {
+    FILE *fp;            /* NULL once closed */
+    FileMode mode;
+    bool owned;          /* fp is ours to close, false for stdin */
+    /* reading */
+    char *buf;
+    size_t pos;
+    size_t len;
+    bool eof;
+    /* writing */
+    Printer out;
+    /* all open files, to flush them at exit */
+    struct File *prev;
+    struct File *next;
+} File;
+
+/* object lifecycle */
+File *file_open(const char *path, FileMode mode);
+File *file_new(FILE *fp, FileMode mode, bool owned);
+bool file_close(File *f);
+void file_delete(File *f);
+/* deletes the handle in the cell of a collected file value */
+void file_finalize(void *cell);
+
+/* reading, both yield NULL at the end of the file and fail on errors */
+bool file_read_line(File *f, Value **line);
+bool file_read_bytes(File *f, size_t n, Value **bytes);
+
+/* writing */
+Printer *file_printer(File *f);
+
+/* maps the first len > 0 bytes of fd read-only into a string value, NULL
+ * on errors; the mapping outlives fd and goes away with the string and
+ * all slices of it */
+Value *file_map(int fd, size_t len);
+
+#endif /* !__FILE_H__ */
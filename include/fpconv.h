@@ -0,0 +1,31 @@
+/*
+ * fpconv.h
+ *
+ * Conversions between doubles and their decimal representation.
+ *
+ * fpconv_dtoa() implements Grisu2 (Florian Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", PLDI
+ * 2010): the digits it produces always read back as the same double and
+ * are the shortest such digits for all but a tiny fraction of inputs.
+ *
+ * fpconv_strtod() implements the Eisel-Lemire algorithm (Daniel Lemire,
+ * "Number Parsing at a Gigabyte per Second", 2021), with Clinger's fast
+ * path in front of it and strtod() as the fallback for inputs with more
+ * than 19 significant digits. The result is always correctly rounded.
+ */
+
+#ifndef __FPCONV_H__
+#define __FPCONV_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* longest output of fpconv_dtoa(), e.g. -2.2250738585072014e-308 */
+#define FPCONV_MAXLEN 32
+
+/* writes d to dst (not NUL-terminated) and returns the length */
+size_t fpconv_dtoa(double d, char *dst);
+/* parses all of buf[0..len): [-]digits[.digits][(e|E)[+|-]digits] */
+bool fpconv_strtod(const char *buf, size_t len, double *d);
+
+#endif /* !__FPCONV_H__ */
@@ -0,0 +1,71 @@
+/*
+ * hamt.h
+ *
+ * Persistent hash sets, as hash array mapped tries: every level of the
+ * trie consumes HAMT_BITS bits of the hash and stores only the slots in
+ * use, so lookups take O(log32 n) steps and adding or removing a key
+ * copies one short path while sharing everything else with the set it
+ * came from. Keys whose hashes are identical share a collision node at
+ * the bottom.
+ *
+ * As with caches, callers hash the keys and pass an equality callback
+ * that may fail.
+ */
+
+#ifndef __HAMT_H__
+#define __HAMT_H__
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HAMT_BITS 5
+#define HAMT_HASH_BITS (sizeof(unsigned long) * CHAR_BIT)
+/* levels that consume hash bits; the one below holds collision nodes */
+#define HAMT_LEVELS ((HAMT_HASH_BITS + HAMT_BITS - 1) / HAMT_BITS)
+#define HAMT_MAX_DEPTH (HAMT_LEVELS + 1)
+
+/* eq(a, b) is 1 if the keys are equal, 0 if not and -1 on errors */
+typedef int (*HamtEq)(const void *a, const void *b);
+
+typedef struct HamtEntry {
+    void *p;              /* a key or, see subnodes, a HamtNode */
+    unsigned long hash;   /* of the key */
+} HamtEntry;
+
+typedef struct HamtNode {
+    /* the slots in use and those of them that hold subnodes; collision
+     * nodes keep their number of keys in bitmap instead */
+    uint32_t bitmap;
+    uint32_t subnodes;
+    HamtEntry entries[];
+} HamtNode;
+
+typedef struct Hamt {
+    const HamtNode *root;  /* NULL if empty */
+    size_t size;
+    HamtEq eq;
+    unsigned long hash;    /* of the whole set, see value_hash(); 0 until needed */
+} Hamt;
+
+typedef struct HamtIter {
+    const HamtNode *nodes[HAMT_MAX_DEPTH];
+    /* the slots of each node still to visit, or for collision nodes the
+     * number of keys */
+    uint32_t todo[HAMT_MAX_DEPTH];
+    int depth;
+} HamtIter;
+
+const Hamt *hamt_new(HamtEq eq);
+/* 1 if an equal key is in h, 0 if not and -1 on errors */
+int hamt_contains(const Hamt *h, const void *key, unsigned long hash);
+/* h with key added or removed, h itself if that doesn't change it and
+ * NULL on errors */
+const Hamt *hamt_insert(const Hamt *h, void *key, unsigned long hash);
+const Hamt *hamt_remove(const Hamt *h, const void *key, unsigned long hash);
+
+/* the keys in no particular order, NULL at the end */
+void hamt_iter_init(HamtIter *it, const Hamt *h);
+void *hamt_iter_next(HamtIter *it);
+
+#endif /* !__HAMT_H__ */
@@ -0,0 +1,66 @@
+/*
+ * Allocation front-end for the garbage collector.
+ *
+ * All managed allocations go through the heap_* functions. The front-end
+ * keeps the books (bytes allocated, live bytes, pauses) and decides when
+ * to collect; marking and sweeping is left to the collector in lib/gc.
+ *
+ * In arena mode the collector is bypassed altogether: memory is handed
+ * out by a chunked bump allocator and never reclaimed before exit, which
+ * is the cheapest option for short-lived scripts.
+ */
+
+#ifndef __HEAP_H__
+#define __HEAP_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    size_t initial_capacity;  /* allocation map slots */
+    size_t min_capacity;      /* never shrink the allocation map below this */
+    double downsize_factor;   /* allocation map load factor for shrinking */
+    double upsize_factor;     /* allocation map load factor for growing */
+    double sweep_factor;      /* collect once live data drops below this heap fraction */
+    size_t initial_heap;      /* heap size (bytes) that triggers the first collection */
+    size_t max_heap;          /* hard limit in bytes, 0 for no limit */
+    bool arena;               /* bump allocation, no collection */
+} HeapConfig;
+
+typedef struct {
+    size_t collections;       /* number of collections run */
+    double pause_total;       /* total time spent collecting (ms) */
+    double pause_max;         /* longest single collection (ms) */
+    size_t bytes_allocated;   /* cumulative bytes handed out */
+    size_t live_bytes;        /* live bytes after the last collection */
+    size_t heap_size;         /* bytes currently held */
+    size_t peak_heap;         /* maximum of heap_size */
+    size_t arena_reserved;    /* bytes reserved for arena chunks */
+} HeapStats;
+
+/* configuration */
+void heap_config_init(HeapConfig *config);
+bool heap_config_set(HeapConfig *config, const char *name, const char *value);
+
+/* lifecycle */
+void heap_start(const HeapConfig *config, void *bos);
+void heap_stop();
+
+/* allocation */
+void *heap_malloc(size_t size);
+void *heap_calloc(size_t count, size_t size);
+/* like heap_malloc, but NULL instead of exiting when the block would
+ * exceed the heap limit or can't be allocated: for blocks as large as a
+ * script asks for, so that it gets an error it can catch */
+void *heap_try_malloc(size_t size);
+/* dtor runs when the collector frees the block (never in arena mode) */
+void *heap_malloc_dtor(size_t size, void (*dtor)(void *));
+char *heap_strdup(const char *str);
+void heap_free(void *ptr, size_t size);
+void *heap_make_static(void *ptr);
+
+/* collection */
+size_t heap_collect();
+const HeapStats *heap_stats();
+
+#endif /* !__HEAP_H__ */
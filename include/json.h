@@ -0,0 +1,53 @@
+/*
+ * json.h
+ *
+ * Reads JSON into stutter values and writes values back as JSON.
+ *
+ * Reading follows the two stages of simdjson (Langdale and Lemire,
+ * "Parsing Gigabytes of JSON per Second", 2019): the first stage
+ * classifies the input 64 bytes at a time with the vector kernels in
+ * scan.h and collects the offsets of all structural characters outside
+ * of strings, the second stage walks that index and builds the values
+ * without looking at the bytes in between.
+ *
+ * The mapping is
+ *
+ *   null -> nil, true/false -> bool, string -> string,
+ *   number -> int if it is integral and fits, float otherwise,
+ *   array -> list, object -> sorted map of string keys
+ *
+ * so documents round-trip, except that the members of objects are
+ * written in key order and of repeated keys only the last is kept.
+ * Sequences are written as arrays and symbols as strings.
+ */
+
+#ifndef __JSON_H__
+#define __JSON_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "printer.h"
+#include "value.h"
+
+typedef enum {
+    JSON_OK,
+    JSON_EOF,
+    JSON_FAIL
+} JsonResult;
+
+/* reads the single document in buf[0..len), strings in the result may
+ * share the bytes of the managed block base (if not NULL) */
+Value *json_read(const char *buf, size_t len, const void *base);
+
+/* reads a stream of documents, e.g. one per line, from fp in blocks */
+typedef struct JsonReader JsonReader;
+
+JsonReader *json_reader_new(FILE *fp);
+void json_reader_delete(JsonReader *r);
+JsonResult json_reader_next(JsonReader *r, Value **v);
+
+/* fails for values that have no JSON representation */
+bool json_write(Printer *p, const Value *v);
+
+#endif /* !__JSON_H__ */
@@ -20,46 +20,44 @@ typedef enum {
 
 extern const char *token_type_names[];
 
+/*
+ * Tokens are slices of the lexer's buffer and only valid for as long as
+ * the lexer is; when it reads a stream, only until the next token is
+ * read. For strings, the slice covers the raw text between the quotes;
+ * use lexer_token_copy() to get the unescaped contents.
+ */
 typedef struct {
     TokenType type;
-    union {
-        char *str;
-        int int_;
-        double double_;
-    } as;
+    size_t offset;
+    size_t length;
     size_t line;
     size_t column;
 } LexerToken;
 
-#define LEXER_TOKEN_VAL_AS_STR(t) (t->as.str)
-#define LEXER_TOKEN_VAL_AS_INT(t) (t->as.int_)
-#define LEXER_TOKEN_VAL_AS_FLOAT(t) (t->as.double_)
-
-typedef enum {
-    LEXER_STATE_ZERO,
-    LEXER_STATE_COMMENT,
-    LEXER_STATE_NUMBER,
-    LEXER_STATE_FLOAT,
-    LEXER_STATE_SYMBOL,
-    LEXER_STATE_STRING,
-    LEXER_STATE_ESCAPESTRING,
-    LEXER_STATE_UNQUOTE,
-    LEXER_STATE_MINUS
-} LexerState;
-
 typedef struct {
-    FILE *fp;
-    LexerState state;
+    const char *buf;
+    size_t len;
+    size_t pos;
     size_t line_no;
     size_t char_no;
+    size_t line_start;   /* offset of the current line */
+    char *owned;         /* buffer read from a stream, freed with the lexer */
+    size_t capacity;     /* of the owned buffer */
+    FILE *stream;        /* read in blocks into owned, NULL once exhausted */
+    size_t mapped;       /* size of an mmap'ed buffer, 0 if not mapped */
+    size_t released;     /* mapped pages below this offset have been dropped */
 } Lexer;
 
 /* object lifecycle */
-Lexer *lexer_new(FILE *fp);
+Lexer *lexer_new(const char *buf, size_t len);
+Lexer *lexer_new_file(FILE *fp);
 void lexer_delete(Lexer *l);
 
 /* interface */
-LexerToken *lexer_get_token(Lexer *l);
-void lexer_delete_token(LexerToken *tok);
+LexerToken lexer_get_token(Lexer *l);
+const char *lexer_token_text(const Lexer *l, const LexerToken *tok);
+size_t lexer_token_copy(const Lexer *l, const LexerToken *tok, char *dst);
+int lexer_token_int(const Lexer *l, const LexerToken *tok);
+double lexer_token_float(const Lexer *l, const LexerToken *tok);
 
 #endif /* !__LEXER_H__ */
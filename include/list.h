@@ -11,12 +11,41 @@ typedef struct ListItem {
 } ListItem;
 
 
+/*
+ * The cells of a list live in a single contiguous block, laid out in
+ * traversal order. `cells` points to the start of that block: the collector
+ * does not recognize interior pointers, so every list (including the views
+ * returned by list_tail()) holds on to the block base.
+ */
 typedef struct List {
     struct ListItem *begin;
     struct ListItem *end;
     size_t size;
+    struct ListItem *cells;
+    unsigned long hash;  /* of the elements, see value_hash(); 0 until needed */
 } List;
 
+/*
+ * Builds a list by appending in amortized O(1) time. The elements are
+ * collected in managed memory, so the collector sees them while the list
+ * is under construction; list_builder_finish() lays them out as a list
+ * and resets the builder.
+ */
+typedef struct ListBuilder {
+    void **items;
+    size_t size;
+    size_t capacity;
+} ListBuilder;
+
+/*
+ * Cumulative counts of the cell blocks handed out by list copies; their
+ * ratio is the average number of cells that share one block.
+ */
+typedef struct {
+    size_t blocks;            /* cell blocks allocated */
+    size_t cells;             /* cells in those blocks */
+} ListStats;
+
 const List *list_new();
 const List *list_dup(const List *l);
 void *list_head(const List *l);
@@ -27,4 +56,10 @@ const List *list_cons(const List *l, void *value);
 size_t list_size(const List *l);
 bool list_is_empty(const List *l);
 
+void list_builder_init(ListBuilder *b);
+void list_builder_append(ListBuilder *b, void *value);
+const List *list_builder_finish(ListBuilder *b);
+
+const ListStats *list_stats();
+
 #endif /* !__LIST_H__ */
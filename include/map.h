@@ -9,10 +9,11 @@
 #include <stddef.h>
 
 typedef struct MapItem {
-    char *key;
     void *value;
     size_t size;
+    unsigned long hash;  /* djb2 of the key, kept for lookups and resizes */
     struct MapItem *next;
+    char key[];  /* stored inline, next to the chain pointer */
 } MapItem;
 
 typedef struct Map {
@@ -27,6 +28,9 @@ void map_delete(Map *);
 void *map_get(Map *ht, char *key);
 void map_put(Map *ht, char *key, void *value, size_t siz);
 void map_remove(Map *ht, char *key);
+/* same, for callers that already know djb2(key) */
+void *map_get_hashed(Map *ht, const char *key, unsigned long hash);
+void map_put_hashed(Map *ht, const char *key, unsigned long hash, void *value, size_t siz);
 void map_resize(Map *ht, size_t capacity);
 
 // helpers
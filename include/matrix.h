@@ -0,0 +1,29 @@
+/*
+ * matrix.h
+ *
+ * Kernels for dense matrices of doubles, stored row-major: element (i, j)
+ * of an m x n matrix is a[i * n + j]. The multiplication works on blocks
+ * of B that stay in the cache and adds rows of them into C with the SIMD
+ * kernels in numvec.h, so it runs close to the speed of the cache instead
+ * of the memory.
+ */
+
+#ifndef __MATRIX_H__
+#define __MATRIX_H__
+
+#include <stddef.h>
+
+/* block sizes: MATRIX_BLOCK_K rows of MATRIX_BLOCK_N columns of B
+ * (256 KiB) fit in the L2 cache, a row of a block of C in the L1 cache */
+#define MATRIX_BLOCK_K 128
+#define MATRIX_BLOCK_N 256
+/* tiles of the transposition */
+#define MATRIX_TILE 32
+
+/* c = a * b, where a is m x k, b is k x n and c is m x n; c may not
+ * overlap a or b */
+void matrix_mul(double *c, const double *a, const double *b, size_t m, size_t k, size_t n);
+/* out = a^T for an m x n matrix a, out is n x m */
+void matrix_transpose(double *out, const double *a, size_t m, size_t n);
+
+#endif /* !__MATRIX_H__ */
@@ -0,0 +1,82 @@
+/*
+ * numvec.h
+ *
+ * Kernels for the typed numeric vectors, f64-vector and i64-vector. Like
+ * the scanners in scan.h they come in a scalar, an SSE2 and an AVX2
+ * version and the implementation is picked at runtime based on what the
+ * CPU supports. SSE2 has no 64 bit integer multiplication or comparison,
+ * those fall back to the scalar version at that level.
+ *
+ * All kernels work on n elements of buffers of any alignment; vectors
+ * allocate theirs NUMVEC_ALIGN aligned so the loads never split a cache
+ * line. Where b is an operand, bstep is 1 for an element-wise operation
+ * and 0 to broadcast the scalar b[0].
+ *
+ * Float sums and dot products are added up in several lanes at once,
+ * so their rounding may differ from a plain loop in the last bits.
+ * Integer arithmetic wraps around.
+ */
+
+#ifndef __NUMVEC_H__
+#define __NUMVEC_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUMVEC_ALIGN 32
+
+typedef enum {
+    NUMVEC_SCALAR,
+    NUMVEC_SSE2,
+    NUMVEC_AVX2
+} NumvecLevel;
+
+extern const char *numvec_level_names[];
+
+/* pick the best implementation for this CPU */
+void numvec_init();
+/* force an implementation, fails if the CPU doesn't support it */
+bool numvec_select(NumvecLevel level);
+NumvecLevel numvec_level();
+
+typedef enum {
+    NUMVEC_ADD,
+    NUMVEC_SUB,
+    NUMVEC_MUL,
+    NUMVEC_DIV
+} NumvecOp;
+
+typedef enum {
+    NUMVEC_LT,
+    NUMVEC_LE,
+    NUMVEC_GT,
+    NUMVEC_GE,
+    NUMVEC_EQ
+} NumvecCmp;
+
+/* out[i] = a[i] op b[i * bstep], out may be a or b; integer division
+ * fails on a zero divisor (and leaves out partially written) */
+void numvec_f64_arith(NumvecOp op, double *out, const double *a,
+                      const double *b, size_t bstep, size_t n);
+bool numvec_i64_arith(NumvecOp op, int64_t *out, const int64_t *a,
+                      const int64_t *b, size_t bstep, size_t n);
+
+/* mask[i] = 1 if a[i] cmp b[i * bstep] holds, 0 otherwise (also for NaNs) */
+void numvec_f64_cmp(NumvecCmp cmp, int64_t *mask, const double *a,
+                    const double *b, size_t bstep, size_t n);
+void numvec_i64_cmp(NumvecCmp cmp, int64_t *mask, const int64_t *a,
+                    const int64_t *b, size_t bstep, size_t n);
+
+/* reductions, min and max require n > 0 and are unspecified for NaNs */
+double numvec_f64_sum(const double *a, size_t n);
+int64_t numvec_i64_sum(const int64_t *a, size_t n);
+double numvec_f64_dot(const double *a, const double *b, size_t n);
+int64_t numvec_i64_dot(const int64_t *a, const int64_t *b, size_t n);
+void numvec_f64_min_max(const double *a, size_t n, double *min, double *max);
+void numvec_i64_min_max(const int64_t *a, size_t n, int64_t *min, int64_t *max);
+
+/* y[i] += alpha * x[i], the inner loop of matrix multiplication */
+void numvec_f64_axpy(double *y, double alpha, const double *x, size_t n);
+
+#endif /* !__NUMVEC_H__ */
@@ -6,10 +6,28 @@
 
 enum ParseResult {
     PARSER_FAIL,
-    PARSER_SUCCESS
+    PARSER_SUCCESS,
+    PARSER_EOF
 };
 typedef enum ParseResult ParseResult;
 
+/*
+ * Deeper forms fail to parse. The parser itself doesn't use the C stack
+ * per nesting level, but the collector marks nested lists recursively.
+ */
+#define PARSER_MAX_DEPTH 10000
+
+/* parse a complete program, returns its first form */
 ParseResult parser_parse(FILE *stream, Value **ast);
+ParseResult parser_parse_buffer(const char *buf, size_t len, Value **ast);
+/* like parser_parse_buffer, but strings in the result may share str's bytes */
+ParseResult parser_parse_string(const Value *str, Value **ast);
+
+/* incremental parsing, one top-level form at a time */
+typedef struct Parser Parser;
+
+Parser *parser_new(FILE *stream);
+void parser_delete(Parser *p);
+ParseResult parser_next(Parser *p, Value **form);
 
 #endif /* !__PARSER_H__ */
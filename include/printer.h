@@ -0,0 +1,59 @@
+/*
+ * printer.h
+ *
+ * Serializes values to a FILE through a user-space buffer, or into a
+ * string. pr, prn and str share the formatting code, so what is printed
+ * is exactly what pr-str returns.
+ */
+
+#ifndef __PRINTER_H__
+#define __PRINTER_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "value.h"
+
+#define PRINTER_BUFSIZE (1 << 16)
+
+typedef enum {
+    PRINTER_FLUSH_LINE,      /* after every print call that ends a line */
+    PRINTER_FLUSH_BLOCK,     /* whenever the buffer is full */
+    PRINTER_FLUSH_EXPLICIT   /* only on (flush) and at exit, the buffer grows */
+} PrinterFlush;
+
+extern const char *printer_flush_names[];
+
+typedef struct Printer {
+    FILE *fp;            /* destination, NULL to collect into sb */
+    StringBuilder sb;
+    char *buf;           /* output pending for fp, plain malloc'd memory */
+    size_t len;
+    size_t capacity;
+    PrinterFlush policy;
+    bool newline;        /* a line was completed since the last flush */
+} Printer;
+
+/* object lifecycle */
+void printer_init(Printer *p, FILE *fp, PrinterFlush policy);
+void printer_init_string(Printer *p);
+Value *printer_finish(Printer *p);
+void printer_delete(Printer *p);
+
+/* the printer behind pr and prn, flushed at exit */
+Printer *printer_stdout();
+bool printer_set_policy(const char *name);
+
+/* output */
+void printer_write(Printer *p, const char *str, size_t len);
+void printer_write_char(Printer *p, char c);
+void printer_write_int(Printer *p, long n);
+void printer_write_float(Printer *p, double d);
+void printer_printf(Printer *p, const char *fmt, ...);
+void printer_value(Printer *p, const Value *v);
+void printer_values(Printer *p, const Value *args, bool printable);
+
+/* applies the flush policy, to be called after each print call */
+void printer_end(Printer *p);
+void printer_flush(Printer *p);
+
+#endif /* !__PRINTER_H__ */
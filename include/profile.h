@@ -0,0 +1,41 @@
+/*
+ * Opt-in allocation profiler.
+ *
+ * Allocations are attributed to a kind (e.g. a value type) and to the
+ * allocation site, i.e. the stutter function that was executing. While
+ * profiling is off, the only cost on the allocation paths is the check
+ * of `profile_enabled` in PROFILE_ALLOC().
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *kind;
+    size_t count;   /* live allocations */
+    size_t bytes;   /* live bytes */
+} ProfileKind;
+
+extern bool profile_enabled;
+
+#define PROFILE_ALLOC(ptr, size, kind) do {\
+    if (profile_enabled) profile_alloc(ptr, size, kind);\
+} while (0)
+
+void profile_start();
+void profile_alloc(void *ptr, size_t size, const char *kind);
+void profile_free(void *ptr);
+
+/* allocation sites */
+int profile_site();
+void profile_set_site(int site);
+int profile_intern_site(const char *name);
+
+/* reporting */
+size_t profile_kinds(const ProfileKind **kinds);
+void profile_report();
+
+#endif /* !__PROFILE_H__ */
@@ -0,0 +1,57 @@
+/*
+ * scan.h
+ *
+ * Byte scanning primitives for the lexer and the JSON reader. On x86 they
+ * look at 16 (SSE2) or 32 (AVX2) bytes at a time, the implementation is
+ * picked at runtime based on what the CPU supports. Elsewhere a scalar
+ * version is used.
+ *
+ * The scan_* functions scan buf[pos..len) and return the offset of the
+ * first byte they stop at, or len if there is none.
+ */
+
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+} ScanLevel;
+
+extern const char *scan_level_names[];
+
+/* pick the best implementation for this CPU */
+void scan_init();
+/* force an implementation, fails if the CPU doesn't support it */
+bool scan_select(ScanLevel level);
+ScanLevel scan_level();
+
+/* skip ' ', '\t', '\r' and '\n', counting line feeds into *lines and
+ * moving *line_start past the last one */
+size_t scan_space(const char *buf, size_t pos, size_t len,
+                  size_t *lines, size_t *line_start);
+/* find the next '\n' */
+size_t scan_line(const char *buf, size_t pos, size_t len);
+/* find the next '"', '\\' or '\n' */
+size_t scan_string(const char *buf, size_t pos, size_t len);
+
+/* classification of a 64 byte block, bit i stands for byte i */
+typedef struct {
+    uint64_t quote;      /* '"' */
+    uint64_t backslash;  /* '\\' */
+    uint64_t op;         /* '{', '}', '[', ']', ':' and ',' */
+    uint64_t space;      /* ' ', '\t', '\r' and '\n' */
+    uint64_t control;    /* bytes below 0x20 */
+} ScanJsonBlock;
+
+#define SCAN_JSON_BLOCK 64
+
+/* classify the bytes of a JSON text, block must hold 64 readable bytes */
+void scan_json_block(const char *block, ScanJsonBlock *m);
+
+#endif /* !__SCAN_H__ */
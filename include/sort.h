@@ -0,0 +1,51 @@
+/*
+ * sort.h
+ *
+ * Stable merge sorts for the sort and sort-by builtins. Both sort
+ * positions into the sequence being sorted, so they never touch values
+ * (or the collector) themselves:
+ *
+ * - sort_keys() orders positions by integer keys without any callbacks;
+ *   floats are mapped onto integers that order the same way, see
+ *   sort_f64_key(). Above SORT_PARALLEL_MIN keys the work is split over
+ *   sort_threads() threads.
+ * - sort_indices() orders positions with a comparison callback, which
+ *   may call back into the interpreter and fail.
+ */
+
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* runs shorter than this are sorted by insertion */
+#define SORT_RUN 32
+/* inputs with fewer keys are always sorted on the calling thread */
+#define SORT_PARALLEL_MIN (1 << 16)
+#define SORT_MAX_THREADS 16
+
+typedef struct SortKey {
+    int64_t key;
+    size_t index;
+} SortKey;
+
+/* threads for large inputs, 0 for one per CPU (the default) and 1 to
+ * never sort in parallel */
+void sort_set_threads(unsigned n);
+unsigned sort_threads();
+
+/* an integer key that orders like d, with -0.0 equal to 0.0 and NaNs
+ * after everything else */
+int64_t sort_f64_key(double d);
+
+/* stable, by key */
+void sort_keys(SortKey *keys, size_t n);
+
+/* less(a, b, ctx) is 1 if position a goes before position b, 0 if not
+ * and -1 on errors, which stop the sort and make it return false */
+typedef int (*SortLess)(size_t a, size_t b, void *ctx);
+bool sort_indices(size_t *indices, size_t n, SortLess less, void *ctx);
+
+#endif /* !__SORT_H__ */
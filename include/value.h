@@ -1,34 +1,60 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <stdarg.h>
 #include "array.h"
+#include "btree.h"
+#include "cache.h"
 #include "env.h"
-#include "gc.h"
+#include "hamt.h"
+#include "heap.h"
 #include "map.h"
 #include "list.h"
+#include "numvec.h"
 
 #define BOOL(v) (v->value.bool_)
+#define BTREE(v) (v->value.btree)
 #define BUILTIN_FN(v) (v->value.builtin_fn)
-#define EXCEPTION(v) (v->value.str)
+#define EXCEPTION(v) (value_cstr(v))
+#define FILE_HANDLE(v) (*v->value.file)
 #define FLOAT(v) (v->value.float_)
 #define FN(v) (v->value.fn)
+#define HAMT(v) (v->value.hamt)
 #define INT(v)  (v->value.int_)
 #define LIST(v) (v->value.list)
-#define STRING(v) (v->value.str)
-#define SYMBOL(v) (v->value.str)
+#define MATRIX(v) (v->value.matrix)
+#define MEMO(v) (v->value.memo)
+#define NUMVEC(v) (v->value.numvec)
+#define SEQ(v) (v->value.seq)
+#define STRING(v) (value_cstr(v))
+#define SYMBOL(v) (value_cstr(v))
+#define XFORM(v) (v->value.xform)
+/* bytes and length of a string, symbol or exception, not NUL-terminated */
+#define STRING_PTR(v) (v->value.str->ptr)
+#define STRING_LEN(v) (v->value.str->len)
 
 typedef enum {
     VALUE_BOOL,
     VALUE_BUILTIN_FN,
+    VALUE_CACHE,
     VALUE_EXCEPTION,
+    VALUE_F64_VECTOR,
+    VALUE_FILE,
     VALUE_FLOAT,
     VALUE_FN,
+    VALUE_HASH_SET,
+    VALUE_I64_VECTOR,
     VALUE_INT,
+    VALUE_LAZY_SEQ,
     VALUE_LIST,
     VALUE_MACRO_FN,
+    VALUE_MATRIX,
     VALUE_NIL,
+    VALUE_SORTED_MAP,
+    VALUE_SORTED_SET,
     VALUE_STRING,
-    VALUE_SYMBOL
+    VALUE_SYMBOL,
+    VALUE_TRANSDUCER
 } ValueType;
 
 extern const char *value_type_names[];
@@ -39,16 +65,166 @@ typedef struct CompositeFunction {
     Environment *env;
 } CompositeFunction;
 
+/*
+ * Payload of string, symbol and exception values. The bytes are either
+ * stored inline, right after the header, or the string is a slice of a
+ * larger managed buffer (e.g. a file read by slurp, or the text that
+ * read-string parses) which `base` keeps alive. Slices are not
+ * necessarily NUL-terminated, STRING() and friends copy them the first
+ * time a C string is needed.
+ */
+typedef struct String {
+    size_t len;
+    const char *ptr;
+    const void *base;   /* start of the buffer a slice points into */
+    unsigned long hash; /* djb2 of the bytes, 0 until first needed */
+    bool terminated;    /* ptr[len] == '\0' */
+    char data[];
+} String;
+
+/*
+ * Builds a string by appending in amortized O(1) time. The bytes are
+ * collected in a managed buffer that grows geometrically and is handed
+ * over to the string value by string_builder_finish().
+ */
+typedef struct StringBuilder {
+    char *buf;
+    size_t len;
+    size_t capacity;
+} StringBuilder;
+
+/*
+ * Payload of f64-vector and i64-vector values: a fixed number of unboxed
+ * elements, contiguous and NUMVEC_ALIGN aligned for the kernels in
+ * numvec.h. Like strings, a vector may be a view of a part of a larger
+ * buffer, which `base` keeps alive.
+ */
+typedef struct NumVec {
+    size_t size;
+    union {
+        double *f64;
+        int64_t *i64;
+    } data;
+    const void *base;
+    unsigned long hash;  /* see value_hash(), 0 until needed */
+} NumVec;
+
+/*
+ * Payload of matrix values: rows x cols doubles, row-major and aligned
+ * like the elements of a vector, see matrix.h. A matrix may be a view of
+ * some of the rows of a larger one.
+ */
+typedef struct Matrix {
+    size_t rows;
+    size_t cols;
+    double *data;
+    const void *base;
+    unsigned long hash;
+} Matrix;
+
+struct File;  /* see file.h */
+
+/*
+ * A sequence whose elements are produced on demand by next(state, &rest),
+ * which returns the next element or NULL at the end. Generators simply
+ * advance their state; next() may instead set rest to the list or
+ * sequence that follows the element it returned, which ends the
+ * generator. Elements are realized in order, at most once, and cached in
+ * blocks of up to SEQ_BLOCK_SIZE elements, each linked to what follows
+ * it. A long realized sequence is thus a short chain for the collector's
+ * recursive mark, and as long as nobody holds on to its head a sequence
+ * can be walked in constant memory.
+ */
+#define SEQ_BLOCK_SIZE 32
+
+typedef struct SeqBlock {
+    size_t size;        /* realized elements */
+    size_t capacity;
+    bool realizing;     /* next() is running */
+    /* NULL once the block is complete, rest then follows the elements
+     * (NULL at the end of the sequence) */
+    struct Value *(*next)(void *state, struct Value **rest);
+    void *state;
+    struct Value *rest;
+    struct Value *items[];
+} SeqBlock;
+
+/* a lazy sequence value is a position in a block */
+typedef struct LazySeq {
+    SeqBlock *block;
+    size_t index;
+} LazySeq;
+
+/*
+ * Walks a list, a vector, a lazy sequence or nil without allocating (but
+ * for boxing vector elements), realizing lazy sequences one element at a
+ * time.
+ */
+typedef struct SeqIter {
+    const struct Value *list;
+    const struct ListItem *item;
+    const struct Value *vector;
+    SeqBlock *block;
+    size_t index;
+} SeqIter;
+
+/*
+ * A transducer, e.g. (comp (filter p) (map f)): the steps that every
+ * element of a sequence goes through, in order, before it is handed on.
+ * It describes the transformation only and doesn't depend on where the
+ * elements come from or what is done with them, so reduce, into and
+ * lazy sequences can all run a whole pipeline in a single pass.
+ */
+typedef enum {
+    XFORM_MAP,
+    XFORM_FILTER,
+    XFORM_REMOVE,
+    XFORM_KEEP,
+    XFORM_TAKE,
+    XFORM_DROP,
+    XFORM_TAKE_WHILE
+} XformKind;
+
+typedef struct XformStep {
+    XformKind kind;
+    struct Value *fn;   /* NULL for take and drop */
+    int n;              /* the count of take and drop */
+} XformStep;
+
+typedef struct Xform {
+    size_t size;
+    XformStep steps[];
+} Xform;
+
+/*
+ * Payload of lru-cache values and memoized functions. A memoized function
+ * is a cache of its results, keyed by argument list, together with the
+ * function that computes them; caches filled by cache-put have no
+ * function.
+ */
+typedef struct Memo {
+    Cache *cache;
+    struct Value *fn;
+} Memo;
+
 typedef struct Value {
     ValueType type;
     union {
         bool bool_;
         int int_;
         double float_;
-        char *str;
+        String *str;
         Array *vector;
         const List *list;
         Map *map;
+        struct File **file;
+        LazySeq *seq;
+        Xform *xform;
+        NumVec *numvec;
+        Matrix *matrix;
+        Memo *memo;
+        const Hamt *hamt;
+        const BTree *btree;
         struct Value *(*builtin_fn)(const struct Value *);
         CompositeFunction *fn;
     } value;
@@ -73,18 +249,91 @@ Value *value_new_bool(const bool bool_);
 Value *value_new_exception(const char *str);
 Value *value_make_exception(const char *fmt, ...);
 Value *value_new_int(int int_);
-Value *value_new_float(float float_);
+Value *value_new_float(double float_);
 Value *value_new_builtin_fn(Value * (fn)(const Value *));
 Value *value_new_fn(Value *args, Value *body, Environment *env);
 Value *value_new_macro(Value *args, Value *body, Environment *env);
 Value *value_new_string(const char *str);
+Value *value_new_string_len(const char *str, size_t len);
+Value *value_new_string_slice(const void *base, const char *ptr, size_t len);
+Value *value_new_string_owned(char *buf, size_t len);
+Value *value_new_string_terminated(const void *base, const char *ptr, size_t len);
 Value *value_new_symbol(const char *str);
 Value *value_new_list(const List *l);
 Value *value_make_list(Value *v);
+/* finalize(cell) runs when the cell holding the file is collected */
+Value *value_new_file(struct File *file, void (*finalize)(void *cell));
+Value *value_new_lazy_seq(Value *(*next)(void *state, Value **rest), void *state);
+/* a realized cell, e.g. for consing onto a sequence without realizing it */
+Value *value_new_seq_cell(Value *first, Value *rest);
+/* a transducer of size steps, for the caller to fill in */
+Value *value_new_transducer(size_t size);
+/* persistent collections: a hash set, or a sorted set or map */
+Value *value_new_hash_set(const Hamt *h);
+Value *value_new_sorted(ValueType type, const BTree *t);
+/* an empty cache of at most capacity entries (0 for no bound) and, for
+ * memoized functions, the function that fills it */
+Value *value_new_cache(size_t capacity, CacheEq eq, Value *fn);
+
+/* the most elements a vector or matrix can hold, anything more doesn't
+ * fit in a size_t worth of bytes */
+#define VALUE_NUMBERS_MAX ((SIZE_MAX - NUMVEC_ALIGN) / sizeof(double))
+
+/* vectors of size <= VALUE_NUMBERS_MAX uninitialized elements, NULL if
+ * they don't fit in the heap */
+Value *value_new_f64_vector(size_t size);
+Value *value_new_i64_vector(size_t size);
+/* elements [start, end) of a vector, sharing its buffer */
+Value *value_new_vector_view(const Value *v, size_t start, size_t end);
+bool value_is_vector(const Value *v);
+/* element i boxed as a float or an int; i64 elements that don't fit an
+ * int become floats */
+Value *value_vector_nth(const Value *v, size_t i);
+Value *value_from_i64(int64_t i);
+
+/* a rows x cols matrix of uninitialized elements, rows * cols at most
+ * VALUE_NUMBERS_MAX; NULL if they don't fit in the heap */
+Value *value_new_matrix(size_t rows, size_t cols);
+/* rows [start, end) of a matrix, sharing its buffer */
+Value *value_new_matrix_view(const Value *m, size_t start, size_t end);
+/* row i of a matrix as an f64-vector, sharing its buffer */
+Value *value_matrix_row(const Value *m, size_t i);
+
+/* sequences: lists, vectors, lazy sequences and nil */
+bool value_is_seq(const Value *v);
+/* first element, realizing it if necessary; NULL at the end */
+Value *value_seq_first(const Value *v);
+/* everything after the first element, or v itself at the end */
+Value *value_seq_rest(const Value *v);
+void value_seq_iter_init(SeqIter *it, const Value *v);
+/* the state of v if it is a lazy sequence of next() that hasn't been
+ * realized at all, NULL otherwise */
+void *value_seq_unrealized(const Value *v, Value *(*next)(void *state, Value **rest));
+/* the next element, NULL at the end or if realizing it failed */
+Value *value_seq_iter_next(SeqIter *it);
 Value *value_head(const Value *v);
 Value *value_tail(const Value *v);
 void value_delete(Value *v);
 void value_print(const Value *v);
+char *value_cstr(const Value *v);
+const void *value_string_base(const Value *v);
+unsigned long value_string_hash(const Value *v);
+/* consistent with =, so equal numbers, strings, symbols and sequences
+ * hash alike; functions, files and transducers hash by identity. Lists,
+ * vectors and matrices cache their hash, lazy sequences are realized
+ * (and leave an exception pending if that fails). Never 0. */
+unsigned long value_hash(const Value *v);
+bool value_string_eq(const Value *a, const Value *b);
+int value_string_cmp(const Value *a, const Value *b);
+
+void string_builder_init(StringBuilder *sb);
+void string_builder_append(StringBuilder *sb, const char *str, size_t len);
+void string_builder_append_char(StringBuilder *sb, char c);
+void string_builder_append_int(StringBuilder *sb, long n);
+void string_builder_printf(StringBuilder *sb, const char *fmt, ...);
+void string_builder_vprintf(StringBuilder *sb, const char *fmt, va_list args);
+Value *string_builder_finish(StringBuilder *sb);
+void string_builder_discard(StringBuilder *sb);
 
 
 #endif /* !VALUE_H */
@@ -19,6 +19,11 @@ static bool is_compound_fn(const Value *fn)
     return fn->type == VALUE_FN || fn->type == VALUE_MACRO_FN;
 }
 
+static bool is_memoized_fn(const Value *fn)
+{
+    return fn->type == VALUE_CACHE && MEMO(fn)->fn;
+}
+
 static Value *apply_builtin_fn(Value *fn, Value *args)
 {
     if (fn && fn->type == VALUE_BUILTIN_FN && fn->value.builtin_fn) {
@@ -53,7 +58,7 @@ static Value *apply_compound_fn(Value *fn, Value *args,
             if (!arg_value) {
                 break;
             }
-            env_set(env, arg_name->value.str, arg_value);
+            env_set_symbol(env, arg_name, arg_value);
             arg_names = list_tail(arg_names);
             arg_values = list_tail(arg_values);
             arg_name = list_head(arg_names);
@@ -66,7 +71,7 @@ static Value *apply_compound_fn(Value *fn, Value *args,
                 return NULL;
             }
             Value *rest_value = value_new_list(arg_values);
-            env_set(env, SYMBOL(rest_name), rest_value);
+            env_set_symbol(env, rest_name, rest_value);
             arg_name = list_head(arg_names);
             arg_name = arg_value = NULL;
         }
@@ -83,6 +88,31 @@ static Value *apply_compound_fn(Value *fn, Value *args,
     return NULL;
 }
 
+static Value *apply_memoized_fn(Value *fn, Value *args)
+{
+    /* the result has to be cached, so the call can't be a tail call */
+    Memo *memo = MEMO(fn);
+    unsigned long hash = value_hash(args);
+    if (exc_is_pending()) {
+        return NULL;
+    }
+    void *cached;
+    int found = cache_get(memo->cache, args, hash, &cached);
+    if (found) {
+        return found > 0 ? cached : NULL;
+    }
+    Value *tco_expr;
+    Environment *tco_env;
+    Value *result = apply(memo->fn, args, &tco_expr, &tco_env);
+    if (tco_expr && !exc_is_pending()) {
+        result = eval(tco_expr, tco_env);
+    }
+    if (!result || exc_is_pending() || cache_put(memo->cache, args, hash, result) < 0) {
+        return NULL;
+    }
+    return result;
+}
+
 Value *apply(Value *fn, Value *args, Value **tco_expr, Environment **tco_env)
 {
     if (!fn) {
@@ -95,6 +125,8 @@ Value *apply(Value *fn, Value *args, Value **tco_expr, Environment **tco_env)
         return apply_builtin_fn(fn, args);
     } else if (is_compound_fn(fn)) {
         return apply_compound_fn(fn, args, tco_expr, tco_env);
+    } else if (is_memoized_fn(fn)) {
+        return apply_memoized_fn(fn, args);
     } else {
         exc_set(value_make_exception("apply: not a function"));
         return NULL;
@@ -1,29 +1,32 @@
 #include "array.h"
 
-#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "heap.h"
+
 
 Array *array_new(const size_t item_size)
 {
-    // default to 2 elements for empty arrays
-    return array_new_with_capacity(item_size, 2);
+    // the buffer is allocated by the first push
+    return array_new_with_capacity(item_size, 0);
 }
 
 Array *array_new_with_capacity(const size_t item_size, const size_t capacity)
 {
-    Array *array = malloc(sizeof(Array));
-    array->p = calloc(capacity, item_size);
+    Array *array = heap_malloc(sizeof(Array));
+    array->p = capacity ? heap_calloc(capacity, item_size) : NULL;
     array->bytes = item_size;
     array->capacity = capacity;
+    array->head = 0;
     array->size = 0;
     return array;
 }
 
 void array_delete(Array *a)
 {
-    free(a->p);
-    free(a);
+    heap_free(a->p, a->capacity * a->bytes);
+    heap_free(a, sizeof(Array));
 }
 
 static uint64_t next_power_of_2(uint64_t v)
@@ -40,40 +43,66 @@ static uint64_t next_power_of_2(uint64_t v)
     return v;
 }
 
-static void array_resize(Array *a, size_t requested_capacity)
+static void array_relocate(Array *a, size_t capacity, size_t head)
+{
+    /* moves the items to p[head], in a new buffer if the capacity changes */
+    if (capacity == a->capacity) {
+        if (a->size) {
+            memmove(a->p + head * a->bytes, a->p + a->head * a->bytes, a->size * a->bytes);
+        }
+    } else {
+        char *p = capacity ? heap_malloc(capacity * a->bytes) : NULL;
+        if (a->size) {
+            memcpy(p + head * a->bytes, a->p + a->head * a->bytes, a->size * a->bytes);
+        }
+        heap_free(a->p, a->capacity * a->bytes);
+        a->p = p;
+        a->capacity = capacity;
+    }
+    a->head = head;
+}
+
+static void array_reserve(Array *a, size_t n, int front)
 {
-    size_t new_capacity = next_power_of_2(requested_capacity);
-    if (a->size > new_capacity) a->size = new_capacity;
-    a->p = realloc(a->p, new_capacity * a->bytes);
-    a->capacity = new_capacity;
+    /* makes room for n more items at the front or the back; if the
+     * buffer is at most three quarters full the items are only moved to
+     * the middle, otherwise it doubles, so either way both sides end up
+     * with room for at least an eighth of the capacity */
+    size_t room = front ? a->head : a->capacity - a->head - a->size;
+    if (n <= room) {
+        return;
+    }
+    size_t total = a->size + n;
+    size_t capacity = a->capacity;
+    if (total > capacity - capacity / 4) {
+        capacity = next_power_of_2(total);
+        if (capacity < 2 * a->capacity) {
+            capacity = 2 * a->capacity;
+        }
+    }
+    /* spread the free room evenly, counting the new items with the side
+     * they go to */
+    size_t free = (capacity - total) / 2;
+    array_relocate(a, capacity, front ? free + n : free);
 }
 
 void *array_at(Array *a, size_t i)
 {
-    return (void *) (a->p + i * a->bytes);
+    return (void *) (a->p + (a->head + i) * a->bytes);
 }
 
 void array_push_back(Array *a, const void *value, size_t n)
 {
-    size_t total = n + a->size;
-    array_resize(a, total);
-    char *pos = a->p + (a->size * a->bytes);
-    memcpy(pos, value, n * a->bytes);
+    array_reserve(a, n, 0);
+    memcpy(a->p + (a->head + a->size) * a->bytes, value, n * a->bytes);
     a->size += n;
 }
 
 void array_push_front(Array *a, const void *value, size_t n)
 {
-    size_t total = n + a->size;
-    // allocate sufficient memory
-    array_resize(a, total);
-    // shift contents away from the front
-    size_t width = n * a->bytes;
-    char *pos = a->p + width;
-    memmove(pos, a->p, a->size * a->bytes);
-    // insert at the front
-    memcpy(a->p, value, width);
-    // update the size info
+    array_reserve(a, n, 1);
+    a->head -= n;
+    memcpy(a->p + a->head * a->bytes, value, n * a->bytes);
     a->size += n;
 }
 
@@ -81,23 +110,18 @@ void *array_pop_back(Array *a)
 {
     if (a->size == 0) return NULL;
     a->size--;
-    return a->p + a->size * a->bytes;
+    return a->p + (a->head + a->size) * a->bytes;
 }
 
 void *array_pop_front(Array *a)
 {
     if (a->size == 0)
         return NULL;
-    // swap
-    char tmp[a->bytes];
-    memcpy(&tmp, a->p, a->bytes);
-    memmove(a->p, a->p + a->bytes, (a->size - 1) * a->bytes);
     a->size--;
-    memcpy(a->p + a->size * a->bytes, &tmp, a->bytes);
-    return (void *) (a->p + a->size * a->bytes);
+    return a->p + a->head++ * a->bytes;
 }
 
 void array_shrink(Array *a)
 {
-    array_resize(a, a->size);
+    array_relocate(a, a->size ? next_power_of_2(a->size) : 0, 0);
 }
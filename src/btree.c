@@ -0,0 +1,415 @@
+#include "btree.h"
+
+#include <string.h>
+
+#include "heap.h"
+#include "profile.h"
+
+
+const BTree *btree_new(BTreeCmp cmp)
+{
+    BTree *t = heap_malloc(sizeof(BTree));
+    PROFILE_ALLOC(t, sizeof(BTree), "BTREE");
+    t->root = NULL;
+    t->size = 0;
+    t->cmp = cmp;
+    t->hash = 0;
+    return t;
+}
+
+static const BTree *btree_with(const BTree *t, const BTreeNode *root, size_t size)
+{
+    BTree *with = heap_malloc(sizeof(BTree));
+    PROFILE_ALLOC(with, sizeof(BTree), "BTREE");
+    with->root = root;
+    with->size = size;
+    with->cmp = t->cmp;
+    with->hash = 0;
+    return with;
+}
+
+/*
+ * Nodes are never changed once they are in a tree. Updates load a node
+ * into a scratch node, which has room for one entry too many, change it
+ * there and store it as one node, or two if it overflowed.
+ */
+
+typedef struct Scratch {
+    unsigned n;
+    bool leaf;
+    BTreeEntry entries[BTREE_MAX + 1];
+    const BTreeNode *children[BTREE_MAX + 2];
+} Scratch;
+
+typedef struct Split {
+    const BTreeNode *left;
+    const BTreeNode *right;  /* NULL unless the node overflowed */
+    BTreeEntry middle;
+} Split;
+
+static BTreeNode *node_make(const BTreeEntry *entries, unsigned n, const BTreeNode *const *children, bool leaf)
+{
+    /* n entries and, unless leaf, n + 1 children */
+    size_t size = sizeof(BTreeNode) + n * sizeof(BTreeEntry) + (leaf ? 0 : (n + 1) * sizeof(BTreeNode *));
+    BTreeNode *node = heap_malloc(size);
+    PROFILE_ALLOC(node, size, "BTREE");
+    node->n = n;
+    node->leaf = leaf;
+    memcpy(node->entries, entries, n * sizeof(BTreeEntry));
+    if (!leaf) {
+        memcpy(btree_children(node), children, (n + 1) * sizeof(BTreeNode *));
+    }
+    return node;
+}
+
+static void scratch_load(Scratch *s, const BTreeNode *node)
+{
+    s->n = node->n;
+    s->leaf = node->leaf;
+    memcpy(s->entries, node->entries, node->n * sizeof(BTreeEntry));
+    if (!node->leaf) {
+        memcpy(s->children, btree_children(node), (node->n + 1) * sizeof(BTreeNode *));
+    }
+}
+
+static const BTreeNode *scratch_node(const Scratch *s)
+{
+    return node_make(s->entries, s->n, s->children, s->leaf);
+}
+
+static void scratch_store(const Scratch *s, Split *out)
+{
+    if (s->n <= BTREE_MAX) {
+        out->left = scratch_node(s);
+        out->right = NULL;
+        return;
+    }
+    unsigned mid = s->n / 2;
+    out->left = node_make(s->entries, mid, s->children, s->leaf);
+    out->middle = s->entries[mid];
+    out->right = node_make(s->entries + mid + 1, s->n - mid - 1, s->children + mid + 1, s->leaf);
+}
+
+static void scratch_insert(Scratch *s, unsigned i, BTreeEntry e, const BTreeNode *right)
+{
+    /* e before entry i, with right as the child after it */
+    memmove(s->entries + i + 1, s->entries + i, (s->n - i) * sizeof(BTreeEntry));
+    s->entries[i] = e;
+    if (!s->leaf) {
+        memmove(s->children + i + 2, s->children + i + 1, (s->n - i) * sizeof(BTreeNode *));
+        s->children[i + 1] = right;
+    }
+    s->n++;
+}
+
+static void scratch_erase(Scratch *s, unsigned i)
+{
+    /* entry i and the child after it */
+    memmove(s->entries + i, s->entries + i + 1, (s->n - i - 1) * sizeof(BTreeEntry));
+    if (!s->leaf) {
+        memmove(s->children + i + 1, s->children + i + 2, (s->n - i - 1) * sizeof(BTreeNode *));
+    }
+    s->n--;
+}
+
+static void scratch_fix(Scratch *s, unsigned i)
+{
+    /* refills child i if it has fewer than BTREE_MIN entries: from a
+     * neighbour with entries to spare or else by merging the two */
+    const BTreeNode *child = s->children[i];
+    if (child->n >= BTREE_MIN) {
+        return;
+    }
+    Scratch c;
+    scratch_load(&c, child);
+    if (i > 0 && s->children[i - 1]->n > BTREE_MIN) {
+        const BTreeNode *left = s->children[i - 1];
+        memmove(c.entries + 1, c.entries, c.n * sizeof(BTreeEntry));
+        c.entries[0] = s->entries[i - 1];
+        if (!c.leaf) {
+            memmove(c.children + 1, c.children, (c.n + 1) * sizeof(BTreeNode *));
+            c.children[0] = btree_children(left)[left->n];
+        }
+        c.n++;
+        s->entries[i - 1] = left->entries[left->n - 1];
+        s->children[i - 1] = node_make(left->entries, left->n - 1,
+                                       left->leaf ? NULL : btree_children(left), left->leaf);
+        s->children[i] = scratch_node(&c);
+    } else if (i < s->n && s->children[i + 1]->n > BTREE_MIN) {
+        const BTreeNode *right = s->children[i + 1];
+        c.entries[c.n] = s->entries[i];
+        if (!c.leaf) {
+            c.children[c.n + 1] = btree_children(right)[0];
+        }
+        c.n++;
+        s->entries[i] = right->entries[0];
+        s->children[i] = scratch_node(&c);
+        s->children[i + 1] = node_make(right->entries + 1, right->n - 1,
+                                       right->leaf ? NULL : btree_children(right) + 1, right->leaf);
+    } else {
+        /* both neighbours are as small as they get, so the two nodes and
+         * the entry between them fit in one */
+        unsigned j = i > 0 ? i - 1 : i;
+        const BTreeNode *a = s->children[j], *b = s->children[j + 1];
+        Scratch m;
+        scratch_load(&m, a);
+        m.entries[m.n] = s->entries[j];
+        memcpy(m.entries + m.n + 1, b->entries, b->n * sizeof(BTreeEntry));
+        if (!m.leaf) {
+            memcpy(m.children + m.n + 1, btree_children(b), (b->n + 1) * sizeof(BTreeNode *));
+        }
+        m.n += 1 + b->n;
+        s->children[j] = scratch_node(&m);
+        scratch_erase(s, j);
+    }
+}
+
+/*
+ * Lookups and updates
+ */
+
+static int node_search(const BTreeNode *node, const void *key, BTreeCmp cmp, unsigned *pos)
+{
+    /* 1 with the position of key, 0 with the position it would go to or
+     * -1 on errors */
+    unsigned lo = 0, hi = node->n;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        int c = cmp(node->entries[mid].key, key);
+        if (c == BTREE_ERROR) {
+            return -1;
+        }
+        if (c == 0) {
+            *pos = mid;
+            return 1;
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return 0;
+}
+
+int btree_get(const BTree *t, const void *key, const BTreeEntry **entry)
+{
+    for (const BTreeNode *node = t->root; node != NULL; ) {
+        unsigned pos;
+        int found = node_search(node, key, t->cmp, &pos);
+        if (found) {
+            if (found > 0) {
+                *entry = &node->entries[pos];
+            }
+            return found;
+        }
+        node = node->leaf ? NULL : btree_children(node)[pos];
+    }
+    return 0;
+}
+
+static int node_insert(const BTreeNode *node, BTreeEntry e, BTreeCmp cmp, Split *out)
+{
+    /* 1 if the key was added, 2 if its value changed, 0 if nothing did
+     * and -1 on errors */
+    unsigned pos;
+    int found = node_search(node, e.key, cmp, &pos);
+    if (found < 0) {
+        return -1;
+    }
+    Scratch s;
+    if (found) {
+        if (node->entries[pos].value == e.value) {
+            return 0;
+        }
+        scratch_load(&s, node);
+        s.entries[pos].value = e.value;
+        scratch_store(&s, out);
+        return 2;
+    }
+    int status = 1;
+    scratch_load(&s, node);
+    if (node->leaf) {
+        scratch_insert(&s, pos, e, NULL);
+    } else {
+        Split sub;
+        status = node_insert(btree_children(node)[pos], e, cmp, &sub);
+        if (status <= 0) {
+            return status;
+        }
+        s.children[pos] = sub.left;
+        if (sub.right) {
+            scratch_insert(&s, pos, sub.middle, sub.right);
+        }
+    }
+    scratch_store(&s, out);
+    return status;
+}
+
+const BTree *btree_insert(const BTree *t, void *key, void *value)
+{
+    BTreeEntry e = { .key = key, .value = value };
+    if (!t->root) {
+        return btree_with(t, node_make(&e, 1, NULL, true), 1);
+    }
+    Split split;
+    int status = node_insert(t->root, e, t->cmp, &split);
+    if (status <= 0) {
+        return status < 0 ? NULL : t;
+    }
+    const BTreeNode *root = split.left;
+    if (split.right) {
+        const BTreeNode *children[] = { split.left, split.right };
+        root = node_make(&split.middle, 1, children, false);
+    }
+    return btree_with(t, root, t->size + (status == 1));
+}
+
+static const BTreeNode *node_remove_last(const BTreeNode *node, BTreeEntry *last)
+{
+    if (node->leaf) {
+        *last = node->entries[node->n - 1];
+        return node_make(node->entries, node->n - 1, NULL, true);
+    }
+    Scratch s;
+    scratch_load(&s, node);
+    s.children[s.n] = node_remove_last(btree_children(node)[node->n], last);
+    scratch_fix(&s, s.n);
+    return scratch_node(&s);
+}
+
+static int node_remove(const BTreeNode *node, const void *key, BTreeCmp cmp, const BTreeNode **out)
+{
+    /* 1 if the key was removed, 0 if it wasn't there and -1 on errors;
+     * *out may be left with fewer than BTREE_MIN entries */
+    unsigned pos;
+    int found = node_search(node, key, cmp, &pos);
+    if (found < 0 || (!found && node->leaf)) {
+        return found;
+    }
+    Scratch s;
+    scratch_load(&s, node);
+    if (node->leaf) {
+        scratch_erase(&s, pos);
+        *out = scratch_node(&s);
+        return 1;
+    }
+    if (found) {
+        /* the entry goes, its predecessor takes its place */
+        s.children[pos] = node_remove_last(btree_children(node)[pos], &s.entries[pos]);
+    } else {
+        int status = node_remove(btree_children(node)[pos], key, cmp, &s.children[pos]);
+        if (status <= 0) {
+            return status;
+        }
+    }
+    scratch_fix(&s, pos);
+    *out = scratch_node(&s);
+    return 1;
+}
+
+const BTree *btree_remove(const BTree *t, const void *key)
+{
+    if (!t->root) {
+        return t;
+    }
+    const BTreeNode *root;
+    int status = node_remove(t->root, key, t->cmp, &root);
+    if (status <= 0) {
+        return status < 0 ? NULL : t;
+    }
+    if (root->n == 0) {
+        root = root->leaf ? NULL : btree_children(root)[0];
+    }
+    return btree_with(t, root, t->size - 1);
+}
+
+const BTreeEntry *btree_first(const BTree *t)
+{
+    const BTreeNode *node = t->root;
+    if (!node) {
+        return NULL;
+    }
+    while (!node->leaf) {
+        node = btree_children(node)[0];
+    }
+    return &node->entries[0];
+}
+
+const BTreeEntry *btree_last(const BTree *t)
+{
+    const BTreeNode *node = t->root;
+    if (!node) {
+        return NULL;
+    }
+    while (!node->leaf) {
+        node = btree_children(node)[node->n];
+    }
+    return &node->entries[node->n - 1];
+}
+
+/*
+ * Iteration
+ */
+
+static void iter_push(BTreeIter *it, const BTreeNode *node, unsigned pos)
+{
+    ++it->depth;
+    it->nodes[it->depth] = node;
+    it->pos[it->depth] = pos;
+}
+
+static void iter_descend(BTreeIter *it, const BTreeNode *node)
+{
+    /* down to the least entry under node */
+    for (;;) {
+        iter_push(it, node, 0);
+        if (node->leaf) {
+            return;
+        }
+        node = btree_children(node)[0];
+    }
+}
+
+bool btree_iter_init(BTreeIter *it, const BTree *t, const void *from)
+{
+    it->depth = -1;
+    if (!from) {
+        if (t->root) {
+            iter_descend(it, t->root);
+        }
+        return true;
+    }
+    for (const BTreeNode *node = t->root; node != NULL; ) {
+        unsigned pos;
+        int found = node_search(node, from, t->cmp, &pos);
+        if (found < 0) {
+            return false;
+        }
+        iter_push(it, node, pos);
+        if (found || node->leaf) {
+            break;
+        }
+        node = btree_children(node)[pos];
+    }
+    return true;
+}
+
+const BTreeEntry *btree_iter_next(BTreeIter *it)
+{
+    while (it->depth >= 0) {
+        const BTreeNode *node = it->nodes[it->depth];
+        unsigned pos = it->pos[it->depth];
+        if (pos >= node->n) {
+            --it->depth;
+            continue;
+        }
+        it->pos[it->depth] = pos + 1;
+        if (!node->leaf) {
+            iter_descend(it, btree_children(node)[pos + 1]);
+        }
+        return &node->entries[pos];
+    }
+    return NULL;
+}
@@ -0,0 +1,198 @@
+#include "cache.h"
+
+#include <string.h>
+
+#include "heap.h"
+#include "profile.h"
+
+#define CACHE_MIN_SLOTS 8
+
+
+Cache *cache_new(size_t capacity, CacheEq eq)
+{
+    Cache *c = heap_malloc(sizeof(Cache));
+    PROFILE_ALLOC(c, sizeof(Cache), "CACHE");
+    c->n_slots = CACHE_MIN_SLOTS;
+    c->slots = heap_calloc(c->n_slots, sizeof(size_t));
+    PROFILE_ALLOC(c->slots, c->n_slots * sizeof(size_t), "CACHE");
+    c->allocated = capacity && capacity < CACHE_MIN_SLOTS / 2 ? capacity : CACHE_MIN_SLOTS / 2;
+    c->entries = heap_malloc(c->allocated * sizeof(CacheEntry));
+    PROFILE_ALLOC(c->entries, c->allocated * sizeof(CacheEntry), "CACHE");
+    c->size = 0;
+    c->capacity = capacity;
+    c->newest = c->oldest = CACHE_NONE;
+    c->hits = c->misses = 0;
+    c->eq = eq;
+    return c;
+}
+
+/*
+ * Recency, a doubly linked list through the entries
+ */
+
+static void cache_unlink(Cache *c, size_t pos)
+{
+    CacheEntry *e = &c->entries[pos];
+    if (e->newer != CACHE_NONE) {
+        c->entries[e->newer].older = e->older;
+    } else {
+        c->newest = e->older;
+    }
+    if (e->older != CACHE_NONE) {
+        c->entries[e->older].newer = e->newer;
+    } else {
+        c->oldest = e->newer;
+    }
+}
+
+static void cache_push_newest(Cache *c, size_t pos)
+{
+    CacheEntry *e = &c->entries[pos];
+    e->newer = CACHE_NONE;
+    e->older = c->newest;
+    if (c->newest != CACHE_NONE) {
+        c->entries[c->newest].newer = pos;
+    } else {
+        c->oldest = pos;
+    }
+    c->newest = pos;
+}
+
+static void cache_touch(Cache *c, size_t pos)
+{
+    if (pos != c->newest) {
+        cache_unlink(c, pos);
+        cache_push_newest(c, pos);
+    }
+}
+
+/*
+ * Slots, linear probing
+ */
+
+static int cache_find(Cache *c, const void *key, unsigned long hash, size_t *slot)
+{
+    /* 1 with the slot of key in *slot, 0 if key is not cached and -1 on
+     * errors */
+    size_t mask = c->n_slots - 1;
+    for (size_t i = hash & mask; c->slots[i]; i = (i + 1) & mask) {
+        const CacheEntry *e = &c->entries[c->slots[i] - 1];
+        if (e->hash == hash) {
+            int eq = c->eq(e->key, key);
+            if (eq) {
+                *slot = i;
+                return eq;
+            }
+        }
+    }
+    return 0;
+}
+
+static size_t cache_free_slot(const Cache *c, unsigned long hash)
+{
+    size_t mask = c->n_slots - 1;
+    size_t i = hash & mask;
+    while (c->slots[i]) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void cache_remove_slot(Cache *c, size_t i)
+{
+    /* backward shift: move later entries of the probe sequence into the
+     * hole unless that would put them before their home slot */
+    size_t mask = c->n_slots - 1;
+    for (size_t j = (i + 1) & mask; c->slots[j]; j = (j + 1) & mask) {
+        size_t home = c->entries[c->slots[j] - 1].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            c->slots[i] = c->slots[j];
+            i = j;
+        }
+    }
+    c->slots[i] = 0;
+}
+
+static size_t cache_evict(Cache *c)
+{
+    /* frees the least recently used entry and returns its position */
+    size_t pos = c->oldest;
+    size_t mask = c->n_slots - 1;
+    size_t i = c->entries[pos].hash & mask;
+    while (c->slots[i] != pos + 1) {
+        i = (i + 1) & mask;
+    }
+    cache_remove_slot(c, i);
+    cache_unlink(c, pos);
+    return pos;
+}
+
+static void cache_grow(Cache *c)
+{
+    /* room for one more entry, keeping at most half the slots in use */
+    if (c->size == c->allocated) {
+        size_t allocated = 2 * c->allocated;
+        if (c->capacity && allocated > c->capacity) {
+            allocated = c->capacity;
+        }
+        CacheEntry *entries = heap_malloc(allocated * sizeof(CacheEntry));
+        PROFILE_ALLOC(entries, allocated * sizeof(CacheEntry), "CACHE");
+        memcpy(entries, c->entries, c->size * sizeof(CacheEntry));
+        heap_free(c->entries, c->allocated * sizeof(CacheEntry));
+        c->entries = entries;
+        c->allocated = allocated;
+    }
+    if (2 * (c->size + 1) > c->n_slots) {
+        heap_free(c->slots, c->n_slots * sizeof(size_t));
+        c->n_slots *= 2;
+        c->slots = heap_calloc(c->n_slots, sizeof(size_t));
+        PROFILE_ALLOC(c->slots, c->n_slots * sizeof(size_t), "CACHE");
+        for (size_t pos = 0; pos < c->size; ++pos) {
+            c->slots[cache_free_slot(c, c->entries[pos].hash)] = pos + 1;
+        }
+    }
+}
+
+int cache_get(Cache *c, const void *key, unsigned long hash, void **value)
+{
+    size_t slot;
+    int found = cache_find(c, key, hash, &slot);
+    if (found > 0) {
+        size_t pos = c->slots[slot] - 1;
+        cache_touch(c, pos);
+        *value = c->entries[pos].value;
+        c->hits++;
+    } else if (found == 0) {
+        c->misses++;
+    }
+    return found;
+}
+
+int cache_put(Cache *c, void *key, unsigned long hash, void *value)
+{
+    size_t slot;
+    int found = cache_find(c, key, hash, &slot);
+    if (found < 0) {
+        return -1;
+    }
+    size_t pos;
+    if (found) {
+        pos = c->slots[slot] - 1;
+        cache_touch(c, pos);
+    } else {
+        /* entries stay packed at the front, an evicted entry's position
+         * is reused right away */
+        if (c->capacity && c->size == c->capacity) {
+            pos = cache_evict(c);
+        } else {
+            cache_grow(c);
+            pos = c->size++;
+        }
+        c->entries[pos].key = key;
+        c->entries[pos].hash = hash;
+        c->slots[cache_free_slot(c, hash)] = pos + 1;
+        cache_push_newest(c, pos);
+    }
+    c->entries[pos].value = value;
+    return 0;
+}
@@ -2,12 +2,25 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "apply.h"
 #include "eval.h"
 #include "exc.h"
+#include "file.h"
+#include "heap.h"
+#include "json.h"
 #include "log.h"
+#include "matrix.h"
+#include "printer.h"
+#include "profile.h"
+#include "sort.h"
 
 
 #define NARGS(args) list_size(LIST(args))
@@ -63,9 +76,19 @@ bool is_truthy(const Value *v)
     case VALUE_STRING:
     case VALUE_SYMBOL:
     case VALUE_LIST:
+    case VALUE_LAZY_SEQ:
     case VALUE_FN:
     case VALUE_MACRO_FN:
     case VALUE_BUILTIN_FN:
+    case VALUE_FILE:
+    case VALUE_TRANSDUCER:
+    case VALUE_CACHE:
+    case VALUE_HASH_SET:
+    case VALUE_SORTED_MAP:
+    case VALUE_SORTED_SET:
+    case VALUE_F64_VECTOR:
+    case VALUE_I64_VECTOR:
+    case VALUE_MATRIX:
         return true;
     }
 }
@@ -102,37 +125,90 @@ Value *core_is_list(const Value *args)
     return arg0->type == VALUE_LIST ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
 }
 
+static bool is_set(const Value *v)
+{
+    return v->type == VALUE_HASH_SET || v->type == VALUE_SORTED_SET;
+}
+
+static size_t coll_size(const Value *v)
+{
+    /* the size of a set or sorted map */
+    return v->type == VALUE_HASH_SET ? HAMT(v)->size : BTREE(v)->size;
+}
+
+static unsigned long coll_cached_hash(const Value *v)
+{
+    return v->type == VALUE_HASH_SET ? HAMT(v)->hash : BTREE(v)->hash;
+}
+
+/* the elements of a set in no particular order, or of a sorted set or
+ * the keys of a sorted map in order */
+typedef struct CollIter {
+    bool hashed;
+    HamtIter hamt;
+    BTreeIter btree;
+} CollIter;
+
+static void coll_iter_init(CollIter *it, const Value *coll)
+{
+    it->hashed = coll->type == VALUE_HASH_SET;
+    if (it->hashed) {
+        hamt_iter_init(&it->hamt, HAMT(coll));
+    } else {
+        btree_iter_init(&it->btree, BTREE(coll), NULL);
+    }
+}
+
+static Value *coll_iter_next(CollIter *it)
+{
+    if (it->hashed) {
+        return hamt_iter_next(&it->hamt);
+    }
+    const BTreeEntry *e = btree_iter_next(&it->btree);
+    return e ? e->key : NULL;
+}
+
 Value *core_is_empty(const Value *args)
 {
     CHECK_ARGLIST(args);
     REQUIRE_LIST_CARDINALITY(args, 1ul, "empty? requires exactly one parameter");
     Value *arg0 = ARG(args, 0);
+    if (value_is_vector(arg0)) {
+        return NUMVEC(arg0)->size ? VALUE_CONST_FALSE : VALUE_CONST_TRUE;
+    }
+    if (is_set(arg0) || arg0->type == VALUE_SORTED_MAP) {
+        return coll_size(arg0) ? VALUE_CONST_FALSE : VALUE_CONST_TRUE;
+    }
+    if (arg0->type == VALUE_LAZY_SEQ) {
+        Value *first = value_seq_first(arg0);
+        return exc_is_pending() ? NULL : first ? VALUE_CONST_FALSE : VALUE_CONST_TRUE;
+    }
     REQUIRE_VALUE_TYPE(arg0, VALUE_LIST, "empty? requires a list type");
     return NARGS(arg0) == 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
 }
 
-static float acc_add(float acc, float x)
+static double acc_add(double acc, double x)
 {
     return acc + x;
 }
 
-static float acc_sub(float acc, float x)
+static double acc_sub(double acc, double x)
 {
     return acc - x;
 }
 
-static float acc_mul(float acc, float x)
+static double acc_mul(double acc, double x)
 {
     return acc * x;
 }
 
-static float acc_div(float acc, float x)
+static double acc_div(double acc, double x)
 {
     return acc / x;
 }
 
 
-static Value *core_acc(const Value *args, float (*acc_fn)(float, float))
+static Value *core_acc(const Value *args, double (*acc_fn)(double, double))
 {
     CHECK_ARGLIST(args);
     REQUIRE_LIST_CARDINALITY_GE(args, 1ul, "Require at least one argument");
@@ -140,12 +216,12 @@ static Value *core_acc(const Value *args, float (*acc_fn)(float, float))
     bool all_int = true;
     const List *list = args->value.list;
     Value *head = list_head(list);
-    float acc;
+    double acc;
     if (head->type == VALUE_FLOAT) {
         acc = head->value.float_;
         all_int = false;
     } else if (head->type == VALUE_INT) {
-        acc = (float) head->value.int_;
+        acc = (double) head->value.int_;
     } else {
         exc_set(value_make_exception("Non-numeric argument in accumulation"));
         return NULL;
@@ -156,7 +232,7 @@ static Value *core_acc(const Value *args, float (*acc_fn)(float, float))
             acc = acc_fn(acc, head->value.float_);
             all_int = false;
         } else if (head->type == VALUE_INT) {
-            acc = acc_fn(acc, (float) head->value.int_);
+            acc = acc_fn(acc, (double) head->value.int_);
         } else {
             exc_set(value_make_exception("Non-numeric argument in accumulation"));
             return NULL;
@@ -174,7 +250,9 @@ static Value *core_acc(const Value *args, float (*acc_fn)(float, float))
 
 Value *core_add(const Value *args)
 {
-    return core_acc(args, acc_add);
+    /* (+) is 0 and (*) is 1, so (reduce + ()) works as expected */
+    CHECK_ARGLIST(args);
+    return NARGS(args) ? core_acc(args, acc_add) : value_new_int(0);
 }
 
 Value *core_sub(const Value *args)
@@ -184,7 +262,8 @@ Value *core_sub(const Value *args)
 
 Value *core_mul(const Value *args)
 {
-    return core_acc(args, acc_mul);
+    CHECK_ARGLIST(args);
+    return NARGS(args) ? core_acc(args, acc_mul) : value_new_int(1);
 }
 
 Value *core_div(const Value *args)
@@ -192,6 +271,115 @@ Value *core_div(const Value *args)
     return core_acc(args, acc_div);
 }
 
+static bool is_seq(const Value *v)
+{
+    return v->type == VALUE_LIST || v->type == VALUE_LAZY_SEQ || value_is_vector(v);
+}
+
+static Value *cmp_eq(const Value *a, const Value *b);
+
+static Value *cmp_seq_eq(const Value *a, const Value *b)
+{
+    /* a lazy sequence equals any list or sequence with the same elements,
+     * which are realized only as far as they agree */
+    SeqIter it_a, it_b;
+    value_seq_iter_init(&it_a, a);
+    value_seq_iter_init(&it_b, b);
+    while (true) {
+        Value *head_a = value_seq_iter_next(&it_a);
+        Value *head_b = value_seq_iter_next(&it_b);
+        if (exc_is_pending()) {
+            return NULL;
+        }
+        if (!head_a || !head_b) {
+            return head_a == head_b ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        }
+        Value *cmp_result = cmp_eq(head_a, head_b);
+        if (!(cmp_result == VALUE_CONST_TRUE)) {
+            return cmp_result;  /* NULL or VALUE_CONST_FALSE */
+        }
+    }
+}
+
+/* equal values hash alike, so differing cached hashes settle = early */
+#define HASHES_DIFFER(x, y) ((x)->hash && (y)->hash && (x)->hash != (y)->hash)
+
+static bool cmp_vector_eq(const Value *a, const Value *b)
+{
+    /* element by element, so 0.0 equals -0.0 and NaN nothing */
+    const NumVec *x = NUMVEC(a), *y = NUMVEC(b);
+    if (x->size != y->size || HASHES_DIFFER(x, y)) {
+        return false;
+    }
+    for (size_t i = 0; i < x->size; ++i) {
+        if (a->type == VALUE_F64_VECTOR ? x->data.f64[i] != y->data.f64[i]
+                                        : x->data.i64[i] != y->data.i64[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool cmp_matrix_eq(const Value *a, const Value *b)
+{
+    const Matrix *x = MATRIX(a), *y = MATRIX(b);
+    if (x->rows != y->rows || x->cols != y->cols || HASHES_DIFFER(x, y)) {
+        return false;
+    }
+    for (size_t i = 0; i < x->rows * x->cols; ++i) {
+        if (x->data[i] != y->data[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int set_contains(const Value *set, const Value *x);
+static Value *coll_conj(Value *coll, Value *x, const char *name);
+static Value *coll_first(const Value *coll);
+
+static Value *cmp_set_eq(const Value *a, const Value *b)
+{
+    /* sets of either kind are equal with the same elements, and hash
+     * alike, so differing cached hashes settle it early */
+    unsigned long hash_a = coll_cached_hash(a), hash_b = coll_cached_hash(b);
+    if (coll_size(a) != coll_size(b) || (hash_a && hash_b && hash_a != hash_b)) {
+        return VALUE_CONST_FALSE;
+    }
+    CollIter it;
+    coll_iter_init(&it, a);
+    for (Value *x; (x = coll_iter_next(&it)) != NULL; ) {
+        int found = set_contains(b, x);
+        if (found <= 0) {
+            return found < 0 ? NULL : VALUE_CONST_FALSE;
+        }
+    }
+    return VALUE_CONST_TRUE;
+}
+
+static Value *cmp_map_eq(const Value *a, const Value *b)
+{
+    /* both in order, so entry by entry */
+    const BTree *x = BTREE(a), *y = BTREE(b);
+    if (x->size != y->size || HASHES_DIFFER(x, y)) {
+        return VALUE_CONST_FALSE;
+    }
+    BTreeIter it_a, it_b;
+    btree_iter_init(&it_a, x, NULL);
+    btree_iter_init(&it_b, y, NULL);
+    for (const BTreeEntry *e_a, *e_b; (e_a = btree_iter_next(&it_a)) != NULL; ) {
+        e_b = btree_iter_next(&it_b);
+        Value *cmp_result = cmp_eq(e_a->key, e_b->key);
+        if (cmp_result == VALUE_CONST_TRUE) {
+            cmp_result = cmp_eq(e_a->value, e_b->value);
+        }
+        if (!(cmp_result == VALUE_CONST_TRUE)) {
+            return cmp_result;  /* NULL or VALUE_CONST_FALSE */
+        }
+    }
+    return VALUE_CONST_TRUE;
+}
+
 static Value *cmp_eq(const Value *a, const Value *b)
 {
     if (a->type == b->type) {
@@ -211,7 +399,7 @@ static Value *cmp_eq(const Value *a, const Value *b)
             return FLOAT(a) == FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_STRING:
         case VALUE_SYMBOL:
-            return strcmp(STRING(a), STRING(b)) == 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+            return value_string_eq(a, b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_BUILTIN_FN:
             /* For built-in functions we currently use identity == equality */
             return BUILTIN_FN(a) == BUILTIN_FN(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
@@ -219,37 +407,51 @@ static Value *cmp_eq(const Value *a, const Value *b)
         case VALUE_MACRO_FN:
             /* For composite  functions we currently use identity == equality */
             return FN(a) == FN(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        case VALUE_FILE:
+            return FILE_HANDLE(a) == FILE_HANDLE(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        case VALUE_TRANSDUCER:
+            return XFORM(a) == XFORM(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        case VALUE_CACHE:
+            return MEMO(a) == MEMO(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        case VALUE_HASH_SET:
+        case VALUE_SORTED_SET:
+            return cmp_set_eq(a, b);
+        case VALUE_SORTED_MAP:
+            return cmp_map_eq(a, b);
+        case VALUE_F64_VECTOR:
+        case VALUE_I64_VECTOR:
+            return cmp_vector_eq(a, b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        case VALUE_MATRIX:
+            return cmp_matrix_eq(a, b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        case VALUE_LAZY_SEQ:
+            return cmp_seq_eq(a, b);
         case VALUE_LIST:
-            if (list_size(LIST(a)) == list_size(LIST(b))) {
-                /* empty lists can be equal */
-                if (list_size(LIST(a)) == 0) {
-                    return VALUE_CONST_TRUE;
-                }
-                /* else compare contents */
-                const List *list_a = LIST(a);
-                const List *list_b = LIST(b);
-                Value *head_a;
-                Value *head_b;
-                while ((head_a = list_head(list_a)) && (head_b = list_head(list_b))) {
-                    Value *cmp_result = cmp_eq(head_a, head_b);
+            if (list_size(LIST(a)) == list_size(LIST(b)) && !HASHES_DIFFER(LIST(a), LIST(b))) {
+                /* walk the cells, list_tail() would allocate */
+                const ListItem *item_a = LIST(a)->begin;
+                const ListItem *item_b = LIST(b)->begin;
+                for (; item_a != NULL; item_a = item_a->next, item_b = item_b->next) {
+                    Value *cmp_result = cmp_eq(item_a->p, item_b->p);
                     if (!(cmp_result == VALUE_CONST_TRUE)) {
                         return cmp_result;  /* NULL or VALUE_CONST_FALSE */
                     }
-                    list_a = list_tail(list_a);
-                    list_b = list_tail(list_b);
                 }
                 return VALUE_CONST_TRUE;
             }
             return VALUE_CONST_FALSE;
         }
     } else if (a->type == VALUE_INT && b->type == VALUE_FLOAT) {
-        return ((float) INT(a)) == FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return ((double) INT(a)) == FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     } else if (b->type == VALUE_INT && a->type == VALUE_FLOAT) {
-        return ((float) INT(b)) == FLOAT(a) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return ((double) INT(b)) == FLOAT(a) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     } else if (b->type == VALUE_NIL || a->type == VALUE_NIL) {
         /* nil can be compared to anything but will yield false unless compared
          * to itself */
         return VALUE_CONST_FALSE;
+    } else if (is_seq(a) && is_seq(b)) {
+        return cmp_seq_eq(a, b);
+    } else if (is_set(a) && is_set(b)) {
+        return cmp_set_eq(a, b);
     }
     exc_set(value_make_exception("Cannot compare incompatible types"));
     return NULL;
@@ -274,20 +476,44 @@ static Value *cmp_lt(const Value *a, const Value *b)
             return FLOAT(a) < FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_STRING:
         case VALUE_SYMBOL:
-            return strcmp(STRING(a), STRING(b)) < 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+            return value_string_cmp(a, b) < 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_BUILTIN_FN:
         case VALUE_FN:
         case VALUE_MACRO_FN:
             exc_set(value_make_exception("Cannot order functions"));
             return NULL;
+        case VALUE_FILE:
+            exc_set(value_make_exception("Cannot order files"));
+            return NULL;
+        case VALUE_TRANSDUCER:
+            exc_set(value_make_exception("Cannot order transducers"));
+            return NULL;
+        case VALUE_CACHE:
+            exc_set(value_make_exception("Cannot order caches"));
+            return NULL;
+        case VALUE_HASH_SET:
+        case VALUE_SORTED_SET:
+            exc_set(value_make_exception("Cannot order sets"));
+            return NULL;
+        case VALUE_SORTED_MAP:
+            exc_set(value_make_exception("Cannot order maps"));
+            return NULL;
+        case VALUE_F64_VECTOR:
+        case VALUE_I64_VECTOR:
+            exc_set(value_make_exception("Cannot order vectors"));
+            return NULL;
+        case VALUE_MATRIX:
+            exc_set(value_make_exception("Cannot order matrices"));
+            return NULL;
         case VALUE_LIST:
+        case VALUE_LAZY_SEQ:
             exc_set(value_make_exception("Cannot order lists"));
             return NULL;
         }
     } else if (a->type == VALUE_INT && b->type == VALUE_FLOAT) {
-        return ((float) INT(a)) < FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return ((double) INT(a)) < FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     } else if (b->type == VALUE_INT && a->type == VALUE_FLOAT) {
-        return FLOAT(a) < ((float) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return FLOAT(a) < ((double) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     }
     exc_set(value_make_exception("Cannot compare incompatible types"));
     return NULL;
@@ -312,20 +538,44 @@ static Value *cmp_leq(const Value *a, const Value *b)
             return FLOAT(a) <= FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_STRING:
         case VALUE_SYMBOL:
-            return strcmp(STRING(a), STRING(b)) <= 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+            return value_string_cmp(a, b) <= 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_BUILTIN_FN:
         case VALUE_FN:
         case VALUE_MACRO_FN:
             exc_set(value_make_exception("Cannot order functions"));
             return NULL;
+        case VALUE_FILE:
+            exc_set(value_make_exception("Cannot order files"));
+            return NULL;
+        case VALUE_TRANSDUCER:
+            exc_set(value_make_exception("Cannot order transducers"));
+            return NULL;
+        case VALUE_CACHE:
+            exc_set(value_make_exception("Cannot order caches"));
+            return NULL;
+        case VALUE_HASH_SET:
+        case VALUE_SORTED_SET:
+            exc_set(value_make_exception("Cannot order sets"));
+            return NULL;
+        case VALUE_SORTED_MAP:
+            exc_set(value_make_exception("Cannot order maps"));
+            return NULL;
+        case VALUE_F64_VECTOR:
+        case VALUE_I64_VECTOR:
+            exc_set(value_make_exception("Cannot order vectors"));
+            return NULL;
+        case VALUE_MATRIX:
+            exc_set(value_make_exception("Cannot order matrices"));
+            return NULL;
         case VALUE_LIST:
+        case VALUE_LAZY_SEQ:
             exc_set(value_make_exception("Cannot order lists"));
             return NULL;
         }
     } else if (a->type == VALUE_INT && b->type == VALUE_FLOAT) {
-        return ((float) INT(a)) <= FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return ((double) INT(a)) <= FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     } else if (b->type == VALUE_INT && a->type == VALUE_FLOAT) {
-        return FLOAT(a) <= ((float) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return FLOAT(a) <= ((double) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     }
     exc_set(value_make_exception("Cannot compare incompatible types"));
     return NULL;
@@ -350,20 +600,44 @@ static Value *cmp_gt(const Value *a, const Value *b)
             return FLOAT(a) > FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_STRING:
         case VALUE_SYMBOL:
-            return strcmp(STRING(a), STRING(b)) > 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+            return value_string_cmp(a, b) > 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_BUILTIN_FN:
         case VALUE_FN:
         case VALUE_MACRO_FN:
             exc_set(value_make_exception("Cannot order functions"));
             return NULL;
+        case VALUE_FILE:
+            exc_set(value_make_exception("Cannot order files"));
+            return NULL;
+        case VALUE_TRANSDUCER:
+            exc_set(value_make_exception("Cannot order transducers"));
+            return NULL;
+        case VALUE_CACHE:
+            exc_set(value_make_exception("Cannot order caches"));
+            return NULL;
+        case VALUE_HASH_SET:
+        case VALUE_SORTED_SET:
+            exc_set(value_make_exception("Cannot order sets"));
+            return NULL;
+        case VALUE_SORTED_MAP:
+            exc_set(value_make_exception("Cannot order maps"));
+            return NULL;
+        case VALUE_F64_VECTOR:
+        case VALUE_I64_VECTOR:
+            exc_set(value_make_exception("Cannot order vectors"));
+            return NULL;
+        case VALUE_MATRIX:
+            exc_set(value_make_exception("Cannot order matrices"));
+            return NULL;
         case VALUE_LIST:
+        case VALUE_LAZY_SEQ:
             exc_set(value_make_exception("Cannot order lists"));
             return NULL;
         }
     } else if (a->type == VALUE_INT && b->type == VALUE_FLOAT) {
-        return ((float) INT(a)) > FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return ((double) INT(a)) > FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     } else if (b->type == VALUE_INT && a->type == VALUE_FLOAT) {
-        return FLOAT(a) > ((float) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return FLOAT(a) > ((double) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     }
     exc_set(value_make_exception("Cannot compare incompatible types"));
     return NULL;
@@ -388,20 +662,44 @@ static Value *cmp_geq(const Value *a, const Value *b)
             return FLOAT(a) >= FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_STRING:
         case VALUE_SYMBOL:
-            return strcmp(STRING(a), STRING(b)) >= 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+            return value_string_cmp(a, b) >= 0 ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
         case VALUE_BUILTIN_FN:
         case VALUE_FN:
         case VALUE_MACRO_FN:
             exc_set(value_make_exception("Cannot order functions"));
             return NULL;
+        case VALUE_FILE:
+            exc_set(value_make_exception("Cannot order files"));
+            return NULL;
+        case VALUE_TRANSDUCER:
+            exc_set(value_make_exception("Cannot order transducers"));
+            return NULL;
+        case VALUE_CACHE:
+            exc_set(value_make_exception("Cannot order caches"));
+            return NULL;
+        case VALUE_HASH_SET:
+        case VALUE_SORTED_SET:
+            exc_set(value_make_exception("Cannot order sets"));
+            return NULL;
+        case VALUE_SORTED_MAP:
+            exc_set(value_make_exception("Cannot order maps"));
+            return NULL;
+        case VALUE_F64_VECTOR:
+        case VALUE_I64_VECTOR:
+            exc_set(value_make_exception("Cannot order vectors"));
+            return NULL;
+        case VALUE_MATRIX:
+            exc_set(value_make_exception("Cannot order matrices"));
+            return NULL;
         case VALUE_LIST:
+        case VALUE_LAZY_SEQ:
             exc_set(value_make_exception("Cannot order lists"));
             return NULL;
         }
     } else if (a->type == VALUE_INT && b->type == VALUE_FLOAT) {
-        return ((float) INT(a)) >= FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return ((double) INT(a)) >= FLOAT(b) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     } else if (b->type == VALUE_INT && a->type == VALUE_FLOAT) {
-        return FLOAT(a) >= ((float) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+        return FLOAT(a) >= ((double) INT(b)) ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
     }
     exc_set(value_make_exception("Cannot compare incompatible types"));
     return NULL;
@@ -454,93 +752,12 @@ Value *core_geq(const Value *args)
 }
 
 
-static char *str_append(char *str, size_t n_str, char *partial, size_t n_partial)
-{
-    str = realloc(str, n_str + n_partial + 1);
-    strncat(str, partial, n_partial);
-    return str;
-}
-
-static char *core_str_inner(char *str, const Value *v)
-{
-    char *partial;
-    switch(v->type) {
-    case VALUE_NIL:
-        str = str_append(str, strlen(str), "nil", 3);
-        break;
-    case VALUE_BOOL:
-        partial = BOOL(v) ? "true" : "false";
-        str = str_append(str, strlen(str), partial, strlen(partial));
-        break;
-    case VALUE_INT:
-        asprintf(&partial, "%d", INT(v));
-        str = str_append(str, strlen(str), partial, strlen(partial));
-        free(partial);
-        break;
-    case VALUE_FLOAT:
-        asprintf(&partial, "%f", FLOAT(v));
-        str = str_append(str, strlen(str), partial, strlen(partial));
-        free(partial);
-        break;
-    case VALUE_STRING:
-    case VALUE_SYMBOL:
-    case VALUE_EXCEPTION:
-        asprintf(&partial, "%s", STRING(v));
-        str = str_append(str, strlen(str), partial, strlen(partial));
-        free(partial);
-        break;
-    case VALUE_LIST:
-        str = str_append(str, strlen(str), "(", 1);
-        Value *head2;
-        const List *tail2 = v->value.list;
-        while((head2 = list_head(tail2)) != NULL) {
-            str = core_str_inner(str, head2);
-            tail2 = list_tail(tail2);
-            if (list_head(tail2)) {
-                str = str_append(str, strlen(str), " ", 1);
-            }
-        }
-        str = str_append(str, strlen(str), ")", 1);
-        break;
-    case VALUE_FN:
-    case VALUE_MACRO_FN:
-        str = str_append(str, strlen(str), "(lambda ", 8);
-        str = core_str_inner(str, FN(v)->args);
-        str = str_append(str, strlen(str), " ", 1);
-        str = core_str_inner(str, FN(v)->body);
-        str = str_append(str, strlen(str), ")", 1);
-        break;
-    case VALUE_BUILTIN_FN:
-        asprintf(&partial, "#<builtin_fn@%p>", (void *) v->value.builtin_fn);
-        str = str_append(str, strlen(str), partial, strlen(partial));
-        free(partial);
-        break;
-    }
-    return str;
-}
-
 Value *core_str_outer(const Value *args, bool printable)
 {
-    if (!args)
-        return value_new_string("");
-
-    char *str = calloc(1, sizeof(char));
-    if (args->type == VALUE_LIST) {
-        const List *list = LIST(args);
-        Value *head;
-        while ((head = list_head(list)) != NULL) {
-            str = core_str_inner(str, head);
-            list = list_tail(list);
-            if (printable) {
-                str = str_append(str, strlen(str), " ", 1);
-            }
-        }
-    } else {
-        str = core_str_inner(str, args);
-    }
-    Value *ret = value_new_string(str);
-    free(str);
-    return ret;
+    Printer p;
+    printer_init_string(&p);
+    printer_values(&p, args, printable);
+    return printer_finish(&p);
 }
 
 Value *core_str(const Value *args)
@@ -550,8 +767,10 @@ Value *core_str(const Value *args)
 
 Value *core_pr(const Value *args)
 {
-    Value *str = core_str_outer(args, true);
-    fprintf(stdout, "%s", str->value.str);
+    /* serialized straight into the output buffer */
+    Printer *out = printer_stdout();
+    printer_values(out, args, true);
+    printer_end(out);
     return VALUE_CONST_NIL;
 }
 
@@ -564,10 +783,20 @@ Value *core_pr_str(const Value *args)
 
 Value *core_prn(const Value *args)
 {
-    Value *str = core_str_outer(args, true);
-    fprintf(stdout, "%s", str->value.str);
-    fprintf(stdout, "\n");
-    fflush(stdout);
+    Printer *out = printer_stdout();
+    printer_values(out, args, true);
+    printer_write_char(out, '\n');
+    printer_end(out);
+    return VALUE_CONST_NIL;
+}
+
+
+Value *core_flush(const Value *args)
+{
+    // (flush)
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 0ul, "FLUSH takes no arguments");
+    printer_flush(printer_stdout());
     return VALUE_CONST_NIL;
 }
 
@@ -579,10 +808,45 @@ Value *core_count(const Value *args)
     if (is_nil(list)) {
         return value_new_int(0);
     }
-    REQUIRE_VALUE_TYPE(list, VALUE_LIST, "count requires a list argument");
+    if (list->type == VALUE_STRING) {
+        return value_new_int(STRING_LEN(list));
+    }
+    if (value_is_vector(list)) {
+        return value_new_int(NUMVEC(list)->size);
+    }
+    if (is_set(list) || list->type == VALUE_SORTED_MAP) {
+        return value_new_int(coll_size(list));
+    }
+    if (list->type == VALUE_LAZY_SEQ) {
+        /* realizes the whole sequence */
+        SeqIter it;
+        int n = 0;
+        for (value_seq_iter_init(&it, list); value_seq_iter_next(&it); ) {
+            n++;
+        }
+        return exc_is_pending() ? NULL : value_new_int(n);
+    }
+    REQUIRE_VALUE_TYPE(list, VALUE_LIST, "count requires a list or string argument");
     return value_new_int(NARGS(list));
 }
 
+static Value *slurp_stream(FILE *f, const Value *path)
+{
+    StringBuilder sb;
+    string_builder_init(&sb);
+    char chunk[PRINTER_BUFSIZE];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        string_builder_append(&sb, chunk, n);
+    }
+    if (ferror(f)) {
+        string_builder_discard(&sb);
+        exc_set(value_make_exception("Failed to read file %s", STRING(path)));
+        return NULL;
+    }
+    return string_builder_finish(&sb);
+}
+
 Value *core_slurp(const Value *args)
 {
     CHECK_ARGLIST(args);
@@ -597,8 +861,20 @@ Value *core_slurp(const Value *args)
         exc_set(value_make_exception("Failed to open file %s: %s", STRING(v), strerror(errno)));
         goto out;
     }
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode)
+            && st.st_size >= FILE_MAP_THRESHOLD
+            && (retval = file_map(fileno(f), st.st_size))) {
+        /* large files are mapped rather than read and held on the heap */
+        goto out_file;
+    }
     int ret;
     if ((ret = fseek(f, 0L, SEEK_END)) != 0) {
+        if (errno == ESPIPE) {
+            /* pipes and the like are read until they run dry */
+            retval = slurp_stream(f, v);
+            goto out_file;
+        }
         exc_set(value_make_exception("Failed to determine file size for %s: %s",
                                      STRING(v), strerror(errno)));
         goto out_file;
@@ -609,7 +885,12 @@ Value *core_slurp(const Value *args)
                                      STRING(v), strerror(errno)));
         goto out_file;
     }
-    char *buf = malloc(fsize + 1);
+    /* read straight into the string's buffer, the value takes it over */
+    char *buf = heap_try_malloc(fsize + 1);
+    if (!buf) {
+        exc_set(value_make_exception("Out of memory: no room for the %ld bytes of %s", fsize, STRING(v)));
+        goto out_file;
+    }
     if ((ret = fseek(f, 0L, SEEK_SET)) != 0) {
         exc_set(value_make_exception("Failed to read file %s", STRING(v)));
         goto out_buf;
@@ -619,10 +900,10 @@ Value *core_slurp(const Value *args)
         exc_set(value_make_exception("Failed to read file %s", STRING(v)));
         goto out_buf;
     }
-    buf[fsize] = '\0';
-    retval = value_new_string(buf); // FIXME: fx value constructors to avoid copy
+    retval = value_new_string_owned(buf, fsize);
+    goto out_file;
 out_buf:
-    free(buf);
+    heap_free(buf, fsize + 1);
 out_file:
     fclose(f);
 out:
@@ -630,145 +911,1836 @@ out:
 }
 
 
-Value *core_cons(const Value *args)
+Value *core_mmap_file(const Value *args)
 {
+    // (mmap-file path), the contents of a file mapped read-only into memory
     CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY(args, 2ul, "CONS takes exactly two arguments");
-    Value *first = ARG(args, 0);
-    Value *second = ARG(args, 1);
-    REQUIRE_VALUE_TYPE(second, VALUE_LIST, "the second parameter to CONS must be a list");
-    return value_new_list(list_cons(LIST(second), first));
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "mmap-file takes exactly one argument");
+    Value *path = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(path, VALUE_STRING, "mmap-file takes a string argument");
+    int fd = open(STRING(path), O_RDONLY);
+    if (fd < 0) {
+        exc_set(value_make_exception("Failed to open file %s: %s", STRING(path), strerror(errno)));
+        return NULL;
+    }
+    Value *retval = NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        exc_set(value_make_exception("Failed to determine file size for %s: %s",
+                                     STRING(path), strerror(errno)));
+    } else if (st.st_size == 0) {
+        /* there is nothing to map */
+        retval = value_new_string("");
+    } else if (!(retval = file_map(fd, st.st_size))) {
+        exc_set(value_make_exception("Failed to map file %s: %s", STRING(path), strerror(errno)));
+    }
+    close(fd);
+    return retval;
 }
 
-Value *core_concat(const Value *args)
+Value *core_subs(const Value *args)
 {
+    // (subs s start) or (subs s start end), shares the bytes of s
     CHECK_ARGLIST(args);
-    const List *concat = list_new();
-    for (const ListItem *i = LIST(args)->begin; i != NULL; i = i->next) {
-        Value *v = (Value *) i->p;
-        REQUIRE_VALUE_TYPE(v, VALUE_LIST, "all parameters to CONCAT must be lists");
-        for (const ListItem *j = LIST(v)->begin; j != NULL; j = j->next) {
-            concat = list_conj(concat, j->p);
-        }
+    REQUIRE_LIST_CARDINALITY_GE(args, 2ul, "subs takes a string, a start and an optional end");
+    Value *s = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(s, VALUE_STRING, "the first parameter to subs must be a string");
+    Value *start = ARG(args, 1);
+    REQUIRE_VALUE_TYPE(start, VALUE_INT, "the start passed to subs must be an integer");
+    size_t end = STRING_LEN(s);
+    if (NARGS(args) > 2) {
+        Value *e = ARG(args, 2);
+        REQUIRE_VALUE_TYPE(e, VALUE_INT, "the end passed to subs must be an integer");
+        end = INT(e) < 0 ? SIZE_MAX : (size_t) INT(e);
+    }
+    if (INT(start) < 0 || (size_t) INT(start) > end || end > STRING_LEN(s)) {
+        exc_set(value_make_exception("Index error"));
+        return NULL;
     }
-    return value_new_list(concat);
+    return value_new_string_slice(value_string_base(s), STRING_PTR(s) + INT(start),
+                                  end - INT(start));
 }
 
-Value *core_map(const Value *args)
+static const char *find_bytes(const char *hay, size_t hay_len, const char *needle, size_t needle_len)
 {
-    /* (map f '(a b c ...)) */
-    CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY(args, 2ul, "MAP takes exactly two parameters");
-    Value *fn = ARG(args, 0);
-    Value *fn_args = ARG(args, 1);
-
-    REQUIRE_VALUE_TYPE(fn_args, VALUE_LIST, "The second parameter to MAP must be a list");
-    const List *mapped = list_new();
-    Value *tco_expr = NULL;
-    Environment *tco_env;
-    for (size_t i = 0; i < list_size(LIST(fn_args)); ++i) {
-        Value *result = apply(fn, value_make_list(ARG(fn_args, i)),
-                              &tco_expr, &tco_env);
-        /* apply() may defer to eval() because of TCO support, we
-         * need to catch that and eval the expression */
-        if (tco_expr && !exc_is_pending()) {
-            result = eval(tco_expr, tco_env);
-        }
-        if (!result) {
-            assert(exc_is_pending());
+    /* the first needle in hay, NULL if there is none; memmem() isn't
+     * standard C */
+    if (needle_len == 0) {
+        return hay;
+    }
+    const char *end = hay + hay_len;
+    while ((size_t) (end - hay) >= needle_len) {
+        hay = memchr(hay, needle[0], end - hay - needle_len + 1);
+        if (!hay) {
             return NULL;
         }
-        mapped = list_conj(mapped, result);
+        if (memcmp(hay, needle, needle_len) == 0) {
+            return hay;
+        }
+        ++hay;
     }
-    return value_new_list(mapped);
+    return NULL;
 }
 
-Value *core_apply(const Value *args)
+Value *core_index_of(const Value *args)
 {
-    /* (apply f a b c d ...) == (f a b c d ...) */
+    // (index-of s needle) or (index-of s needle from), nil if not found
     CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY_GE(args, 2ul, "APPLY requires at least two arguments");
-    Value *fn = ARG(args, 0);
-    Value *fn_args = value_new_list(list_tail(LIST(args)));
-    size_t n_args = NARGS(fn_args);
-
-    /* Merge the arguments w/ a potential list of arguments at the end of
-     * the argument list */
-    if (is_list(ARG(fn_args, n_args - 1))) {
-        const List *concat = list_new();
-        for (const ListItem *j = LIST(fn_args)->begin; j != LIST(fn_args)->end; j = j->next) {
-            concat = list_conj(concat, j->p);
-        }
-        for (const ListItem *j = LIST(((Value *)(LIST(fn_args)->end->p)))->begin; j != NULL; j = j->next) {
-            concat = list_conj(concat, j->p);
+    REQUIRE_LIST_CARDINALITY_GE(args, 2ul, "index-of takes a string, a substring and an optional offset");
+    Value *s = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(s, VALUE_STRING, "the first parameter to index-of must be a string");
+    Value *needle = ARG(args, 1);
+    REQUIRE_VALUE_TYPE(needle, VALUE_STRING, "the second parameter to index-of must be a string");
+    size_t from = 0;
+    if (NARGS(args) > 2) {
+        Value *f = ARG(args, 2);
+        REQUIRE_VALUE_TYPE(f, VALUE_INT, "the offset passed to index-of must be an integer");
+        if (INT(f) < 0 || (size_t) INT(f) > STRING_LEN(s)) {
+            exc_set(value_make_exception("Index error"));
+            return NULL;
         }
-        fn_args = value_new_list(concat);
+        from = INT(f);
     }
-    Value *tco_expr;
-    Environment *tco_env;
-    Value *result = apply(fn, fn_args, &tco_expr, &tco_env);
-    /* need to call eval since apply defers to eval for TCO support */
-    if (tco_expr && !exc_is_pending()) {
-        result = eval(tco_expr, tco_env);
+    const char *hay = STRING_PTR(s);
+    const char *found = find_bytes(hay + from, STRING_LEN(s) - from,
+                                   STRING_PTR(needle), STRING_LEN(needle));
+    if (!found) {
+        return VALUE_CONST_NIL;
     }
-    if (!result) {
-        assert(exc_is_pending());
+    if (found - hay > INT_MAX) {
+        exc_set(value_make_exception("index-of: offset %ld is out of range", (long) (found - hay)));
         return NULL;
     }
-    return result;
+    return value_new_int(found - hay);
 }
 
-Value *core_is_nil(const Value *args)
+static File *file_arg(const Value *v, bool reading, const char *fn)
 {
-    CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY(args, 1ul, "NIL? takes exactly one argument");
-    Value *expr = ARG(args, 0);
-    return value_new_bool(is_nil(expr));
+    /* the handle of an open file value, NULL with an exception otherwise */
+    if (v->type != VALUE_FILE) {
+        exc_set(value_make_exception("%s: expected %s, got %s", fn,
+                                     value_type_names[VALUE_FILE], value_type_names[v->type]));
+        return NULL;
+    }
+    File *f = FILE_HANDLE(v);
+    if (!f->fp) {
+        exc_set(value_make_exception("%s: file is closed", fn));
+        return NULL;
+    }
+    if ((f->mode == FILE_READ) != reading) {
+        exc_set(value_make_exception("%s: file is not open for %s", fn,
+                                     reading ? "reading" : "writing"));
+        return NULL;
+    }
+    return f;
 }
 
-Value *core_is_true(const Value *args)
+Value *core_open(const Value *args)
 {
+    /* (open path) or (open path mode), mode is "r", "w" or "a" */
     CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY(args, 1ul, "TRUE? takes exactly one argument");
-    Value *expr = ARG(args, 0);
-    return value_new_bool(is_true(expr));
+    REQUIRE_LIST_CARDINALITY_GE(args, 1ul, "open takes a path and an optional mode");
+    Value *path = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(path, VALUE_STRING, "the first parameter to open must be a string");
+    FileMode mode = FILE_READ;
+    if (NARGS(args) > 1) {
+        Value *m = ARG(args, 1);
+        REQUIRE_VALUE_TYPE(m, VALUE_STRING, "the mode passed to open must be a string");
+        for (mode = FILE_READ; mode <= FILE_APPEND; ++mode) {
+            if (strcmp(STRING(m), file_mode_names[mode]) == 0) {
+                break;
+            }
+        }
+        if (mode > FILE_APPEND) {
+            exc_set(value_make_exception("Invalid file mode %s", STRING(m)));
+            return NULL;
+        }
+    }
+    File *f = file_open(STRING(path), mode);
+    if (!f) {
+        exc_set(value_make_exception("Failed to open file %s: %s", STRING(path), strerror(errno)));
+        return NULL;
+    }
+    return value_new_file(f, file_finalize);
 }
 
-Value *core_is_false(const Value *args)
+Value *core_close(const Value *args)
 {
+    // (close f)
     CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY(args, 1ul, "FALSE? takes exactly one argument");
-    Value *expr = ARG(args, 0);
-    return value_new_bool(is_false(expr));
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "close takes exactly one argument");
+    Value *v = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(v, VALUE_FILE, "close takes a file argument");
+    if (!file_close(FILE_HANDLE(v))) {
+        exc_set(value_make_exception("Failed to close file: %s", strerror(errno)));
+        return NULL;
+    }
+    return VALUE_CONST_NIL;
 }
 
-Value *core_is_symbol(const Value *args)
+Value *core_read_line(const Value *args)
 {
+    // (read-line f), nil at the end of the file
     CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY(args, 1ul, "SYMBOL? takes exactly one argument");
-    Value *expr = ARG(args, 0);
-    return value_new_bool(is_symbol(expr));
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "read-line takes exactly one argument");
+    File *f = file_arg(ARG(args, 0), true, "read-line");
+    Value *line;
+    if (!f) {
+        return NULL;
+    }
+    if (!file_read_line(f, &line)) {
+        exc_set(value_make_exception("Failed to read line: %s", strerror(errno)));
+        return NULL;
+    }
+    return line ? line : VALUE_CONST_NIL;
 }
 
-Value *core_symbol(const Value *args)
+Value *core_read_bytes(const Value *args)
 {
+    // (read-bytes f n), up to n bytes as a string, nil at the end of the file
     CHECK_ARGLIST(args);
-    REQUIRE_LIST_CARDINALITY(args, 1ul, "SYMBOL takes exactly one argument");
-    Value *expr = ARG(args, 0);
-    return value_new_symbol(STRING(expr));
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "read-bytes takes exactly two arguments");
+    File *f = file_arg(ARG(args, 0), true, "read-bytes");
+    if (!f) {
+        return NULL;
+    }
+    Value *n = ARG(args, 1);
+    REQUIRE_VALUE_TYPE(n, VALUE_INT, "the second parameter to read-bytes must be an integer");
+    if (INT(n) < 0) {
+        exc_set(value_make_exception("read-bytes: negative count %d", INT(n)));
+        return NULL;
+    }
+    Value *bytes;
+    if (!file_read_bytes(f, INT(n), &bytes)) {
+        exc_set(value_make_exception("Failed to read bytes: %s", strerror(errno)));
+        return NULL;
+    }
+    return bytes ? bytes : VALUE_CONST_NIL;
 }
 
-Value *core_assert(const Value *args)
+static Value *line_seq_next(void *state, Value **rest)
 {
-    CHECK_ARGLIST(args);
-    size_t nargs = NARGS(args);
-    if (nargs < 1 || nargs > 2) {
-        exc_set(value_make_exception("Invalid argument list in core function: "
-                                     "core_assert takes 1 or 2 arguments."));
+    /* state is the file value, which the sequence keeps alive */
+    (void) rest;
+    File *f = file_arg((Value *) state, true, "line-seq");
+    Value *line;
+    if (!f) {
         return NULL;
     }
-    const Value *arg0 = ARG(args, 0);
-    const Value *arg1 = NULL;
+    if (!file_read_line(f, &line)) {
+        exc_set(value_make_exception("Failed to read line: %s", strerror(errno)));
+        return NULL;
+    }
+    return line;
+}
+
+Value *core_line_seq(const Value *args)
+{
+    // (line-seq f), the remaining lines of f, read as they are needed
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "line-seq takes exactly one argument");
+    Value *v = ARG(args, 0);
+    if (!file_arg(v, true, "line-seq")) {
+        return NULL;
+    }
+    return value_new_lazy_seq(line_seq_next, v);
+}
+
+Value *core_write(const Value *args)
+{
+    // (write f & args), like str but into f
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY_GE(args, 1ul, "write takes a file and the values to write");
+    File *f = file_arg(ARG(args, 0), false, "write");
+    if (!f) {
+        return NULL;
+    }
+    Value *rest = value_new_list(list_tail(LIST(args)));
+    printer_values(file_printer(f), rest, false);
+    return VALUE_CONST_NIL;
+}
+
+Value *core_spit(const Value *args)
+{
+    // (spit path x) writes (str x) to the file at path
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "spit takes exactly two arguments");
+    Value *path = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(path, VALUE_STRING, "the first parameter to spit must be a string");
+    File *f = file_open(STRING(path), FILE_WRITE);
+    if (!f) {
+        exc_set(value_make_exception("Failed to open file %s: %s", STRING(path), strerror(errno)));
+        return NULL;
+    }
+    printer_value(file_printer(f), ARG(args, 1));
+    bool ok = file_close(f);
+    file_delete(f);
+    if (!ok) {
+        exc_set(value_make_exception("Failed to write file %s: %s", STRING(path), strerror(errno)));
+        return NULL;
+    }
+    return VALUE_CONST_NIL;
+}
+
+
+Value *core_read_json(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "read-json takes exactly one argument");
+    Value *v = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(v, VALUE_STRING, "read-json takes a string argument");
+    /* strings in the document become slices of v */
+    return json_read(STRING_PTR(v), STRING_LEN(v), value_string_base(v));
+}
+
+
+Value *core_read_json_file(const Value *args)
+{
+    /* (read-json-file path f) calls f on each document in the file and
+     * returns their number; only one block of the file is held at a time */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "read-json-file takes exactly two arguments");
+    Value *path = ARG(args, 0);
+    Value *fn = ARG(args, 1);
+    REQUIRE_VALUE_TYPE(path, VALUE_STRING, "the first parameter to read-json-file must be a string");
+    FILE *f = NULL;
+    if (!(f = fopen(STRING(path), "r"))) {
+        exc_set(value_make_exception("Failed to open file %s: %s", STRING(path), strerror(errno)));
+        return NULL;
+    }
+    Value *retval = NULL;
+    JsonReader *r = json_reader_new(f);
+    JsonResult res;
+    Value *doc;
+    int n = 0;
+    while ((res = json_reader_next(r, &doc)) == JSON_OK) {
+        Value *tco_expr = NULL;
+        Environment *tco_env;
+        Value *result = apply(fn, value_make_list(doc), &tco_expr, &tco_env);
+        if (tco_expr && !exc_is_pending()) {
+            result = eval(tco_expr, tco_env);
+        }
+        if (!result) {
+            assert(exc_is_pending());
+            goto out;
+        }
+        n++;
+    }
+    if (res == JSON_EOF) {
+        retval = value_new_int(n);
+    }
+out:
+    json_reader_delete(r);
+    fclose(f);
+    return retval;
+}
+
+
+Value *core_write_json(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "write-json takes exactly one argument");
+    Printer p;
+    printer_init_string(&p);
+    if (!json_write(&p, ARG(args, 0))) {
+        string_builder_discard(&p.sb);
+        return NULL;
+    }
+    return printer_finish(&p);
+}
+
+
+Value *core_write_json_file(const Value *args)
+{
+    /* (write-json-file path v) */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "write-json-file takes exactly two arguments");
+    Value *path = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(path, VALUE_STRING, "the first parameter to write-json-file must be a string");
+    FILE *f = NULL;
+    if (!(f = fopen(STRING(path), "w"))) {
+        exc_set(value_make_exception("Failed to open file %s: %s", STRING(path), strerror(errno)));
+        return NULL;
+    }
+    Printer p;
+    printer_init(&p, f, PRINTER_FLUSH_BLOCK);
+    bool ok = json_write(&p, ARG(args, 1));
+    if (ok) {
+        printer_write_char(&p, '\n');
+    }
+    printer_delete(&p);
+    if (fclose(f) != 0 && ok) {
+        exc_set(value_make_exception("Failed to write file %s: %s", STRING(path), strerror(errno)));
+        ok = false;
+    }
+    return ok ? VALUE_CONST_NIL : NULL;
+}
+
+Value *core_cons(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "CONS takes exactly two arguments");
+    Value *first = ARG(args, 0);
+    Value *second = ARG(args, 1);
+    if (second->type == VALUE_LAZY_SEQ) {
+        /* the sequence stays unrealized */
+        return value_new_seq_cell(first, second);
+    }
+    REQUIRE_VALUE_TYPE(second, VALUE_LIST, "the second parameter to CONS must be a list");
+    return value_new_list(list_cons(LIST(second), first));
+}
+
+Value *core_concat(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    ListBuilder concat;
+    list_builder_init(&concat);
+    for (const ListItem *i = LIST(args)->begin; i != NULL; i = i->next) {
+        Value *v = (Value *) i->p;
+        if (!is_seq(v)) {
+            exc_set(value_make_exception("all parameters to CONCAT must be lists"));
+            return NULL;
+        }
+        SeqIter it;
+        value_seq_iter_init(&it, v);
+        for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ) {
+            list_builder_append(&concat, x);
+        }
+        if (exc_is_pending()) {
+            return NULL;
+        }
+    }
+    Value *v = value_new_list(NULL);
+    LIST(v) = list_builder_finish(&concat);
+    return v;
+}
+
+static Value *call_fn(Value *fn, Value *args)
+{
+    Value *tco_expr = NULL;
+    Environment *tco_env;
+    Value *result = apply(fn, args, &tco_expr, &tco_env);
+    /* apply() may defer to eval() because of TCO support, we
+     * need to catch that and eval the expression */
+    if (tco_expr && !exc_is_pending()) {
+        result = eval(tco_expr, tco_env);
+    }
+    return result;
+}
+
+typedef struct RangeState {
+    int next;
+    int end;
+    int step;
+    bool bounded;
+} RangeState;
+
+static Value *range_next(void *state, Value **rest)
+{
+    (void) rest;
+    RangeState *r = state;
+    if (r->bounded && (r->step > 0 ? r->next >= r->end
+                       : r->step < 0 ? r->next <= r->end : r->next == r->end)) {
+        return NULL;
+    }
+    Value *x = value_new_int(r->next);
+    r->next += r->step;
+    return x;
+}
+
+Value *core_range(const Value *args)
+{
+    /* (range), (range end), (range start end) or (range start end step) */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) > 3) {
+        exc_set(value_make_exception("range takes at most three arguments"));
+        return NULL;
+    }
+    int bounds[3] = { 0, 0, 1 };
+    for (size_t i = 0; i < NARGS(args); ++i) {
+        Value *arg = ARG(args, i);
+        REQUIRE_VALUE_TYPE(arg, VALUE_INT, "the arguments to range must be integers");
+        bounds[i] = INT(arg);
+    }
+    RangeState *r = heap_malloc(sizeof(RangeState));
+    *r = (RangeState) { .next = 0, .end = 0, .step = 1, .bounded = NARGS(args) > 0 };
+    if (NARGS(args) == 1) {
+        r->end = bounds[0];
+    } else {
+        r->next = bounds[0];
+        r->end = bounds[1];
+        r->step = bounds[2];
+    }
+    return value_new_lazy_seq(range_next, r);
+}
+
+typedef struct IterateState {
+    Value *fn;
+    Value *x;
+    bool started;
+} IterateState;
+
+static Value *iterate_next(void *state, Value **rest)
+{
+    (void) rest;
+    IterateState *it = state;
+    if (it->started) {
+        it->x = call_fn(it->fn, value_make_list(it->x));
+    }
+    it->started = true;
+    return it->x;
+}
+
+Value *core_iterate(const Value *args)
+{
+    /* (iterate f x) is x, (f x), (f (f x)), ... */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "iterate takes exactly two arguments");
+    IterateState *it = heap_malloc(sizeof(IterateState));
+    *it = (IterateState) { .fn = ARG(args, 0), .x = ARG(args, 1), .started = false };
+    return value_new_lazy_seq(iterate_next, it);
+}
+
+/*
+ * Transducers. (map f), (filter p) and friends without a sequence make a
+ * one-step transducer, comp chains them. With a sequence they make a lazy
+ * sequence that runs the transducer over it. transduce, into and sequence
+ * run all the steps of the transducer they are given in a single loop:
+ * (transduce (comp (filter p) (map f)) + xs) builds no sequence in
+ * between. Lazy sequences are walked through their cache instead, so that
+ * the functions of a sequence run once per element however often it is
+ * traversed.
+ */
+typedef struct XformRun {
+    const Xform *xform;
+    int *counts;        /* elements that reached each take and drop step */
+    bool done;          /* a take or take-while step is finished */
+} XformRun;
+
+static void xform_run_init(XformRun *run, const Xform *xform)
+{
+    run->xform = xform;
+    run->counts = xform->size ? heap_calloc(xform->size, sizeof(int)) : NULL;
+    run->done = false;
+    for (size_t i = 0; i < xform->size; ++i) {
+        if (xform->steps[i].kind == XFORM_TAKE && xform->steps[i].n <= 0) {
+            run->done = true;
+        }
+    }
+}
+
+static Value *xform_run_step(XformRun *run, Value *x)
+{
+    /* x after all steps, NULL if a step leaves it out or fails */
+    for (size_t i = 0; i < run->xform->size && x; ++i) {
+        const XformStep *step = &run->xform->steps[i];
+        Value *keep;
+        switch (step->kind) {
+        case XFORM_MAP:
+            x = call_fn(step->fn, value_make_list(x));
+            break;
+        case XFORM_KEEP:
+            x = call_fn(step->fn, value_make_list(x));
+            if (x && is_nil(x)) {
+                return NULL;
+            }
+            break;
+        case XFORM_FILTER:
+        case XFORM_REMOVE:
+        case XFORM_TAKE_WHILE:
+            keep = call_fn(step->fn, value_make_list(x));
+            if (!keep) {
+                return NULL;
+            }
+            if (is_truthy(keep) == (step->kind == XFORM_REMOVE)) {
+                run->done = run->done || step->kind == XFORM_TAKE_WHILE;
+                return NULL;
+            }
+            break;
+        case XFORM_TAKE:
+            /* stop before anything past the last element is pulled */
+            if (++run->counts[i] >= step->n) {
+                run->done = true;
+            }
+            break;
+        case XFORM_DROP:
+            if (run->counts[i] < step->n) {
+                ++run->counts[i];
+                return NULL;
+            }
+            break;
+        }
+    }
+    return x;
+}
+
+typedef struct XformSource {
+    SeqIter it;
+    /* an unrealized range is counted through privately, so that neither
+     * its elements nor the blocks holding them are kept by the range */
+    RangeState range;
+    bool counting;
+} XformSource;
+
+static void xform_source_init(XformSource *source, const Value *coll)
+{
+    RangeState *r = value_seq_unrealized(coll, range_next);
+    source->counting = r != NULL;
+    if (r) {
+        source->range = *r;
+    } else {
+        value_seq_iter_init(&source->it, coll);
+    }
+}
+
+static Value *xform_run_next(XformRun *run, XformSource *source)
+{
+    /* the next element of the source that makes it through all steps,
+     * NULL at the end or on errors */
+    while (!run->done) {
+        Value *x = source->counting ? range_next(&source->range, NULL)
+                                    : value_seq_iter_next(&source->it);
+        if (!x) {
+            return NULL;
+        }
+        Value *y = xform_run_step(run, x);
+        if (y || exc_is_pending()) {
+            return y;
+        }
+    }
+    return NULL;
+}
+
+typedef struct XformSeq {
+    Value *coll;
+    XformSource source;
+    XformRun run;
+} XformSeq;
+
+static Value *xform_seq_next(void *state, Value **rest)
+{
+    (void) rest;
+    XformSeq *s = state;
+    return xform_run_next(&s->run, &s->source);
+}
+
+/* the transducer of reduce, which passes every element on */
+static const Xform xform_identity = { .size = 0 };
+
+static Value *xform_seq(const Xform *xform, const Value *coll)
+{
+    XformSeq *s = heap_malloc(sizeof(XformSeq));
+    s->coll = (Value *) coll;
+    xform_source_init(&s->source, s->coll);
+    xform_run_init(&s->run, xform);
+    return value_new_lazy_seq(xform_seq_next, s);
+}
+
+static Value *make_args(Value *a, Value *b)
+{
+    ListBuilder args;
+    list_builder_init(&args);
+    list_builder_append(&args, a);
+    list_builder_append(&args, b);
+    Value *v = value_new_list(NULL);
+    LIST(v) = list_builder_finish(&args);
+    return v;
+}
+
+static Value *xform_reduce(Value *f, Value *acc, const Xform *xform, const Value *coll)
+{
+    /* (f (f (f acc x0) x1) ...) for the elements of coll that make it
+     * through xform; without acc the first element starts it off, and
+     * (f) is the result for no elements at all */
+    XformRun run;
+    XformSource source;
+    xform_source_init(&source, coll);
+    xform_run_init(&run, xform ? xform : &xform_identity);
+    if (!acc && !(acc = xform_run_next(&run, &source))) {
+        return exc_is_pending() ? NULL : call_fn(f, value_new_list(NULL));
+    }
+    for (Value *x; (x = xform_run_next(&run, &source)) != NULL; ) {
+        if (!(acc = call_fn(f, make_args(acc, x)))) {
+            return NULL;
+        }
+    }
+    return exc_is_pending() ? NULL : acc;
+}
+
+static Value *xform_builtin(const Value *args, XformKind kind, const char *name)
+{
+    /* (name arg) is a transducer, (name arg coll) the lazy sequence of
+     * running it over coll */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) < 1 || NARGS(args) > 2) {
+        exc_set(value_make_exception("%s takes one or two arguments", name));
+        return NULL;
+    }
+    Value *arg = ARG(args, 0);
+    Value *xform = value_new_transducer(1);
+    XformStep *step = &XFORM(xform)->steps[0];
+    *step = (XformStep) { .kind = kind, .fn = NULL, .n = 0 };
+    if (kind == XFORM_TAKE || kind == XFORM_DROP) {
+        if (arg->type != VALUE_INT) {
+            exc_set(value_make_exception("%s requires an integer count", name));
+            return NULL;
+        }
+        step->n = INT(arg);
+    } else {
+        step->fn = arg;
+    }
+    if (NARGS(args) == 1) {
+        return xform;
+    }
+    Value *coll = ARG(args, 1);
+    if (!value_is_seq(coll)) {
+        exc_set(value_make_exception("%s requires a sequence", name));
+        return NULL;
+    }
+    return xform_seq(XFORM(xform), coll);
+}
+
+Value *core_map(const Value *args)
+{
+    /* (map f coll), lazily */
+    return xform_builtin(args, XFORM_MAP, "map");
+}
+
+Value *core_filter(const Value *args)
+{
+    /* (filter pred coll), the elements pred holds for */
+    return xform_builtin(args, XFORM_FILTER, "filter");
+}
+
+Value *core_remove(const Value *args)
+{
+    /* (remove pred coll), the elements pred doesn't hold for */
+    return xform_builtin(args, XFORM_REMOVE, "remove");
+}
+
+Value *core_keep(const Value *args)
+{
+    /* (keep f coll), the results of f that aren't nil */
+    return xform_builtin(args, XFORM_KEEP, "keep");
+}
+
+Value *core_take(const Value *args)
+{
+    /* (take n coll), the first n elements of coll; nothing past them is
+     * realized */
+    return xform_builtin(args, XFORM_TAKE, "take");
+}
+
+Value *core_drop(const Value *args)
+{
+    /* (drop n coll), all but the first n elements of coll */
+    return xform_builtin(args, XFORM_DROP, "drop");
+}
+
+Value *core_take_while(const Value *args)
+{
+    /* (take-while pred coll), the elements of coll up to the first one
+     * pred doesn't hold for */
+    return xform_builtin(args, XFORM_TAKE_WHILE, "take-while");
+}
+
+Value *core_comp(const Value *args)
+{
+    /* (comp xf ...), the steps of xf and then those of the rest */
+    CHECK_ARGLIST(args);
+    size_t size = 0;
+    for (const ListItem *i = LIST(args)->begin; i != NULL; i = i->next) {
+        Value *xf = i->p;
+        REQUIRE_VALUE_TYPE(xf, VALUE_TRANSDUCER, "comp composes transducers");
+        size += XFORM(xf)->size;
+    }
+    Value *xform = value_new_transducer(size);
+    size = 0;
+    for (const ListItem *i = LIST(args)->begin; i != NULL; i = i->next) {
+        const Xform *xf = XFORM(((Value *) i->p));
+        memcpy(XFORM(xform)->steps + size, xf->steps, xf->size * sizeof(XformStep));
+        size += xf->size;
+    }
+    return xform;
+}
+
+static Value *seq_arg(const Value *args, size_t i, const char *name)
+{
+    Value *coll = ARG(args, i);
+    if (!value_is_seq(coll)) {
+        exc_set(value_make_exception("%s requires a sequence", name));
+        return NULL;
+    }
+    return coll;
+}
+
+Value *core_reduce(const Value *args)
+{
+    /* (reduce f coll) or (reduce f init coll) */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) < 2 || NARGS(args) > 3) {
+        exc_set(value_make_exception("reduce takes two or three arguments"));
+        return NULL;
+    }
+    Value *coll = seq_arg(args, NARGS(args) - 1, "reduce");
+    Value *init = NARGS(args) == 3 ? ARG(args, 1) : NULL;
+    return coll ? xform_reduce(ARG(args, 0), init, NULL, coll) : NULL;
+}
+
+Value *core_transduce(const Value *args)
+{
+    /* (transduce xform f coll) or (transduce xform f init coll) */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) < 3 || NARGS(args) > 4) {
+        exc_set(value_make_exception("transduce takes three or four arguments"));
+        return NULL;
+    }
+    Value *xform = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(xform, VALUE_TRANSDUCER, "the first parameter to transduce must be a transducer");
+    Value *coll = seq_arg(args, NARGS(args) - 1, "transduce");
+    Value *init = NARGS(args) == 4 ? ARG(args, 2) : NULL;
+    return coll ? xform_reduce(ARG(args, 1), init, XFORM(xform), coll) : NULL;
+}
+
+Value *core_into(const Value *args)
+{
+    /* (into to coll) or (into to xform coll), the elements of to followed
+     * by those of coll, passed through xform */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) < 2 || NARGS(args) > 3) {
+        exc_set(value_make_exception("into takes two or three arguments"));
+        return NULL;
+    }
+    Value *to = ARG(args, 0);
+    if (!is_set(to) && to->type != VALUE_SORTED_MAP && !seq_arg(args, 0, "into")) {
+        return NULL;
+    }
+    Value *coll = seq_arg(args, NARGS(args) - 1, "into");
+    if (!coll) {
+        return NULL;
+    }
+    const Xform *xform = &xform_identity;
+    if (NARGS(args) == 3) {
+        Value *xf = ARG(args, 1);
+        REQUIRE_VALUE_TYPE(xf, VALUE_TRANSDUCER, "the second parameter to into must be a transducer");
+        xform = XFORM(xf);
+    }
+    XformRun run;
+    XformSource source;
+    if (is_set(to) || to->type == VALUE_SORTED_MAP) {
+        /* (into set coll), each element added in turn */
+        xform_source_init(&source, coll);
+        xform_run_init(&run, xform);
+        for (Value *x; to && (x = xform_run_next(&run, &source)) != NULL; ) {
+            to = coll_conj(to, x, "into");
+        }
+        return exc_is_pending() ? NULL : to;
+    }
+    ListBuilder into;
+    list_builder_init(&into);
+    SeqIter it;
+    value_seq_iter_init(&it, to);
+    for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ) {
+        list_builder_append(&into, x);
+    }
+    xform_source_init(&source, coll);
+    xform_run_init(&run, xform);
+    for (Value *x; (x = xform_run_next(&run, &source)) != NULL; ) {
+        list_builder_append(&into, x);
+    }
+    if (exc_is_pending()) {
+        return NULL;
+    }
+    Value *v = value_new_list(NULL);
+    LIST(v) = list_builder_finish(&into);
+    return v;
+}
+
+Value *core_sequence(const Value *args)
+{
+    /* (sequence xform coll), the lazy sequence of running xform over coll */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "sequence takes exactly two arguments");
+    Value *xform = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(xform, VALUE_TRANSDUCER, "the first parameter to sequence must be a transducer");
+    Value *coll = seq_arg(args, 1, "sequence");
+    return coll ? xform_seq(XFORM(xform), coll) : NULL;
+}
+
+/*
+ * Typed numeric vectors, see numvec.h for the kernels. Operations take a
+ * vector and either another vector of the same type and size or a
+ * number, which is applied to every element.
+ */
+static bool is_number(const Value *v)
+{
+    return v->type == VALUE_INT || v->type == VALUE_FLOAT;
+}
+
+static bool vector_set(Value *vec, size_t i, const Value *x)
+{
+    if (vec->type == VALUE_F64_VECTOR && is_number(x)) {
+        NUMVEC(vec)->data.f64[i] = x->type == VALUE_INT ? INT(x) : FLOAT(x);
+        return true;
+    }
+    if (vec->type == VALUE_I64_VECTOR && x->type == VALUE_INT) {
+        NUMVEC(vec)->data.i64[i] = INT(x);
+        return true;
+    }
+    exc_set(value_make_exception("%s elements must be %s", vec->type == VALUE_F64_VECTOR ? "f64-vector" : "i64-vector",
+                                 vec->type == VALUE_F64_VECTOR ? "numbers" : "integers"));
+    return false;
+}
+
+static Value *vector_alloc(ValueType type, size_t n)
+{
+    /* n uninitialized elements, or an error if they don't fit in the heap */
+    Value *vec = type == VALUE_F64_VECTOR ? value_new_f64_vector(n) : value_new_i64_vector(n);
+    if (!vec) {
+        exc_set(value_make_exception("Out of memory: no room for a vector of %lu elements", n));
+    }
+    return vec;
+}
+
+static Value *vector_of_range(ValueType type, const RangeState *r)
+{
+    /* fills the vector without realizing the range */
+    int64_t n = 0;
+    if (!r->bounded || r->step == 0) {
+        if (r->bounded && r->next == r->end) {
+            n = 0;
+        } else {
+            exc_set(value_make_exception("Cannot make a vector of an infinite range"));
+            return NULL;
+        }
+    } else if (r->step > 0 && r->end > r->next) {
+        n = ((int64_t) r->end - r->next + r->step - 1) / r->step;
+    } else if (r->step < 0 && r->end < r->next) {
+        n = ((int64_t) r->next - r->end - r->step - 1) / -r->step;
+    }
+    Value *vec = vector_alloc(type, n);
+    if (!vec) {
+        return NULL;
+    }
+    for (int64_t i = 0; i < n; ++i) {
+        int64_t x = r->next + i * r->step;
+        if (type == VALUE_F64_VECTOR) {
+            NUMVEC(vec)->data.f64[i] = (double) x;
+        } else {
+            NUMVEC(vec)->data.i64[i] = x;
+        }
+    }
+    return vec;
+}
+
+static Value *vector_new(ValueType type, const Value *args)
+{
+    /* (f64-vector coll) or (f64-vector x ...) */
+    CHECK_ARGLIST(args);
+    const Value *coll = args;
+    if (NARGS(args) == 1 && value_is_seq(ARG(args, 0))) {
+        coll = ARG(args, 0);
+    }
+    RangeState *r = value_seq_unrealized(coll, range_next);
+    if (r) {
+        return vector_of_range(type, r);
+    }
+    size_t n = 0;
+    if (value_is_vector(coll)) {
+        n = NUMVEC(coll)->size;
+    } else if (coll->type == VALUE_LIST) {
+        n = NARGS(coll);
+    } else {
+        /* realizes the sequence once, and then walks the cached elements */
+        SeqIter it;
+        for (value_seq_iter_init(&it, coll); value_seq_iter_next(&it); ) {
+            n++;
+        }
+        if (exc_is_pending()) {
+            return NULL;
+        }
+    }
+    Value *vec = vector_alloc(type, n);
+    if (!vec) {
+        return NULL;
+    }
+    if (coll->type == type) {
+        memcpy(NUMVEC(vec)->data.f64, NUMVEC(coll)->data.f64, n * sizeof(double));
+        return vec;
+    }
+    if (coll->type == VALUE_F64_VECTOR) {
+        exc_set(value_make_exception("i64-vector elements must be integers"));
+        return NULL;
+    }
+    SeqIter it;
+    value_seq_iter_init(&it, coll);
+    for (size_t i = 0; i < n; ++i) {
+        if (!vector_set(vec, i, value_seq_iter_next(&it))) {
+            return NULL;
+        }
+    }
+    return vec;
+}
+
+Value *core_f64_vector(const Value *args)
+{
+    return vector_new(VALUE_F64_VECTOR, args);
+}
+
+Value *core_i64_vector(const Value *args)
+{
+    return vector_new(VALUE_I64_VECTOR, args);
+}
+
+static Value *vector_operand(const Value *a, const Value *b, const char *name,
+                             double *f64, int64_t *i64, size_t *bstep)
+{
+    /* checks the operands of a binary operation, for a number b it is
+     * converted into *f64 or *i64 and broadcast */
+    if (!value_is_vector(a)) {
+        exc_set(value_make_exception("%s requires a vector", name));
+        return NULL;
+    }
+    if (a->type == VALUE_F64_VECTOR && is_number(b)) {
+        *f64 = b->type == VALUE_INT ? INT(b) : FLOAT(b);
+        *bstep = 0;
+        return (Value *) a;
+    }
+    if (a->type == VALUE_I64_VECTOR && b->type == VALUE_INT) {
+        *i64 = INT(b);
+        *bstep = 0;
+        return (Value *) a;
+    }
+    if (b->type != a->type || NUMVEC(b)->size != NUMVEC(a)->size) {
+        exc_set(value_make_exception("%s requires vectors of the same type and size, or a %s",
+                                     name, a->type == VALUE_F64_VECTOR ? "number" : "integer"));
+        return NULL;
+    }
+    *f64 = 0;
+    *i64 = 0;
+    *bstep = 1;
+    return (Value *) a;
+}
+
+static Value *vector_arith(const Value *args, NumvecOp op, const char *name)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "Vector arithmetic takes exactly two arguments");
+    Value *a = ARG(args, 0);
+    Value *b = ARG(args, 1);
+    double f64;
+    int64_t i64;
+    size_t bstep;
+    if (!vector_operand(a, b, name, &f64, &i64, &bstep)) {
+        return NULL;
+    }
+    size_t n = NUMVEC(a)->size;
+    if (a->type == VALUE_F64_VECTOR) {
+        Value *out = vector_alloc(VALUE_F64_VECTOR, n);
+        if (!out) {
+            return NULL;
+        }
+        numvec_f64_arith(op, NUMVEC(out)->data.f64, NUMVEC(a)->data.f64,
+                         bstep ? NUMVEC(b)->data.f64 : &f64, bstep, n);
+        return out;
+    }
+    Value *out = vector_alloc(VALUE_I64_VECTOR, n);
+    if (!out) {
+        return NULL;
+    }
+    if (!numvec_i64_arith(op, NUMVEC(out)->data.i64, NUMVEC(a)->data.i64,
+                          bstep ? NUMVEC(b)->data.i64 : &i64, bstep, n)) {
+        exc_set(value_make_exception("Division by zero"));
+        return NULL;
+    }
+    return out;
+}
+
+Value *core_vec_add(const Value *args)
+{
+    return vector_arith(args, NUMVEC_ADD, "vec-add");
+}
+
+Value *core_vec_sub(const Value *args)
+{
+    return vector_arith(args, NUMVEC_SUB, "vec-sub");
+}
+
+Value *core_vec_mul(const Value *args)
+{
+    return vector_arith(args, NUMVEC_MUL, "vec-mul");
+}
+
+Value *core_vec_div(const Value *args)
+{
+    return vector_arith(args, NUMVEC_DIV, "vec-div");
+}
+
+Value *core_vec_scale(const Value *args)
+{
+    /* (vec-scale v k), every element times the number k */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "vec-scale takes exactly two arguments");
+    if (!is_number(ARG(args, 1))) {
+        exc_set(value_make_exception("vec-scale requires a number to scale by"));
+        return NULL;
+    }
+    return vector_arith(args, NUMVEC_MUL, "vec-scale");
+}
+
+static Value *vector_cmp(const Value *args, NumvecCmp cmp, const char *name)
+{
+    /* an i64-vector mask, 1 where the comparison holds and 0 elsewhere */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "Vector comparisons take exactly two arguments");
+    Value *a = ARG(args, 0);
+    Value *b = ARG(args, 1);
+    double f64;
+    int64_t i64;
+    size_t bstep;
+    if (!vector_operand(a, b, name, &f64, &i64, &bstep)) {
+        return NULL;
+    }
+    Value *mask = vector_alloc(VALUE_I64_VECTOR, NUMVEC(a)->size);
+    if (!mask) {
+        return NULL;
+    }
+    if (a->type == VALUE_F64_VECTOR) {
+        numvec_f64_cmp(cmp, NUMVEC(mask)->data.i64, NUMVEC(a)->data.f64,
+                       bstep ? NUMVEC(b)->data.f64 : &f64, bstep, NUMVEC(a)->size);
+    } else {
+        numvec_i64_cmp(cmp, NUMVEC(mask)->data.i64, NUMVEC(a)->data.i64,
+                       bstep ? NUMVEC(b)->data.i64 : &i64, bstep, NUMVEC(a)->size);
+    }
+    return mask;
+}
+
+Value *core_vec_lt(const Value *args)
+{
+    return vector_cmp(args, NUMVEC_LT, "vec<");
+}
+
+Value *core_vec_leq(const Value *args)
+{
+    return vector_cmp(args, NUMVEC_LE, "vec<=");
+}
+
+Value *core_vec_gt(const Value *args)
+{
+    return vector_cmp(args, NUMVEC_GT, "vec>");
+}
+
+Value *core_vec_geq(const Value *args)
+{
+    return vector_cmp(args, NUMVEC_GE, "vec>=");
+}
+
+Value *core_vec_eq(const Value *args)
+{
+    return vector_cmp(args, NUMVEC_EQ, "vec=");
+}
+
+Value *core_sum(const Value *args)
+{
+    /* (sum coll), of a vector without boxing its elements */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "sum takes exactly one argument");
+    Value *coll = ARG(args, 0);
+    if (coll->type == VALUE_F64_VECTOR) {
+        return value_new_float(numvec_f64_sum(NUMVEC(coll)->data.f64, NUMVEC(coll)->size));
+    }
+    if (coll->type == VALUE_I64_VECTOR) {
+        return value_from_i64(numvec_i64_sum(NUMVEC(coll)->data.i64, NUMVEC(coll)->size));
+    }
+    if (!value_is_seq(coll)) {
+        exc_set(value_make_exception("sum requires a sequence"));
+        return NULL;
+    }
+    double sum = 0;
+    bool all_int = true;
+    SeqIter it;
+    value_seq_iter_init(&it, coll);
+    for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ) {
+        if (!is_number(x)) {
+            exc_set(value_make_exception("Non-numeric argument in accumulation"));
+            return NULL;
+        }
+        all_int = all_int && x->type == VALUE_INT;
+        sum += x->type == VALUE_INT ? INT(x) : FLOAT(x);
+    }
+    if (exc_is_pending()) {
+        return NULL;
+    }
+    return all_int ? value_from_i64((int64_t) sum) : value_new_float(sum);
+}
+
+Value *core_dot(const Value *args)
+{
+    /* (dot a b), the sum of the products of the elements of two vectors */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "dot takes exactly two arguments");
+    Value *a = ARG(args, 0);
+    Value *b = ARG(args, 1);
+    if (!value_is_vector(a) || b->type != a->type || NUMVEC(a)->size != NUMVEC(b)->size) {
+        exc_set(value_make_exception("dot requires two vectors of the same type and size"));
+        return NULL;
+    }
+    if (a->type == VALUE_F64_VECTOR) {
+        return value_new_float(numvec_f64_dot(NUMVEC(a)->data.f64, NUMVEC(b)->data.f64, NUMVEC(a)->size));
+    }
+    return value_from_i64(numvec_i64_dot(NUMVEC(a)->data.i64, NUMVEC(b)->data.i64, NUMVEC(a)->size));
+}
+
+static Value *min_max(const Value *args, bool max, const char *name)
+{
+    /* (min x ...) of numbers, or (min coll) of the elements of coll */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY_GE(args, 1ul, "min and max require at least one argument");
+    const Value *coll = args;
+    if (NARGS(args) == 1 && value_is_seq(ARG(args, 0))) {
+        coll = ARG(args, 0);
+    }
+    if (value_is_vector(coll) && NUMVEC(coll)->size) {
+        const NumVec *v = NUMVEC(coll);
+        if (coll->type == VALUE_F64_VECTOR) {
+            double lo, hi;
+            numvec_f64_min_max(v->data.f64, v->size, &lo, &hi);
+            return value_new_float(max ? hi : lo);
+        }
+        int64_t lo, hi;
+        numvec_i64_min_max(v->data.i64, v->size, &lo, &hi);
+        return value_from_i64(max ? hi : lo);
+    }
+    Value *best = NULL;
+    SeqIter it;
+    value_seq_iter_init(&it, coll);
+    for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ) {
+        if (!is_number(x)) {
+            exc_set(value_make_exception("%s requires numbers", name));
+            return NULL;
+        }
+        Value *better = best ? (max ? cmp_lt(best, x) : cmp_lt(x, best)) : VALUE_CONST_TRUE;
+        if (better == VALUE_CONST_TRUE) {
+            best = x;
+        }
+    }
+    if (!best && !exc_is_pending()) {
+        exc_set(value_make_exception("%s of an empty sequence", name));
+    }
+    return best;
+}
+
+Value *core_min(const Value *args)
+{
+    return min_max(args, false, "min");
+}
+
+Value *core_max(const Value *args)
+{
+    return min_max(args, true, "max");
+}
+
+/*
+ * Dense matrices of doubles, see matrix.h for the kernels. Rows are
+ * contiguous, so a row or a range of rows is a view of the matrix while
+ * columns are copied.
+ */
+static Value *require_matrix(const Value *m, const char *name)
+{
+    if (m->type != VALUE_MATRIX) {
+        exc_set(value_make_exception("%s requires a matrix", name));
+        return NULL;
+    }
+    return (Value *) m;
+}
+
+static bool require_index(const Value *i, size_t end, const char *name)
+{
+    /* an int in [0, end) */
+    if (i->type != VALUE_INT) {
+        exc_set(value_make_exception("%s requires integer indices", name));
+        return false;
+    }
+    if (INT(i) < 0 || (size_t) INT(i) >= end) {
+        exc_set(value_make_exception("Index error"));
+        return false;
+    }
+    return true;
+}
+
+static bool require_range(const Value *start, const Value *end, size_t size, const char *name)
+{
+    /* [start, end) within [0, size] */
+    if (start->type != VALUE_INT || end->type != VALUE_INT) {
+        exc_set(value_make_exception("%s requires integer indices", name));
+        return false;
+    }
+    if (INT(start) < 0 || INT(start) > INT(end) || (size_t) INT(end) > size) {
+        exc_set(value_make_exception("Index error"));
+        return false;
+    }
+    return true;
+}
+
+static bool matrix_fill(double *data, size_t n, const Value *coll)
+{
+    /* the first n elements of coll, which must have exactly n */
+    if (coll->type == VALUE_F64_VECTOR && NUMVEC(coll)->size == n) {
+        memcpy(data, NUMVEC(coll)->data.f64, n * sizeof(double));
+        return true;
+    }
+    SeqIter it;
+    value_seq_iter_init(&it, coll);
+    size_t i = 0;
+    for (Value *x; i < n && (x = value_seq_iter_next(&it)) != NULL; ++i) {
+        if (!is_number(x)) {
+            exc_set(value_make_exception("matrix elements must be numbers"));
+            return false;
+        }
+        data[i] = x->type == VALUE_INT ? INT(x) : FLOAT(x);
+    }
+    /* one element past n is enough to tell that coll is too long */
+    bool more = i == n && value_seq_iter_next(&it) != NULL;
+    if (exc_is_pending()) {
+        return false;
+    }
+    if (i != n || more) {
+        exc_set(value_make_exception("matrix expected %lu elements", n));
+        return false;
+    }
+    return true;
+}
+
+static size_t seq_count(const Value *coll)
+{
+    if (value_is_vector(coll)) {
+        return NUMVEC(coll)->size;
+    }
+    if (coll->type == VALUE_LIST) {
+        return list_size(LIST(coll));
+    }
+    size_t n = 0;
+    SeqIter it;
+    for (value_seq_iter_init(&it, coll); value_seq_iter_next(&it); ) {
+        n++;
+    }
+    return n;
+}
+
+static Value *matrix_alloc(size_t rows, size_t cols)
+{
+    /* a rows x cols matrix of uninitialized elements, or an error if it
+     * doesn't fit in the heap */
+    if (cols && rows > VALUE_NUMBERS_MAX / cols) {
+        exc_set(value_make_exception("a %lu x %lu matrix is too large", rows, cols));
+        return NULL;
+    }
+    Value *m = value_new_matrix(rows, cols);
+    if (!m) {
+        exc_set(value_make_exception("Out of memory: no room for a %lu x %lu matrix", rows, cols));
+    }
+    return m;
+}
+
+Value *core_matrix(const Value *args)
+{
+    /* (matrix rows), (matrix r c) of zeros or (matrix r c coll) filled
+     * row by row from coll */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY_GE(args, 1ul, "matrix requires at least one argument");
+    Value *arg0 = ARG(args, 0);
+    if (NARGS(args) == 1) {
+        if (!value_is_seq(arg0)) {
+            exc_set(value_make_exception("matrix requires a sequence of rows"));
+            return NULL;
+        }
+        size_t rows = seq_count(arg0);
+        Value *first = value_seq_first(arg0);
+        if (exc_is_pending()) {
+            return NULL;
+        }
+        if (first && !value_is_seq(first)) {
+            exc_set(value_make_exception("matrix rows must be sequences"));
+            return NULL;
+        }
+        size_t cols = first ? seq_count(first) : 0;
+        Value *m = matrix_alloc(rows, cols);
+        if (!m) {
+            return NULL;
+        }
+        SeqIter it;
+        value_seq_iter_init(&it, arg0);
+        for (size_t i = 0; i < rows; ++i) {
+            Value *row = value_seq_iter_next(&it);
+            if (!value_is_seq(row)) {
+                exc_set(value_make_exception("matrix rows must be sequences"));
+                return NULL;
+            }
+            if (!matrix_fill(MATRIX(m)->data + i * cols, cols, row)) {
+                return NULL;
+            }
+        }
+        return m;
+    }
+    Value *rows = arg0;
+    Value *cols = ARG(args, 1);
+    if (rows->type != VALUE_INT || cols->type != VALUE_INT || INT(rows) < 0 || INT(cols) < 0) {
+        exc_set(value_make_exception("matrix requires a non-negative number of rows and columns"));
+        return NULL;
+    }
+    Value *m = matrix_alloc(INT(rows), INT(cols));
+    if (!m) {
+        return NULL;
+    }
+    size_t n = (size_t) INT(rows) * INT(cols);
+    if (NARGS(args) == 2) {
+        memset(MATRIX(m)->data, 0, n * sizeof(double));
+        return m;
+    }
+    Value *coll = ARG(args, 2);
+    if (!value_is_seq(coll)) {
+        exc_set(value_make_exception("matrix requires a sequence of elements"));
+        return NULL;
+    }
+    return matrix_fill(MATRIX(m)->data, n, coll) ? m : NULL;
+}
+
+Value *core_mat_shape(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "mat-shape takes exactly one argument");
+    Value *m = require_matrix(ARG(args, 0), "mat-shape");
+    if (!m) {
+        return NULL;
+    }
+    Value *shape = value_make_list(value_new_int(MATRIX(m)->rows));
+    LIST(shape) = list_conj(LIST(shape), value_new_int(MATRIX(m)->cols));
+    return shape;
+}
+
+Value *core_mat_ref(const Value *args)
+{
+    /* (mat-ref m i j) */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 3ul, "mat-ref takes exactly three arguments");
+    Value *m = require_matrix(ARG(args, 0), "mat-ref");
+    Value *i = ARG(args, 1);
+    Value *j = ARG(args, 2);
+    if (!m || !require_index(i, MATRIX(m)->rows, "mat-ref") || !require_index(j, MATRIX(m)->cols, "mat-ref")) {
+        return NULL;
+    }
+    return value_new_float(MATRIX(m)->data[INT(i) * MATRIX(m)->cols + INT(j)]);
+}
+
+Value *core_mat_row(const Value *args)
+{
+    /* (mat-row m i), an f64-vector view of row i */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "mat-row takes exactly two arguments");
+    Value *m = require_matrix(ARG(args, 0), "mat-row");
+    Value *i = ARG(args, 1);
+    if (!m || !require_index(i, MATRIX(m)->rows, "mat-row")) {
+        return NULL;
+    }
+    return value_matrix_row(m, INT(i));
+}
+
+Value *core_mat_col(const Value *args)
+{
+    /* (mat-col m j), a copy of column j as an f64-vector */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "mat-col takes exactly two arguments");
+    Value *m = require_matrix(ARG(args, 0), "mat-col");
+    Value *j = ARG(args, 1);
+    if (!m || !require_index(j, MATRIX(m)->cols, "mat-col")) {
+        return NULL;
+    }
+    const Matrix *x = MATRIX(m);
+    Value *col = vector_alloc(VALUE_F64_VECTOR, x->rows);
+    if (!col) {
+        return NULL;
+    }
+    for (size_t i = 0; i < x->rows; ++i) {
+        NUMVEC(col)->data.f64[i] = x->data[i * x->cols + INT(j)];
+    }
+    return col;
+}
+
+Value *core_mat_rows(const Value *args)
+{
+    /* (mat-rows m start end), a view of rows [start, end) */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 3ul, "mat-rows takes exactly three arguments");
+    Value *m = require_matrix(ARG(args, 0), "mat-rows");
+    Value *start = ARG(args, 1);
+    Value *end = ARG(args, 2);
+    if (!m || !require_range(start, end, MATRIX(m)->rows, "mat-rows")) {
+        return NULL;
+    }
+    return value_new_matrix_view(m, INT(start), INT(end));
+}
+
+Value *core_mat_cols(const Value *args)
+{
+    /* (mat-cols m start end), a copy of columns [start, end) */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 3ul, "mat-cols takes exactly three arguments");
+    Value *m = require_matrix(ARG(args, 0), "mat-cols");
+    Value *from = ARG(args, 1);
+    Value *to = ARG(args, 2);
+    if (!m || !require_range(from, to, MATRIX(m)->cols, "mat-cols")) {
+        return NULL;
+    }
+    const Matrix *x = MATRIX(m);
+    size_t start = INT(from), cols = INT(to) - start;
+    Value *out = matrix_alloc(x->rows, cols);
+    if (!out) {
+        return NULL;
+    }
+    for (size_t i = 0; i < x->rows; ++i) {
+        memcpy(MATRIX(out)->data + i * cols, x->data + i * x->cols + start, cols * sizeof(double));
+    }
+    return out;
+}
+
+Value *core_transpose(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "transpose takes exactly one argument");
+    Value *m = require_matrix(ARG(args, 0), "transpose");
+    if (!m) {
+        return NULL;
+    }
+    Value *out = matrix_alloc(MATRIX(m)->cols, MATRIX(m)->rows);
+    if (!out) {
+        return NULL;
+    }
+    matrix_transpose(MATRIX(out)->data, MATRIX(m)->data, MATRIX(m)->rows, MATRIX(m)->cols);
+    return out;
+}
+
+Value *core_mat_mul(const Value *args)
+{
+    /* (mat* a b), the product of two matrices, of a matrix and an
+     * f64-vector or of a matrix and a number */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "mat* takes exactly two arguments");
+    Value *a = require_matrix(ARG(args, 0), "mat*");
+    if (!a) {
+        return NULL;
+    }
+    const Matrix *x = MATRIX(a);
+    Value *b = ARG(args, 1);
+    if (is_number(b)) {
+        double k = b->type == VALUE_INT ? INT(b) : FLOAT(b);
+        Value *out = matrix_alloc(x->rows, x->cols);
+        if (!out) {
+            return NULL;
+        }
+        numvec_f64_arith(NUMVEC_MUL, MATRIX(out)->data, x->data, &k, 0, x->rows * x->cols);
+        return out;
+    }
+    if (b->type == VALUE_F64_VECTOR && NUMVEC(b)->size == x->cols) {
+        Value *out = vector_alloc(VALUE_F64_VECTOR, x->rows);
+        if (!out) {
+            return NULL;
+        }
+        for (size_t i = 0; i < x->rows; ++i) {
+            NUMVEC(out)->data.f64[i] = numvec_f64_dot(x->data + i * x->cols, NUMVEC(b)->data.f64, x->cols);
+        }
+        return out;
+    }
+    if (b->type != VALUE_MATRIX || MATRIX(b)->rows != x->cols) {
+        exc_set(value_make_exception("mat* requires a matrix with %lu rows, an f64-vector of %lu elements or a number",
+                                     x->cols, x->cols));
+        return NULL;
+    }
+    Value *out = matrix_alloc(x->rows, MATRIX(b)->cols);
+    if (!out) {
+        return NULL;
+    }
+    matrix_mul(MATRIX(out)->data, x->data, MATRIX(b)->data, x->rows, x->cols, MATRIX(b)->cols);
+    return out;
+}
+
+static Value *matrix_arith(const Value *args, NumvecOp op, const char *name)
+{
+    /* element-wise with a matrix of the same shape or a number */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "Matrix arithmetic takes exactly two arguments");
+    Value *a = require_matrix(ARG(args, 0), name);
+    if (!a) {
+        return NULL;
+    }
+    const Matrix *x = MATRIX(a);
+    Value *b = ARG(args, 1);
+    double k = 0;
+    const double *y = &k;
+    size_t bstep = 0;
+    if (is_number(b)) {
+        k = b->type == VALUE_INT ? INT(b) : FLOAT(b);
+    } else if (b->type == VALUE_MATRIX && MATRIX(b)->rows == x->rows && MATRIX(b)->cols == x->cols) {
+        y = MATRIX(b)->data;
+        bstep = 1;
+    } else {
+        exc_set(value_make_exception("%s requires matrices of the same shape, or a number", name));
+        return NULL;
+    }
+    Value *out = matrix_alloc(x->rows, x->cols);
+    if (!out) {
+        return NULL;
+    }
+    numvec_f64_arith(op, MATRIX(out)->data, x->data, y, bstep, x->rows * x->cols);
+    return out;
+}
+
+Value *core_mat_add(const Value *args)
+{
+    return matrix_arith(args, NUMVEC_ADD, "mat+");
+}
+
+Value *core_mat_sub(const Value *args)
+{
+    return matrix_arith(args, NUMVEC_SUB, "mat-");
+}
+
+Value *core_mat_emul(const Value *args)
+{
+    return matrix_arith(args, NUMVEC_MUL, "mat-emul");
+}
+
+Value *core_mat_ediv(const Value *args)
+{
+    return matrix_arith(args, NUMVEC_DIV, "mat-ediv");
+}
+
+/*
+ * Sorting, see sort.h. The elements (and, for sort-by, their keys) are
+ * collected in arrays first; numeric keys are sorted as integers without
+ * calling back into the interpreter, everything else is compared with <
+ * or the comparator.
+ */
+typedef struct SortContext {
+    Array *keys;
+    Value *cmp;
+} SortContext;
+
+static int sort_less(size_t a, size_t b, void *ctx)
+{
+    /* a comparator may return a boolean, or a number like compareTo */
+    SortContext *s = ctx;
+    Value *x = *array_typed_at(s->keys, a, Value *);
+    Value *y = *array_typed_at(s->keys, b, Value *);
+    Value *result = s->cmp ? call_fn(s->cmp, make_args(x, y)) : cmp_lt(x, y);
+    if (!result) {
+        return -1;
+    }
+    if (result->type == VALUE_INT) {
+        return INT(result) < 0;
+    }
+    if (result->type == VALUE_FLOAT) {
+        return FLOAT(result) < 0;
+    }
+    return is_truthy(result);
+}
+
+static Value *sort_seq(const Value *coll, Value *keyfn, Value *cmp, const char *name)
+{
+    if (!value_is_seq(coll)) {
+        exc_set(value_make_exception("%s requires a sequence", name));
+        return NULL;
+    }
+    Array *items = array_new(sizeof(Value *));
+    SeqIter it;
+    value_seq_iter_init(&it, coll);
+    for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ) {
+        array_push_back(items, &x, 1);
+    }
+    if (exc_is_pending()) {
+        return NULL;
+    }
+    size_t n = array_size(items);
+    Array *keys = items;
+    if (keyfn) {
+        keys = array_new_with_capacity(sizeof(Value *), n);
+        for (size_t i = 0; i < n; ++i) {
+            Value *key = call_fn(keyfn, value_make_list(*array_typed_at(items, i, Value *)));
+            if (!key) {
+                return NULL;
+            }
+            array_push_back(keys, &key, 1);
+        }
+    }
+    size_t *order = malloc(n * sizeof(size_t));
+    bool all_int = !cmp, all_numbers = !cmp;
+    for (size_t i = 0; i < n && all_numbers; ++i) {
+        Value *key = *array_typed_at(keys, i, Value *);
+        all_int = all_int && key->type == VALUE_INT;
+        all_numbers = is_number(key);
+    }
+    if (all_numbers) {
+        SortKey *sorted = malloc(n * sizeof(SortKey));
+        for (size_t i = 0; i < n; ++i) {
+            Value *key = *array_typed_at(keys, i, Value *);
+            sorted[i].key = all_int ? INT(key) : sort_f64_key(key->type == VALUE_INT ? INT(key) : FLOAT(key));
+            sorted[i].index = i;
+        }
+        sort_keys(sorted, n);
+        for (size_t i = 0; i < n; ++i) {
+            order[i] = sorted[i].index;
+        }
+        free(sorted);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            order[i] = i;
+        }
+        SortContext ctx = { .keys = keys, .cmp = cmp };
+        if (!sort_indices(order, n, sort_less, &ctx)) {
+            free(order);
+            return NULL;
+        }
+    }
+    ListBuilder sorted;
+    list_builder_init(&sorted);
+    for (size_t i = 0; i < n; ++i) {
+        list_builder_append(&sorted, *array_typed_at(items, order[i], Value *));
+    }
+    free(order);
+    Value *v = value_new_list(NULL);
+    LIST(v) = list_builder_finish(&sorted);
+    return v;
+}
+
+Value *core_sort(const Value *args)
+{
+    /* (sort coll) or (sort cmp coll), stable */
+    CHECK_ARGLIST(args);
+    size_t n = NARGS(args);
+    if (n < 1 || n > 2) {
+        exc_set(value_make_exception("sort takes a sequence and an optional comparator"));
+        return NULL;
+    }
+    return sort_seq(ARG(args, n - 1), NULL, n == 2 ? ARG(args, 0) : NULL, "sort");
+}
+
+Value *core_sort_by(const Value *args)
+{
+    /* (sort-by keyfn coll) or (sort-by keyfn cmp coll), stable and
+     * calling keyfn once per element */
+    CHECK_ARGLIST(args);
+    size_t n = NARGS(args);
+    if (n < 2 || n > 3) {
+        exc_set(value_make_exception("sort-by takes a key function, an optional comparator and a sequence"));
+        return NULL;
+    }
+    return sort_seq(ARG(args, n - 1), ARG(args, 0), n == 3 ? ARG(args, 1) : NULL, "sort-by");
+}
+
+Value *core_hash(const Value *args)
+{
+    /* (hash x), equal for values that are =, folded into an int */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "hash requires exactly one parameter");
+    unsigned long h = value_hash(ARG(args, 0));
+    if (exc_is_pending()) {
+        return NULL;
+    }
+    return value_new_int((int) (h ^ (h >> 32)));
+}
+
+Value *core_apply(const Value *args)
+{
+    /* (apply f a b c d ...) == (f a b c d ...) */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY_GE(args, 2ul, "APPLY requires at least two arguments");
+    Value *fn = ARG(args, 0);
+    Value *fn_args = value_new_list(list_tail(LIST(args)));
+    size_t n_args = NARGS(fn_args);
+
+    /* Merge the arguments w/ a potential list of arguments at the end of
+     * the argument list */
+    if (is_seq(ARG(fn_args, n_args - 1))) {
+        ListBuilder concat;
+        list_builder_init(&concat);
+        for (const ListItem *j = LIST(fn_args)->begin; j != LIST(fn_args)->end; j = j->next) {
+            list_builder_append(&concat, j->p);
+        }
+        SeqIter it;
+        value_seq_iter_init(&it, LIST(fn_args)->end->p);
+        for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ) {
+            list_builder_append(&concat, x);
+        }
+        if (exc_is_pending()) {
+            return NULL;
+        }
+        fn_args = value_new_list(NULL);
+        LIST(fn_args) = list_builder_finish(&concat);
+    }
+    Value *tco_expr;
+    Environment *tco_env;
+    Value *result = apply(fn, fn_args, &tco_expr, &tco_env);
+    /* need to call eval since apply defers to eval for TCO support */
+    if (tco_expr && !exc_is_pending()) {
+        result = eval(tco_expr, tco_env);
+    }
+    if (!result) {
+        assert(exc_is_pending());
+        return NULL;
+    }
+    return result;
+}
+
+Value *core_is_nil(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "NIL? takes exactly one argument");
+    Value *expr = ARG(args, 0);
+    return value_new_bool(is_nil(expr));
+}
+
+Value *core_is_true(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "TRUE? takes exactly one argument");
+    Value *expr = ARG(args, 0);
+    return value_new_bool(is_true(expr));
+}
+
+Value *core_is_false(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "FALSE? takes exactly one argument");
+    Value *expr = ARG(args, 0);
+    return value_new_bool(is_false(expr));
+}
+
+Value *core_is_symbol(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "SYMBOL? takes exactly one argument");
+    Value *expr = ARG(args, 0);
+    return value_new_bool(is_symbol(expr));
+}
+
+Value *core_symbol(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "SYMBOL takes exactly one argument");
+    Value *expr = ARG(args, 0);
+    return value_new_symbol(STRING(expr));
+}
+
+Value *core_assert(const Value *args)
+{
+    CHECK_ARGLIST(args);
+    size_t nargs = NARGS(args);
+    if (nargs < 1 || nargs > 2) {
+        exc_set(value_make_exception("Invalid argument list in core function: "
+                                     "core_assert takes 1 or 2 arguments."));
+        return NULL;
+    }
+    const Value *arg0 = ARG(args, 0);
+    const Value *arg1 = NULL;
     if (nargs == 2) {
         arg1 = ARG(args, 1);
         REQUIRE_VALUE_TYPE(arg1, VALUE_STRING,
@@ -779,7 +2751,7 @@ Value *core_assert(const Value *args)
     }
     if (nargs == 1) {
         exc_set(value_make_exception("Assert failed: %s is not true.",
-                                     core_pr_str(arg0)->value.str));
+                                     STRING(core_pr_str(arg0))));
     } else {
         exc_set(value_make_exception("Assert failed: %s", STRING(arg1)));
     }
@@ -800,9 +2772,27 @@ Value *core_nth(const Value *args)
     CHECK_ARGLIST(args);
     REQUIRE_LIST_CARDINALITY(args, 2ul, "NTH takes exactly two arguments");
     Value *coll = ARG(args, 0);
-    REQUIRE_VALUE_TYPE(coll, VALUE_LIST, "First argument to nth must be a collection");
     Value *pos = ARG(args, 1);
     REQUIRE_VALUE_TYPE(pos, VALUE_INT, "Second argument to nth must be an integer");
+    if (value_is_vector(coll)) {
+        if (INT(pos) < 0 || (size_t) INT(pos) >= NUMVEC(coll)->size) {
+            exc_set(value_make_exception("Index error"));
+            return NULL;
+        }
+        return value_vector_nth(coll, INT(pos));
+    }
+    if (coll->type == VALUE_LAZY_SEQ && INT(pos) >= 0) {
+        SeqIter it;
+        Value *x;
+        int i = 0;
+        value_seq_iter_init(&it, coll);
+        while ((x = value_seq_iter_next(&it)) && i++ < INT(pos));
+        if (!x && !exc_is_pending()) {
+            exc_set(value_make_exception("Index error"));
+        }
+        return x;
+    }
+    REQUIRE_VALUE_TYPE(coll, VALUE_LIST, "First argument to nth must be a collection");
     if (INT(pos) < 0 || (unsigned) INT(pos) >= NARGS(coll)) {
        exc_set(value_make_exception("Index error"));
         return NULL;
@@ -816,10 +2806,20 @@ Value *core_first(const Value *args)
     CHECK_ARGLIST(args);
     REQUIRE_LIST_CARDINALITY(args, 1ul, "FIRST takes exactly one argument");
     Value *coll = ARG(args, 0);
-    if (is_nil(coll) || NARGS(coll) == 0) {
+    if (is_nil(coll)) {
         return VALUE_CONST_NIL;
     }
+    if (coll->type == VALUE_LAZY_SEQ || value_is_vector(coll)) {
+        Value *first = value_seq_first(coll);
+        return exc_is_pending() ? NULL : first ? first : VALUE_CONST_NIL;
+    }
+    if (is_set(coll) || coll->type == VALUE_SORTED_MAP) {
+        return coll_first(coll);
+    }
     REQUIRE_VALUE_TYPE(coll, VALUE_LIST, "Argument to FIRST must be a collection or NIL");
+    if (NARGS(coll) == 0) {
+        return VALUE_CONST_NIL;
+    }
     return ARG(coll, 0);
 }
 
@@ -829,9 +2829,567 @@ Value *core_rest(const Value *args)
     CHECK_ARGLIST(args);
     REQUIRE_LIST_CARDINALITY(args, 1ul, "REST takes exactly one argument");
     Value *coll = ARG(args, 0);
-    if (is_nil(coll) || NARGS(coll) <= 1) {
+    if (is_nil(coll)) {
         return value_new_list(NULL);
     }
+    if (coll->type == VALUE_LAZY_SEQ || value_is_vector(coll)) {
+        Value *rest = value_seq_rest(coll);
+        return exc_is_pending() ? NULL : rest;
+    }
     REQUIRE_VALUE_TYPE(coll, VALUE_LIST, "Argument to REST must be a collection or NIL");
+    if (NARGS(coll) <= 1) {
+        return value_new_list(NULL);
+    }
     return value_new_list(list_tail(LIST(coll)));
 }
+
+Value *core_gc(const Value *args)
+{
+    // (gc)
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 0ul, "GC takes no arguments");
+    heap_collect();
+    return VALUE_CONST_NIL;
+}
+
+static Value *size_value(size_t n)
+{
+    /* byte counts can outgrow int */
+    return n <= INT_MAX ? value_new_int((int) n) : value_new_float((double) n);
+}
+
+static const List *stats_entry(const List *stats, const char *name, Value *value)
+{
+    Value *entry = value_make_list(value_new_symbol(name));
+    LIST(entry) = list_conj(LIST(entry), value);
+    return list_conj(stats, entry);
+}
+
+Value *core_gc_stats(const Value *args)
+{
+    // (gc-stats) => ((collections n) (pause-total-ms t) ...)
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 0ul, "GC-STATS takes no arguments");
+    const HeapStats *hs = heap_stats();
+    const List *stats = list_new();
+    stats = stats_entry(stats, "collections", size_value(hs->collections));
+    stats = stats_entry(stats, "pause-total-ms", value_new_float(hs->pause_total));
+    stats = stats_entry(stats, "pause-max-ms", value_new_float(hs->pause_max));
+    stats = stats_entry(stats, "bytes-allocated", size_value(hs->bytes_allocated));
+    stats = stats_entry(stats, "live-bytes", size_value(hs->live_bytes));
+    stats = stats_entry(stats, "heap-bytes", size_value(hs->heap_size));
+    stats = stats_entry(stats, "peak-heap-bytes", size_value(hs->peak_heap));
+    const ListStats *ls = list_stats();
+    stats = stats_entry(stats, "list-blocks", size_value(ls->blocks));
+    stats = stats_entry(stats, "list-cells", size_value(ls->cells));
+    return value_new_list(stats);
+}
+
+Value *core_heap_histogram(const Value *args)
+{
+    // (heap-histogram) => ((VALUE_INT count bytes) ...), live allocations only
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 0ul, "HEAP-HISTOGRAM takes no arguments");
+    if (!profile_enabled) {
+        exc_set(value_make_exception("HEAP-HISTOGRAM requires --profile-alloc"));
+        return NULL;
+    }
+    const ProfileKind *kinds;
+    size_t n_kinds = profile_kinds(&kinds);
+    const List *histogram = list_new();
+    for (size_t i = 0; i < n_kinds; ++i) {
+        if (kinds[i].count == 0) continue;
+        Value *row = value_make_list(value_new_symbol(kinds[i].kind));
+        LIST(row) = list_conj(LIST(row), size_value(kinds[i].count));
+        LIST(row) = list_conj(LIST(row), size_value(kinds[i].bytes));
+        histogram = list_conj(histogram, row);
+    }
+    return value_new_list(histogram);
+}
+
+/*
+ * Caches and memoized functions
+ */
+
+static int key_eq(const void *a, const void *b)
+{
+    /* keys of caches and hash sets; those that = refuses to compare, like
+     * a string and an int, are simply different keys */
+    const Value *x = a, *y = b;
+    if (x->type != y->type && !(is_number(x) && is_number(y)) && !(is_seq(x) && is_seq(y))
+            && !(is_set(x) && is_set(y))) {
+        return 0;
+    }
+    Value *eq = cmp_eq(x, y);
+    return eq ? eq == VALUE_CONST_TRUE : -1;
+}
+
+static bool cache_capacity(const Value *v, size_t *capacity, const char *name)
+{
+    if (v->type != VALUE_INT || INT(v) < 1) {
+        exc_set(value_make_exception("%s requires a positive integer capacity", name));
+        return false;
+    }
+    *capacity = INT(v);
+    return true;
+}
+
+static Memo *require_cache(const Value *c, const char *name)
+{
+    if (c->type != VALUE_CACHE) {
+        exc_set(value_make_exception("%s requires a cache", name));
+        return NULL;
+    }
+    return MEMO(c);
+}
+
+Value *core_memoize(const Value *args)
+{
+    /* (memoize f) caches every result of f, (memoize f capacity) only
+     * those of the capacity most recently used argument lists */
+    CHECK_ARGLIST(args);
+    size_t n = NARGS(args);
+    if (n < 1 || n > 2) {
+        exc_set(value_make_exception("memoize takes a function and an optional capacity"));
+        return NULL;
+    }
+    Value *fn = ARG(args, 0);
+    if (fn->type != VALUE_FN && fn->type != VALUE_BUILTIN_FN
+            && !(fn->type == VALUE_CACHE && MEMO(fn)->fn)) {
+        exc_set(value_make_exception("memoize requires a function"));
+        return NULL;
+    }
+    size_t capacity = 0;
+    if (n == 2 && !cache_capacity(ARG(args, 1), &capacity, "memoize")) {
+        return NULL;
+    }
+    return value_new_cache(capacity, key_eq, fn);
+}
+
+Value *core_lru_cache(const Value *args)
+{
+    /* (lru-cache capacity) */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "lru-cache requires exactly one parameter");
+    size_t capacity;
+    if (!cache_capacity(ARG(args, 0), &capacity, "lru-cache")) {
+        return NULL;
+    }
+    return value_new_cache(capacity, key_eq, NULL);
+}
+
+Value *core_cache_get(const Value *args)
+{
+    /* (cache-get c key) or (cache-get c key default), nil by default */
+    CHECK_ARGLIST(args);
+    size_t n = NARGS(args);
+    if (n < 2 || n > 3) {
+        exc_set(value_make_exception("cache-get takes a cache, a key and an optional default"));
+        return NULL;
+    }
+    Memo *memo = require_cache(ARG(args, 0), "cache-get");
+    if (!memo) {
+        return NULL;
+    }
+    Value *key = ARG(args, 1);
+    unsigned long hash = value_hash(key);
+    void *value;
+    int found = exc_is_pending() ? -1 : cache_get(memo->cache, key, hash, &value);
+    if (found < 0) {
+        return NULL;
+    }
+    return found ? value : n == 3 ? ARG(args, 2) : VALUE_CONST_NIL;
+}
+
+Value *core_cache_put(const Value *args)
+{
+    /* (cache-put c key value) => value */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 3ul, "cache-put requires exactly three parameters");
+    Memo *memo = require_cache(ARG(args, 0), "cache-put");
+    if (!memo) {
+        return NULL;
+    }
+    Value *key = ARG(args, 1);
+    Value *value = ARG(args, 2);
+    unsigned long hash = value_hash(key);
+    if (exc_is_pending() || cache_put(memo->cache, key, hash, value) < 0) {
+        return NULL;
+    }
+    return value;
+}
+
+Value *core_cache_stats(const Value *args)
+{
+    // (cache-stats c) => ((hits n) (misses n) (size n) (capacity n)), capacity nil if unbounded
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "cache-stats requires exactly one parameter");
+    Memo *memo = require_cache(ARG(args, 0), "cache-stats");
+    if (!memo) {
+        return NULL;
+    }
+    const Cache *c = memo->cache;
+    const List *stats = list_new();
+    stats = stats_entry(stats, "hits", size_value(c->hits));
+    stats = stats_entry(stats, "misses", size_value(c->misses));
+    stats = stats_entry(stats, "size", size_value(c->size));
+    stats = stats_entry(stats, "capacity", c->capacity ? size_value(c->capacity) : VALUE_CONST_NIL);
+    return value_new_list(stats);
+}
+
+/*
+ * Persistent sets and sorted maps: hash sets are HAMTs (see hamt.h) and
+ * sorted sets and maps B-trees (see btree.h), so lookups and updates take
+ * logarithmic time and every update leaves the original intact.
+ */
+
+static int sorted_cmp(const void *a, const void *b)
+{
+    /* keys order like <, and those it refuses to order fail the update */
+    Value *lt = cmp_lt(a, b);
+    if (lt == VALUE_CONST_TRUE) {
+        return -1;
+    }
+    Value *gt = lt ? cmp_lt(b, a) : NULL;
+    if (!gt) {
+        return BTREE_ERROR;
+    }
+    return gt == VALUE_CONST_TRUE ? 1 : 0;
+}
+
+static int set_contains(const Value *set, const Value *x)
+{
+    if (set->type == VALUE_HASH_SET) {
+        unsigned long hash = value_hash(x);
+        return exc_is_pending() ? -1 : hamt_contains(HAMT(set), x, hash);
+    }
+    const BTreeEntry *e;
+    return btree_get(BTREE(set), x, &e);
+}
+
+static Value *coll_with(Value *coll, const void *updated)
+{
+    /* coll itself if the update didn't change it */
+    if (!updated) {
+        return NULL;
+    }
+    if (coll->type == VALUE_HASH_SET) {
+        return updated == HAMT(coll) ? coll : value_new_hash_set(updated);
+    }
+    return updated == BTREE(coll) ? coll : value_new_sorted(coll->type, updated);
+}
+
+static Value *map_entry(const BTreeEntry *e)
+{
+    Value *entry = value_make_list(e->key);
+    LIST(entry) = list_conj(LIST(entry), e->value);
+    return entry;
+}
+
+static Value *coll_conj(Value *coll, Value *x, const char *name)
+{
+    /* coll with x added, where x is a (key value) list for maps */
+    switch (coll->type) {
+    case VALUE_HASH_SET: {
+        unsigned long hash = value_hash(x);
+        return exc_is_pending() ? NULL : coll_with(coll, hamt_insert(HAMT(coll), x, hash));
+    }
+    case VALUE_SORTED_SET:
+        return coll_with(coll, btree_insert(BTREE(coll), x, NULL));
+    case VALUE_SORTED_MAP:
+        if (x->type != VALUE_LIST || NARGS(x) != 2) {
+            exc_set(value_make_exception("%s requires (key value) entries for sorted maps", name));
+            return NULL;
+        }
+        return coll_with(coll, btree_insert(BTREE(coll), ARG(x, 0), ARG(x, 1)));
+    default:
+        exc_set(value_make_exception("%s requires a set or a sorted map", name));
+        return NULL;
+    }
+}
+
+static Value *coll_disj(Value *coll, Value *key, const char *name)
+{
+    /* coll without the element or map key key */
+    switch (coll->type) {
+    case VALUE_HASH_SET: {
+        unsigned long hash = value_hash(key);
+        return exc_is_pending() ? NULL : coll_with(coll, hamt_remove(HAMT(coll), key, hash));
+    }
+    case VALUE_SORTED_SET:
+    case VALUE_SORTED_MAP:
+        return coll_with(coll, btree_remove(BTREE(coll), key));
+    default:
+        exc_set(value_make_exception("%s requires a set or a sorted map", name));
+        return NULL;
+    }
+}
+
+static Value *coll_first(const Value *coll)
+{
+    if (coll->type == VALUE_HASH_SET) {
+        HamtIter it;
+        hamt_iter_init(&it, HAMT(coll));
+        Value *first = hamt_iter_next(&it);
+        return first ? first : VALUE_CONST_NIL;
+    }
+    const BTreeEntry *e = btree_first(BTREE(coll));
+    if (!e) {
+        return VALUE_CONST_NIL;
+    }
+    return coll->type == VALUE_SORTED_MAP ? map_entry(e) : e->key;
+}
+
+static Value *coll_new(const Value *args, Value *coll, const char *name)
+{
+    /* coll with each argument added */
+    for (const ListItem *i = LIST(args)->begin; coll && i != NULL; i = i->next) {
+        coll = coll_conj(coll, i->p, name);
+    }
+    return coll;
+}
+
+Value *core_hash_set(const Value *args)
+{
+    /* (hash-set x ...) */
+    CHECK_ARGLIST(args);
+    return coll_new(args, value_new_hash_set(hamt_new(key_eq)), "hash-set");
+}
+
+Value *core_sorted_set(const Value *args)
+{
+    /* (sorted-set x ...), ordered by < */
+    CHECK_ARGLIST(args);
+    return coll_new(args, value_new_sorted(VALUE_SORTED_SET, btree_new(sorted_cmp)), "sorted-set");
+}
+
+Value *core_sorted_map(const Value *args)
+{
+    /* (sorted-map k v ...), ordered by < on the keys */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) % 2) {
+        exc_set(value_make_exception("sorted-map requires an even number of parameters"));
+        return NULL;
+    }
+    const BTree *t = btree_new(sorted_cmp);
+    for (const ListItem *i = LIST(args)->begin; t && i != NULL; i = i->next->next) {
+        t = btree_insert(t, i->p, i->next->p);
+    }
+    return t ? value_new_sorted(VALUE_SORTED_MAP, t) : NULL;
+}
+
+Value *core_conj(const Value *args)
+{
+    /* (conj set x ...) or (conj map (k v) ...) */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) < 1) {
+        exc_set(value_make_exception("conj requires a collection"));
+        return NULL;
+    }
+    Value *coll = ARG(args, 0);
+    for (const ListItem *i = LIST(args)->begin->next; coll && i != NULL; i = i->next) {
+        coll = coll_conj(coll, i->p, "conj");
+    }
+    return coll;
+}
+
+static Value *coll_remove_all(const Value *args, ValueType type, const char *name)
+{
+    /* (name coll key ...), where coll is a set or has the given type */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) < 1) {
+        exc_set(value_make_exception("%s requires a collection", name));
+        return NULL;
+    }
+    Value *coll = ARG(args, 0);
+    if (type == VALUE_SORTED_MAP ? coll->type != type : !is_set(coll)) {
+        exc_set(value_make_exception("%s requires a %s", name, type == VALUE_SORTED_MAP ? "sorted map" : "set"));
+        return NULL;
+    }
+    for (const ListItem *i = LIST(args)->begin->next; coll && i != NULL; i = i->next) {
+        coll = coll_disj(coll, i->p, name);
+    }
+    return coll;
+}
+
+Value *core_disj(const Value *args)
+{
+    /* (disj set x ...) */
+    return coll_remove_all(args, VALUE_SORTED_SET, "disj");
+}
+
+Value *core_dissoc(const Value *args)
+{
+    /* (dissoc map k ...) */
+    return coll_remove_all(args, VALUE_SORTED_MAP, "dissoc");
+}
+
+Value *core_assoc(const Value *args)
+{
+    /* (assoc map k v ...) */
+    CHECK_ARGLIST(args);
+    if (NARGS(args) < 1 || NARGS(args) % 2 == 0) {
+        exc_set(value_make_exception("assoc requires a sorted map and keys with values"));
+        return NULL;
+    }
+    Value *map = ARG(args, 0);
+    REQUIRE_VALUE_TYPE(map, VALUE_SORTED_MAP, "assoc requires a sorted map");
+    const BTree *t = BTREE(map);
+    for (const ListItem *i = LIST(args)->begin->next; t && i != NULL; i = i->next->next) {
+        t = btree_insert(t, i->p, i->next->p);
+    }
+    return coll_with(map, t);
+}
+
+Value *core_get(const Value *args)
+{
+    /* (get coll key) or (get coll key default): the value of key in a
+     * map, or key itself if it is in a set; nil by default */
+    CHECK_ARGLIST(args);
+    size_t n = NARGS(args);
+    if (n < 2 || n > 3) {
+        exc_set(value_make_exception("get takes a collection, a key and an optional default"));
+        return NULL;
+    }
+    Value *coll = ARG(args, 0);
+    Value *key = ARG(args, 1);
+    Value *missing = n == 3 ? ARG(args, 2) : VALUE_CONST_NIL;
+    if (is_nil(coll)) {
+        return missing;
+    }
+    if (coll->type == VALUE_HASH_SET) {
+        int found = set_contains(coll, key);
+        return found < 0 ? NULL : found ? key : missing;
+    }
+    if (coll->type != VALUE_SORTED_SET && coll->type != VALUE_SORTED_MAP) {
+        exc_set(value_make_exception("get requires a set or a sorted map"));
+        return NULL;
+    }
+    const BTreeEntry *e;
+    int found = btree_get(BTREE(coll), key, &e);
+    if (found <= 0) {
+        return found < 0 ? NULL : missing;
+    }
+    return coll->type == VALUE_SORTED_MAP ? e->value : e->key;
+}
+
+Value *core_contains(const Value *args)
+{
+    /* (contains? coll key), for the elements of sets and keys of maps */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 2ul, "contains? requires exactly two parameters");
+    Value *coll = ARG(args, 0);
+    if (!is_set(coll) && coll->type != VALUE_SORTED_MAP) {
+        exc_set(value_make_exception("contains? requires a set or a sorted map"));
+        return NULL;
+    }
+    const BTreeEntry *e;
+    int found = coll->type == VALUE_SORTED_MAP ? btree_get(BTREE(coll), ARG(args, 1), &e)
+                                               : set_contains(coll, ARG(args, 1));
+    return found < 0 ? NULL : found ? VALUE_CONST_TRUE : VALUE_CONST_FALSE;
+}
+
+Value *core_seq(const Value *args)
+{
+    /* (seq coll), the elements of a set or the (key value) entries of a
+     * map as a list, in order if it is sorted; sequences are returned
+     * as they are */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "seq requires exactly one parameter");
+    Value *coll = ARG(args, 0);
+    if (is_nil(coll) || is_seq(coll)) {
+        return coll;
+    }
+    if (!is_set(coll) && coll->type != VALUE_SORTED_MAP) {
+        exc_set(value_make_exception("seq requires a collection"));
+        return NULL;
+    }
+    ListBuilder seq;
+    list_builder_init(&seq);
+    if (coll->type == VALUE_SORTED_MAP) {
+        BTreeIter it;
+        btree_iter_init(&it, BTREE(coll), NULL);
+        for (const BTreeEntry *e; (e = btree_iter_next(&it)) != NULL; ) {
+            list_builder_append(&seq, map_entry(e));
+        }
+    } else {
+        CollIter it;
+        coll_iter_init(&it, coll);
+        for (Value *x; (x = coll_iter_next(&it)) != NULL; ) {
+            list_builder_append(&seq, x);
+        }
+    }
+    Value *v = value_new_list(NULL);
+    LIST(v) = list_builder_finish(&seq);
+    return v;
+}
+
+Value *core_subseq(const Value *args)
+{
+    /* (subseq sorted start) or (subseq sorted start end), the elements or
+     * entries with start <= key < end in order; a nil bound is open */
+    CHECK_ARGLIST(args);
+    size_t n = NARGS(args);
+    if (n < 2 || n > 3) {
+        exc_set(value_make_exception("subseq takes a sorted collection, a start and an optional end"));
+        return NULL;
+    }
+    Value *coll = ARG(args, 0);
+    if (coll->type != VALUE_SORTED_SET && coll->type != VALUE_SORTED_MAP) {
+        exc_set(value_make_exception("subseq requires a sorted set or map"));
+        return NULL;
+    }
+    Value *start = ARG(args, 1);
+    Value *end = n == 3 ? ARG(args, 2) : VALUE_CONST_NIL;
+    BTreeIter it;
+    if (!btree_iter_init(&it, BTREE(coll), is_nil(start) ? NULL : start)) {
+        return NULL;
+    }
+    ListBuilder seq;
+    list_builder_init(&seq);
+    for (const BTreeEntry *e; (e = btree_iter_next(&it)) != NULL; ) {
+        if (!is_nil(end)) {
+            int cmp = sorted_cmp(e->key, end);
+            if (cmp == BTREE_ERROR) {
+                return NULL;
+            }
+            if (cmp >= 0) {
+                break;
+            }
+        }
+        list_builder_append(&seq, coll->type == VALUE_SORTED_MAP ? map_entry(e) : e->key);
+    }
+    Value *v = value_new_list(NULL);
+    LIST(v) = list_builder_finish(&seq);
+    return v;
+}
+
+Value *core_last(const Value *args)
+{
+    /* (last coll), the greatest element or entry of a sorted collection
+     * and the last element of a sequence; nil if there is none */
+    CHECK_ARGLIST(args);
+    REQUIRE_LIST_CARDINALITY(args, 1ul, "last requires exactly one parameter");
+    Value *coll = ARG(args, 0);
+    if (is_nil(coll)) {
+        return VALUE_CONST_NIL;
+    }
+    if (coll->type == VALUE_SORTED_SET || coll->type == VALUE_SORTED_MAP) {
+        const BTreeEntry *e = btree_last(BTREE(coll));
+        return !e ? VALUE_CONST_NIL : coll->type == VALUE_SORTED_MAP ? map_entry(e) : e->key;
+    }
+    if (coll->type == VALUE_LIST) {
+        return NARGS(coll) ? LIST(coll)->end->p : VALUE_CONST_NIL;
+    }
+    if (!is_seq(coll)) {
+        exc_set(value_make_exception("last requires a sequence or a sorted collection"));
+        return NULL;
+    }
+    Value *last = NULL;
+    SeqIter it;
+    value_seq_iter_init(&it, coll);
+    for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ) {
+        last = x;
+    }
+    return exc_is_pending() ? NULL : last ? last : VALUE_CONST_NIL;
+}
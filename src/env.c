@@ -1,11 +1,11 @@
 #include "env.h"
-#include "gc.h"
+#include "heap.h"
 #include "log.h"
 #include "value.h"
 
 Environment *env_new(Environment *parent)
 {
-    Environment *env = gc_malloc(&gc, sizeof(Environment));
+    Environment *env = heap_malloc(sizeof(Environment));
     env->parent = parent;
     env->map = map_new(32);
     return env;
@@ -31,6 +31,25 @@ Value *env_get(Environment *env, char *symbol)
     return NULL;
 }
 
+void env_set_symbol(Environment *env, const Value *symbol, const Value *value)
+{
+    map_put_hashed(env->map, SYMBOL(symbol), value_string_hash(symbol),
+                   (void *) value, sizeof(Value));
+}
+
+Value *env_get_symbol(Environment *env, const Value *symbol)
+{
+    const char *key = SYMBOL(symbol);
+    unsigned long hash = value_string_hash(symbol);
+    Value *value;
+    for (Environment *cur_env = env; cur_env; cur_env = cur_env->parent) {
+        if (cur_env->map && (value = map_get_hashed(cur_env->map, key, hash))) {
+            return value;
+        }
+    }
+    return NULL;
+}
+
 bool env_contains(Environment *env, char *symbol)
 {
     return env_get(env, symbol) != NULL;
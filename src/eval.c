@@ -8,6 +8,7 @@
 #include "log.h"
 #include "core.h"
 #include "exc.h"
+#include "profile.h"
 
 static bool is_self_evaluating(const Value *value)
 {
@@ -15,7 +16,16 @@ static bool is_self_evaluating(const Value *value)
            || value->type == VALUE_INT
            || value->type == VALUE_STRING
            || value->type == VALUE_NIL
-           || value->type == VALUE_FN;
+           || value->type == VALUE_FN
+           || value->type == VALUE_FILE
+           || value->type == VALUE_LAZY_SEQ
+           || value->type == VALUE_TRANSDUCER
+           || value->type == VALUE_CACHE
+           || value->type == VALUE_HASH_SET
+           || value->type == VALUE_SORTED_MAP
+           || value->type == VALUE_SORTED_SET
+           || value_is_vector(value)
+           || value->type == VALUE_MATRIX;
 }
 
 static bool is_variable(const Value *value)
@@ -82,7 +92,7 @@ static bool is_if(const Value *value)
 
 static bool is_do(const Value *value)
 {
-    return is_list_that_starts_with(value, "do", 2);
+    return is_list_that_starts_with(value, "do", 3);
 }
 
 static bool is_try(const Value *value)
@@ -90,6 +100,12 @@ static bool is_try(const Value *value)
     return is_list_that_starts_with(value, "try", 3);
 }
 
+static bool is_lazy_seq(const Value *value)
+{
+    // (lazy-seq body)
+    return is_list_that_starts_with(value, "lazy-seq", 9);
+}
+
 static Value *get_macro_fn(const Value *form, Environment *env)
 {
     /*
@@ -100,7 +116,7 @@ static Value *get_macro_fn(const Value *form, Environment *env)
     if (is_list(form)) {
         Value *first = list_head(LIST(form));
         if (first && is_symbol(first)) {
-            Value *fn = env_get(env, SYMBOL(first));
+            Value *fn = env_get_symbol(env, first);
             if (fn && is_macro(fn))
                 return fn;
         }
@@ -127,7 +143,7 @@ static bool has_cardinality(const Value *expr, const size_t cardinality)
 static Value *lookup_variable_value(Value *expr, Environment *env)
 {
     Value *sym = NULL;
-    if ((sym = env_get(env, SYMBOL(expr))) == NULL) {
+    if ((sym = env_get_symbol(env, expr)) == NULL) {
         exc_set(value_make_exception("Unknown name: %s", SYMBOL(expr)));
         return NULL;
     }
@@ -149,14 +165,14 @@ static Value *eval_assignment(Value *expr, Environment *env)
     // (set! var value)
     if (has_cardinality(expr, 3)) {
         Value *name = list_nth(LIST(expr), 1);
-        if (env_contains(env, SYMBOL(name))) {
+        if (env_get_symbol(env, name)) {
             Value *value = list_nth(LIST(expr), 2);
             value = eval(value, env);
             if (!value) {
                 assert(exc_is_pending());
                 return NULL;
             }
-            env_set(env, SYMBOL(name), value);
+            env_set_symbol(env, name, value);
             return value;
         }
         exc_set(value_make_exception("Could not find symbol %s.", SYMBOL(name)));
@@ -178,7 +194,7 @@ static Value *eval_definition(Value *expr, Environment *env)
             assert(exc_is_pending());
             return NULL;
         }
-        env_set(env, SYMBOL(name), value);
+        env_set_symbol(env, name, value);
         return value;
     }
     exc_set(value_make_exception("def requires 2 args"));
@@ -193,7 +209,7 @@ static Value *eval_macro_definition(Value *expr, Environment *env)
         Value *args = list_nth(LIST(expr), 2);
         Value *body = list_nth(LIST(expr), 3);
         Value *macro = value_new_macro(args, body, env);
-        env_set(env, SYMBOL(name), macro);
+        env_set_symbol(env, name, macro);
         return macro;
     }
     exc_set(value_make_exception("Invalid macro declaration"));
@@ -220,7 +236,7 @@ static Value *eval_let(Value *expr, Environment *env, Value **tco_expr, Environm
                 assert(exc_is_pending());
                 return NULL;
             }
-            env_set(inner, SYMBOL(name), evaluated_value);
+            env_set_symbol(inner, name, evaluated_value);
             list = list_tail(list_tail(list)); // +2
             name = list_head(list);
             value = name ? list_head(list_tail(list)) : NULL;
@@ -270,7 +286,7 @@ static Value *eval_try(Value *expr, Environment *env)
             // LOG_CRITICAL("Caught exception: %s", EXCEPTION(exc_get()));
             Environment *ex_env = env_new(env);
             Value *name = list_nth(LIST(catch_form), 1);
-            env_set(ex_env, STRING(name), exc_get());
+            env_set_symbol(ex_env, name, exc_get());
             exc_clear();
             result = eval(list_nth(LIST(catch_form), 2), ex_env);
             if (!result) {
@@ -298,6 +314,36 @@ static Value *declare_fn(Value *expr, Environment *env)
     return NULL;
 }
 
+static Value *lazy_seq_next(void *state, Value **rest)
+{
+    /* the body evaluates to the sequence the cell stands for */
+    Value *thunk = state;
+    Value *seq = eval(FN(thunk)->body, FN(thunk)->env);
+    if (!seq) {
+        return NULL;
+    }
+    if (!value_is_seq(seq)) {
+        exc_set(value_make_exception("The body of lazy-seq must evaluate to a sequence"));
+        return NULL;
+    }
+    Value *first = value_seq_first(seq);
+    if (first) {
+        *rest = value_seq_rest(seq);
+    }
+    return first;
+}
+
+static Value *eval_lazy_seq(Value *expr, Environment *env)
+{
+    // (lazy-seq body), body is evaluated when the sequence is realized
+    if (has_cardinality(expr, 2)) {
+        Value *thunk = value_new_fn(NULL, list_nth(LIST(expr), 1), env);
+        return value_new_lazy_seq(lazy_seq_next, thunk);
+    }
+    exc_set(value_make_exception("Invalid lazy-seq, requires a body"));
+    return NULL;
+}
+
 static Value *eval_do(Value *expr, Environment *env, Value **tco_expr, Environment **tco_env)
 {
     // (do sexpr sexpr ...)
@@ -469,7 +515,16 @@ static Value *eval_all(Value *expr, Environment *env)
 }
 
 
-Value *eval(Value *expr, Environment *env)
+static void profile_enter_fn(const Value *expr, const Value *fn)
+{
+    /* attribute allocations in the body to the name the fn was called by */
+    if (fn->type == VALUE_FN) {
+        const Value *op = list_head(LIST(expr));
+        profile_set_site(profile_intern_site(is_symbol(op) ? SYMBOL(op) : "<lambda>"));
+    }
+}
+
+static Value *eval_expr(Value *expr, Environment *env)
 {
     Value *tco_expr = NULL;
     Value *ret = NULL;
@@ -560,6 +615,8 @@ tco:
         return eval_try(expr, env);
     } else if (is_lambda(expr)) {
         return declare_fn(expr, env);
+    } else if (is_lazy_seq(expr)) {
+        return eval_lazy_seq(expr, env);
     } else if (is_macro_expansion(expr)) {
         return macroexpand_1(expr, env);
     } else if (is_application(expr)) {
@@ -577,6 +634,9 @@ tco:
         }
         ret = apply(fn, args, &tco_expr, &tco_env);
         if (tco_expr && tco_env) {
+            if (profile_enabled) {
+                profile_enter_fn(expr, fn);
+            }
             expr = tco_expr;
             env = tco_env;
             goto tco;
@@ -591,3 +651,15 @@ tco:
     exc_set(value_new_exception("Unknown expression"));
     return NULL;
 }
+
+Value *eval(Value *expr, Environment *env)
+{
+    if (profile_enabled) {
+        /* allocation sites are scoped to the eval() call */
+        int site = profile_site();
+        Value *ret = eval_expr(expr, env);
+        profile_set_site(site);
+        return ret;
+    }
+    return eval_expr(expr, env);
+}
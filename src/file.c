@@ -0,0 +1,236 @@
+#include "file.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "scan.h"
+
+const char *file_mode_names[] = {
+    "r",
+    "w",
+    "a"
+};
+
+static File *open_files = NULL;
+static bool exit_registered = false;
+
+
+static void file_flush_all()
+{
+    for (File *f = open_files; f; f = f->next) {
+        if (f->mode != FILE_READ) {
+            printer_flush(&f->out);
+        }
+    }
+}
+
+File *file_new(FILE *fp, FileMode mode, bool owned)
+{
+    File *f = malloc(sizeof(File));
+    *f = (File) {
+        .fp = fp, .mode = mode, .owned = owned, .buf = NULL, .pos = 0,
+        .len = 0, .eof = false, .prev = NULL, .next = open_files
+    };
+    if (mode == FILE_READ) {
+        /* we buffer ourselves, in bigger blocks than stdio would */
+        setvbuf(fp, NULL, _IONBF, 0);
+    } else {
+        printer_init(&f->out, fp, PRINTER_FLUSH_BLOCK);
+    }
+    if (open_files) {
+        open_files->prev = f;
+    }
+    open_files = f;
+    if (!exit_registered) {
+        atexit(file_flush_all);
+        exit_registered = true;
+    }
+    return f;
+}
+
+File *file_open(const char *path, FileMode mode)
+{
+    FILE *fp = fopen(path, file_mode_names[mode]);
+    return fp ? file_new(fp, mode, true) : NULL;
+}
+
+bool file_close(File *f)
+{
+    if (!f->fp) {
+        return true;
+    }
+    bool ok = true;
+    if (f->mode == FILE_READ) {
+        free(f->buf);
+        f->buf = NULL;
+    } else {
+        printer_delete(&f->out);
+        ok = fflush(f->fp) == 0 && !ferror(f->fp);
+    }
+    if (f->owned && fclose(f->fp) != 0) {
+        ok = false;
+    }
+    f->fp = NULL;
+    if (f->prev) {
+        f->prev->next = f->next;
+    } else {
+        open_files = f->next;
+    }
+    if (f->next) {
+        f->next->prev = f->prev;
+    }
+    return ok;
+}
+
+void file_delete(File *f)
+{
+    file_close(f);
+    free(f);
+}
+
+void file_finalize(void *cell)
+{
+    file_delete(*(File **) cell);
+}
+
+static bool file_fill(File *f)
+{
+    /* refills the (consumed) buffer, false on errors */
+    if (!f->buf) {
+        f->buf = malloc(FILE_BUFSIZE);
+    }
+    f->pos = 0;
+    f->len = fread(f->buf, 1, FILE_BUFSIZE, f->fp);
+    if (f->len < FILE_BUFSIZE) {
+        if (ferror(f->fp)) {
+            return false;
+        }
+        f->eof = true;
+    }
+    return true;
+}
+
+static size_t file_line_len(const char *line, size_t len)
+{
+    /* lines end in "\n" or "\r\n" */
+    return len && line[len - 1] == '\r' ? len - 1 : len;
+}
+
+static Value *file_line_builder(StringBuilder *sb)
+{
+    sb->len = file_line_len(sb->buf, sb->len);
+    return string_builder_finish(sb);
+}
+
+bool file_read_line(File *f, Value **line)
+{
+    /* a line is copied out of the buffer, so the buffer can be reused;
+     * lines that span a refill are collected in a string builder */
+    StringBuilder sb;
+    bool partial = false;
+    *line = NULL;
+    while (true) {
+        if (f->pos == f->len) {
+            if (f->eof || !file_fill(f)) {
+                break;
+            }
+            if (f->len == 0) {
+                break;
+            }
+        }
+        size_t end = scan_line(f->buf, f->pos, f->len);
+        if (end < f->len) {
+            if (partial) {
+                string_builder_append(&sb, f->buf + f->pos, end - f->pos);
+                *line = file_line_builder(&sb);
+            } else {
+                const char *start = f->buf + f->pos;
+                *line = value_new_string_len(start, file_line_len(start, end - f->pos));
+            }
+            f->pos = end + 1;
+            return true;
+        }
+        if (!partial) {
+            string_builder_init(&sb);
+            partial = true;
+        }
+        string_builder_append(&sb, f->buf + f->pos, f->len - f->pos);
+        f->pos = f->len;
+    }
+    if (partial) {
+        /* the last line has no line feed */
+        *line = file_line_builder(&sb);
+    }
+    return !ferror(f->fp);
+}
+
+bool file_read_bytes(File *f, size_t n, Value **bytes)
+{
+    *bytes = NULL;
+    if (f->pos == f->len && (f->eof || !file_fill(f) || f->len == 0)) {
+        return !ferror(f->fp);
+    }
+    size_t buffered = f->len - f->pos;
+    if (n <= buffered) {
+        *bytes = value_new_string_len(f->buf + f->pos, n);
+        f->pos += n;
+        return true;
+    }
+    /* drain the buffer, read the rest straight into the result */
+    char *buf = heap_malloc(n + 1);
+    memcpy(buf, f->buf + f->pos, buffered);
+    f->pos = f->len;
+    size_t len = buffered;
+    if (!f->eof) {
+        len += fread(buf + buffered, 1, n - buffered, f->fp);
+        if (len < n) {
+            if (ferror(f->fp)) {
+                heap_free(buf, n + 1);
+                return false;
+            }
+            f->eof = true;
+        }
+    }
+    *bytes = value_new_string_owned(buf, len);
+    return true;
+}
+
+Printer *file_printer(File *f)
+{
+    return &f->out;
+}
+
+typedef struct FileMapping {
+    void *addr;
+    size_t size;
+} FileMapping;
+
+static void file_unmap(void *cell)
+{
+    FileMapping *m = cell;
+    munmap(m->addr, m->size);
+}
+
+Value *file_map(int fd, size_t len)
+{
+    /* the file is mapped over a zeroed anonymous region that is at least
+     * one byte longer, so the string is NUL-terminated without copying it
+     * even if its length is a multiple of the page size */
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (len / page + 1) * page;
+    char *addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    if (mmap(addr, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(addr, size);
+        return NULL;
+    }
+    /* the cell is the managed base of the string and its slices */
+    FileMapping *m = heap_malloc_dtor(sizeof(FileMapping), file_unmap);
+    m->addr = addr;
+    m->size = size;
+    return value_new_string_terminated(m, addr, len);
+}
@@ -0,0 +1,328 @@
+#include "hamt.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "heap.h"
+#include "profile.h"
+
+#define HAMT_MASK ((1u << HAMT_BITS) - 1)
+
+
+const Hamt *hamt_new(HamtEq eq)
+{
+    Hamt *h = heap_malloc(sizeof(Hamt));
+    PROFILE_ALLOC(h, sizeof(Hamt), "HAMT");
+    h->root = NULL;
+    h->size = 0;
+    h->eq = eq;
+    h->hash = 0;
+    return h;
+}
+
+static const Hamt *hamt_with(const Hamt *h, const HamtNode *root, size_t size)
+{
+    Hamt *with = heap_malloc(sizeof(Hamt));
+    PROFILE_ALLOC(with, sizeof(Hamt), "HAMT");
+    with->root = root;
+    with->size = size;
+    with->eq = h->eq;
+    with->hash = 0;
+    return with;
+}
+
+/*
+ * Nodes, which are never changed once they are in a set
+ */
+
+static unsigned node_count(const HamtNode *n, int level)
+{
+    return level >= (int) HAMT_LEVELS ? n->bitmap : (unsigned) __builtin_popcount(n->bitmap);
+}
+
+static uint32_t slot_bit(unsigned long hash, int level)
+{
+    return 1u << ((hash >> (level * HAMT_BITS)) & HAMT_MASK);
+}
+
+static unsigned slot_index(const HamtNode *n, uint32_t bit)
+{
+    return __builtin_popcount(n->bitmap & (bit - 1));
+}
+
+static HamtNode *node_new(unsigned count, uint32_t bitmap, uint32_t subnodes)
+{
+    HamtNode *n = heap_malloc(sizeof(HamtNode) + count * sizeof(HamtEntry));
+    PROFILE_ALLOC(n, sizeof(HamtNode) + count * sizeof(HamtEntry), "HAMT");
+    n->bitmap = bitmap;
+    n->subnodes = subnodes;
+    return n;
+}
+
+static HamtNode *node_with(const HamtNode *n, unsigned count, unsigned i, HamtEntry e)
+{
+    /* a copy with entry i replaced by e */
+    HamtNode *with = node_new(count, n->bitmap, n->subnodes);
+    memcpy(with->entries, n->entries, count * sizeof(HamtEntry));
+    with->entries[i] = e;
+    return with;
+}
+
+static HamtNode *node_inserting(const HamtNode *n, unsigned count, unsigned i, HamtEntry e)
+{
+    /* a copy with e inserted before entry i */
+    HamtNode *with = node_new(count + 1, n->bitmap, n->subnodes);
+    memcpy(with->entries, n->entries, i * sizeof(HamtEntry));
+    with->entries[i] = e;
+    memcpy(with->entries + i + 1, n->entries + i, (count - i) * sizeof(HamtEntry));
+    return with;
+}
+
+static HamtNode *node_removing(const HamtNode *n, unsigned count, unsigned i)
+{
+    HamtNode *without = node_new(count - 1, n->bitmap, n->subnodes);
+    memcpy(without->entries, n->entries, i * sizeof(HamtEntry));
+    memcpy(without->entries + i, n->entries + i + 1, (count - i - 1) * sizeof(HamtEntry));
+    return without;
+}
+
+static HamtNode *node_pair(int level, HamtEntry a, HamtEntry b)
+{
+    /* a node for two different keys, as deep as their hashes agree */
+    if (level >= (int) HAMT_LEVELS) {
+        HamtNode *n = node_new(2, 2, 0);
+        n->entries[0] = a;
+        n->entries[1] = b;
+        return n;
+    }
+    uint32_t bit_a = slot_bit(a.hash, level), bit_b = slot_bit(b.hash, level);
+    if (bit_a == bit_b) {
+        HamtNode *n = node_new(1, bit_a, bit_a);
+        n->entries[0] = (HamtEntry) { .p = node_pair(level + 1, a, b), .hash = 0 };
+        return n;
+    }
+    HamtNode *n = node_new(2, bit_a | bit_b, 0);
+    n->entries[bit_a < bit_b ? 0 : 1] = a;
+    n->entries[bit_a < bit_b ? 1 : 0] = b;
+    return n;
+}
+
+static bool node_single_key(const HamtNode *n, int level)
+{
+    return node_count(n, level) == 1 && (level >= (int) HAMT_LEVELS || !n->subnodes);
+}
+
+/*
+ * Lookups and updates; *status is 1 if the key was added or removed, 0
+ * if the set is unchanged and -1 on errors
+ */
+
+int hamt_contains(const Hamt *h, const void *key, unsigned long hash)
+{
+    const HamtNode *n = h->root;
+    for (int level = 0; n != NULL; ++level) {
+        if (level >= (int) HAMT_LEVELS) {
+            for (unsigned i = 0; i < n->bitmap; ++i) {
+                int eq = h->eq(n->entries[i].p, key);
+                if (eq) {
+                    return eq;
+                }
+            }
+            return 0;
+        }
+        uint32_t bit = slot_bit(hash, level);
+        if (!(n->bitmap & bit)) {
+            return 0;
+        }
+        const HamtEntry *e = &n->entries[slot_index(n, bit)];
+        if (!(n->subnodes & bit)) {
+            return e->hash == hash ? h->eq(e->p, key) : 0;
+        }
+        n = e->p;
+    }
+    return 0;
+}
+
+static const HamtNode *node_insert(const HamtNode *n, int level, HamtEntry e, HamtEq eq, int *status)
+{
+    *status = 0;
+    unsigned count = node_count(n, level);
+    if (level >= (int) HAMT_LEVELS) {
+        for (unsigned i = 0; i < count; ++i) {
+            int equal = eq(n->entries[i].p, e.p);
+            if (equal) {
+                *status = equal < 0 ? -1 : 0;
+                return n;
+            }
+        }
+        HamtNode *with = node_inserting(n, count, count, e);
+        with->bitmap = count + 1;
+        *status = 1;
+        return with;
+    }
+    uint32_t bit = slot_bit(e.hash, level);
+    unsigned i = slot_index(n, bit);
+    if (!(n->bitmap & bit)) {
+        HamtNode *with = node_inserting(n, count, i, e);
+        with->bitmap |= bit;
+        *status = 1;
+        return with;
+    }
+    const HamtEntry *old = &n->entries[i];
+    if (n->subnodes & bit) {
+        const HamtNode *child = node_insert(old->p, level + 1, e, eq, status);
+        if (*status <= 0) {
+            return n;
+        }
+        return node_with(n, count, i, (HamtEntry) { .p = (void *) child, .hash = 0 });
+    }
+    if (old->hash == e.hash) {
+        int equal = eq(old->p, e.p);
+        if (equal) {
+            *status = equal < 0 ? -1 : 0;
+            return n;
+        }
+    }
+    HamtNode *with = node_with(n, count, i, (HamtEntry) { .p = node_pair(level + 1, *old, e), .hash = 0 });
+    with->subnodes |= bit;
+    *status = 1;
+    return with;
+}
+
+const Hamt *hamt_insert(const Hamt *h, void *key, unsigned long hash)
+{
+    HamtEntry e = { .p = key, .hash = hash };
+    if (!h->root) {
+        HamtNode *root = node_new(1, slot_bit(hash, 0), 0);
+        root->entries[0] = e;
+        return hamt_with(h, root, 1);
+    }
+    int status;
+    const HamtNode *root = node_insert(h->root, 0, e, h->eq, &status);
+    if (status < 0) {
+        return NULL;
+    }
+    return status ? hamt_with(h, root, h->size + 1) : h;
+}
+
+static const HamtNode *node_remove(const HamtNode *n, int level, const void *key, unsigned long hash,
+                                   HamtEq eq, int *status)
+{
+    /* NULL if that leaves n empty */
+    *status = 0;
+    unsigned count = node_count(n, level);
+    if (level >= (int) HAMT_LEVELS) {
+        for (unsigned i = 0; i < count; ++i) {
+            int equal = eq(n->entries[i].p, key);
+            if (equal < 0) {
+                *status = -1;
+                return n;
+            }
+            if (equal) {
+                *status = 1;
+                if (count == 1) {
+                    return NULL;
+                }
+                HamtNode *without = node_removing(n, count, i);
+                without->bitmap = count - 1;
+                return without;
+            }
+        }
+        return n;
+    }
+    uint32_t bit = slot_bit(hash, level);
+    if (!(n->bitmap & bit)) {
+        return n;
+    }
+    unsigned i = slot_index(n, bit);
+    const HamtEntry *old = &n->entries[i];
+    if (n->subnodes & bit) {
+        const HamtNode *child = node_remove(old->p, level + 1, key, hash, eq, status);
+        if (*status <= 0) {
+            return n;
+        }
+        if (child && node_single_key(child, level + 1)) {
+            /* pull a lone key up, so a trie only gets as deep as its keys
+             * need */
+            HamtNode *with = node_with(n, count, i, child->entries[0]);
+            with->subnodes &= ~bit;
+            return with;
+        }
+        if (child) {
+            return node_with(n, count, i, (HamtEntry) { .p = (void *) child, .hash = 0 });
+        }
+    } else {
+        int equal = old->hash == hash ? eq(old->p, key) : 0;
+        if (equal <= 0) {
+            *status = equal;
+            return n;
+        }
+        *status = 1;
+    }
+    if (count == 1) {
+        return NULL;
+    }
+    HamtNode *without = node_removing(n, count, i);
+    without->bitmap &= ~bit;
+    without->subnodes &= ~bit;
+    return without;
+}
+
+const Hamt *hamt_remove(const Hamt *h, const void *key, unsigned long hash)
+{
+    if (!h->root) {
+        return h;
+    }
+    int status;
+    const HamtNode *root = node_remove(h->root, 0, key, hash, h->eq, &status);
+    if (status < 0) {
+        return NULL;
+    }
+    return status ? hamt_with(h, root, h->size - 1) : h;
+}
+
+/*
+ * Iteration, depth first with an explicit stack
+ */
+
+static void iter_push(HamtIter *it, const HamtNode *n)
+{
+    ++it->depth;
+    it->nodes[it->depth] = n;
+    /* the slots in use, or the number of keys of a collision node */
+    it->todo[it->depth] = n->bitmap;
+}
+
+void hamt_iter_init(HamtIter *it, const Hamt *h)
+{
+    it->depth = -1;
+    if (h->root) {
+        iter_push(it, h->root);
+    }
+}
+
+void *hamt_iter_next(HamtIter *it)
+{
+    while (it->depth >= 0) {
+        const HamtNode *n = it->nodes[it->depth];
+        uint32_t todo = it->todo[it->depth];
+        if (!todo) {
+            --it->depth;
+            continue;
+        }
+        if (it->depth >= (int) HAMT_LEVELS) {
+            /* collision nodes count down through their keys */
+            it->todo[it->depth] = todo - 1;
+            return n->entries[n->bitmap - todo].p;
+        }
+        uint32_t bit = todo & -todo;
+        it->todo[it->depth] = todo & ~bit;
+        const HamtEntry *e = &n->entries[slot_index(n, bit)];
+        if (n->subnodes & bit) {
+            iter_push(it, e->p);
+        } else {
+            return e->p;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,345 @@
+#include "heap.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc.h"
+#include "log.h"
+#include "profile.h"
+
+/*
+ * The collector is paused for its whole lifetime: it would otherwise
+ * decide to sweep on its own (based on the number of allocations) and
+ * the front-end could neither account for the freed memory nor enforce
+ * a heap limit. Instead, heap_malloc() triggers a collection whenever
+ * the heap outgrows `threshold`, which is re-computed from the live
+ * data after every collection.
+ */
+
+static HeapConfig heap_config;
+static HeapStats heap_stats_;
+static size_t threshold;
+
+/*
+ * Arena mode: a chain of chunks, the head is the one we bump-allocate
+ * from. Chunks come from calloc() and are never reused, so arena memory
+ * is zeroed already.
+ */
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_ALIGN 16
+#define ARENA_LIMIT ((size_t) 1 << 30)
+#define ARENA_HEADER ((sizeof(ArenaChunk) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    char *pos;
+    char *end;
+} ArenaChunk;
+
+static ArenaChunk *arena;
+
+
+void heap_config_init(HeapConfig *config)
+{
+    *config = (HeapConfig) {
+        .initial_capacity = 16384,
+        .min_capacity = 16384,
+        .downsize_factor = 0.2,
+        .upsize_factor = 0.8,
+        .sweep_factor = 0.5,
+        .initial_heap = 1 << 20,
+        .max_heap = 0,
+        .arena = false
+    };
+}
+
+static bool parse_size(const char *str, size_t *size)
+{
+    /* accepts plain byte counts and K, M, G suffixes, but nothing that
+     * doesn't fit in a size_t */
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(str, &end, 10);
+    if (!isdigit((unsigned char) *str) || errno == ERANGE) return false;
+    unsigned shift = 0;
+    switch (*end) {
+    case 'G':
+    case 'g':
+        shift = 30;
+        end++;
+        break;
+    case 'M':
+    case 'm':
+        shift = 20;
+        end++;
+        break;
+    case 'K':
+    case 'k':
+        shift = 10;
+        end++;
+        break;
+    default:
+        break;
+    }
+    if (*end != '\0' || n > SIZE_MAX >> shift) return false;
+    *size = (size_t) n << shift;
+    return true;
+}
+
+static bool parse_factor(const char *str, double *factor)
+{
+    char *end;
+    double f = strtod(str, &end);
+    if (end == str || *end != '\0' || f <= 0.0 || f >= 1.0) return false;
+    *factor = f;
+    return true;
+}
+
+bool heap_config_set(HeapConfig *config, const char *name, const char *value)
+{
+    if (strcmp(name, "initial-capacity") == 0) {
+        return parse_size(value, &config->initial_capacity);
+    } else if (strcmp(name, "min-capacity") == 0) {
+        return parse_size(value, &config->min_capacity);
+    } else if (strcmp(name, "downsize-factor") == 0) {
+        return parse_factor(value, &config->downsize_factor);
+    } else if (strcmp(name, "upsize-factor") == 0) {
+        return parse_factor(value, &config->upsize_factor);
+    } else if (strcmp(name, "sweep-factor") == 0) {
+        return parse_factor(value, &config->sweep_factor);
+    } else if (strcmp(name, "initial-heap") == 0) {
+        return parse_size(value, &config->initial_heap);
+    } else if (strcmp(name, "max-heap") == 0) {
+        return parse_size(value, &config->max_heap);
+    }
+    return false;
+}
+
+static void heap_update_threshold()
+{
+    threshold = (size_t) (heap_stats_.live_bytes / heap_config.sweep_factor);
+    if (threshold < heap_config.initial_heap) {
+        threshold = heap_config.initial_heap;
+    }
+    if (heap_config.max_heap && threshold > heap_config.max_heap) {
+        threshold = heap_config.max_heap;
+    }
+}
+
+static void arena_report()
+{
+    fprintf(stderr, "arena: peak usage %lu bytes (%lu bytes reserved)\n",
+            heap_stats_.peak_heap, heap_stats_.arena_reserved);
+}
+
+void heap_start(const HeapConfig *config, void *bos)
+{
+    if (config) {
+        heap_config = *config;
+    } else {
+        heap_config_init(&heap_config);
+    }
+    memset(&heap_stats_, 0, sizeof(HeapStats));
+    if (heap_config.arena) {
+        if (!heap_config.max_heap) {
+            heap_config.max_heap = ARENA_LIMIT;
+        }
+        atexit(arena_report);
+        return;
+    }
+    heap_update_threshold();
+    gc_start_ext(&gc, bos,
+                 heap_config.initial_capacity, heap_config.min_capacity,
+                 heap_config.downsize_factor, heap_config.upsize_factor,
+                 heap_config.sweep_factor);
+    gc_pause(&gc);
+}
+
+void heap_stop()
+{
+    if (heap_config.arena) {
+        while (arena) {
+            ArenaChunk *next = arena->next;
+            free(arena);
+            arena = next;
+        }
+        return;
+    }
+    gc_stop(&gc);
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+size_t heap_collect()
+{
+    if (heap_config.arena) {
+        return 0;
+    }
+    double start = now_ms();
+    size_t freed = gc_run(&gc);
+    double pause = now_ms() - start;
+    heap_stats_.collections++;
+    heap_stats_.pause_total += pause;
+    if (pause > heap_stats_.pause_max) {
+        heap_stats_.pause_max = pause;
+    }
+    heap_stats_.heap_size -= freed < heap_stats_.heap_size ? freed : heap_stats_.heap_size;
+    heap_stats_.live_bytes = heap_stats_.heap_size;
+    heap_update_threshold();
+    return freed;
+}
+
+const HeapStats *heap_stats()
+{
+    return &heap_stats_;
+}
+
+static bool heap_exceeds(size_t size, size_t limit)
+{
+    /* heap_size + size > limit, without overflowing */
+    return heap_stats_.heap_size > limit || size > limit - heap_stats_.heap_size;
+}
+
+static bool heap_reserve(size_t size)
+{
+    /* accounts for size more bytes, false if they exceed the heap limit */
+    if (!heap_config.arena && heap_exceeds(size, threshold)) {
+        heap_collect();
+    }
+    if (heap_config.max_heap && heap_exceeds(size, heap_config.max_heap)) {
+        return false;
+    }
+    heap_stats_.heap_size += size;
+    heap_stats_.bytes_allocated += size;
+    if (heap_stats_.heap_size > heap_stats_.peak_heap) {
+        heap_stats_.peak_heap = heap_stats_.heap_size;
+    }
+    return true;
+}
+
+static void *arena_alloc(size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+    if (arena && (size_t) (arena->end - arena->pos) >= size) {
+        void *ptr = arena->pos;
+        arena->pos += size;
+        return ptr;
+    }
+    size_t n = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+    ArenaChunk *chunk = calloc(1, ARENA_HEADER + n);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->pos = (char *) chunk + ARENA_HEADER;
+    chunk->end = chunk->pos + n;
+    heap_stats_.arena_reserved += n;
+    if (arena && size > ARENA_CHUNK_SIZE) {
+        /* oversized: keep allocating from the current chunk */
+        chunk->next = arena->next;
+        arena->next = chunk;
+    } else {
+        chunk->next = arena;
+        arena = chunk;
+    }
+    chunk->pos += size;
+    return chunk->pos - size;
+}
+
+static void *heap_try_alloc(size_t count, size_t size, bool zeroed, void (*dtor)(void *))
+{
+    /* count blocks of size bytes, NULL if they don't fit under the heap
+     * limit or the system can't provide them */
+    if ((count && size > SIZE_MAX / count) || !heap_reserve(count * size)) {
+        return NULL;
+    }
+    void *ptr;
+    if (heap_config.arena) {
+        ptr = arena_alloc(count * size);
+    } else if (zeroed) {
+        ptr = gc_calloc_ext(&gc, count, size, dtor);
+    } else {
+        ptr = gc_malloc_ext(&gc, count * size, dtor);
+    }
+    if (!ptr) {
+        heap_stats_.heap_size -= count * size;
+        heap_stats_.bytes_allocated -= count * size;
+    }
+    return ptr;
+}
+
+static void *heap_alloc(size_t count, size_t size, bool zeroed, void (*dtor)(void *))
+{
+    /* like heap_try_alloc(), but failing is fatal */
+    void *ptr = heap_try_alloc(count, size, zeroed, dtor);
+    if (!ptr && count && size) {
+        /* malloc(0) may return NULL */
+        if (size > SIZE_MAX / count) {
+            LOG_CRITICAL("Out of memory: allocating %lu blocks of %lu bytes overflows", count, size);
+        } else if (heap_config.max_heap && heap_exceeds(count * size, heap_config.max_heap)) {
+            LOG_CRITICAL("Out of memory: allocating %lu bytes exceeds the heap limit of %lu bytes",
+                         count * size, heap_config.max_heap);
+        } else {
+            LOG_CRITICAL("Out of memory: failed to allocate %lu bytes", count * size);
+        }
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void *heap_malloc(size_t size)
+{
+    /* with the profiler on, it learns when the collector frees the block */
+    return heap_alloc(1, size, false, profile_enabled ? profile_free : NULL);
+}
+
+void *heap_try_malloc(size_t size)
+{
+    return heap_try_alloc(1, size, false, profile_enabled ? profile_free : NULL);
+}
+
+void *heap_calloc(size_t count, size_t size)
+{
+    return heap_alloc(count, size, true, profile_enabled ? profile_free : NULL);
+}
+
+void *heap_malloc_dtor(size_t size, void (*dtor)(void *))
+{
+    /* not seen by the allocation profiler, which needs the dtor slot itself */
+    return heap_alloc(1, size, false, dtor);
+}
+
+char *heap_strdup(const char *str)
+{
+    size_t n = strlen(str) + 1;
+    char *copy = heap_malloc(n);
+    memcpy(copy, str, n);
+    return copy;
+}
+
+void heap_free(void *ptr, size_t size)
+{
+    /* the caller vouches for the size, we cannot look it up; gc_free()
+     * runs the block's dtor, which tells the profiler */
+    if (ptr && !heap_config.arena) {
+        gc_free(&gc, ptr);
+        heap_stats_.heap_size -= size < heap_stats_.heap_size ? size : heap_stats_.heap_size;
+    }
+}
+
+void *heap_make_static(void *ptr)
+{
+    if (heap_config.arena) {
+        return ptr;
+    }
+    return gc_make_static(&gc, ptr);
+}
@@ -31,12 +31,14 @@ Value *ir_from_ast_atom(AstAtom *atom)
 
 Value *ir_from_ast_list(AstList *ast_list)
 {
-    if (ast_list->node.type == AST_LIST_EMPTY) {
-        return value_new_list(NULL);
+    /* walk the list instead of recursing per element */
+    ListBuilder items;
+    list_builder_init(&items);
+    for (AstList *l = ast_list; l->node.type != AST_LIST_EMPTY; l = l->as.compound.list) {
+        list_builder_append(&items, ir_from_ast_sexpr(l->as.compound.sexpr));
     }
-    Value *sexpr = ir_from_ast_sexpr(ast_list->as.compound.sexpr);
-    Value *list = ir_from_ast_list(ast_list->as.compound.list);
-    list->value.list = list_cons(list->value.list, sexpr);
+    Value *list = value_new_list(NULL);
+    LIST(list) = list_builder_finish(&items);
     return list;
 }
 
@@ -0,0 +1,803 @@
+#include "json.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+#include "exc.h"
+#include "fpconv.h"
+#include "heap.h"
+#include "list.h"
+#include "scan.h"
+
+/* the reader fills its window in blocks of this size */
+#define JSON_READER_BLOCK (1 << 20)
+
+typedef enum {
+    JSON_STEP_DONE,     /* a complete document was read */
+    JSON_STEP_MORE,     /* the input ended within the document */
+    JSON_STEP_ERROR
+} JsonStep;
+
+/* offsets of the structural characters, in input order */
+typedef struct {
+    uint32_t *pos;
+    size_t size;
+    size_t capacity;
+} JsonIndex;
+
+typedef struct {
+    const char *buf;
+    size_t len;
+    const void *base;   /* managed block holding buf, if any */
+    bool partial;       /* more input may follow buf[len - 1] */
+    JsonIndex ix;
+    size_t next;        /* next entry of ix to look at */
+    const char *error;
+    size_t error_at;
+} JsonParser;
+
+struct JsonReader {
+    FILE *fp;
+    char *buf;          /* the current window, strings read from it share its bytes */
+    size_t offset;      /* of buf[0] in the stream */
+    bool eof;
+    JsonParser p;
+};
+
+enum { JSON_ARRAY, JSON_OBJECT };
+
+typedef struct {
+    int type;
+    Value *key;         /* key of the object member being read */
+    ListBuilder list;   /* elements of an array */
+    const BTree *map;   /* members of an object */
+} JsonFrame;
+
+
+static void json_parser_init(JsonParser *p, const char *buf, size_t len,
+                             const void *base, bool partial)
+{
+    *p = (JsonParser) {
+        .buf = buf, .len = len, .base = base, .partial = partial,
+        .ix = { .pos = NULL, .size = 0, .capacity = 0 },
+        .next = 0, .error = NULL, .error_at = 0
+    };
+}
+
+static JsonStep json_error(JsonParser *p, const char *error, size_t at)
+{
+    p->error = error;
+    p->error_at = at;
+    return JSON_STEP_ERROR;
+}
+
+/*
+ * Stage 1: the structural index
+ */
+
+static uint64_t prefix_xor(uint64_t x)
+{
+    /* bit i becomes the parity of bits 0..i */
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/*
+ * Flags the bytes that follow an odd-length run of backslashes, i.e. the
+ * escaped ones. *prev carries a pending escape over into the next block.
+ */
+static uint64_t json_escaped(uint64_t backslash, uint64_t *prev)
+{
+    const uint64_t even = 0x5555555555555555ull;
+    backslash &= ~*prev;
+    uint64_t follows = backslash << 1 | *prev;
+    uint64_t odd_starts = backslash & ~even & ~follows;
+    uint64_t runs;
+    *prev = __builtin_add_overflow(odd_starts, backslash, &runs);
+    return (even ^ (runs << 1)) & follows;
+}
+
+static bool json_index_reserve(JsonIndex *ix, size_t n)
+{
+    /* false if out of memory, the index is unchanged then */
+    if (ix->size + n <= ix->capacity) {
+        return true;
+    }
+    size_t capacity = ix->capacity ? ix->capacity : 1024;
+    while (ix->size + n > capacity) {
+        capacity *= 2;
+    }
+    uint32_t *pos = realloc(ix->pos, capacity * sizeof(uint32_t));
+    if (!pos) {
+        return false;
+    }
+    ix->pos = pos;
+    ix->capacity = capacity;
+    return true;
+}
+
+static JsonStep json_index(JsonParser *p)
+{
+    /* quotes, the structural characters outside of strings and the
+     * first byte of every number and literal */
+    uint64_t prev_escaped = 0, prev_in_string = 0, prev_scalar = 0;
+    char tail[SCAN_JSON_BLOCK];
+    p->ix.size = 0;
+    p->next = 0;
+    if (p->len > UINT32_MAX) {
+        return json_error(p, "input too large", 0);
+    }
+    for (size_t at = 0; at < p->len; at += SCAN_JSON_BLOCK) {
+        const char *block = p->buf + at;
+        if (p->len - at < SCAN_JSON_BLOCK) {
+            /* don't read past the end, the last block is padded with blanks */
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, p->len - at);
+            block = tail;
+        }
+        ScanJsonBlock m;
+        scan_json_block(block, &m);
+        uint64_t quote = m.quote & ~json_escaped(m.backslash, &prev_escaped);
+        /* from each opening quote up to, but excluding, its closing quote */
+        uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = (uint64_t) ((int64_t) in_string >> 63);
+        uint64_t control = m.control & in_string;
+        if (control) {
+            return json_error(p, "control character in string", at + __builtin_ctzll(control));
+        }
+        uint64_t scalar = ~(m.op | m.space | m.quote);
+        uint64_t scalar_start = scalar & ~(scalar << 1 | prev_scalar);
+        prev_scalar = scalar >> 63;
+        uint64_t structural = quote | ((m.op | scalar_start) & ~in_string);
+
+        if (!json_index_reserve(&p->ix, SCAN_JSON_BLOCK)) {
+            return json_error(p, "out of memory", at);
+        }
+        uint32_t *out = p->ix.pos + p->ix.size;
+        while (structural) {
+            *out++ = (uint32_t) (at + __builtin_ctzll(structural));
+            structural &= structural - 1;
+        }
+        p->ix.size = out - p->ix.pos;
+    }
+    return JSON_STEP_DONE;
+}
+
+/*
+ * Stage 2: building the values
+ */
+
+static int json_key_cmp(const void *a, const void *b)
+{
+    /* objects are sorted maps keyed by strings in the order of <, and
+     * keys of any other type added to them later fail to compare */
+    const Value *x = a, *y = b;
+    if (x->type != VALUE_STRING || y->type != VALUE_STRING) {
+        exc_set(value_make_exception("maps read from JSON require string keys"));
+        return BTREE_ERROR;
+    }
+    return value_string_cmp(x, y);
+}
+
+/* the stack of frames is an Array, which the collector scans, so it sees
+ * the partial arrays and objects */
+static JsonFrame *json_stack_push(Array *stack, int type)
+{
+    JsonFrame frame = {
+        .type = type,
+        .key = NULL,
+        .map = type == JSON_OBJECT ? btree_new(json_key_cmp) : NULL
+    };
+    list_builder_init(&frame.list);
+    array_push_back(stack, &frame, 1);
+    return array_typed_at(stack, array_size(stack) - 1, JsonFrame);
+}
+
+static Value *json_frame_finish(JsonFrame *frame)
+{
+    if (frame->type == JSON_OBJECT) {
+        return value_new_sorted(VALUE_SORTED_MAP, frame->map);
+    }
+    Value *value = value_new_list(NULL);
+    LIST(value) = list_builder_finish(&frame->list);
+    return value;
+}
+
+static bool json_hex4(const char *s, size_t n, unsigned int *cp)
+{
+    if (n < 4) {
+        return false;
+    }
+    *cp = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = s[i];
+        unsigned int d;
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            d = (c | 0x20) - 'a' + 10;
+        } else {
+            return false;
+        }
+        *cp = *cp << 4 | d;
+    }
+    return true;
+}
+
+static size_t json_utf8(char *dst, unsigned int cp)
+{
+    if (cp < 0x80) {
+        dst[0] = (char) cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        dst[0] = (char) (0xc0 | cp >> 6);
+        dst[1] = (char) (0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        dst[0] = (char) (0xe0 | cp >> 12);
+        dst[1] = (char) (0x80 | (cp >> 6 & 0x3f));
+        dst[2] = (char) (0x80 | (cp & 0x3f));
+        return 3;
+    }
+    dst[0] = (char) (0xf0 | cp >> 18);
+    dst[1] = (char) (0x80 | (cp >> 12 & 0x3f));
+    dst[2] = (char) (0x80 | (cp >> 6 & 0x3f));
+    dst[3] = (char) (0x80 | (cp & 0x3f));
+    return 4;
+}
+
+static JsonStep json_unescape(JsonParser *p, const char *s, size_t n, Value **v)
+{
+    /* the result is never longer than the escaped text */
+    char *buf = heap_malloc(n + 1);
+    size_t len = 0;
+    size_t i = 0;
+    while (i < n) {
+        const char *bs = memchr(s + i, '\\', n - i);
+        size_t run = bs ? (size_t) (bs - s) - i : n - i;
+        memcpy(buf + len, s + i, run);
+        len += run;
+        i += run;
+        if (!bs) {
+            break;
+        }
+        if (++i == n) {
+            goto bad;
+        }
+        unsigned int cp, lo;
+        switch (s[i++]) {
+        case '"':
+        case '\\':
+        case '/':
+            buf[len++] = s[i - 1];
+            break;
+        case 'b':
+            buf[len++] = '\b';
+            break;
+        case 'f':
+            buf[len++] = '\f';
+            break;
+        case 'n':
+            buf[len++] = '\n';
+            break;
+        case 'r':
+            buf[len++] = '\r';
+            break;
+        case 't':
+            buf[len++] = '\t';
+            break;
+        case 'u':
+            if (!json_hex4(s + i, n - i, &cp)) {
+                goto bad;
+            }
+            i += 4;
+            if (cp >= 0xdc00 && cp < 0xe000) {
+                goto bad;
+            }
+            if (cp >= 0xd800 && cp < 0xdc00) {
+                /* a surrogate pair */
+                if (!(n - i >= 6 && s[i] == '\\' && s[i + 1] == 'u'
+                      && json_hex4(s + i + 2, n - i - 2, &lo)
+                      && lo >= 0xdc00 && lo < 0xe000)) {
+                    goto bad;
+                }
+                i += 6;
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            len += json_utf8(buf + len, cp);
+            break;
+        default:
+            goto bad;
+        }
+    }
+    *v = value_new_string_owned(buf, len);
+    return JSON_STEP_DONE;
+bad:
+    heap_free(buf, n + 1);
+    return json_error(p, "invalid escape sequence", (size_t) (s - p->buf) + i - 1);
+}
+
+static JsonStep json_string(JsonParser *p, size_t at, Value **v)
+{
+    /* inside a string only quotes are indexed, the next entry closes it */
+    if (p->next >= p->ix.size) {
+        return JSON_STEP_MORE;
+    }
+    size_t end = p->ix.pos[p->next++];
+    const char *s = p->buf + at + 1;
+    size_t n = end - at - 1;
+    if (memchr(s, '\\', n)) {
+        return json_unescape(p, s, n, v);
+    }
+    *v = p->base ? value_new_string_slice(p->base, s, n) : value_new_string_len(s, n);
+    return JSON_STEP_DONE;
+}
+
+static bool json_number(const char *s, size_t n, Value **v)
+{
+    /* -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+    size_t i = 0;
+    bool integral = true;
+    if (s[i] == '-') {
+        i++;
+    }
+    size_t digits = i;
+    if (i < n && s[i] == '0') {
+        i++;
+    } else {
+        while (i < n && s[i] >= '0' && s[i] <= '9') {
+            i++;
+        }
+    }
+    if (i == digits) {
+        return false;
+    }
+    digits = i - digits;
+    if (i < n && s[i] == '.') {
+        size_t frac = ++i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') {
+            i++;
+        }
+        if (i == frac) {
+            return false;
+        }
+        integral = false;
+    }
+    if (i < n && (s[i] | 0x20) == 'e') {
+        if (++i < n && (s[i] == '+' || s[i] == '-')) {
+            i++;
+        }
+        size_t exp = i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') {
+            i++;
+        }
+        if (i == exp) {
+            return false;
+        }
+        integral = false;
+    }
+    if (i != n) {
+        return false;
+    }
+    if (integral && digits <= 10) {
+        long x = 0;
+        for (i = s[0] == '-'; i < n; ++i) {
+            x = 10 * x + (s[i] - '0');
+        }
+        x = s[0] == '-' ? -x : x;
+        if (x >= INT_MIN && x <= INT_MAX) {
+            *v = value_new_int((int) x);
+            return true;
+        }
+    }
+    double d;
+    if (!fpconv_strtod(s, n, &d)) {
+        return false;
+    }
+    *v = value_new_float(d);
+    return true;
+}
+
+static JsonStep json_scalar(JsonParser *p, size_t at, Value **v)
+{
+    size_t end = at;
+    while (end < p->len) {
+        char c = p->buf[end];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ','
+            || c == ']' || c == '}' || c == ':' || c == '[' || c == '{' || c == '"') {
+            break;
+        }
+        end++;
+    }
+    if (end == p->len && p->partial) {
+        return JSON_STEP_MORE;
+    }
+    const char *s = p->buf + at;
+    size_t n = end - at;
+    switch (*s) {
+    case 't':
+        if (n == 4 && memcmp(s, "true", 4) == 0) {
+            *v = VALUE_CONST_TRUE;
+            return JSON_STEP_DONE;
+        }
+        break;
+    case 'f':
+        if (n == 5 && memcmp(s, "false", 5) == 0) {
+            *v = VALUE_CONST_FALSE;
+            return JSON_STEP_DONE;
+        }
+        break;
+    case 'n':
+        if (n == 4 && memcmp(s, "null", 4) == 0) {
+            *v = VALUE_CONST_NIL;
+            return JSON_STEP_DONE;
+        }
+        break;
+    default:
+        if (json_number(s, n, v)) {
+            return JSON_STEP_DONE;
+        }
+    }
+    return json_error(p, "invalid literal", at);
+}
+
+static JsonStep json_key(JsonParser *p, JsonFrame *frame)
+{
+    /* "key" : */
+    if (p->next >= p->ix.size) {
+        return JSON_STEP_MORE;
+    }
+    size_t at = p->ix.pos[p->next++];
+    if (p->buf[at] != '"') {
+        return json_error(p, "expected a string key", at);
+    }
+    JsonStep step = json_string(p, at, &frame->key);
+    if (step != JSON_STEP_DONE) {
+        return step;
+    }
+    if (p->next >= p->ix.size) {
+        return JSON_STEP_MORE;
+    }
+    at = p->ix.pos[p->next++];
+    if (p->buf[at] != ':') {
+        return json_error(p, "expected ':'", at);
+    }
+    return JSON_STEP_DONE;
+}
+
+static JsonStep json_parse(JsonParser *p, Value **v)
+{
+    /* reads one document, starting at the next entry of the index */
+    Array *stack = array_new(sizeof(JsonFrame));
+    JsonStep step;
+    *v = NULL;
+    while (true) {
+        if (p->next >= p->ix.size) {
+            step = JSON_STEP_MORE;
+            goto out;
+        }
+        size_t at = p->ix.pos[p->next++];
+        Value *value = NULL;
+        switch (p->buf[at]) {
+        case '[':
+        case '{': {
+            int type = p->buf[at] == '[' ? JSON_ARRAY : JSON_OBJECT;
+            JsonFrame *frame = json_stack_push(stack, type);
+            if (p->next >= p->ix.size) {
+                step = JSON_STEP_MORE;
+                goto out;
+            }
+            if (p->buf[p->ix.pos[p->next]] != (type == JSON_ARRAY ? ']' : '}')) {
+                if (type == JSON_OBJECT
+                    && (step = json_key(p, frame)) != JSON_STEP_DONE) {
+                    goto out;
+                }
+                continue;
+            }
+            p->next++;
+            value = json_frame_finish(array_typed_pop_back(stack, JsonFrame));
+            break;
+        }
+        case '"':
+            if ((step = json_string(p, at, &value)) != JSON_STEP_DONE) {
+                goto out;
+            }
+            break;
+        case ']':
+        case '}':
+        case ',':
+        case ':':
+            step = json_error(p, "unexpected character", at);
+            goto out;
+        default:
+            if ((step = json_scalar(p, at, &value)) != JSON_STEP_DONE) {
+                goto out;
+            }
+        }
+        /* a complete value ends up in the innermost open array or object,
+         * or is the result; it may complete the arrays and objects around it */
+        while (true) {
+            if (array_size(stack) == 0) {
+                *v = value;
+                step = JSON_STEP_DONE;
+                goto out;
+            }
+            JsonFrame *frame = array_typed_at(stack, array_size(stack) - 1, JsonFrame);
+            if (frame->type == JSON_OBJECT) {
+                /* string keys always compare, a repeated key keeps the
+                 * last value */
+                frame->map = btree_insert(frame->map, frame->key, value);
+                frame->key = NULL;
+            } else {
+                list_builder_append(&frame->list, value);
+            }
+            if (p->next >= p->ix.size) {
+                step = JSON_STEP_MORE;
+                goto out;
+            }
+            at = p->ix.pos[p->next++];
+            if (p->buf[at] == ',') {
+                if (frame->type == JSON_OBJECT && (step = json_key(p, frame)) != JSON_STEP_DONE) {
+                    goto out;
+                }
+                break;
+            }
+            if (p->buf[at] != (frame->type == JSON_ARRAY ? ']' : '}')) {
+                step = json_error(p, "expected ',' or the end of the array or object", at);
+                goto out;
+            }
+            value = json_frame_finish(array_typed_pop_back(stack, JsonFrame));
+        }
+    }
+out:
+    array_delete(stack);
+    return step;
+}
+
+Value *json_read(const char *buf, size_t len, const void *base)
+{
+    JsonParser p;
+    json_parser_init(&p, buf, len, base, false);
+    Value *v = NULL;
+    JsonStep step = json_index(&p);
+    if (step == JSON_STEP_DONE) {
+        step = json_parse(&p, &v);
+    }
+    if (step == JSON_STEP_DONE && p.next < p.ix.size) {
+        step = json_error(&p, "unexpected data after the document", p.ix.pos[p.next]);
+    }
+    if (step == JSON_STEP_MORE) {
+        step = json_error(&p, "unexpected end of input", len);
+    }
+    free(p.ix.pos);
+    if (step != JSON_STEP_DONE) {
+        exc_set(value_make_exception("Invalid JSON at offset %lu: %s",
+                                     (unsigned long) p.error_at, p.error));
+        return NULL;
+    }
+    return v;
+}
+
+/*
+ * Streaming
+ */
+
+JsonReader *json_reader_new(FILE *fp)
+{
+    /* managed, so the collector sees the window while the reader is in use */
+    JsonReader *r = heap_malloc(sizeof(JsonReader));
+    r->fp = fp;
+    r->buf = NULL;
+    r->offset = 0;
+    r->eof = false;
+    json_parser_init(&r->p, NULL, 0, NULL, true);
+    return r;
+}
+
+void json_reader_delete(JsonReader *r)
+{
+    free(r->p.ix.pos);
+    heap_free(r, sizeof(JsonReader));
+}
+
+static JsonStep json_reader_fill(JsonReader *r)
+{
+    /* moves the unread part of the window into a new window, followed by
+     * the next block. The old window is left to the collector: strings
+     * read so far still point into it. */
+    JsonParser *p = &r->p;
+    size_t keep = p->next < p->ix.size ? p->ix.pos[p->next] : p->len;
+    size_t rest = p->len - keep;
+    size_t capacity = 2 * rest > JSON_READER_BLOCK ? 2 * rest : JSON_READER_BLOCK;
+    char *buf = heap_malloc(capacity);
+    if (rest) {
+        memcpy(buf, p->buf + keep, rest);
+    }
+    size_t n = fread(buf + rest, 1, capacity - rest, r->fp);
+    if (n < capacity - rest) {
+        if (ferror(r->fp)) {
+            return json_error(p, strerror(errno), p->len);
+        }
+        r->eof = true;
+    }
+    r->buf = buf;
+    r->offset += keep;
+    p->buf = buf;
+    p->len = rest + n;
+    p->base = buf;
+    p->partial = !r->eof;
+    return json_index(p);
+}
+
+JsonResult json_reader_next(JsonReader *r, Value **v)
+{
+    JsonParser *p = &r->p;
+    while (true) {
+        size_t first = p->next;
+        JsonStep step = json_parse(p, v);
+        if (step == JSON_STEP_DONE) {
+            return JSON_OK;
+        }
+        if (step == JSON_STEP_MORE) {
+            /* read the document again once there's more input */
+            p->next = first;
+            if (!r->eof) {
+                if ((step = json_reader_fill(r)) == JSON_STEP_DONE) {
+                    continue;
+                }
+            } else if (first == p->ix.size) {
+                return JSON_EOF;
+            } else {
+                step = json_error(p, "unexpected end of input", p->len);
+            }
+        }
+        exc_set(value_make_exception("Invalid JSON at offset %lu: %s",
+                                     (unsigned long) (r->offset + p->error_at), p->error));
+        return JSON_FAIL;
+    }
+}
+
+/*
+ * Writing
+ */
+
+static void json_write_string(Printer *p, const char *s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    printer_write_char(p, '"');
+    size_t run = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char) s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        printer_write(p, s + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"':
+            printer_write(p, "\\\"", 2);
+            break;
+        case '\\':
+            printer_write(p, "\\\\", 2);
+            break;
+        case '\n':
+            printer_write(p, "\\n", 2);
+            break;
+        case '\r':
+            printer_write(p, "\\r", 2);
+            break;
+        case '\t':
+            printer_write(p, "\\t", 2);
+            break;
+        default: {
+            char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+            printer_write(p, u, sizeof(u));
+        }
+        }
+    }
+    printer_write(p, s + run, len - run);
+    printer_write_char(p, '"');
+}
+
+bool json_write(Printer *p, const Value *v)
+{
+    switch (v->type) {
+    case VALUE_NIL:
+        printer_write(p, "null", 4);
+        break;
+    case VALUE_BOOL:
+        if (BOOL(v)) {
+            printer_write(p, "true", 4);
+        } else {
+            printer_write(p, "false", 5);
+        }
+        break;
+    case VALUE_INT:
+        printer_write_int(p, INT(v));
+        break;
+    case VALUE_FLOAT:
+        if (!isfinite(FLOAT(v))) {
+            exc_set(value_make_exception("JSON has no representation for %s",
+                                         isnan(FLOAT(v)) ? "nan" : "inf"));
+            return false;
+        }
+        printer_write_float(p, FLOAT(v));
+        break;
+    case VALUE_STRING:
+    case VALUE_SYMBOL:
+        json_write_string(p, STRING_PTR(v), STRING_LEN(v));
+        break;
+    case VALUE_LIST:
+        printer_write_char(p, '[');
+        for (const ListItem *i = LIST(v)->begin; i != NULL; i = i->next) {
+            if (i != LIST(v)->begin) {
+                printer_write_char(p, ',');
+            }
+            if (!json_write(p, i->p)) {
+                return false;
+            }
+        }
+        printer_write_char(p, ']');
+        break;
+    case VALUE_SORTED_MAP: {
+        BTreeIter it;
+        btree_iter_init(&it, BTREE(v), NULL);
+        printer_write_char(p, '{');
+        for (const BTreeEntry *e = btree_iter_next(&it); e != NULL; ) {
+            const Value *key = e->key;
+            if (key->type != VALUE_STRING && key->type != VALUE_SYMBOL) {
+                exc_set(value_make_exception("JSON object keys must be strings"));
+                return false;
+            }
+            json_write_string(p, STRING_PTR(key), STRING_LEN(key));
+            printer_write_char(p, ':');
+            if (!json_write(p, e->value)) {
+                return false;
+            }
+            if ((e = btree_iter_next(&it)) != NULL) {
+                printer_write_char(p, ',');
+            }
+        }
+        printer_write_char(p, '}');
+        break;
+    }
+    case VALUE_F64_VECTOR:
+    case VALUE_I64_VECTOR:
+    case VALUE_LAZY_SEQ: {
+        /* always an array, a lazy sequence is realized once */
+        SeqIter it;
+        value_seq_iter_init(&it, v);
+        printer_write_char(p, '[');
+        for (Value *item = value_seq_iter_next(&it); item != NULL; ) {
+            if (!json_write(p, item)) {
+                return false;
+            }
+            if ((item = value_seq_iter_next(&it)) != NULL) {
+                printer_write_char(p, ',');
+            }
+        }
+        if (exc_is_pending()) {
+            return false;
+        }
+        printer_write_char(p, ']');
+        break;
+    }
+    default:
+        exc_set(value_make_exception("JSON has no representation for a value of type %s",
+                                     value_type_names[v->type]));
+        return false;
+    }
+    return true;
+}
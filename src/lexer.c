@@ -1,7 +1,15 @@
 #include "lexer.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fpconv.h"
+#include "log.h"
+#include "scan.h"
 
 const char *token_type_names[] = {
     "LEXER_TOK_ERROR",
@@ -18,9 +26,43 @@ const char *token_type_names[] = {
     "LEXER_TOK_EOF"
 };
 
-static char *symbol_chars = "!&*+-0123456789<=>?@"
-                            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                            "abcdefghijklmnopqrstuvwxyz";
+/* character classes */
+#define CC_SYMBOL 0x01  /* may appear in a symbol */
+#define CC_SPACE  0x02  /* whitespace */
+
+/* spelled out, range designators aren't standard C */
+static const unsigned char char_class[256] = {
+    ['!'] = CC_SYMBOL,
+    ['&'] = CC_SYMBOL,
+    ['*'] = CC_SYMBOL,
+    ['+'] = CC_SYMBOL,
+    ['-'] = CC_SYMBOL,
+    ['0'] = CC_SYMBOL, ['1'] = CC_SYMBOL, ['2'] = CC_SYMBOL, ['3'] = CC_SYMBOL, ['4'] = CC_SYMBOL,
+    ['5'] = CC_SYMBOL, ['6'] = CC_SYMBOL, ['7'] = CC_SYMBOL, ['8'] = CC_SYMBOL, ['9'] = CC_SYMBOL,
+    ['<'] = CC_SYMBOL,
+    ['='] = CC_SYMBOL,
+    ['>'] = CC_SYMBOL,
+    ['?'] = CC_SYMBOL,
+    ['@'] = CC_SYMBOL,
+    ['A'] = CC_SYMBOL, ['B'] = CC_SYMBOL, ['C'] = CC_SYMBOL, ['D'] = CC_SYMBOL, ['E'] = CC_SYMBOL,
+    ['F'] = CC_SYMBOL, ['G'] = CC_SYMBOL, ['H'] = CC_SYMBOL, ['I'] = CC_SYMBOL, ['J'] = CC_SYMBOL,
+    ['K'] = CC_SYMBOL, ['L'] = CC_SYMBOL, ['M'] = CC_SYMBOL, ['N'] = CC_SYMBOL, ['O'] = CC_SYMBOL,
+    ['P'] = CC_SYMBOL, ['Q'] = CC_SYMBOL, ['R'] = CC_SYMBOL, ['S'] = CC_SYMBOL, ['T'] = CC_SYMBOL,
+    ['U'] = CC_SYMBOL, ['V'] = CC_SYMBOL, ['W'] = CC_SYMBOL, ['X'] = CC_SYMBOL, ['Y'] = CC_SYMBOL,
+    ['Z'] = CC_SYMBOL,
+    ['a'] = CC_SYMBOL, ['b'] = CC_SYMBOL, ['c'] = CC_SYMBOL, ['d'] = CC_SYMBOL, ['e'] = CC_SYMBOL,
+    ['f'] = CC_SYMBOL, ['g'] = CC_SYMBOL, ['h'] = CC_SYMBOL, ['i'] = CC_SYMBOL, ['j'] = CC_SYMBOL,
+    ['k'] = CC_SYMBOL, ['l'] = CC_SYMBOL, ['m'] = CC_SYMBOL, ['n'] = CC_SYMBOL, ['o'] = CC_SYMBOL,
+    ['p'] = CC_SYMBOL, ['q'] = CC_SYMBOL, ['r'] = CC_SYMBOL, ['s'] = CC_SYMBOL, ['t'] = CC_SYMBOL,
+    ['u'] = CC_SYMBOL, ['v'] = CC_SYMBOL, ['w'] = CC_SYMBOL, ['x'] = CC_SYMBOL, ['y'] = CC_SYMBOL,
+    ['z'] = CC_SYMBOL,
+    [' '] = CC_SPACE,
+    ['\t'] = CC_SPACE,
+    ['\r'] = CC_SPACE,
+    ['\n'] = CC_SPACE
+};
+
+#define CHAR_CLASS(c) (char_class[(unsigned char) (c)])
 
 typedef enum {
     KEY_BEL =  7,
@@ -32,381 +74,430 @@ typedef enum {
     KEY_CR  = 13
 } EscapeChars;
 
-Lexer *lexer_new(FILE *fp)
+/* pages of a mapped file are dropped in steps of this many bytes */
+#define LEXER_RELEASE_WINDOW (4 << 20)
+/* other input is read in blocks of this many bytes */
+#define LEXER_STREAM_BLOCK (1 << 16)
+
+Lexer *lexer_new(const char *buf, size_t len)
 {
+    scan_init();
     Lexer *lexer = (Lexer *) malloc(sizeof(Lexer));
     *lexer = (Lexer) {
-        .fp = fp,
-        .state = LEXER_STATE_ZERO,
+        .buf = buf,
+        .len = len,
+        .pos = 0,
         .line_no = 1,
-        .char_no = 0
+        .char_no = 0,
+        .line_start = 0,
+        .owned = NULL,
+        .capacity = 0,
+        .stream = NULL,
+        .mapped = 0,
+        .released = 0
     };
     return lexer;
 }
 
-void lexer_delete(Lexer *l)
+static void *lexer_realloc(void *buf, size_t size)
 {
-    free(l);
+    void *grown = realloc(buf, size);
+    if (!grown) {
+        LOG_CRITICAL("Out of memory: failed to allocate %lu bytes for the input", size);
+        exit(EXIT_FAILURE);
+    }
+    return grown;
 }
 
-void lexer_delete_token(LexerToken *t)
+Lexer *lexer_new_file(FILE *fp)
 {
-    if (t) {
-        switch(t->type) {
-        case LEXER_TOK_INT:
-        case LEXER_TOK_FLOAT:
-        case LEXER_TOK_EOF:
-            break;
-        case LEXER_TOK_STRING:
-        case LEXER_TOK_ERROR:
-        case LEXER_TOK_SYMBOL:
-        case LEXER_TOK_LPAREN:
-        case LEXER_TOK_RPAREN:
-        case LEXER_TOK_QUOTE:
-        case LEXER_TOK_QUASIQUOTE:
-        case LEXER_TOK_UNQUOTE:
-        case LEXER_TOK_SPLICE_UNQUOTE:
-            free(t->as.str);
-            break;
+    /* Regular files are mapped, anything else (pipes, memory streams) is
+     * read a block at a time as tokens are asked for, so that memory use
+     * depends on the longest token rather than on the input. */
+    int fd = fileno(fp);
+    struct stat st;
+    if (fd >= 0 && ftell(fp) == 0 && fstat(fd, &st) == 0
+            && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            Lexer *lexer = lexer_new(p, st.st_size);
+            lexer->mapped = st.st_size;
+            return lexer;
         }
-        free(t);
     }
+    char *buf = lexer_realloc(NULL, LEXER_STREAM_BLOCK);
+    Lexer *lexer = lexer_new(buf, 0);
+    lexer->owned = buf;
+    lexer->capacity = LEXER_STREAM_BLOCK;
+    lexer->stream = fp;
+    return lexer;
 }
 
-static LexerToken *lexer_make_token(const Lexer *l,
-                                    const TokenType token_type,
-                                    const char *buf)
+void lexer_delete(Lexer *l)
 {
-    LexerToken *tok = (LexerToken *) malloc(sizeof(LexerToken));
-    if (tok) {
-        tok->type = token_type;
-        tok->line = l->line_no;
-        tok->column = l->char_no;
-        switch(token_type) {
-        case LEXER_TOK_INT:
-            tok->as.int_ = atoi(buf);
-            break;
-        case LEXER_TOK_FLOAT:
-            tok->as.double_ = atof(buf);
-            break;
-        case LEXER_TOK_STRING:
-        case LEXER_TOK_ERROR:
-        case LEXER_TOK_SYMBOL:
-        case LEXER_TOK_LPAREN:
-        case LEXER_TOK_RPAREN:
-        case LEXER_TOK_QUOTE:
-        case LEXER_TOK_QUASIQUOTE:
-        case LEXER_TOK_UNQUOTE:
-        case LEXER_TOK_SPLICE_UNQUOTE:
-            tok->as.str = strdup(buf);
-            break;
-        case LEXER_TOK_EOF:
-            tok->as.str = NULL;
-            break;
+    if (l) {
+        if (l->mapped) {
+            munmap((void *) l->buf, l->mapped);
         }
+        free(l->owned);
+        free(l);
+    }
+}
+
+static void lexer_release(Lexer *l)
+{
+    /* Let the kernel drop the pages of a mapped file that we've scanned
+     * already, so that lexing a large file does not keep all of it
+     * resident. The mapping stays valid, should a token slice be read
+     * again the page is simply faulted back in. */
+    static size_t page_size = 0;
+    if (!page_size) {
+        page_size = (size_t) sysconf(_SC_PAGESIZE);
+    }
+    size_t end = l->pos & ~(page_size - 1);
+    if (end - l->released >= LEXER_RELEASE_WINDOW) {
+        madvise((char *) l->buf + l->released, end - l->released, MADV_DONTNEED);
+        l->released = end;
     }
-    return tok;
 }
 
-static void lexer_advance_next_char(Lexer *l)
+static LexerToken lexer_make_token(Lexer *l, const TokenType token_type,
+                                   size_t start, size_t end)
 {
-    l->char_no++;
+    l->char_no = l->pos - l->line_start;
+    return (LexerToken) {
+        .type = token_type,
+        .offset = start,
+        .length = end - start,
+        .line = l->line_no,
+        .column = l->char_no
+    };
 }
 
 static void lexer_advance_next_line(Lexer *l)
 {
+    /* called with pos just past the line feed */
     l->line_no++;
-    l->char_no = 0;
+    l->line_start = l->pos;
 }
 
-LexerToken *lexer_get_token(Lexer *l)
+static LexerToken lexer_scan_string(Lexer *l, size_t start)
 {
-    char buf[1024] = {0};
-    size_t bufpos = 0;
-    int c;
-    char *pos;
-    while ((c = fgetc(l->fp)) != EOF) {
-        lexer_advance_next_char(l);
-        switch (l->state) {
-        case LEXER_STATE_ZERO:
-            switch(c) {
-            case ';':
-                l->state = LEXER_STATE_COMMENT;
-                break;
-            case '(':
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_LPAREN, buf);
-                break;
-            case ')':
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_RPAREN, buf);
-                break;
-            case '\'':
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_QUOTE, buf);
-                break;
-            case '`':
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_QUASIQUOTE, buf);
-                break;
-            /* start an unquote */
-            case '~':
-                buf[bufpos++] = c;
-                l->state = LEXER_STATE_UNQUOTE;
-                break;
-            /* start a string */
-            case '\"':
-                /* don't put c in the buffer */
-                l->state = LEXER_STATE_STRING;
-                break;
-            /* start  number */
-            case '0' ... '9':
-                buf[bufpos++] = c;
-                l->state = LEXER_STATE_NUMBER;
-                break;
-            /* start a symbol */
-            case 'a' ... 'z':
-            case 'A' ... 'Z':
-            case '+':
-            case '/':
-            case '*':
-            case '<':
-            case '=':
-            case '>':
-            case '&':
-                buf[bufpos++] = c;
-                l->state = LEXER_STATE_SYMBOL;
-                break;
-            case '-':
-                buf[bufpos++] = c;
-                l->state = LEXER_STATE_MINUS;
-                break;
-            /* eat whitespace */
-            case ' ':
-            case '\r':
-            case '\t':
-                break;
-            case '\n':
-                lexer_advance_next_line(l);
-                break;
-            /* error */
-            default:
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_ERROR, buf);
-            }
-            break;
+    /* start is the offset of the opening quote */
+    while ((l->pos = scan_string(l->buf, l->pos, l->len)) < l->len) {
+        char c = l->buf[l->pos++];
+        if (c == '\"') {
+            return lexer_make_token(l, LEXER_TOK_STRING, start + 1, l->pos - 1);
+        }
+        if (c == '\\' && l->pos < l->len) {
+            /* escapes are decoded by lexer_token_copy() */
+            c = l->buf[l->pos++];
+        }
+        if (c == '\n') {
+            lexer_advance_next_line(l);
+        }
+    }
+    return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
+}
 
-        case LEXER_STATE_COMMENT:
-            switch(c) {
-            case '\n':
-                lexer_advance_next_line(l);
-                l->state = LEXER_STATE_ZERO;
-                break;
-            default:
-                /* gobble up everything until EOL */
-                break;
-            }
+static LexerToken lexer_scan_number(Lexer *l, size_t start, TokenType type)
+{
+    /* the caller may have consumed the first digit already */
+    bool digits = l->pos > start && l->buf[l->pos - 1] >= '0' && l->buf[l->pos - 1] <= '9';
+    while (l->pos < l->len) {
+        switch (l->buf[l->pos]) {
+        case '0' ... '9':
+            l->pos++;
+            digits = true;
             break;
-
-        case LEXER_STATE_MINUS:
-            /* This one is a little finicky since we want to allow for
-             * symbols that start with a dash ("-main"), negative numbers
-             * (-1, -2.4, -.7), and the subtraction operator (- 3 1). */
-            switch(c) {
-            case '0' ... '9':
-                buf[bufpos++] = c;
-                l->state = LEXER_STATE_NUMBER;
-                break;
-            case '.':
-                buf[bufpos++] = c;
-                l->state = LEXER_STATE_FLOAT;
-                break;
-            /* start a symbol */
-            case 'a' ... 'z':
-            case 'A' ... 'Z':
-            case '+':
-            case '/':
-            case '*':
-            case '<':
-            case '=':
-            case '>':
-                ungetc(c, l->fp);
-                l->char_no--;
-                l->state = LEXER_STATE_SYMBOL;
-                break;
-            /* minus symbol */
-            case ' ':
-            case '\r':
-            case '\t':
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_SYMBOL, buf);
-                break;
-            case '\n':
-                lexer_advance_next_line(l);
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_SYMBOL, buf);
-                break;
-            /* error */
-            default:
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_ERROR, buf);
-
+        case '.':
+            l->pos++;
+            if (type == LEXER_TOK_FLOAT) {
+                return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
             }
+            type = LEXER_TOK_FLOAT;
             break;
-        case LEXER_STATE_UNQUOTE:
-            l->state = LEXER_STATE_ZERO;
-            if (c == '@') {
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_SPLICE_UNQUOTE, buf);
-            } else {
-                ungetc(c, l->fp);
-                l->char_no--;
-                return lexer_make_token(l, LEXER_TOK_UNQUOTE, buf);
+        case 'e':
+        case 'E':
+            /* an exponent ends the number: [eE][+-]?[0-9]+ */
+            l->pos++;
+            if (!digits) {
+                return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
             }
-            break;
-
-        case LEXER_STATE_STRING:
-            if (c != '\"') {
-                if (c == '\\') {
-                    l->state = LEXER_STATE_ESCAPESTRING;
-                    break;
+            if (l->pos < l->len && (l->buf[l->pos] == '+' || l->buf[l->pos] == '-')) {
+                l->pos++;
+            }
+            if (l->pos == l->len || l->buf[l->pos] < '0' || l->buf[l->pos] > '9') {
+                if (l->pos < l->len) {
+                    l->pos++;
                 }
-                buf[bufpos++] = c;
-                if (c == '\n') lexer_advance_next_line(l);
-            } else {
-                /* don't put c in the buffer */
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_STRING, buf);
+                return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
             }
-            break;
-
-        case LEXER_STATE_ESCAPESTRING:
-            /* supports all C escape sequences except for hex and octal */
-            switch(c) {
-                case '\n':
-                    /* ignore escaped line feeds */
-                    break;
-                case '\\':
-                case '"':
-                    /* keep the char and go back to string processing */
-                    buf[bufpos++] = c;
-                    break;
-                case 'a':
-                    buf[bufpos++] = KEY_BEL;
-                    break;
-                case 'b':
-                    buf[bufpos++] = KEY_BS;
-                    break;
-                case 'f':
-                    buf[bufpos++] = KEY_FF;
-                    break;
-                case 'n':
-                    buf[bufpos++] = KEY_LF;
-                    break;
-                case 'r':
-                    buf[bufpos++] = KEY_CR;
-                    break;
-                case 't':
-                    buf[bufpos++] = KEY_HT;
-                    break;
-                case 'v':
-                    buf[bufpos++] = KEY_VT;
-                    break;
-                default:
-                    /* Invalid escape sequeence. Keep the sequence and go
-                     * back to string processing */
-                    buf[bufpos++] = '\\';
-                    ungetc(c, l->fp);
-                    l->char_no--;
-                    break;
+            while (l->pos < l->len && l->buf[l->pos] >= '0' && l->buf[l->pos] <= '9') {
+                l->pos++;
             }
-            l->state = LEXER_STATE_STRING;
-            break;
+            if (l->pos < l->len && !(CHAR_CLASS(l->buf[l->pos]) & CC_SPACE)
+                && l->buf[l->pos] != '(' && l->buf[l->pos] != ')') {
+                l->pos++;
+                return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
+            }
+            return lexer_make_token(l, LEXER_TOK_FLOAT, start, l->pos);
+        /* delimiters are left for the next token */
+        case '(':
+        case ')':
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            return lexer_make_token(l, type, start, l->pos);
+        default:
+            l->pos++;
+            return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
+        }
+    }
+    return lexer_make_token(l, type, start, l->pos);
+}
+
+static LexerToken lexer_scan_symbol(Lexer *l, size_t start)
+{
+    while (l->pos < l->len && (CHAR_CLASS(l->buf[l->pos]) & CC_SYMBOL)) {
+        l->pos++;
+    }
+    return lexer_make_token(l, LEXER_TOK_SYMBOL, start, l->pos);
+}
 
-        case LEXER_STATE_NUMBER:
-            switch(c) {
-            case '(':
-            case ')':
-                ungetc(c, l->fp);
-                l->char_no--;
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_INT, buf);
-            case '\n':
+static LexerToken lexer_scan_minus(Lexer *l, size_t start)
+{
+    /* This one is a little finicky since we want to allow for
+     * symbols that start with a dash ("-main"), negative numbers
+     * (-1, -2.4, -.7), and the subtraction operator (- 3 1). */
+    if (l->pos == l->len) {
+        return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
+    }
+    switch (l->buf[l->pos]) {
+    case '0' ... '9':
+        return lexer_scan_number(l, start, LEXER_TOK_INT);
+    case '.':
+        l->pos++;
+        return lexer_scan_number(l, start, LEXER_TOK_FLOAT);
+    /* start a symbol */
+    case 'a' ... 'z':
+    case 'A' ... 'Z':
+    case '+':
+    case '/':
+    case '*':
+    case '<':
+    case '=':
+    case '>':
+        return lexer_scan_symbol(l, start);
+    /* minus symbol */
+    case ' ':
+    case '\r':
+    case '\t':
+    case '\n':
+        return lexer_make_token(l, LEXER_TOK_SYMBOL, start, l->pos);
+    /* error */
+    default:
+        l->pos++;
+        return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
+    }
+}
+
+static bool lexer_fill(Lexer *l, size_t keep)
+{
+    /* Reads the next block of the stream, dropping what is buffered
+     * before offset keep. false at the end of the stream. */
+    if (keep > 0) {
+        memmove(l->owned, l->owned + keep, l->len - keep);
+        l->len -= keep;
+        l->pos -= keep;
+        /* may wrap around, pos - line_start is still the column */
+        l->line_start -= keep;
+    } else if (l->len == l->capacity) {
+        /* a single token fills the buffer */
+        l->capacity *= 2;
+        l->owned = lexer_realloc(l->owned, l->capacity);
+    }
+    l->buf = l->owned;
+    size_t n = fread(l->owned + l->len, 1, l->capacity - l->len, l->stream);
+    l->len += n;
+    return n > 0;
+}
+
+static LexerToken lexer_scan_token(Lexer *l)
+{
+    while (l->pos < l->len) {
+        size_t start = l->pos;
+        char c = l->buf[l->pos++];
+        switch (c) {
+        /* eat whitespace */
+        case ' ':
+        case '\r':
+        case '\t':
+        case '\n':
+            if (c == '\n') {
                 lexer_advance_next_line(l);
-            case '\t':
-            case '\r':
-            case ' ':
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_INT, buf);
-            case '.':
-                buf[bufpos++] = c;
-                l->state = LEXER_STATE_FLOAT;
-                break;
-            case '0' ... '9':
-                buf[bufpos++] = c;
-                break;
-            default:
-                /* error */
-                buf[bufpos++] = c;
-                return lexer_make_token(l, LEXER_TOK_ERROR, buf);
             }
-            break;
-        case LEXER_STATE_FLOAT:
-            switch(c) {
-            case '(':
-            case ')':
-                ungetc(c, l->fp);
-                l->char_no--;
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_FLOAT, buf);
-            case '\n':
-                lexer_advance_next_line(l);
-            case '\t':
-            case '\r':
-            case ' ':
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_FLOAT, buf);
-            case '0' ... '9':
-                buf[bufpos++] = c;
-                break;
-            default:
-                /* error */
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_ERROR, buf);
+            /* single separators are the norm, only scan actual runs */
+            if (l->pos < l->len && (CHAR_CLASS(l->buf[l->pos]) & CC_SPACE)) {
+                l->pos = scan_space(l->buf, l->pos, l->len,
+                                    &l->line_no, &l->line_start);
             }
             break;
-        case LEXER_STATE_SYMBOL:
-            pos = strchr(symbol_chars, c);
-            if (pos != NULL) {
-                buf[bufpos++] = c;
-            } else {
-                ungetc(c, l->fp);
-                l->char_no--;
-                l->state = LEXER_STATE_ZERO;
-                return lexer_make_token(l, LEXER_TOK_SYMBOL, buf);
+        case ';':
+            /* gobble up everything until EOL */
+            l->pos = scan_line(l->buf, l->pos, l->len);
+            break;
+        case '(':
+            return lexer_make_token(l, LEXER_TOK_LPAREN, start, l->pos);
+        case ')':
+            return lexer_make_token(l, LEXER_TOK_RPAREN, start, l->pos);
+        case '\'':
+            return lexer_make_token(l, LEXER_TOK_QUOTE, start, l->pos);
+        case '`':
+            return lexer_make_token(l, LEXER_TOK_QUASIQUOTE, start, l->pos);
+        /* unquote or splice-unquote */
+        case '~':
+            if (l->pos == l->len) {
+                return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
+            }
+            if (l->buf[l->pos] == '@') {
+                l->pos++;
+                return lexer_make_token(l, LEXER_TOK_SPLICE_UNQUOTE, start, l->pos);
             }
+            return lexer_make_token(l, LEXER_TOK_UNQUOTE, start, l->pos);
+        case '\"':
+            return lexer_scan_string(l, start);
+        case '0' ... '9':
+            return lexer_scan_number(l, start, LEXER_TOK_INT);
+        /* start a symbol */
+        case 'a' ... 'z':
+        case 'A' ... 'Z':
+        case '+':
+        case '/':
+        case '*':
+        case '<':
+        case '=':
+        case '>':
+        case '&':
+            return lexer_scan_symbol(l, start);
+        case '-':
+            return lexer_scan_minus(l, start);
+        /* error */
+        default:
+            return lexer_make_token(l, LEXER_TOK_ERROR, start, l->pos);
+        }
+    }
+    return lexer_make_token(l, LEXER_TOK_EOF, l->pos, l->pos);
+}
+
+LexerToken lexer_get_token(Lexer *l)
+{
+    if (l->mapped) {
+        lexer_release(l);
+    }
+    while (true) {
+        size_t pos = l->pos;
+        size_t line_no = l->line_no;
+        size_t line_start = l->line_start;
+        LexerToken tok = lexer_scan_token(l);
+        if (!l->stream || l->pos < l->len) {
+            return tok;
+        }
+        /* the token runs up to the end of what has been read, so it may
+         * go on in the stream: read on and scan it again */
+        l->pos = pos;
+        l->line_no = line_no;
+        l->line_start = line_start;
+        if (!lexer_fill(l, pos)) {
+            l->stream = NULL;
+        }
+    }
+}
+
+const char *lexer_token_text(const Lexer *l, const LexerToken *tok)
+{
+    return l->buf + tok->offset;
+}
+
+size_t lexer_token_copy(const Lexer *l, const LexerToken *tok, char *dst)
+{
+    /* dst must hold at least tok->length + 1 bytes */
+    const char *src = lexer_token_text(l, tok);
+    if (tok->type != LEXER_TOK_STRING) {
+        memcpy(dst, src, tok->length);
+        dst[tok->length] = '\0';
+        return tok->length;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < tok->length; ++i) {
+        if (src[i] != '\\' || i + 1 == tok->length) {
+            dst[n++] = src[i];
+            continue;
+        }
+        /* supports all C escape sequences except for hex and octal */
+        char c = src[++i];
+        switch (c) {
+        case '\n':
+            /* ignore escaped line feeds */
+            break;
+        case '\\':
+        case '"':
+            dst[n++] = c;
+            break;
+        case 'a':
+            dst[n++] = KEY_BEL;
+            break;
+        case 'b':
+            dst[n++] = KEY_BS;
+            break;
+        case 'f':
+            dst[n++] = KEY_FF;
+            break;
+        case 'n':
+            dst[n++] = KEY_LF;
+            break;
+        case 'r':
+            dst[n++] = KEY_CR;
+            break;
+        case 't':
+            dst[n++] = KEY_HT;
+            break;
+        case 'v':
+            dst[n++] = KEY_VT;
             break;
         default:
-            buf[bufpos++] = c;
-            return lexer_make_token(l, LEXER_TOK_ERROR, buf);
+            /* Invalid escape sequence, keep it */
+            dst[n++] = '\\';
+            dst[n++] = c;
+            break;
         }
     }
-    /* acceptance states */
-    switch(l->state) {
-    case LEXER_STATE_ZERO:
-    case LEXER_STATE_COMMENT:
-        return lexer_make_token(l, LEXER_TOK_EOF, NULL);
-    case LEXER_STATE_NUMBER:
-        l->state = LEXER_STATE_ZERO;
-        return lexer_make_token(l, LEXER_TOK_INT, buf);
-    case LEXER_STATE_FLOAT:
-        l->state = LEXER_STATE_ZERO;
-        return lexer_make_token(l, LEXER_TOK_FLOAT, buf);
-    case LEXER_STATE_SYMBOL:
-        l->state = LEXER_STATE_ZERO;
-        return lexer_make_token(l, LEXER_TOK_SYMBOL, buf);
-    default:
-        return lexer_make_token(l, LEXER_TOK_ERROR, buf);
+    dst[n] = '\0';
+    return n;
+}
+
+int lexer_token_int(const Lexer *l, const LexerToken *tok)
+{
+    const char *src = lexer_token_text(l, tok);
+    size_t i = 0;
+    int sign = 1;
+    if (tok->length > 0 && src[0] == '-') {
+        sign = -1;
+        i++;
     }
+    unsigned int n = 0;
+    for (; i < tok->length; ++i) {
+        n = 10 * n + (unsigned int) (src[i] - '0');
+    }
+    return sign * (int) n;
 }
 
+double lexer_token_float(const Lexer *l, const LexerToken *tok)
+{
+    /* the token was validated by the lexer, parse the slice in place */
+    double d = 0;
+    fpconv_strtod(lexer_token_text(l, tok), tok->length, &d);
+    return d;
+}
@@ -1,55 +1,68 @@
 #include "list.h"
-#include "gc.h"
+#include "heap.h"
+#include "profile.h"
 
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
 
+static ListStats list_stats_;
+
 const List *list_new()
 {
     // doubly-linked list, managed memory
-    List *list = (List *) gc_malloc(&gc, sizeof(List));
-    list->begin = list->end = NULL;
+    List *list = (List *) heap_malloc(sizeof(List));
+    PROFILE_ALLOC(list, sizeof(List), "LIST");
+    list->begin = list->end = list->cells = NULL;
     list->size = 0;
+    list->hash = 0;
     return list;
 }
 
-static ListItem *list_item_new(void *value)
+/*
+ * Allocates a list with n linked (but empty) cells. All cells are carved
+ * out of a single block in traversal order.
+ */
+static List *list_new_with_size(const size_t n)
 {
-    ListItem *item = (ListItem *) gc_calloc(&gc, 1, sizeof(ListItem));
-    item->p = value;
-    return item;
+    List *list = (List *) heap_calloc(1, sizeof(List));
+    PROFILE_ALLOC(list, sizeof(List), "LIST");
+    if (n == 0) {
+        return list;
+    }
+    ListItem *cells = (ListItem *) heap_calloc(n, sizeof(ListItem));
+    PROFILE_ALLOC(cells, n * sizeof(ListItem), "LIST");
+    list_stats_.blocks++;
+    list_stats_.cells += n;
+    for (size_t i = 0; i < n; ++i) {
+        cells[i].prev = i > 0 ? &cells[i - 1] : NULL;
+        cells[i].next = i + 1 < n ? &cells[i + 1] : NULL;
+    }
+    list->cells = cells;
+    list->begin = &cells[0];
+    list->end = &cells[n - 1];
+    list->size = n;
+    return list;
 }
 
-static ListItem *list_item_copy(const ListItem *li)
+/*
+ * Copies the elements of l into a fresh list, leaving `front` empty cells
+ * before and `back` empty cells after the copied elements.
+ */
+static List *list_mutable_copy_ext(const List *l, size_t front, size_t back)
 {
-    ListItem *copy = (ListItem *) gc_calloc(&gc, 1, sizeof(ListItem));
-    memcpy(copy, li, sizeof(ListItem));
-    return copy;
+    List *new_l = list_new_with_size(front + list_size(l) + back);
+    ListItem *dst = new_l->cells + front;
+    for (const ListItem *src = l->begin; src != NULL; src = src->next) {
+        (dst++)->p = src->p;
+    }
+    return new_l;
 }
 
 static List *list_mutable_copy(const List *l)
 {
-    List *new_l = gc_calloc(&gc, 1, sizeof(List));
-    void *head = NULL;
-    ListItem *prev = NULL;
-    while ((head = list_head(l)) != NULL) {
-        ListItem *new_li = list_item_new(head);
-        new_li->prev = prev;
-        if (!prev) {
-            new_l->begin = new_li;
-            new_l->begin->prev = NULL;
-        } else {
-            new_li->prev->next = new_li;
-        }
-        new_l->size++;
-        l = list_tail(l);
-        prev = new_li;
-    }
-    new_l->end = prev;
-    if (new_l->end) new_l->end->next = NULL;
-    return new_l;
+    return list_mutable_copy_ext(l, 0, 0);
 }
 
 const List *list_dup(const List *l)
@@ -59,39 +72,15 @@ const List *list_dup(const List *l)
 
 const List *list_conj(const List *l, void *value)
 {
-    List *nl = list_mutable_copy(l);
-    ListItem *item = list_item_new(value);
-    if (nl->size > 0) {
-        nl->end->next = item;
-        item->prev = nl->end;
-        nl->end = item;
-        item->next = NULL;
-        nl->size++;
-    } else {
-        nl->begin = nl->end = item;
-        item->prev = NULL;
-        item->next = NULL;
-        nl->size = 1;
-    }
+    List *nl = list_mutable_copy_ext(l, 0, 1);
+    nl->end->p = value;
     return nl;
 }
 
 const List *list_cons(const List *l, void *value)
 {
-    List *nl = list_mutable_copy(l);
-    ListItem *item = list_item_new(value);
-    if (nl->size > 0) {
-        item->next = nl->begin;
-        nl->begin->prev = item;
-        nl->begin = item;
-        item->prev = NULL;
-        nl->size++;
-    } else {
-        nl->begin = nl->end = item;
-        item->prev = NULL;
-        item->next = NULL;
-        nl->size = 1;
-    }
+    List *nl = list_mutable_copy_ext(l, 1, 0);
+    nl->begin->p = value;
     return nl;
 }
 
@@ -139,16 +128,20 @@ const List *list_tail(const List *l)
     assert(l && "Invalid argument: l must not be NULL");
     if (l) {
         // flat copy
-        List *tail = (List *) gc_malloc(&gc, sizeof(List));
+        List *tail = (List *) heap_malloc(sizeof(List));
+        PROFILE_ALLOC(tail, sizeof(List), "LIST");
+        tail->hash = 0;
         if (l->size > 1) {
             tail->begin = l->begin->next;
             tail->end = l->end;
             tail->size = l->size - 1;
+            tail->cells = l->cells;
             return tail;
         } else {
             tail->begin = NULL;
             tail->end = NULL;
             tail->size = 0;
+            tail->cells = NULL;
             return tail;
         }
     }
@@ -164,3 +157,39 @@ bool list_is_empty(const List *l)
 {
     return list_size(l) == 0;
 }
+
+void list_builder_init(ListBuilder *b)
+{
+    *b = (ListBuilder) { .items = NULL, .size = 0, .capacity = 0 };
+}
+
+void list_builder_append(ListBuilder *b, void *value)
+{
+    if (b->size == b->capacity) {
+        size_t capacity = b->capacity ? 2 * b->capacity : 8;
+        void **items = heap_malloc(capacity * sizeof(void *));
+        if (b->size) {
+            memcpy(items, b->items, b->size * sizeof(void *));
+        }
+        heap_free(b->items, b->capacity * sizeof(void *));
+        b->items = items;
+        b->capacity = capacity;
+    }
+    b->items[b->size++] = value;
+}
+
+const List *list_builder_finish(ListBuilder *b)
+{
+    List *list = list_new_with_size(b->size);
+    for (size_t i = 0; i < b->size; ++i) {
+        list->cells[i].p = b->items[i];
+    }
+    heap_free(b->items, b->capacity * sizeof(void *));
+    list_builder_init(b);
+    return list;
+}
+
+const ListStats *list_stats()
+{
+    return &list_stats_;
+}
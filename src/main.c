@@ -1,4 +1,6 @@
+#include <ctype.h>
 #include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,14 +12,19 @@
 #include "env.h"
 #include "eval.h"
 #include "exc.h"
-#include "gc.h"
+#include "file.h"
+#include "heap.h"
 #include "list.h"
 #include "log.h"
 #include "parser.h"
+#include "printer.h"
+#include "profile.h"
+#include "sort.h"
 #include "value.h"
 
 Value *core_read_string(const Value *args);
 Value *core_eval(const Value *str);
+Value *core_load_file(const Value *args);
 
 /* The global environment */
 Environment *ENV;
@@ -37,6 +44,7 @@ Environment *global_env()
     env_set(env, "pr", value_new_builtin_fn(core_pr));
     env_set(env, "pr-str", value_new_builtin_fn(core_pr_str));
     env_set(env, "prn", value_new_builtin_fn(core_prn));
+    env_set(env, "flush", value_new_builtin_fn(core_flush));
 
     Value *add = value_new_builtin_fn(core_add);
     env_set(env, "+", add);
@@ -78,43 +86,106 @@ Environment *global_env()
     env_set(env, "symbol", value_new_builtin_fn(core_symbol));
     env_set(env, "str", value_new_builtin_fn(core_str));
     env_set(env, "slurp", value_new_builtin_fn(core_slurp));
+    env_set(env, "mmap-file", value_new_builtin_fn(core_mmap_file));
+    env_set(env, "subs", value_new_builtin_fn(core_subs));
+    env_set(env, "index-of", value_new_builtin_fn(core_index_of));
     env_set(env, "eval", value_new_builtin_fn(core_eval));
     env_set(env, "read-string", value_new_builtin_fn(core_read_string));
+    env_set(env, "load-file", value_new_builtin_fn(core_load_file));
+    env_set(env, "read-json", value_new_builtin_fn(core_read_json));
+    env_set(env, "read-json-file", value_new_builtin_fn(core_read_json_file));
+    env_set(env, "write-json", value_new_builtin_fn(core_write_json));
+    env_set(env, "write-json-file", value_new_builtin_fn(core_write_json_file));
+    env_set(env, "open", value_new_builtin_fn(core_open));
+    env_set(env, "close", value_new_builtin_fn(core_close));
+    env_set(env, "read-line", value_new_builtin_fn(core_read_line));
+    env_set(env, "read-bytes", value_new_builtin_fn(core_read_bytes));
+    env_set(env, "line-seq", value_new_builtin_fn(core_line_seq));
+    env_set(env, "write", value_new_builtin_fn(core_write));
+    env_set(env, "spit", value_new_builtin_fn(core_spit));
+    env_set(env, "*in*", value_new_file(file_new(stdin, FILE_READ, false), file_finalize));
 
     env_set(env, "cons", value_new_builtin_fn(core_cons));
     env_set(env, "concat", value_new_builtin_fn(core_concat));
 
     env_set(env, "map", value_new_builtin_fn(core_map));
+    env_set(env, "range", value_new_builtin_fn(core_range));
+    env_set(env, "iterate", value_new_builtin_fn(core_iterate));
+    env_set(env, "take", value_new_builtin_fn(core_take));
+    env_set(env, "drop", value_new_builtin_fn(core_drop));
+    env_set(env, "take-while", value_new_builtin_fn(core_take_while));
+    env_set(env, "filter", value_new_builtin_fn(core_filter));
+    env_set(env, "remove", value_new_builtin_fn(core_remove));
+    env_set(env, "keep", value_new_builtin_fn(core_keep));
+    env_set(env, "comp", value_new_builtin_fn(core_comp));
+    env_set(env, "sequence", value_new_builtin_fn(core_sequence));
+    env_set(env, "reduce", value_new_builtin_fn(core_reduce));
+    env_set(env, "transduce", value_new_builtin_fn(core_transduce));
+    env_set(env, "into", value_new_builtin_fn(core_into));
+    env_set(env, "f64-vector", value_new_builtin_fn(core_f64_vector));
+    env_set(env, "i64-vector", value_new_builtin_fn(core_i64_vector));
+    env_set(env, "vec-add", value_new_builtin_fn(core_vec_add));
+    env_set(env, "vec-sub", value_new_builtin_fn(core_vec_sub));
+    env_set(env, "vec-mul", value_new_builtin_fn(core_vec_mul));
+    env_set(env, "vec-div", value_new_builtin_fn(core_vec_div));
+    env_set(env, "vec-scale", value_new_builtin_fn(core_vec_scale));
+    env_set(env, "vec<", value_new_builtin_fn(core_vec_lt));
+    env_set(env, "vec<=", value_new_builtin_fn(core_vec_leq));
+    env_set(env, "vec>", value_new_builtin_fn(core_vec_gt));
+    env_set(env, "vec>=", value_new_builtin_fn(core_vec_geq));
+    env_set(env, "vec=", value_new_builtin_fn(core_vec_eq));
+    env_set(env, "sum", value_new_builtin_fn(core_sum));
+    env_set(env, "dot", value_new_builtin_fn(core_dot));
+    env_set(env, "min", value_new_builtin_fn(core_min));
+    env_set(env, "max", value_new_builtin_fn(core_max));
+    env_set(env, "matrix", value_new_builtin_fn(core_matrix));
+    env_set(env, "mat-shape", value_new_builtin_fn(core_mat_shape));
+    env_set(env, "mat-ref", value_new_builtin_fn(core_mat_ref));
+    env_set(env, "mat-row", value_new_builtin_fn(core_mat_row));
+    env_set(env, "mat-col", value_new_builtin_fn(core_mat_col));
+    env_set(env, "mat-rows", value_new_builtin_fn(core_mat_rows));
+    env_set(env, "mat-cols", value_new_builtin_fn(core_mat_cols));
+    env_set(env, "transpose", value_new_builtin_fn(core_transpose));
+    env_set(env, "mat*", value_new_builtin_fn(core_mat_mul));
+    env_set(env, "mat+", value_new_builtin_fn(core_mat_add));
+    env_set(env, "mat-", value_new_builtin_fn(core_mat_sub));
+    env_set(env, "mat-emul", value_new_builtin_fn(core_mat_emul));
+    env_set(env, "mat-ediv", value_new_builtin_fn(core_mat_ediv));
+    env_set(env, "sort", value_new_builtin_fn(core_sort));
+    env_set(env, "sort-by", value_new_builtin_fn(core_sort_by));
+    env_set(env, "hash", value_new_builtin_fn(core_hash));
+    env_set(env, "memoize", value_new_builtin_fn(core_memoize));
+    env_set(env, "lru-cache", value_new_builtin_fn(core_lru_cache));
+    env_set(env, "cache-get", value_new_builtin_fn(core_cache_get));
+    env_set(env, "cache-put", value_new_builtin_fn(core_cache_put));
+    env_set(env, "cache-stats", value_new_builtin_fn(core_cache_stats));
+    env_set(env, "hash-set", value_new_builtin_fn(core_hash_set));
+    env_set(env, "sorted-set", value_new_builtin_fn(core_sorted_set));
+    env_set(env, "sorted-map", value_new_builtin_fn(core_sorted_map));
+    env_set(env, "conj", value_new_builtin_fn(core_conj));
+    env_set(env, "disj", value_new_builtin_fn(core_disj));
+    env_set(env, "assoc", value_new_builtin_fn(core_assoc));
+    env_set(env, "dissoc", value_new_builtin_fn(core_dissoc));
+    env_set(env, "get", value_new_builtin_fn(core_get));
+    env_set(env, "contains?", value_new_builtin_fn(core_contains));
+    env_set(env, "seq", value_new_builtin_fn(core_seq));
+    env_set(env, "subseq", value_new_builtin_fn(core_subseq));
+    env_set(env, "last", value_new_builtin_fn(core_last));
     env_set(env, "apply", value_new_builtin_fn(core_apply));
 
+    env_set(env, "gc", value_new_builtin_fn(core_gc));
+    env_set(env, "gc-stats", value_new_builtin_fn(core_gc_stats));
+    env_set(env, "heap-histogram", value_new_builtin_fn(core_heap_histogram));
+
     env_set(env, "assert", value_new_builtin_fn(core_assert));
     env_set(env, "throw", value_new_builtin_fn(core_throw));
-
-    // add stutter basics
-    size_t N_EXPRS = 1;
-    const char *exprs[N_EXPRS];
-    exprs[0] = "(def load-file"
-               "  (lambda (path)"
-               "    (eval (read-string (str \"(do \" (slurp path) \")\")))))";
-    for (size_t i = 0; i < N_EXPRS; ++i) {
-        eval(core_read_string(value_make_list(value_new_string(exprs[i]))), env);
-    }
     return env;
 }
 
 Value *read_(char *input)
 {
-    // Get a handle on the input
-    size_t n = strlen(input);
-    FILE *stream = fmemopen(input, n, "r");
-    if (!stream) {
-        printf("%s\n", strerror(errno));
-        return NULL;
-    }
-
     Value *ast = NULL;
-    ParseResult success = parser_parse(stream, &ast);
-    fclose(stream);
+    ParseResult success = parser_parse_buffer(input, strlen(input), &ast);
     return success == PARSER_SUCCESS ? ast : NULL;
 }
 
@@ -122,7 +193,8 @@ Value *core_read_string(const Value *args)
 {
     if (is_list(args)) {
         Value *str = list_head(LIST(args));
-        return read_(STRING(str));
+        Value *ast = NULL;
+        return parser_parse_string(str, &ast) == PARSER_SUCCESS ? ast : NULL;
     }
     return NULL;
 }
@@ -139,6 +211,47 @@ Value *core_eval(const Value *args)
     return NULL;
 }
 
+Value *core_load_file(const Value *args)
+{
+    /* (load-file path)
+     *
+     * Reads and evaluates one top-level form at a time, so evaluation
+     * starts right away and every form can be collected once it has been
+     * evaluated. Returns the value of the last form.
+     */
+    if (!is_list(args) || list_size(LIST(args)) != 1) {
+        exc_set(value_make_exception("LOAD-FILE takes exactly one argument"));
+        return NULL;
+    }
+    Value *path = list_head(LIST(args));
+    if (path->type != VALUE_STRING) {
+        exc_set(value_make_exception("LOAD-FILE takes a string argument"));
+        return NULL;
+    }
+    FILE *f = fopen(STRING(path), "r");
+    if (!f) {
+        exc_set(value_make_exception("Failed to open file %s: %s", STRING(path), strerror(errno)));
+        return NULL;
+    }
+    Parser *parser = parser_new(f);
+    Value *result = VALUE_CONST_NIL;
+    Value *form;
+    ParseResult success;
+    while ((success = parser_next(parser, &form)) == PARSER_SUCCESS) {
+        result = eval(form, ENV);
+        if (!result) {
+            break;
+        }
+    }
+    if (success == PARSER_FAIL) {
+        exc_set(value_make_exception("Failed to parse %s", STRING(path)));
+        result = NULL;
+    }
+    parser_delete(parser);
+    fclose(f);
+    return result;
+}
+
 #define BOLD         "\033[1m"
 #define NO_BOLD      "\033[22m"
 
@@ -158,35 +271,141 @@ void show_help()
     char *help =
         " %s\n\n"
         BOLD "USAGE\n" NO_BOLD
-        "  stutter [-h] [file]\n"
+        "  stutter [-h] [--arena] [--profile-alloc] [--flush=POLICY] [--sort-threads=N]\n"
+        "          [--gc-OPTION=VALUE ...] [file]\n"
         "\n"
         BOLD "ARGUMENTS\n" NO_BOLD
         "  file      Execute FILE as a stutter program\n"
         "\n"
         BOLD "OPTIONS\n" NO_BOLD
-        "  -h        Show this help text\n";
+        "  -h        Show this help text\n"
+        "  --arena   Allocate from a region that is never collected and report\n"
+        "            peak usage at exit; meant for short-lived scripts. The heap\n"
+        "            limit (--gc-max-heap) defaults to 1G in this mode\n"
+        "  --profile-alloc\n"
+        "            Track allocations per type and per function, enables\n"
+        "            (heap-histogram) and prints the top allocation sites at exit\n"
+        "  --flush=POLICY\n"
+        "            When to write buffered output of pr and prn: line, block (when\n"
+        "            the buffer is full) or explicit (only on (flush) and at exit).\n"
+        "            Defaults to line on a terminal and block otherwise\n"
+        "  --sort-threads=N\n"
+        "            Threads that sort and sort-by use for large numeric inputs,\n"
+        "            1 to always sort on the main thread. Defaults to one per CPU\n"
+        "\n"
+        BOLD "GARBAGE COLLECTION\n" NO_BOLD
+        "  --gc-initial-capacity=N   Initial number of allocation map slots (16384)\n"
+        "  --gc-min-capacity=N       Minimum number of allocation map slots (16384)\n"
+        "  --gc-downsize-factor=F    Allocation map load factor for shrinking (0.2)\n"
+        "  --gc-upsize-factor=F      Allocation map load factor for growing (0.8)\n"
+        "  --gc-sweep-factor=F       Collect when live data drops below this\n"
+        "                            fraction of the heap (0.5)\n"
+        "  --gc-initial-heap=SIZE    Heap size that triggers the first collection (1M)\n"
+        "  --gc-max-heap=SIZE        Hard heap limit, 0 for none (0). Vectors,\n"
+        "                            matrices and slurp raise an error past it,\n"
+        "                            anything else ends the program\n"
+        "\n"
+        "  Each option can also be set through the environment, e.g.\n"
+        "  STUTTER_GC_MAX_HEAP=512M. SIZE accepts K, M and G suffixes.\n";
     fprintf(stderr, "%s", banner());
     fprintf(stderr, help, __STUTTER_VERSION__);
 }
 
+static const char *gc_options[] = {
+    "initial-capacity",
+    "min-capacity",
+    "downsize-factor",
+    "upsize-factor",
+    "sweep-factor",
+    "initial-heap",
+    "max-heap"
+};
+#define N_GC_OPTIONS (sizeof(gc_options) / sizeof(gc_options[0]))
+
+static void heap_config_from_env(HeapConfig *config)
+{
+    /* --gc-max-heap can be set as STUTTER_GC_MAX_HEAP etc. */
+    char name[64];
+    for (size_t i = 0; i < N_GC_OPTIONS; ++i) {
+        size_t k = snprintf(name, sizeof(name), "STUTTER_GC_");
+        for (const char *c = gc_options[i]; *c && k < sizeof(name) - 1; ++c) {
+            name[k++] = *c == '-' ? '_' : toupper(*c);
+        }
+        name[k] = '\0';
+        const char *value = getenv(name);
+        if (value && !heap_config_set(config, gc_options[i], value)) {
+            fprintf(stderr, "Invalid value for %s: %s\n", name, value);
+            exit(1);
+        }
+    }
+}
+
 int main(int argc, char *argv[])
 {
-    // set up garbage collection, use extended setup for bigger mem limits
-    gc_start_ext(&gc, &argc, 16384, 16384, 0.2, 0.8, 0.5);
-    // create env and tell GC to never collect it
-    ENV = global_env();
-    gc_make_static(&gc, ENV);
+    HeapConfig heap_config;
+    heap_config_init(&heap_config);
+    heap_config_from_env(&heap_config);
+
+    char option_names[N_GC_OPTIONS][32];
+    struct option options[N_GC_OPTIONS + 6];
+    options[0] = (struct option) { "help", no_argument, NULL, 'h' };
+    options[1] = (struct option) { "arena", no_argument, NULL, 'a' };
+    options[2] = (struct option) { "profile-alloc", no_argument, NULL, 'p' };
+    options[3] = (struct option) { "flush", required_argument, NULL, 'f' };
+    options[4] = (struct option) { "sort-threads", required_argument, NULL, 's' };
+    for (size_t i = 0; i < N_GC_OPTIONS; ++i) {
+        snprintf(option_names[i], sizeof(option_names[i]), "gc-%s", gc_options[i]);
+        options[i + 5] = (struct option) {
+            option_names[i], required_argument, NULL, 256 + (int) i
+        };
+    }
+    options[N_GC_OPTIONS + 5] = (struct option) { NULL, 0, NULL, 0 };
 
     int c;
-    while ((c = getopt(argc, argv, "h")) != -1) {
-        switch(c) {
-        case 'h':
-        default:
-            show_help();
-            exit(0);
+    while ((c = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        if (c == 'a') {
+            heap_config.arena = true;
+            continue;
+        }
+        if (c == 'p') {
+            profile_start();
+            continue;
+        }
+        if (c == 'f') {
+            if (!printer_set_policy(optarg)) {
+                fprintf(stderr, "Invalid value for --flush: %s\n", optarg);
+                exit(1);
+            }
+            continue;
+        }
+        if (c == 's') {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || n < 1) {
+                fprintf(stderr, "Invalid value for --sort-threads: %s\n", optarg);
+                exit(1);
+            }
+            sort_set_threads((unsigned) n);
+            continue;
+        }
+        if (c >= 256 && c < 256 + (int) N_GC_OPTIONS) {
+            if (!heap_config_set(&heap_config, gc_options[c - 256], optarg)) {
+                fprintf(stderr, "Invalid value for --gc-%s: %s\n", gc_options[c - 256], optarg);
+                exit(1);
+            }
+            continue;
         }
+        show_help();
+        exit(0);
     }
-    if (argc > 1) {
+
+    // set up garbage collection
+    heap_start(&heap_config, &argc);
+    // create env and tell GC to never collect it
+    ENV = global_env();
+    heap_make_static(ENV);
+
+    if (optind < argc) {
         /* In order to execute a file, explicitly construct a load-file
          * call to avoid interpretation of the filename. */
         Value *src = value_make_list(value_new_symbol("load-file"));
@@ -214,6 +433,7 @@ int main(int argc, char *argv[])
 
     while(true) {
         // char *input = readline("stutter> ");
+        printer_flush(printer_stdout());
         char *input = readline("\U000003BB> ");
         if (input == NULL) {
             break;
@@ -238,7 +458,8 @@ int main(int argc, char *argv[])
         }
         free(input);
     }
-    gc_stop(&gc);
+    printer_flush(printer_stdout());
+    heap_stop();
     fprintf(stdout, "\n");
     return 0;
 }
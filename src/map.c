@@ -3,10 +3,11 @@
 #include <stdbool.h>
 
 #include "djb2.h"
-#include "gc.h"
+#include "heap.h"
 #include "log.h"
 #include "map.h"
 #include "primes.h"
+#include "profile.h"
 
 static double load_factor(Map *ht)
 {
@@ -14,12 +15,16 @@ static double load_factor(Map *ht)
     return (double) ht->size / (double) ht->capacity;
 }
 
-static MapItem *map_item_new(char *key, void *value, size_t siz)
+static MapItem *map_item_new(const char *key, unsigned long hash, void *value, size_t siz)
 {
-    MapItem *item = (MapItem *) gc_malloc(&gc, sizeof(MapItem));
-    item->key = gc_strdup(&gc, key);
+    size_t n_key = strlen(key) + 1;
+    MapItem *item = (MapItem *) heap_malloc(sizeof(MapItem) + n_key);
+    PROFILE_ALLOC(item, sizeof(MapItem) + n_key, "MAP");
+    memcpy(item->key, key, n_key);
+    item->hash = hash;
     item->size = siz;
-    item->value = gc_malloc(&gc, siz);
+    item->value = heap_malloc(siz);
+    PROFILE_ALLOC(item->value, siz, "MAP");
     memcpy(item->value, value, siz);
     item->next = NULL;
     return item;
@@ -28,18 +33,19 @@ static MapItem *map_item_new(char *key, void *value, size_t siz)
 static void map_item_delete(MapItem *item)
 {
     if (item) {
-        gc_free(&gc, item->key);
-        gc_free(&gc, item->value);
-        gc_free(&gc, item);
+        heap_free(item->value, item->size);
+        heap_free(item, sizeof(MapItem) + strlen(item->key) + 1);
     }
 }
 
 Map *map_new(size_t capacity)
 {
-    Map *ht = (Map *) gc_malloc(&gc, sizeof(Map));
+    Map *ht = (Map *) heap_malloc(sizeof(Map));
+    PROFILE_ALLOC(ht, sizeof(Map), "MAP");
     ht->capacity = next_prime(capacity);
     ht->size = 0;
-    ht->items = gc_calloc(&gc, ht->capacity, sizeof(MapItem *));
+    ht->items = heap_calloc(ht->capacity, sizeof(MapItem *));
+    PROFILE_ALLOC(ht->items, ht->capacity * sizeof(MapItem *), "MAP");
     return ht;
 }
 
@@ -55,8 +61,8 @@ void map_delete(Map *ht)
             }
         }
     }
-    gc_free(&gc, ht->items);
-    gc_free(&gc, ht);
+    heap_free(ht->items, ht->capacity * sizeof(MapItem *));
+    heap_free(ht, sizeof(Map));
 }
 
 unsigned long map_index(Map *map, char *key)
@@ -66,16 +72,20 @@ unsigned long map_index(Map *map, char *key)
 
 void map_put(Map *ht, char *key, void *value, size_t siz)
 {
-    // hash
-    unsigned long index = map_index(ht, key);
+    map_put_hashed(ht, key, djb2(key), value, siz);
+}
+
+void map_put_hashed(Map *ht, const char *key, unsigned long hash, void *value, size_t siz)
+{
+    unsigned long index = hash % ht->capacity;
     // LOG_DEBUG("index: %lu", index);
     // create item
-    MapItem *item = map_item_new(key, value, siz);
+    MapItem *item = map_item_new(key, hash, value, siz);
     MapItem *cur = ht->items[index];
     // update if exists
     MapItem *prev = NULL;
     while(cur != NULL) {
-        if (strcmp(cur->key, key) == 0) {
+        if (cur->hash == hash && strcmp(cur->key, key) == 0) {
             // found it
             item->next = cur->next;
             if (!prev) {
@@ -102,10 +112,14 @@ void map_put(Map *ht, char *key, void *value, size_t siz)
 
 void *map_get(Map *ht, char *key)
 {
-    unsigned long index = map_index(ht, key);
-    MapItem *cur = ht->items[index];
+    return map_get_hashed(ht, key, djb2(key));
+}
+
+void *map_get_hashed(Map *ht, const char *key, unsigned long hash)
+{
+    MapItem *cur = ht->items[hash % ht->capacity];
     while(cur != NULL) {
-        if (strncmp(cur->key, key, strlen(cur->key)) == 0) {
+        if (cur->hash == hash && strcmp(cur->key, key) == 0) {
             return cur->value;
         }
         cur = cur->next;
@@ -150,19 +164,20 @@ void map_resize(Map *ht, size_t new_capacity)
     // Replaces the existing items array in the hash table
     // with a resized one and pushes items into the new, correct buckets
     // LOG_DEBUG("Resizing to %lu", new_capacity);
-    MapItem **resized_items = gc_calloc(&gc, new_capacity, sizeof(MapItem *));
+    MapItem **resized_items = heap_calloc(new_capacity, sizeof(MapItem *));
+    PROFILE_ALLOC(resized_items, new_capacity * sizeof(MapItem *), "MAP");
 
     for (size_t i = 0; i < ht->capacity; ++i) {
         MapItem *item = ht->items[i];
         while(item) {
             MapItem *next_item = item->next;
-            unsigned long new_index = djb2(item->key) % new_capacity;
+            unsigned long new_index = item->hash % new_capacity;
             item->next = resized_items[new_index];
             resized_items[new_index] = item;
             item = next_item;
         }
     }
-    gc_free(&gc, ht->items);
+    heap_free(ht->items, ht->capacity * sizeof(MapItem *));
     ht->capacity = new_capacity;
     ht->items = resized_items;
 }
@@ -0,0 +1,42 @@
+#include "matrix.h"
+
+#include <string.h>
+
+#include "numvec.h"
+
+
+void matrix_mul(double *c, const double *a, const double *b, size_t m, size_t k, size_t n)
+{
+    /* for each block of B, every row of A adds the block's rows, scaled
+     * by its elements, into the matching part of its row of C */
+    memset(c, 0, m * n * sizeof(double));
+    for (size_t j0 = 0; j0 < n; j0 += MATRIX_BLOCK_N) {
+        size_t nb = n - j0 < MATRIX_BLOCK_N ? n - j0 : MATRIX_BLOCK_N;
+        for (size_t p0 = 0; p0 < k; p0 += MATRIX_BLOCK_K) {
+            size_t kb = k - p0 < MATRIX_BLOCK_K ? k - p0 : MATRIX_BLOCK_K;
+            for (size_t i = 0; i < m; ++i) {
+                double *ci = c + i * n + j0;
+                const double *ai = a + i * k + p0;
+                for (size_t p = 0; p < kb; ++p) {
+                    numvec_f64_axpy(ci, ai[p], b + (p0 + p) * n + j0, nb);
+                }
+            }
+        }
+    }
+}
+
+void matrix_transpose(double *out, const double *a, size_t m, size_t n)
+{
+    /* tile by tile, so both the reads and the writes stay in the cache */
+    for (size_t i0 = 0; i0 < m; i0 += MATRIX_TILE) {
+        size_t i1 = m - i0 < MATRIX_TILE ? m : i0 + MATRIX_TILE;
+        for (size_t j0 = 0; j0 < n; j0 += MATRIX_TILE) {
+            size_t j1 = n - j0 < MATRIX_TILE ? n : j0 + MATRIX_TILE;
+            for (size_t i = i0; i < i1; ++i) {
+                for (size_t j = j0; j < j1; ++j) {
+                    out[j * m + i] = a[i * n + j];
+                }
+            }
+        }
+    }
+}
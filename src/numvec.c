@@ -0,0 +1,740 @@
+#include "numvec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NUMVEC_X86
+#include <immintrin.h>
+#endif
+
+const char *numvec_level_names[] = {
+    "scalar",
+    "sse2",
+    "avx2"
+};
+
+typedef struct {
+    /* integer division is always scalar, see numvec_i64_arith() */
+    void (*f64_arith)(NumvecOp, double *, const double *, const double *, size_t, size_t);
+    void (*i64_arith)(NumvecOp, int64_t *, const int64_t *, const int64_t *, size_t, size_t);
+    void (*f64_cmp)(NumvecCmp, int64_t *, const double *, const double *, size_t, size_t);
+    void (*i64_cmp)(NumvecCmp, int64_t *, const int64_t *, const int64_t *, size_t, size_t);
+    double (*f64_sum)(const double *, size_t);
+    int64_t (*i64_sum)(const int64_t *, size_t);
+    double (*f64_dot)(const double *, const double *, size_t);
+    int64_t (*i64_dot)(const int64_t *, const int64_t *, size_t);
+    void (*f64_min_max)(const double *, size_t, double *, double *);
+    void (*i64_min_max)(const int64_t *, size_t, int64_t *, int64_t *);
+    void (*f64_axpy)(double *, double, const double *, size_t);
+} NumvecImpl;
+
+/*
+ * Scalar versions, also used for the tails that don't fill a vector
+ * register. Integer arithmetic is done unsigned, where it wraps around
+ * instead of being undefined.
+ */
+
+static void f64_arith_scalar(NumvecOp op, double *out, const double *a,
+                             const double *b, size_t bstep, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        double x = a[i], y = b[i * bstep];
+        switch (op) {
+        case NUMVEC_ADD:
+            out[i] = x + y;
+            break;
+        case NUMVEC_SUB:
+            out[i] = x - y;
+            break;
+        case NUMVEC_MUL:
+            out[i] = x * y;
+            break;
+        case NUMVEC_DIV:
+            out[i] = x / y;
+            break;
+        }
+    }
+}
+
+static void i64_arith_scalar(NumvecOp op, int64_t *out, const int64_t *a,
+                             const int64_t *b, size_t bstep, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t x = (uint64_t) a[i], y = (uint64_t) b[i * bstep];
+        switch (op) {
+        case NUMVEC_ADD:
+            out[i] = (int64_t) (x + y);
+            break;
+        case NUMVEC_SUB:
+            out[i] = (int64_t) (x - y);
+            break;
+        case NUMVEC_MUL:
+            out[i] = (int64_t) (x * y);
+            break;
+        case NUMVEC_DIV:
+            /* not dispatched here */
+            break;
+        }
+    }
+}
+
+static bool i64_div_scalar(int64_t *out, const int64_t *a, const int64_t *b,
+                           size_t bstep, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        int64_t y = b[i * bstep];
+        if (y == 0) {
+            return false;
+        }
+        /* INT64_MIN / -1 overflows, it wraps around to itself */
+        out[i] = y == -1 ? (int64_t) (0 - (uint64_t) a[i]) : a[i] / y;
+    }
+    return true;
+}
+
+static bool cmp_holds(NumvecCmp cmp, bool lt, bool eq, bool gt)
+{
+    switch (cmp) {
+    case NUMVEC_LT:
+        return lt;
+    case NUMVEC_LE:
+        return lt || eq;
+    case NUMVEC_GT:
+        return gt;
+    case NUMVEC_GE:
+        return gt || eq;
+    case NUMVEC_EQ:
+        return eq;
+    }
+    return false;
+}
+
+static void f64_cmp_scalar(NumvecCmp cmp, int64_t *mask, const double *a,
+                           const double *b, size_t bstep, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        double x = a[i], y = b[i * bstep];
+        mask[i] = cmp_holds(cmp, x < y, x == y, x > y);
+    }
+}
+
+static void i64_cmp_scalar(NumvecCmp cmp, int64_t *mask, const int64_t *a,
+                           const int64_t *b, size_t bstep, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        int64_t x = a[i], y = b[i * bstep];
+        mask[i] = cmp_holds(cmp, x < y, x == y, x > y);
+    }
+}
+
+static double f64_sum_scalar(const double *a, size_t n)
+{
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+static int64_t i64_sum_scalar(const int64_t *a, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += (uint64_t) a[i];
+    }
+    return (int64_t) sum;
+}
+
+static double f64_dot_scalar(const double *a, const double *b, size_t n)
+{
+    double dot = 0;
+    for (size_t i = 0; i < n; ++i) {
+        dot += a[i] * b[i];
+    }
+    return dot;
+}
+
+static int64_t i64_dot_scalar(const int64_t *a, const int64_t *b, size_t n)
+{
+    uint64_t dot = 0;
+    for (size_t i = 0; i < n; ++i) {
+        dot += (uint64_t) a[i] * (uint64_t) b[i];
+    }
+    return (int64_t) dot;
+}
+
+static void f64_axpy_scalar(double *y, double alpha, const double *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void f64_min_max_scalar(const double *a, size_t n, double *min, double *max)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] < *min) {
+            *min = a[i];
+        }
+        if (a[i] > *max) {
+            *max = a[i];
+        }
+    }
+}
+
+static void i64_min_max_scalar(const int64_t *a, size_t n, int64_t *min, int64_t *max)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] < *min) {
+            *min = a[i];
+        }
+        if (a[i] > *max) {
+            *max = a[i];
+        }
+    }
+}
+
+/* the min and max kernels start from the first element */
+static void f64_min_max_first(const double *a, size_t n, double *min, double *max)
+{
+    *min = *max = a[0];
+    f64_min_max_scalar(a + 1, n - 1, min, max);
+}
+
+static void i64_min_max_first(const int64_t *a, size_t n, int64_t *min, int64_t *max)
+{
+    *min = *max = a[0];
+    i64_min_max_scalar(a + 1, n - 1, min, max);
+}
+
+#ifdef NUMVEC_X86
+
+/* the lanes of a comparison that count for cmp, all ones or zero */
+static void cmp_select(NumvecCmp cmp, int64_t *lt, int64_t *eq, int64_t *gt)
+{
+    *lt = cmp_holds(cmp, true, false, false) ? -1 : 0;
+    *eq = cmp_holds(cmp, false, true, false) ? -1 : 0;
+    *gt = cmp_holds(cmp, false, false, true) ? -1 : 0;
+}
+
+__attribute__((target("sse2")))
+static void f64_arith_sse2(NumvecOp op, double *out, const double *a,
+                           const double *b, size_t bstep, size_t n)
+{
+    const __m128d scalar = bstep ? _mm_setzero_pd() : _mm_set1_pd(b[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = bstep ? _mm_loadu_pd(b + i) : scalar;
+        switch (op) {
+        case NUMVEC_ADD:
+            x = _mm_add_pd(x, y);
+            break;
+        case NUMVEC_SUB:
+            x = _mm_sub_pd(x, y);
+            break;
+        case NUMVEC_MUL:
+            x = _mm_mul_pd(x, y);
+            break;
+        case NUMVEC_DIV:
+            x = _mm_div_pd(x, y);
+            break;
+        }
+        _mm_storeu_pd(out + i, x);
+    }
+    f64_arith_scalar(op, out + i, a + i, b + i * bstep, bstep, n - i);
+}
+
+__attribute__((target("sse2")))
+static void i64_arith_sse2(NumvecOp op, int64_t *out, const int64_t *a,
+                           const int64_t *b, size_t bstep, size_t n)
+{
+    if (op == NUMVEC_MUL) {
+        /* SSE2 only multiplies 32 bit lanes */
+        i64_arith_scalar(op, out, a, b, bstep, n);
+        return;
+    }
+    const __m128i scalar = bstep ? _mm_setzero_si128() : _mm_set1_epi64x(b[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i y = bstep ? _mm_loadu_si128((const __m128i *) (b + i)) : scalar;
+        x = op == NUMVEC_ADD ? _mm_add_epi64(x, y) : _mm_sub_epi64(x, y);
+        _mm_storeu_si128((__m128i *) (out + i), x);
+    }
+    i64_arith_scalar(op, out + i, a + i, b + i * bstep, bstep, n - i);
+}
+
+__attribute__((target("sse2")))
+static void f64_cmp_sse2(NumvecCmp cmp, int64_t *mask, const double *a,
+                         const double *b, size_t bstep, size_t n)
+{
+    int64_t lt, eq, gt;
+    cmp_select(cmp, &lt, &eq, &gt);
+    const __m128i sel_lt = _mm_set1_epi64x(lt);
+    const __m128i sel_eq = _mm_set1_epi64x(eq);
+    const __m128i sel_gt = _mm_set1_epi64x(gt);
+    const __m128i one = _mm_set1_epi64x(1);
+    const __m128d scalar = bstep ? _mm_setzero_pd() : _mm_set1_pd(b[0]);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = bstep ? _mm_loadu_pd(b + i) : scalar;
+        __m128i m = _mm_or_si128(_mm_and_si128(_mm_castpd_si128(_mm_cmplt_pd(x, y)), sel_lt),
+                                 _mm_or_si128(_mm_and_si128(_mm_castpd_si128(_mm_cmpeq_pd(x, y)), sel_eq),
+                                              _mm_and_si128(_mm_castpd_si128(_mm_cmpgt_pd(x, y)), sel_gt)));
+        _mm_storeu_si128((__m128i *) (mask + i), _mm_and_si128(m, one));
+    }
+    f64_cmp_scalar(cmp, mask + i, a + i, b + i * bstep, bstep, n - i);
+}
+
+__attribute__((target("sse2")))
+static double f64_sum_sse2(const double *a, size_t n)
+{
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+    return lanes[0] + lanes[1] + f64_sum_scalar(a + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static int64_t i64_sum_sse2(const int64_t *a, size_t n)
+{
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        s = _mm_add_epi64(s, _mm_loadu_si128((const __m128i *) (a + i)));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, s);
+    return (int64_t) ((uint64_t) lanes[0] + (uint64_t) lanes[1]
+                      + (uint64_t) i64_sum_scalar(a + i, n - i));
+}
+
+__attribute__((target("sse2")))
+static double f64_dot_sse2(const double *a, const double *b, size_t n)
+{
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+    return lanes[0] + lanes[1] + f64_dot_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void f64_axpy_sse2(double *y, double alpha, const double *x, size_t n)
+{
+    __m128d a = _mm_set1_pd(alpha);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(a, _mm_loadu_pd(x + i))));
+        _mm_storeu_pd(y + i + 2, _mm_add_pd(_mm_loadu_pd(y + i + 2), _mm_mul_pd(a, _mm_loadu_pd(x + i + 2))));
+    }
+    f64_axpy_scalar(y + i, alpha, x + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void f64_min_max_sse2(const double *a, size_t n, double *min, double *max)
+{
+    if (n < 2) {
+        f64_min_max_first(a, n, min, max);
+        return;
+    }
+    __m128d lo = _mm_loadu_pd(a), hi = lo;
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        lo = _mm_min_pd(lo, x);
+        hi = _mm_max_pd(hi, x);
+    }
+    double lanes[2], unused;
+    _mm_storeu_pd(lanes, lo);
+    f64_min_max_first(lanes, 2, min, &unused);
+    _mm_storeu_pd(lanes, hi);
+    f64_min_max_first(lanes, 2, &unused, max);
+    f64_min_max_scalar(a + i, n - i, min, max);
+}
+
+__attribute__((target("avx2")))
+static __m256i mullo_epi64_avx2(__m256i a, __m256i b)
+{
+    /* AVX2 multiplies 32 bit halves only: the low 64 bits of a * b are
+     * lo(a) * lo(b) + ((hi(a) * lo(b) + lo(a) * hi(b)) << 32) */
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                     _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static void f64_arith_avx2(NumvecOp op, double *out, const double *a,
+                           const double *b, size_t bstep, size_t n)
+{
+    const __m256d scalar = bstep ? _mm256_setzero_pd() : _mm256_set1_pd(b[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = bstep ? _mm256_loadu_pd(b + i) : scalar;
+        switch (op) {
+        case NUMVEC_ADD:
+            x = _mm256_add_pd(x, y);
+            break;
+        case NUMVEC_SUB:
+            x = _mm256_sub_pd(x, y);
+            break;
+        case NUMVEC_MUL:
+            x = _mm256_mul_pd(x, y);
+            break;
+        case NUMVEC_DIV:
+            x = _mm256_div_pd(x, y);
+            break;
+        }
+        _mm256_storeu_pd(out + i, x);
+    }
+    f64_arith_scalar(op, out + i, a + i, b + i * bstep, bstep, n - i);
+}
+
+__attribute__((target("avx2")))
+static void i64_arith_avx2(NumvecOp op, int64_t *out, const int64_t *a,
+                           const int64_t *b, size_t bstep, size_t n)
+{
+    const __m256i scalar = bstep ? _mm256_setzero_si256() : _mm256_set1_epi64x(b[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = bstep ? _mm256_loadu_si256((const __m256i *) (b + i)) : scalar;
+        switch (op) {
+        case NUMVEC_ADD:
+            x = _mm256_add_epi64(x, y);
+            break;
+        case NUMVEC_SUB:
+            x = _mm256_sub_epi64(x, y);
+            break;
+        case NUMVEC_MUL:
+            x = mullo_epi64_avx2(x, y);
+            break;
+        case NUMVEC_DIV:
+            break;
+        }
+        _mm256_storeu_si256((__m256i *) (out + i), x);
+    }
+    i64_arith_scalar(op, out + i, a + i, b + i * bstep, bstep, n - i);
+}
+
+__attribute__((target("avx2")))
+static void f64_cmp_avx2(NumvecCmp cmp, int64_t *mask, const double *a,
+                         const double *b, size_t bstep, size_t n)
+{
+    int64_t lt, eq, gt;
+    cmp_select(cmp, &lt, &eq, &gt);
+    const __m256i sel_lt = _mm256_set1_epi64x(lt);
+    const __m256i sel_eq = _mm256_set1_epi64x(eq);
+    const __m256i sel_gt = _mm256_set1_epi64x(gt);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256d scalar = bstep ? _mm256_setzero_pd() : _mm256_set1_pd(b[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = bstep ? _mm256_loadu_pd(b + i) : scalar;
+        /* ordered compares, so NaNs are neither less, equal nor greater */
+        __m256i m_lt = _mm256_castpd_si256(_mm256_cmp_pd(x, y, _CMP_LT_OQ));
+        __m256i m_eq = _mm256_castpd_si256(_mm256_cmp_pd(x, y, _CMP_EQ_OQ));
+        __m256i m_gt = _mm256_castpd_si256(_mm256_cmp_pd(x, y, _CMP_GT_OQ));
+        __m256i m = _mm256_or_si256(_mm256_and_si256(m_lt, sel_lt),
+                                    _mm256_or_si256(_mm256_and_si256(m_eq, sel_eq),
+                                                    _mm256_and_si256(m_gt, sel_gt)));
+        _mm256_storeu_si256((__m256i *) (mask + i), _mm256_and_si256(m, one));
+    }
+    f64_cmp_scalar(cmp, mask + i, a + i, b + i * bstep, bstep, n - i);
+}
+
+__attribute__((target("avx2")))
+static void i64_cmp_avx2(NumvecCmp cmp, int64_t *mask, const int64_t *a,
+                         const int64_t *b, size_t bstep, size_t n)
+{
+    int64_t lt, eq, gt;
+    cmp_select(cmp, &lt, &eq, &gt);
+    const __m256i sel_lt = _mm256_set1_epi64x(lt);
+    const __m256i sel_eq = _mm256_set1_epi64x(eq);
+    const __m256i sel_gt = _mm256_set1_epi64x(gt);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i scalar = bstep ? _mm256_setzero_si256() : _mm256_set1_epi64x(b[0]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = bstep ? _mm256_loadu_si256((const __m256i *) (b + i)) : scalar;
+        __m256i m = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi64(y, x), sel_lt),
+                                    _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi64(x, y), sel_eq),
+                                                    _mm256_and_si256(_mm256_cmpgt_epi64(x, y), sel_gt)));
+        _mm256_storeu_si256((__m256i *) (mask + i), _mm256_and_si256(m, one));
+    }
+    i64_cmp_scalar(cmp, mask + i, a + i, b + i * bstep, bstep, n - i);
+}
+
+__attribute__((target("avx2")))
+static double f64_sum_avx2(const double *a, size_t n)
+{
+    /* two accumulators, so consecutive adds don't wait for each other */
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + f64_sum_scalar(a + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int64_t i64_sum_avx2(const int64_t *a, size_t n)
+{
+    __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_epi64(s0, _mm256_loadu_si256((const __m256i *) (a + i)));
+        s1 = _mm256_add_epi64(s1, _mm256_loadu_si256((const __m256i *) (a + i + 4)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(s0, s1));
+    return (int64_t) ((uint64_t) lanes[0] + (uint64_t) lanes[1] + (uint64_t) lanes[2]
+                      + (uint64_t) lanes[3] + (uint64_t) i64_sum_scalar(a + i, n - i));
+}
+
+__attribute__((target("avx2")))
+static double f64_dot_avx2(const double *a, const double *b, size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + f64_dot_scalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static int64_t i64_dot_avx2(const int64_t *a, const int64_t *b, size_t n)
+{
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s = _mm256_add_epi64(s, mullo_epi64_avx2(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                                 _mm256_loadu_si256((const __m256i *) (b + i))));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, s);
+    return (int64_t) ((uint64_t) lanes[0] + (uint64_t) lanes[1] + (uint64_t) lanes[2]
+                      + (uint64_t) lanes[3] + (uint64_t) i64_dot_scalar(a + i, b + i, n - i));
+}
+
+__attribute__((target("avx2")))
+static void f64_axpy_avx2(double *y, double alpha, const double *x, size_t n)
+{
+    __m256d a = _mm256_set1_pd(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i),
+                                              _mm256_mul_pd(a, _mm256_loadu_pd(x + i))));
+        _mm256_storeu_pd(y + i + 4, _mm256_add_pd(_mm256_loadu_pd(y + i + 4),
+                                                  _mm256_mul_pd(a, _mm256_loadu_pd(x + i + 4))));
+    }
+    f64_axpy_scalar(y + i, alpha, x + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void f64_min_max_avx2(const double *a, size_t n, double *min, double *max)
+{
+    if (n < 4) {
+        f64_min_max_first(a, n, min, max);
+        return;
+    }
+    __m256d lo = _mm256_loadu_pd(a), hi = lo;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        lo = _mm256_min_pd(lo, x);
+        hi = _mm256_max_pd(hi, x);
+    }
+    double lanes[4], unused;
+    _mm256_storeu_pd(lanes, lo);
+    f64_min_max_first(lanes, 4, min, &unused);
+    _mm256_storeu_pd(lanes, hi);
+    f64_min_max_first(lanes, 4, &unused, max);
+    f64_min_max_scalar(a + i, n - i, min, max);
+}
+
+__attribute__((target("avx2")))
+static void i64_min_max_avx2(const int64_t *a, size_t n, int64_t *min, int64_t *max)
+{
+    if (n < 4) {
+        i64_min_max_first(a, n, min, max);
+        return;
+    }
+    __m256i lo = _mm256_loadu_si256((const __m256i *) a), hi = lo;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        lo = _mm256_blendv_epi8(lo, x, _mm256_cmpgt_epi64(lo, x));
+        hi = _mm256_blendv_epi8(hi, x, _mm256_cmpgt_epi64(x, hi));
+    }
+    int64_t lanes[4], unused;
+    _mm256_storeu_si256((__m256i *) lanes, lo);
+    i64_min_max_first(lanes, 4, min, &unused);
+    _mm256_storeu_si256((__m256i *) lanes, hi);
+    i64_min_max_first(lanes, 4, &unused, max);
+    i64_min_max_scalar(a + i, n - i, min, max);
+}
+
+#endif /* NUMVEC_X86 */
+
+static const NumvecImpl impls[] = {
+    {
+        f64_arith_scalar, i64_arith_scalar, f64_cmp_scalar, i64_cmp_scalar,
+        f64_sum_scalar, i64_sum_scalar, f64_dot_scalar, i64_dot_scalar,
+        f64_min_max_first, i64_min_max_first, f64_axpy_scalar
+    },
+#ifdef NUMVEC_X86
+    {
+        f64_arith_sse2, i64_arith_sse2, f64_cmp_sse2, i64_cmp_scalar,
+        f64_sum_sse2, i64_sum_sse2, f64_dot_sse2, i64_dot_scalar,
+        f64_min_max_sse2, i64_min_max_first, f64_axpy_sse2
+    },
+    {
+        f64_arith_avx2, i64_arith_avx2, f64_cmp_avx2, i64_cmp_avx2,
+        f64_sum_avx2, i64_sum_avx2, f64_dot_avx2, i64_dot_avx2,
+        f64_min_max_avx2, i64_min_max_avx2, f64_axpy_avx2
+    },
+#endif
+};
+
+static NumvecLevel level = NUMVEC_SCALAR;
+static bool initialized = false;
+
+static bool numvec_supported(NumvecLevel l)
+{
+    switch (l) {
+    case NUMVEC_SCALAR:
+        return true;
+#ifdef NUMVEC_X86
+    case NUMVEC_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case NUMVEC_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+void numvec_init()
+{
+    if (initialized) {
+        return;
+    }
+    level = NUMVEC_AVX2;
+    while (!numvec_supported(level)) {
+        level--;
+    }
+    initialized = true;
+}
+
+bool numvec_select(NumvecLevel l)
+{
+    if (!numvec_supported(l)) {
+        return false;
+    }
+    level = l;
+    initialized = true;
+    return true;
+}
+
+NumvecLevel numvec_level()
+{
+    return level;
+}
+
+void numvec_f64_arith(NumvecOp op, double *out, const double *a,
+                      const double *b, size_t bstep, size_t n)
+{
+    numvec_init();
+    impls[level].f64_arith(op, out, a, b, bstep, n);
+}
+
+bool numvec_i64_arith(NumvecOp op, int64_t *out, const int64_t *a,
+                      const int64_t *b, size_t bstep, size_t n)
+{
+    if (op == NUMVEC_DIV) {
+        /* no vector unit divides integers */
+        return i64_div_scalar(out, a, b, bstep, n);
+    }
+    numvec_init();
+    impls[level].i64_arith(op, out, a, b, bstep, n);
+    return true;
+}
+
+void numvec_f64_cmp(NumvecCmp cmp, int64_t *mask, const double *a,
+                    const double *b, size_t bstep, size_t n)
+{
+    numvec_init();
+    impls[level].f64_cmp(cmp, mask, a, b, bstep, n);
+}
+
+void numvec_i64_cmp(NumvecCmp cmp, int64_t *mask, const int64_t *a,
+                    const int64_t *b, size_t bstep, size_t n)
+{
+    numvec_init();
+    impls[level].i64_cmp(cmp, mask, a, b, bstep, n);
+}
+
+double numvec_f64_sum(const double *a, size_t n)
+{
+    numvec_init();
+    return impls[level].f64_sum(a, n);
+}
+
+int64_t numvec_i64_sum(const int64_t *a, size_t n)
+{
+    numvec_init();
+    return impls[level].i64_sum(a, n);
+}
+
+double numvec_f64_dot(const double *a, const double *b, size_t n)
+{
+    numvec_init();
+    return impls[level].f64_dot(a, b, n);
+}
+
+int64_t numvec_i64_dot(const int64_t *a, const int64_t *b, size_t n)
+{
+    numvec_init();
+    return impls[level].i64_dot(a, b, n);
+}
+
+void numvec_f64_min_max(const double *a, size_t n, double *min, double *max)
+{
+    numvec_init();
+    impls[level].f64_min_max(a, n, min, max);
+}
+
+void numvec_i64_min_max(const int64_t *a, size_t n, int64_t *min, int64_t *max)
+{
+    numvec_init();
+    impls[level].i64_min_max(a, n, min, max);
+}
+
+void numvec_f64_axpy(double *y, double alpha, const double *x, size_t n)
+{
+    numvec_init();
+    impls[level].f64_axpy(y, alpha, x, n);
+}
@@ -1,5 +1,9 @@
 #include "parser.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
 #include "lexer.h"
 #include "log.h"
 #include "value.h"
@@ -16,326 +20,332 @@
 
 typedef struct {
     Lexer *lexer;
-    LexerToken *cur_tok;
+    LexerToken cur_tok;
+    bool has_tok;
+    char *text;         /* scratch space for token text */
+    size_t text_size;
+    const void *base;   /* managed block holding the input, if any */
 } TokenStream;
 
 
-static TokenStream *tokenstream_new(Lexer *l)
+static TokenStream *tokenstream_new(Lexer *l, const void *base)
 {
     TokenStream *ts = (TokenStream*) malloc(sizeof(TokenStream));
-    *ts = (TokenStream) { .lexer = l, .cur_tok = NULL };
+    *ts = (TokenStream) {
+        .lexer = l, .has_tok = false, .text = NULL, .text_size = 0,
+        .base = base
+    };
     return ts;
 }
 
 static void tokenstream_delete(TokenStream *ts)
 {
     if (ts) {
-        lexer_delete_token(ts->cur_tok);
+        free(ts->text);
         free(ts);
     }
 }
 
 static LexerToken *tokenstream_peek(TokenStream *ts)
 {
-    if (!ts->cur_tok) {
+    if (!ts->has_tok) {
         ts->cur_tok = lexer_get_token(ts->lexer);
+        ts->has_tok = true;
     }
-    return ts->cur_tok;
+    return &ts->cur_tok;
 }
 
-static LexerToken *tokenstream_get(TokenStream *ts)
+static LexerToken tokenstream_get(TokenStream *ts)
 {
-    LexerToken *tok = ts->cur_tok ? ts->cur_tok : lexer_get_token(ts->lexer);
-    ts->cur_tok = NULL;
+    LexerToken tok = ts->has_tok ? ts->cur_tok : lexer_get_token(ts->lexer);
+    ts->has_tok = false;
     return tok;
 }
 
-static void tokenstream_consume(TokenStream *ts)
+static const char *tokenstream_text(TokenStream *ts, const LexerToken *tok,
+                                    size_t *len)
 {
-    if (ts->cur_tok) {
-        lexer_delete_token(ts->cur_tok);
-        ts->cur_tok = NULL;
-    } else {
-        LexerToken *tok = tokenstream_get(ts);
-        lexer_delete_token(tok);
+    /* The scratch buffer only ever grows, so reading a file doesn't
+     * allocate per token. */
+    if (tok->length + 1 > ts->text_size) {
+        size_t size = 2 * (tok->length + 1);
+        char *text = realloc(ts->text, size);
+        if (!text) {
+            LOG_CRITICAL("Out of memory: failed to allocate %lu bytes for a token", size);
+            exit(EXIT_FAILURE);
+        }
+        ts->text = text;
+        ts->text_size = size;
     }
+    size_t n = lexer_token_copy(ts->lexer, tok, ts->text);
+    if (len) {
+        *len = n;
+    }
+    return ts->text;
 }
 
 /*
  * Parser
+ *
+ * The grammar is
+ *
+ *   P -> S S* $
+ *   S -> A | ( S* ) | quote S
+ *
+ * Instead of recursing per nesting level (and per list element), the
+ * parser keeps the open lists and quotes on an explicit stack, so the
+ * nesting depth doesn't depend on the C stack. It is limited to
+ * PARSER_MAX_DEPTH all the same, since marking the result recurses once
+ * per level. Lists are collected with a ListBuilder, which makes reading
+ * a list linear in its length.
  */
 
 /* forward declarations */
 static ParseResult parser_parse_sexpr(TokenStream *ts, Value **ast);
-static ParseResult parser_parse_list(TokenStream *ts, Value **ast);
-static ParseResult parser_parse_atom(TokenStream *ts, Value **ast);
 static ParseResult parser_parse_program(TokenStream *ts, Value **ast);
 
 const char *QUOTES[] = { "quote", "quasiquote", "unquote", "splice-unquote" };
 
-
-ParseResult parser_parse(FILE *stream, Value **ast)
+static ParseResult parser_parse_lexer(Lexer *lexer, const void *base, Value **ast)
 {
-    Lexer *lexer = lexer_new(stream);
-    TokenStream *ts = tokenstream_new(lexer);
+    TokenStream *ts = tokenstream_new(lexer, base);
     ParseResult success = parser_parse_program(ts, ast);
     tokenstream_delete(ts);
     lexer_delete(lexer);
     return success;
 }
 
-static ParseResult parser_parse_program(TokenStream *ts, Value **ast)
+ParseResult parser_parse(FILE *stream, Value **ast)
 {
-    LexerToken *tok = tokenstream_peek(ts);
-    if (!tok) {
-        LOG_CRITICAL("Line %lu, column %lu: Unexpected lexer failure",
-                     ts->lexer->line_no, ts->lexer->char_no);
-        *ast = NULL;
-        return PARSER_FAIL;
-    }
-    switch (tok->type) {
-        case LEXER_TOK_ERROR: {
-            LOG_CRITICAL("Line %lu, column %lu: L -> ? has parse error at \"%s\"",
-                         ts->lexer->line_no, ts->lexer->char_no,
-                         tok->as.str);
-            *ast = NULL;
-            return PARSER_FAIL;
-        }
-        case LEXER_TOK_EOF: {
-            LOG_CRITICAL("Line %lu, column %lu: Unexpected EOF",
-                         ts->lexer->line_no, ts->lexer->char_no);
-            *ast = NULL;
-            return PARSER_FAIL;
-        }
-        case LEXER_TOK_INT:
-        case LEXER_TOK_FLOAT:
-        case LEXER_TOK_STRING:
-        case LEXER_TOK_SYMBOL:
-        case LEXER_TOK_LPAREN:
-        case LEXER_TOK_QUOTE:
-        case LEXER_TOK_QUASIQUOTE:
-        case LEXER_TOK_UNQUOTE:
-        case LEXER_TOK_SPLICE_UNQUOTE: {
-            LOG_DEBUG("Line %lu, column %lu: P -> L $", ts->lexer->line_no, ts->lexer->char_no);
-            ParseResult success;
-            Value *list = NULL;
-            if ((success = parser_parse_list(ts, &list)) != PARSER_SUCCESS) {
-                *ast = NULL;
-                return PARSER_FAIL;
-            }
+    return parser_parse_lexer(lexer_new_file(stream), NULL, ast);
+}
 
-            // consume eof
-            tok = tokenstream_get(ts);
-            if (!tok) {
-                LOG_CRITICAL("Line %lu, column %lu: Unexpected lexer failure",
-                             ts->lexer->line_no, ts->lexer->char_no);
-                *ast = NULL;
-                return PARSER_FAIL;
-            }
-            if (tok->type != LEXER_TOK_EOF) {
-                LOG_CRITICAL("Line %lu, column %lu: Expected EOF, got: %s",
-                             ts->lexer->line_no, ts->lexer->char_no,
-                             token_type_names[tok->type]);
-                lexer_delete_token(tok);
-                *ast = NULL;
-                return PARSER_FAIL;
-            }
-            lexer_delete_token(tok);
-            *ast = list_head(LIST(list));
-            return PARSER_SUCCESS;
-        }
-        default: {
-            LOG_CRITICAL("Line %lu, column %lu: Unexpected token %s",
-                         ts->lexer->line_no, ts->lexer->char_no,
-                         token_type_names[tok->type]);
-            return PARSER_FAIL;
-         }
+ParseResult parser_parse_buffer(const char *buf, size_t len, Value **ast)
+{
+    return parser_parse_lexer(lexer_new(buf, len), NULL, ast);
+}
+
+ParseResult parser_parse_string(const Value *str, Value **ast)
+{
+    /* string literals without escapes end up as slices of str */
+    return parser_parse_lexer(lexer_new(STRING_PTR(str), STRING_LEN(str)),
+                              value_string_base(str), ast);
+}
+
+struct Parser {
+    Lexer *lexer;
+    TokenStream *ts;
+};
+
+Parser *parser_new(FILE *stream)
+{
+    Parser *p = (Parser *) malloc(sizeof(Parser));
+    p->lexer = lexer_new_file(stream);
+    p->ts = tokenstream_new(p->lexer, NULL);
+    return p;
+}
+
+void parser_delete(Parser *p)
+{
+    if (p) {
+        tokenstream_delete(p->ts);
+        lexer_delete(p->lexer);
+        free(p);
     }
-    /* unreachable */
-    LOG_CRITICAL("Reached unreachable code. X-(");
-    return PARSER_FAIL;
 }
 
-static ParseResult parser_parse_list(TokenStream *ts, Value **ast)
+ParseResult parser_next(Parser *p, Value **form)
 {
-    LexerToken *tok = tokenstream_peek(ts);
-    if (!tok) {
-        LOG_CRITICAL("Line %lu, column %lu: Unexpected lexer failure",
-                     ts->lexer->line_no, ts->lexer->char_no);
-        *ast = NULL;
+    /* Only the tokens of the current form are held, so memory use is
+     * bounded by the size of the largest form, not the input. */
+    LexerToken *tok = tokenstream_peek(p->ts);
+    if (tok->type == LEXER_TOK_EOF) {
+        *form = NULL;
+        return PARSER_EOF;
+    }
+    if (parser_parse_sexpr(p->ts, form) != PARSER_SUCCESS) {
+        *form = NULL;
         return PARSER_FAIL;
     }
-    switch (tok->type) {
-        case LEXER_TOK_ERROR: {
-            LOG_CRITICAL("Line %lu, column %lu: L -> ? has parse error at \"%s\"",
-                         ts->lexer->line_no, ts->lexer->char_no,
-                         tok->as.str);
-            *ast = NULL;
-            return PARSER_FAIL;
-        }
-        case LEXER_TOK_EOF:
-        case LEXER_TOK_RPAREN: {
-            LOG_DEBUG("Line %lu, column %lu: L -> eps", ts->lexer->line_no, ts->lexer->char_no);
-            *ast = value_new_list(NULL);
-            return PARSER_SUCCESS;
-        }
-        case LEXER_TOK_INT:
-        case LEXER_TOK_FLOAT:
-        case LEXER_TOK_STRING:
-        case LEXER_TOK_SYMBOL:
-        case LEXER_TOK_LPAREN:
-        case LEXER_TOK_QUOTE:
-        case LEXER_TOK_QUASIQUOTE:
-        case LEXER_TOK_UNQUOTE:
-        case LEXER_TOK_SPLICE_UNQUOTE: {
-            LOG_DEBUG("Line %lu, column %lu: L -> S L", ts->lexer->line_no, ts->lexer->char_no);
-            Value *sexpr = NULL;
-            ParseResult success;
-            if ((success = parser_parse_sexpr(ts, &sexpr)) != PARSER_SUCCESS) {
-                *ast = NULL;
-                return PARSER_FAIL;
-            }
-            Value *list2 = NULL;
-            if ((success = parser_parse_list(ts, &list2)) != PARSER_SUCCESS) {
-                *ast = NULL;
-                return PARSER_FAIL;
-            }
-            Value *list = value_make_list(sexpr);
-            Value *head;
-            while((head = list_head(LIST(list2))) != NULL) {
-                LIST(list) = list_conj(LIST(list), head);
-                LIST(list2) = list_tail(LIST(list2));
-            }
-            *ast = list;
-            return PARSER_SUCCESS;
-        }
-        default: {
-            LOG_CRITICAL("Line %lu, column %lu: Unexpected token type for atom: %s",
-                         ts->lexer->line_no, ts->lexer->char_no,
-                         token_type_names[tok->type]);
-            return PARSER_FAIL;
-         }
+    return PARSER_SUCCESS;
+}
+
+#define PARSE_LIST -1
+
+typedef struct {
+    int quote;          /* index into QUOTES or PARSE_LIST */
+    ListBuilder list;
+} ParseFrame;
+
+/* the stack of frames is an Array, which the collector scans, so it sees
+ * the partial lists */
+static bool parse_stack_push(Array *stack, int quote)
+{
+    if (array_size(stack) == PARSER_MAX_DEPTH) {
+        return false;
     }
-    /* unreachable */
-    LOG_CRITICAL("Reached unreachable code. X-(");
-    return PARSER_FAIL;
+    ParseFrame frame = { .quote = quote };
+    list_builder_init(&frame.list);
+    array_push_back(stack, &frame, 1);
+    return true;
 }
 
-static ParseResult parser_parse_sexpr(TokenStream *ts, Value **ast)
+static ParseFrame *parse_stack_top(Array *stack)
 {
+    if (array_size(stack) == 0) {
+        return NULL;
+    }
+    return array_typed_at(stack, array_size(stack) - 1, ParseFrame);
+}
+
+static ParseResult parser_parse_program(TokenStream *ts, Value **ast)
+{
+    /* returns the first form, but the whole input has to be valid */
+    *ast = NULL;
     LexerToken *tok = tokenstream_peek(ts);
-    if (!tok) {
-        LOG_CRITICAL("Line %lu, column %lu: Unexpected lexer failure",
+    if (tok->type == LEXER_TOK_EOF) {
+        LOG_CRITICAL("Line %lu, column %lu: Unexpected EOF",
                      ts->lexer->line_no, ts->lexer->char_no);
         return PARSER_FAIL;
     }
-    size_t q = 0;
-    switch (tok->type) {
-        /*
-         * S -> ( L )
-         */
-        case LEXER_TOK_LPAREN: {
-            tokenstream_consume(ts); // LPAREN
-            Value *list = NULL;
-            ParseResult success = parser_parse_list(ts, &list);
-            if (success == PARSER_SUCCESS) {
-                tokenstream_consume(ts); // RPAREN
-                *ast = list;
-                return PARSER_SUCCESS;
-            }
+    Value *first = NULL;
+    while (tokenstream_peek(ts)->type != LEXER_TOK_EOF) {
+        Value *sexpr = NULL;
+        if (parser_parse_sexpr(ts, &sexpr) != PARSER_SUCCESS) {
             return PARSER_FAIL;
         }
-        /*
-         * S -> quote S
-         *
-         * Note that the order of labels matters here.
-         */
-        case LEXER_TOK_SPLICE_UNQUOTE:
-            q++;
-        case LEXER_TOK_UNQUOTE:
-            q++;
-        case LEXER_TOK_QUASIQUOTE:
-            q++;
-        case LEXER_TOK_QUOTE: {
-            LOG_DEBUG("Line %lu, column %lu: S -> (quote S)", ts->lexer->line_no, ts->lexer->char_no);
-            Value *quote = value_make_list(value_new_symbol(QUOTES[q]));
-            Value *sexpr;
-            tokenstream_consume(ts);
-            if (parser_parse_sexpr(ts, &sexpr) == PARSER_SUCCESS) {
-                LIST(quote) = list_conj(LIST(quote), sexpr);
-                *ast = quote;
-                return PARSER_SUCCESS;
-            }
+        if (!first) {
+            first = sexpr;
         }
-        /*
-         * S -> A
-         */
-        case LEXER_TOK_INT:
-        case LEXER_TOK_FLOAT:
-        case LEXER_TOK_STRING:
-        case LEXER_TOK_SYMBOL:
-            return parser_parse_atom(ts, ast);
-        /*
-         * failures and wrong tokens
-         */
-        case LEXER_TOK_EOF:
-            LOG_CRITICAL("Line %lu, column %lu: Unexpected EOF",
-                         ts->lexer->line_no, ts->lexer->char_no);
-            return PARSER_FAIL;
-        case LEXER_TOK_ERROR:
-            LOG_CRITICAL("Line %lu, column %lu: Lexer error",
-                         ts->lexer->line_no, ts->lexer->char_no);
-            return PARSER_FAIL;
-        default:
-            LOG_CRITICAL("Line %lu, column %lu: Unexpected token type for atom: %s",
-                         ts->lexer->line_no, ts->lexer->char_no,
-                         token_type_names[tok->type]);
-            return PARSER_FAIL;
     }
+    *ast = first;
     return PARSER_SUCCESS;
 }
 
-static ParseResult parser_parse_atom(TokenStream *ts, Value **ast)
+static ParseResult parser_parse_atom(TokenStream *ts, LexerToken *tok, Value **ast)
 {
-    LexerToken *tok = tokenstream_get(ts);
-    if (!tok) {
-        LOG_CRITICAL("Line %lu, column %lu: Unexpected lexer failure",
-                     ts->lexer->line_no, ts->lexer->char_no);
-        return PARSER_FAIL;
-    }
     switch (tok->type) {
         case LEXER_TOK_INT:
-            *ast = value_new_int(tok->as.int_);
+            *ast = value_new_int(lexer_token_int(ts->lexer, tok));
             break;
         case LEXER_TOK_FLOAT:
-            *ast = value_new_float(tok->as.double_);
+            *ast = value_new_float(lexer_token_float(ts->lexer, tok));
             break;
         case LEXER_TOK_STRING:
-            *ast = value_new_string(tok->as.str);
+            if (ts->base && !memchr(lexer_token_text(ts->lexer, tok), '\\', tok->length)) {
+                *ast = value_new_string_slice(ts->base, lexer_token_text(ts->lexer, tok),
+                                              tok->length);
+            } else {
+                size_t len;
+                const char *text = tokenstream_text(ts, tok, &len);
+                *ast = value_new_string_len(text, len);
+            }
             break;
         case LEXER_TOK_SYMBOL:
-            *ast = value_new_symbol(tok->as.str);
+            *ast = value_new_symbol(tokenstream_text(ts, tok, NULL));
             break;
-        case LEXER_TOK_EOF:
-            LOG_CRITICAL("Line %lu, column %lu: Unexpected EOF",
-                         ts->lexer->line_no, ts->lexer->char_no);
-            lexer_delete_token(tok);
-            return PARSER_FAIL;
-        case LEXER_TOK_ERROR:
-            LOG_CRITICAL("Line %lu, column %lu: Lexer error",
-                         ts->lexer->line_no, ts->lexer->char_no);
-            lexer_delete_token(tok);
-            return PARSER_FAIL;
         default:
             LOG_CRITICAL("Line %lu, column %lu: Unexpected token type for atom: %s",
                          ts->lexer->line_no, ts->lexer->char_no,
                          token_type_names[tok->type]);
-            lexer_delete_token(tok);
             return PARSER_FAIL;
     }
-    lexer_delete_token(tok);
     return PARSER_SUCCESS;
 }
 
-
-
+static ParseResult parser_parse_sexpr(TokenStream *ts, Value **ast)
+{
+    Array *stack = array_new(sizeof(ParseFrame));
+    ParseFrame *top;
+    ParseResult success = PARSER_FAIL;
+    *ast = NULL;
+    while (true) {
+        LexerToken tok = tokenstream_get(ts);
+        Value *sexpr = NULL;
+        size_t q = 0;
+        switch (tok.type) {
+            /*
+             * S -> ( S* )
+             */
+            case LEXER_TOK_LPAREN:
+                LOG_DEBUG("Line %lu, column %lu: S -> ( S* )",
+                          ts->lexer->line_no, ts->lexer->char_no);
+                if (!parse_stack_push(stack, PARSE_LIST)) {
+                    goto too_deep;
+                }
+                continue;
+            case LEXER_TOK_RPAREN:
+                top = parse_stack_top(stack);
+                if (!top || top->quote != PARSE_LIST) {
+                    LOG_CRITICAL("Line %lu, column %lu: Unexpected token %s",
+                                 ts->lexer->line_no, ts->lexer->char_no,
+                                 token_type_names[tok.type]);
+                    goto out;
+                }
+                sexpr = value_new_list(NULL);
+                LIST(sexpr) = list_builder_finish(&array_typed_pop_back(stack, ParseFrame)->list);
+                break;
+            /*
+             * S -> quote S
+             *
+             * Note that the order of labels matters here.
+             */
+            case LEXER_TOK_SPLICE_UNQUOTE:
+                q++;
+            case LEXER_TOK_UNQUOTE:
+                q++;
+            case LEXER_TOK_QUASIQUOTE:
+                q++;
+            case LEXER_TOK_QUOTE:
+                LOG_DEBUG("Line %lu, column %lu: S -> (quote S)",
+                          ts->lexer->line_no, ts->lexer->char_no);
+                if (!parse_stack_push(stack, (int) q)) {
+                    goto too_deep;
+                }
+                continue;
+            /*
+             * S -> A
+             */
+            case LEXER_TOK_INT:
+            case LEXER_TOK_FLOAT:
+            case LEXER_TOK_STRING:
+            case LEXER_TOK_SYMBOL:
+                if (parser_parse_atom(ts, &tok, &sexpr) != PARSER_SUCCESS) {
+                    goto out;
+                }
+                break;
+            /*
+             * failures and wrong tokens
+             */
+            case LEXER_TOK_EOF:
+                LOG_CRITICAL("Line %lu, column %lu: Unexpected EOF",
+                             ts->lexer->line_no, ts->lexer->char_no);
+                goto out;
+            case LEXER_TOK_ERROR:
+                LOG_CRITICAL("Line %lu, column %lu: Lexer error at \"%.*s\"",
+                             ts->lexer->line_no, ts->lexer->char_no,
+                             (int) tok.length, lexer_token_text(ts->lexer, &tok));
+                goto out;
+        }
+        /* a complete expression closes all quotes waiting for it and ends
+         * up in the innermost open list, or is the result */
+        while ((top = parse_stack_top(stack)) && top->quote != PARSE_LIST) {
+            array_pop_back(stack);
+            Value *quote = value_make_list(value_new_symbol(QUOTES[top->quote]));
+            LIST(quote) = list_conj(LIST(quote), sexpr);
+            sexpr = quote;
+        }
+        if (!top) {
+            *ast = sexpr;
+            success = PARSER_SUCCESS;
+            goto out;
+        }
+        list_builder_append(&top->list, sexpr);
+    }
+too_deep:
+    LOG_CRITICAL("Line %lu, column %lu: Nesting deeper than %d",
+                 ts->lexer->line_no, ts->lexer->char_no, PARSER_MAX_DEPTH);
+out:
+    array_delete(stack);
+    return success;
+}
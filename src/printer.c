@@ -0,0 +1,386 @@
+#include "printer.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fpconv.h"
+#include "log.h"
+
+const char *printer_flush_names[] = {
+    "line",
+    "block",
+    "explicit"
+};
+
+static Printer out;
+static bool out_initialized = false;
+static int out_policy = -1;   /* -1: line on a terminal, block otherwise */
+
+
+static void *printer_alloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (!ptr) {
+        LOG_CRITICAL("Out of memory: failed to allocate %lu bytes of output", size);
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void printer_init(Printer *p, FILE *fp, PrinterFlush policy)
+{
+    *p = (Printer) {
+        .fp = fp, .buf = printer_alloc(PRINTER_BUFSIZE), .len = 0,
+        .capacity = PRINTER_BUFSIZE, .policy = policy, .newline = false
+    };
+    string_builder_init(&p->sb);
+}
+
+void printer_init_string(Printer *p)
+{
+    *p = (Printer) {
+        .fp = NULL, .buf = NULL, .len = 0, .capacity = 0,
+        .policy = PRINTER_FLUSH_EXPLICIT, .newline = false
+    };
+    string_builder_init(&p->sb);
+}
+
+Value *printer_finish(Printer *p)
+{
+    return string_builder_finish(&p->sb);
+}
+
+void printer_delete(Printer *p)
+{
+    printer_flush(p);
+    free(p->buf);
+    p->buf = NULL;
+    p->capacity = 0;
+}
+
+static void printer_stdout_exit()
+{
+    printer_flush(&out);
+}
+
+Printer *printer_stdout()
+{
+    if (!out_initialized) {
+        PrinterFlush policy = out_policy >= 0 ? (PrinterFlush) out_policy
+            : isatty(fileno(stdout)) ? PRINTER_FLUSH_LINE : PRINTER_FLUSH_BLOCK;
+        printer_init(&out, stdout, policy);
+        out_initialized = true;
+        atexit(printer_stdout_exit);
+    }
+    return &out;
+}
+
+bool printer_set_policy(const char *name)
+{
+    for (int i = PRINTER_FLUSH_LINE; i <= PRINTER_FLUSH_EXPLICIT; ++i) {
+        if (strcmp(name, printer_flush_names[i]) == 0) {
+            out_policy = i;
+            if (out_initialized) {
+                out.policy = (PrinterFlush) i;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void printer_flush(Printer *p)
+{
+    if (p->fp && p->len) {
+        fwrite(p->buf, 1, p->len, p->fp);
+        fflush(p->fp);
+        p->len = 0;
+    }
+    p->newline = false;
+}
+
+/*
+ * Makes room for n bytes, by flushing or, if nothing may be flushed, by
+ * growing. If the buffer can't grow it is flushed after all, and false
+ * means that n bytes don't fit even then.
+ */
+static bool printer_reserve(Printer *p, size_t n)
+{
+    if (p->len + n <= p->capacity) {
+        return true;
+    }
+    if (p->policy != PRINTER_FLUSH_EXPLICIT) {
+        printer_flush(p);
+        if (n <= p->capacity) {
+            return true;
+        }
+    }
+    size_t capacity = p->capacity;
+    while (p->len + n > capacity) {
+        capacity *= 2;
+    }
+    char *buf = realloc(p->buf, capacity);
+    if (!buf) {
+        printer_flush(p);
+        return n <= p->capacity;
+    }
+    p->buf = buf;
+    p->capacity = capacity;
+    return true;
+}
+
+void printer_write(Printer *p, const char *str, size_t len)
+{
+    if (!p->fp) {
+        string_builder_append(&p->sb, str, len);
+        return;
+    }
+    if (p->policy == PRINTER_FLUSH_LINE && !p->newline) {
+        p->newline = memchr(str, '\n', len) != NULL;
+    }
+    if (len > p->capacity && p->policy != PRINTER_FLUSH_EXPLICIT) {
+        /* too big to buffer, write it through */
+        printer_flush(p);
+        fwrite(str, 1, len, p->fp);
+        return;
+    }
+    if (!printer_reserve(p, len)) {
+        fwrite(str, 1, len, p->fp);
+        return;
+    }
+    memcpy(p->buf + p->len, str, len);
+    p->len += len;
+}
+
+void printer_write_char(Printer *p, char c)
+{
+    if (!p->fp) {
+        string_builder_append_char(&p->sb, c);
+        return;
+    }
+    if (c == '\n') {
+        p->newline = true;
+    }
+    /* always fits once the buffer is flushed */
+    printer_reserve(p, 1);
+    p->buf[p->len++] = c;
+}
+
+void printer_write_int(Printer *p, long n)
+{
+    if (!p->fp) {
+        string_builder_append_int(&p->sb, n);
+        return;
+    }
+    char digits[24];
+    char *d = digits + sizeof(digits);
+    unsigned long u = n < 0 ? -(unsigned long) n : (unsigned long) n;
+    do {
+        *--d = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (n < 0) {
+        *--d = '-';
+    }
+    printer_write(p, d, digits + sizeof(digits) - d);
+}
+
+void printer_write_float(Printer *p, double d)
+{
+    /* shortest digits that read back as d */
+    char digits[FPCONV_MAXLEN];
+    printer_write(p, digits, fpconv_dtoa(d, digits));
+}
+
+void printer_printf(Printer *p, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    if (!p->fp) {
+        string_builder_vprintf(&p->sb, fmt, args);
+        va_end(args);
+        return;
+    }
+    char small[128];
+    char *text = small;
+    va_list retry;
+    va_copy(retry, args);
+    int n = vsnprintf(small, sizeof(small), fmt, args);
+    if (n >= (int) sizeof(small)) {
+        text = printer_alloc(n + 1);
+        vsnprintf(text, n + 1, fmt, retry);
+    }
+    va_end(retry);
+    va_end(args);
+    if (n > 0) {
+        printer_write(p, text, n);
+    }
+    if (text != small) {
+        free(text);
+    }
+}
+
+void printer_value(Printer *p, const Value *v)
+{
+    switch(v->type) {
+    case VALUE_NIL:
+        printer_write(p, "nil", 3);
+        break;
+    case VALUE_BOOL:
+        if (BOOL(v)) {
+            printer_write(p, "true", 4);
+        } else {
+            printer_write(p, "false", 5);
+        }
+        break;
+    case VALUE_INT:
+        printer_write_int(p, INT(v));
+        break;
+    case VALUE_FLOAT:
+        printer_write_float(p, FLOAT(v));
+        break;
+    case VALUE_STRING:
+    case VALUE_SYMBOL:
+    case VALUE_EXCEPTION:
+        printer_write(p, STRING_PTR(v), STRING_LEN(v));
+        break;
+    case VALUE_LIST:
+        printer_write_char(p, '(');
+        Value *head;
+        const List *tail = v->value.list;
+        while((head = list_head(tail)) != NULL) {
+            printer_value(p, head);
+            tail = list_tail(tail);
+            if (list_head(tail)) {
+                printer_write_char(p, ' ');
+            }
+        }
+        printer_write_char(p, ')');
+        break;
+    case VALUE_FN:
+    case VALUE_MACRO_FN:
+        printer_write(p, "(lambda ", 8);
+        printer_value(p, FN(v)->args);
+        printer_write_char(p, ' ');
+        printer_value(p, FN(v)->body);
+        printer_write_char(p, ')');
+        break;
+    case VALUE_BUILTIN_FN:
+        printer_printf(p, "#<builtin_fn@%p>", (void *) v->value.builtin_fn);
+        break;
+    case VALUE_FILE:
+        printer_printf(p, "#<file@%p>", (void *) FILE_HANDLE(v));
+        break;
+    case VALUE_TRANSDUCER:
+        printer_printf(p, "#<transducer@%p>", (void *) XFORM(v));
+        break;
+    case VALUE_CACHE:
+        printer_printf(p, MEMO(v)->fn ? "#<memoized_fn@%p>" : "#<cache@%p>", (void *) MEMO(v));
+        break;
+    case VALUE_F64_VECTOR:
+    case VALUE_I64_VECTOR:
+        printer_write(p, v->type == VALUE_F64_VECTOR ? "#f64[" : "#i64[", 5);
+        for (size_t i = 0; i < NUMVEC(v)->size; ++i) {
+            if (i) {
+                printer_write_char(p, ' ');
+            }
+            if (v->type == VALUE_F64_VECTOR) {
+                printer_write_float(p, NUMVEC(v)->data.f64[i]);
+            } else {
+                printer_write_int(p, NUMVEC(v)->data.i64[i]);
+            }
+        }
+        printer_write_char(p, ']');
+        break;
+    case VALUE_MATRIX:
+        printer_write(p, "#mat[", 5);
+        for (size_t i = 0; i < MATRIX(v)->rows; ++i) {
+            if (i) {
+                printer_write_char(p, ' ');
+            }
+            printer_write_char(p, '[');
+            for (size_t j = 0; j < MATRIX(v)->cols; ++j) {
+                if (j) {
+                    printer_write_char(p, ' ');
+                }
+                printer_write_float(p, MATRIX(v)->data[i * MATRIX(v)->cols + j]);
+            }
+            printer_write_char(p, ']');
+        }
+        printer_write_char(p, ']');
+        break;
+    case VALUE_LAZY_SEQ:
+        /* realizes the whole sequence, like printing it in Clojure */
+        printer_write_char(p, '(');
+        SeqIter it;
+        value_seq_iter_init(&it, v);
+        for (Value *x = value_seq_iter_next(&it); x != NULL; ) {
+            printer_value(p, x);
+            if ((x = value_seq_iter_next(&it)) != NULL) {
+                printer_write_char(p, ' ');
+            }
+        }
+        printer_write_char(p, ')');
+        break;
+    case VALUE_HASH_SET:
+        printer_write(p, "#{", 2);
+        HamtIter hamt_it;
+        hamt_iter_init(&hamt_it, HAMT(v));
+        for (Value *x = hamt_iter_next(&hamt_it); x != NULL; ) {
+            printer_value(p, x);
+            if ((x = hamt_iter_next(&hamt_it)) != NULL) {
+                printer_write_char(p, ' ');
+            }
+        }
+        printer_write_char(p, '}');
+        break;
+    case VALUE_SORTED_MAP:
+    case VALUE_SORTED_SET:
+        /* in order, as #{k ...} or {k v, ...} */
+        printer_write(p, v->type == VALUE_SORTED_SET ? "#{" : "{", v->type == VALUE_SORTED_SET ? 2 : 1);
+        BTreeIter btree_it;
+        btree_iter_init(&btree_it, BTREE(v), NULL);
+        for (const BTreeEntry *e = btree_iter_next(&btree_it); e != NULL; ) {
+            printer_value(p, e->key);
+            if (v->type == VALUE_SORTED_MAP) {
+                printer_write_char(p, ' ');
+                printer_value(p, e->value);
+            }
+            if ((e = btree_iter_next(&btree_it)) != NULL) {
+                printer_write(p, v->type == VALUE_SORTED_SET ? " " : ", ", v->type == VALUE_SORTED_SET ? 1 : 2);
+            }
+        }
+        printer_write_char(p, '}');
+        break;
+    }
+}
+
+void printer_values(Printer *p, const Value *args, bool printable)
+{
+    /* the arguments of str/pr, separated by blanks for pr */
+    if (!args) {
+        return;
+    }
+    if (args->type == VALUE_LIST) {
+        const List *list = LIST(args);
+        Value *head;
+        while ((head = list_head(list)) != NULL) {
+            printer_value(p, head);
+            list = list_tail(list);
+            if (printable) {
+                printer_write_char(p, ' ');
+            }
+        }
+    } else {
+        printer_value(p, args);
+    }
+}
+
+void printer_end(Printer *p)
+{
+    if (p->policy == PRINTER_FLUSH_LINE && p->newline) {
+        printer_flush(p);
+    }
+}
@@ -0,0 +1,236 @@
+#include "profile.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "djb2.h"
+#include "log.h"
+
+/*
+ * Bookkeeping lives in plain malloc'd memory: the profiler must neither
+ * show up in its own statistics nor keep managed objects alive.
+ */
+
+#define PROFILE_MAX_KINDS 64
+#define PROFILE_TOP_SITES 20
+
+typedef struct {
+    char *name;
+    size_t count;  /* cumulative allocations */
+    size_t bytes;  /* cumulative bytes */
+} ProfileSite;
+
+typedef struct ProfileRecord {
+    void *ptr;
+    size_t size;
+    int kind;
+    struct ProfileRecord *next;
+} ProfileRecord;
+
+bool profile_enabled = false;
+
+static ProfileKind kinds[PROFILE_MAX_KINDS];
+static size_t n_kinds = 0;
+
+static ProfileSite *sites = NULL;
+static size_t n_sites = 0;
+static size_t cap_sites = 0;
+static int current_site = 0;
+/* open addressing index into `sites`, -1 marks free slots */
+static int *site_index = NULL;
+
+/* live allocations, keyed by address */
+static ProfileRecord **records = NULL;
+static size_t cap_records = 0;
+static size_t n_records = 0;
+
+
+static void profile_out_of_memory(size_t size)
+{
+    LOG_CRITICAL("Out of memory: the allocation profiler failed to allocate %lu bytes", size);
+    exit(EXIT_FAILURE);
+}
+
+static size_t record_index(void *ptr, size_t capacity)
+{
+    uintptr_t p = (uintptr_t) ptr;
+    p ^= p >> 17;
+    p *= 0x9E3779B97F4A7C15ull;
+    return (size_t) (p >> 16) & (capacity - 1);
+}
+
+static void records_resize(size_t capacity)
+{
+    ProfileRecord **resized = calloc(capacity, sizeof(ProfileRecord *));
+    if (!resized) {
+        profile_out_of_memory(capacity * sizeof(ProfileRecord *));
+    }
+    for (size_t i = 0; i < cap_records; ++i) {
+        ProfileRecord *r = records[i];
+        while (r) {
+            ProfileRecord *next = r->next;
+            size_t j = record_index(r->ptr, capacity);
+            r->next = resized[j];
+            resized[j] = r;
+            r = next;
+        }
+    }
+    free(records);
+    records = resized;
+    cap_records = capacity;
+}
+
+static int kind_index(const char *kind)
+{
+    for (size_t i = 0; i < n_kinds; ++i) {
+        if (kinds[i].kind == kind || strcmp(kinds[i].kind, kind) == 0) {
+            return (int) i;
+        }
+    }
+    if (n_kinds == PROFILE_MAX_KINDS) {
+        LOG_WARNING("Too many allocation kinds, not tracking %s", kind);
+        return -1;
+    }
+    kinds[n_kinds] = (ProfileKind) { .kind = kind, .count = 0, .bytes = 0 };
+    return (int) n_kinds++;
+}
+
+void profile_start()
+{
+    profile_enabled = true;
+    records_resize(1 << 16);
+    /* site 0 collects everything outside of compound functions */
+    current_site = profile_intern_site("<toplevel>");
+    atexit(profile_report);
+}
+
+void profile_alloc(void *ptr, size_t size, const char *kind)
+{
+    if (!ptr) return;
+    int k = kind_index(kind);
+    if (k < 0) return;
+    kinds[k].count++;
+    kinds[k].bytes += size;
+    sites[current_site].count++;
+    sites[current_site].bytes += size;
+
+    if (n_records >= cap_records) {
+        records_resize(cap_records * 2);
+    }
+    ProfileRecord *r = malloc(sizeof(ProfileRecord));
+    if (!r) {
+        profile_out_of_memory(sizeof(ProfileRecord));
+    }
+    size_t i = record_index(ptr, cap_records);
+    *r = (ProfileRecord) {
+        .ptr = ptr, .size = size, .kind = k, .next = records[i]
+    };
+    records[i] = r;
+    n_records++;
+}
+
+void profile_free(void *ptr)
+{
+    if (!records) return;
+    size_t i = record_index(ptr, cap_records);
+    ProfileRecord *prev = NULL;
+    for (ProfileRecord *r = records[i]; r; prev = r, r = r->next) {
+        if (r->ptr == ptr) {
+            kinds[r->kind].count--;
+            kinds[r->kind].bytes -= r->size;
+            if (prev) {
+                prev->next = r->next;
+            } else {
+                records[i] = r->next;
+            }
+            free(r);
+            n_records--;
+            return;
+        }
+    }
+}
+
+int profile_site()
+{
+    return current_site;
+}
+
+void profile_set_site(int site)
+{
+    current_site = site;
+}
+
+static size_t site_slot(const char *name)
+{
+    /* the index has 2 * cap_sites slots, so there is always a free one */
+    size_t mask = 2 * cap_sites - 1;
+    size_t i = djb2((char *) name) & mask;
+    while (site_index[i] >= 0 && strcmp(sites[site_index[i]].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+int profile_intern_site(const char *name)
+{
+    if (n_sites == cap_sites) {
+        size_t capacity = cap_sites ? 2 * cap_sites : 64;
+        ProfileSite *grown = realloc(sites, capacity * sizeof(ProfileSite));
+        if (!grown) {
+            profile_out_of_memory(capacity * sizeof(ProfileSite));
+        }
+        sites = grown;
+        cap_sites = capacity;
+        free(site_index);
+        site_index = malloc(2 * cap_sites * sizeof(int));
+        if (!site_index) {
+            profile_out_of_memory(2 * cap_sites * sizeof(int));
+        }
+        memset(site_index, -1, 2 * cap_sites * sizeof(int));
+        for (size_t i = 0; i < n_sites; ++i) {
+            site_index[site_slot(sites[i].name)] = (int) i;
+        }
+    }
+    size_t slot = site_slot(name);
+    if (site_index[slot] < 0) {
+        char *copy = strdup(name);
+        if (!copy) {
+            profile_out_of_memory(strlen(name) + 1);
+        }
+        sites[n_sites] = (ProfileSite) { .name = copy, .count = 0, .bytes = 0 };
+        site_index[slot] = (int) n_sites++;
+    }
+    return site_index[slot];
+}
+
+size_t profile_kinds(const ProfileKind **kinds_)
+{
+    *kinds_ = kinds;
+    return n_kinds;
+}
+
+static int compare_sites(const void *a, const void *b)
+{
+    const ProfileSite *sa = a;
+    const ProfileSite *sb = b;
+    return (sa->bytes < sb->bytes) - (sa->bytes > sb->bytes);
+}
+
+void profile_report()
+{
+    ProfileSite *sorted = malloc(n_sites * sizeof(ProfileSite));
+    if (!sorted) {
+        LOG_WARNING("Out of memory: no allocation site report");
+        return;
+    }
+    memcpy(sorted, sites, n_sites * sizeof(ProfileSite));
+    qsort(sorted, n_sites, sizeof(ProfileSite), compare_sites);
+    fprintf(stderr, "Top allocation sites by bytes:\n");
+    fprintf(stderr, "%16s %12s  %s\n", "bytes", "count", "site");
+    for (size_t i = 0; i < n_sites && i < PROFILE_TOP_SITES; ++i) {
+        fprintf(stderr, "%16lu %12lu  %s\n", sorted[i].bytes, sorted[i].count, sorted[i].name);
+    }
+    free(sorted);
+}
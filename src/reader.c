@@ -10,7 +10,7 @@
 
 Reader *reader_new(FILE *stream)
 {
-    Lexer *lexer = lexer_new(stream);
+    Lexer *lexer = lexer_new_file(stream);
     Reader *reader = (Reader *) malloc(sizeof(Reader));
     *reader = (Reader) {
         .lexer = lexer
@@ -20,7 +20,7 @@ Reader *reader_new(FILE *stream)
 
 void reader_delete(Reader *r)
 {
-    free(r->lexer);
+    lexer_delete(r->lexer);
     free(r);
 }
 
@@ -32,11 +32,11 @@ AstSexpr *reader_read(Reader *reader)
     ReaderStackToken start = { .type = N_PROG, .ast = {NULL} };
     reader_stack_push(stack, eof);
     reader_stack_push(stack, start);
-    LexerToken *tok;
+    LexerToken token = lexer_get_token(reader->lexer);
+    LexerToken *tok = &token;
     ReaderStackToken tos;
 
-    tok = lexer_get_token(reader->lexer);
-    while (tok != NULL) {
+    while (true) {
         reader_stack_peek(stack, &tos);
         LOG_DEBUG("tos -> %s | tok -> %s",
                   reader_stack_token_type_names[tos.type],
@@ -79,22 +79,24 @@ AstSexpr *reader_read(Reader *reader)
             if (tos.type == N_ATOM && tok->type == LEXER_TOK_INT) {
                 reader_stack_pop(stack, &tos);
                 tos.ast.atom->node.type = AST_ATOM_INT;
-                tos.ast.atom->as.integer = LEXER_TOKEN_VAL_AS_INT(tok);
+                tos.ast.atom->as.integer = lexer_token_int(reader->lexer, tok);
                 LOG_DEBUG("Rule: A->int (int=%d)", tos.ast.atom->as.integer);
             } else if (tos.type == N_ATOM && tok->type == LEXER_TOK_FLOAT) {
                 reader_stack_pop(stack, &tos);
                 tos.ast.atom->node.type = AST_ATOM_FLOAT;
-                tos.ast.atom->as.decimal = LEXER_TOKEN_VAL_AS_FLOAT(tok);
+                tos.ast.atom->as.decimal = lexer_token_float(reader->lexer, tok);
                 LOG_DEBUG("Rule: A->float (float=%.2f)", tos.ast.atom->as.decimal);
             } else if (tos.type == N_ATOM && tok->type == LEXER_TOK_STRING) {
                 reader_stack_pop(stack, &tos);
                 tos.ast.atom->node.type = AST_ATOM_STRING;
-                tos.ast.atom->as.string = strdup(LEXER_TOKEN_VAL_AS_STR(tok));
+                tos.ast.atom->as.string = malloc(tok->length + 1);
+                lexer_token_copy(reader->lexer, tok, tos.ast.atom->as.string);
                 LOG_DEBUG("Rule: A->str (str=%s)", tos.ast.atom->as.string);
             } else if (tos.type == N_ATOM && tok->type == LEXER_TOK_SYMBOL) {
                 reader_stack_pop(stack, &tos);
                 tos.ast.atom->node.type = AST_ATOM_SYMBOL;
-                tos.ast.atom->as.string = strdup(LEXER_TOKEN_VAL_AS_STR(tok));
+                tos.ast.atom->as.string = malloc(tok->length + 1);
+                lexer_token_copy(reader->lexer, tok, tos.ast.atom->as.string);
                 LOG_DEBUG("Rule: A->sym (sym=%s)", tos.ast.atom->as.symbol);
             } else if (tos.type == N_LIST) {
                 if (tok->type == LEXER_TOK_LPAREN ||
@@ -132,7 +134,6 @@ AstSexpr *reader_read(Reader *reader)
                                  reader_stack_token_type_names[tos.type],
                                  token_type_names[tok->type]);
                     ast_delete_sexpr(ast);
-                    lexer_delete_token(tok);
                     reader_stack_delete(stack);
                     return NULL;
                 }
@@ -209,7 +210,6 @@ AstSexpr *reader_read(Reader *reader)
                                  reader_stack_token_type_names[tos.type],
                                  token_type_names[tok->type]);
                     ast_delete_sexpr(ast);
-                    lexer_delete_token(tok);
                     reader_stack_delete(stack);
                     return NULL;
                 }
@@ -246,11 +246,7 @@ AstSexpr *reader_read(Reader *reader)
                 return NULL;
             }
         }
-        lexer_delete_token(tok);
-        tok = lexer_get_token(reader->lexer);
+        token = lexer_get_token(reader->lexer);
     }
-    lexer_delete_token(tok);
-    reader_stack_delete(stack);
-    return ast;
 }
 
@@ -0,0 +1,379 @@
+#include "scan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+const char *scan_level_names[] = {
+    "scalar",
+    "sse2",
+    "avx2"
+};
+
+typedef struct {
+    size_t (*space)(const char *, size_t, size_t, size_t *, size_t *);
+    size_t (*line)(const char *, size_t, size_t);
+    size_t (*string)(const char *, size_t, size_t);
+    void (*json_block)(const char *, ScanJsonBlock *);
+} ScanImpl;
+
+/*
+ * Scalar versions, also used for the tails the vector versions can't
+ * load in one go (we must not read past len: the buffer may be a mapped
+ * file that ends on a page boundary).
+ */
+
+static size_t scan_space_scalar(const char *buf, size_t pos, size_t len,
+                                size_t *lines, size_t *line_start)
+{
+    for (; pos < len; ++pos) {
+        switch (buf[pos]) {
+        case '\n':
+            (*lines)++;
+            *line_start = pos + 1;
+        case ' ':
+        case '\t':
+        case '\r':
+            break;
+        default:
+            return pos;
+        }
+    }
+    return len;
+}
+
+static size_t scan_line_scalar(const char *buf, size_t pos, size_t len)
+{
+    const char *p = memchr(buf + pos, '\n', len - pos);
+    return p ? (size_t) (p - buf) : len;
+}
+
+static size_t scan_string_scalar(const char *buf, size_t pos, size_t len)
+{
+    for (; pos < len; ++pos) {
+        char c = buf[pos];
+        if (c == '"' || c == '\\' || c == '\n') {
+            return pos;
+        }
+    }
+    return len;
+}
+
+static void scan_json_block_scalar(const char *block, ScanJsonBlock *m)
+{
+    *m = (ScanJsonBlock) { 0, 0, 0, 0, 0 };
+    for (int i = 0; i < SCAN_JSON_BLOCK; ++i) {
+        uint64_t bit = 1ull << i;
+        unsigned char c = (unsigned char) block[i];
+        switch (c) {
+        case '"':
+            m->quote |= bit;
+            break;
+        case '\\':
+            m->backslash |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            m->op |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            m->space |= bit;
+            break;
+        }
+        if (c < 0x20) {
+            m->control |= bit;
+        }
+    }
+}
+
+#ifdef SCAN_X86
+
+/* mask flags the line feeds in the block at pos */
+static void scan_count_lines(unsigned int mask, size_t pos,
+                             size_t *lines, size_t *line_start)
+{
+    if (mask) {
+        *lines += __builtin_popcount(mask);
+        *line_start = pos + (31 - __builtin_clz(mask)) + 1;
+    }
+}
+
+__attribute__((target("sse2")))
+static size_t scan_space_sse2(const char *buf, size_t pos, size_t len,
+                              size_t *lines, size_t *line_start)
+{
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i ht = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (buf + pos));
+        __m128i nl = _mm_cmpeq_epi8(v, lf);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp),
+                                               _mm_cmpeq_epi8(v, ht)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, cr), nl));
+        unsigned int stop = ~(unsigned int) _mm_movemask_epi8(ws) & 0xffff;
+        unsigned int nls = (unsigned int) _mm_movemask_epi8(nl);
+        if (stop) {
+            unsigned int k = __builtin_ctz(stop);
+            scan_count_lines(nls & ((1u << k) - 1), pos, lines, line_start);
+            return pos + k;
+        }
+        scan_count_lines(nls, pos, lines, line_start);
+    }
+    return scan_space_scalar(buf, pos, len, lines, line_start);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_line_sse2(const char *buf, size_t pos, size_t len)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (buf + pos));
+        unsigned int stop = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+        if (stop) {
+            return pos + __builtin_ctz(stop);
+        }
+    }
+    return scan_line_scalar(buf, pos, len);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_string_sse2(const char *buf, size_t pos, size_t len)
+{
+    const __m128i dq = _mm_set1_epi8('"');
+    const __m128i bs = _mm_set1_epi8('\\');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (buf + pos));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, dq),
+                                              _mm_cmpeq_epi8(v, bs)),
+                                 _mm_cmpeq_epi8(v, lf));
+        unsigned int stop = (unsigned int) _mm_movemask_epi8(m);
+        if (stop) {
+            return pos + __builtin_ctz(stop);
+        }
+    }
+    return scan_string_scalar(buf, pos, len);
+}
+
+__attribute__((target("sse2")))
+static void scan_json_block_sse2(const char *block, ScanJsonBlock *m)
+{
+    const __m128i dq = _mm_set1_epi8('"');
+    const __m128i bs = _mm_set1_epi8('\\');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i lbrace = _mm_set1_epi8('{');
+    const __m128i rbrace = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i ht = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    *m = (ScanJsonBlock) { 0, 0, 0, 0, 0 };
+    for (int i = 0; i < SCAN_JSON_BLOCK; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (block + i));
+        /* '[' and ']' are '{' and '}' with the 0x20 bit cleared */
+        __m128i folded = _mm_or_si128(v, lower);
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, lbrace),
+                                               _mm_cmpeq_epi8(folded, rbrace)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, colon),
+                                               _mm_cmpeq_epi8(v, comma)));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp),
+                                               _mm_cmpeq_epi8(v, ht)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                                               _mm_cmpeq_epi8(v, lf)));
+        __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl);
+        m->quote |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, dq)) << i;
+        m->backslash |= (uint64_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, bs)) << i;
+        m->op |= (uint64_t) _mm_movemask_epi8(op) << i;
+        m->space |= (uint64_t) _mm_movemask_epi8(ws) << i;
+        m->control |= (uint64_t) _mm_movemask_epi8(control) << i;
+    }
+}
+
+__attribute__((target("avx2")))
+static size_t scan_space_avx2(const char *buf, size_t pos, size_t len,
+                              size_t *lines, size_t *line_start)
+{
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i ht = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (buf + pos));
+        __m256i nl = _mm256_cmpeq_epi8(v, lf);
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+                                                     _mm256_cmpeq_epi8(v, ht)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), nl));
+        unsigned int stop = ~(unsigned int) _mm256_movemask_epi8(ws);
+        unsigned int nls = (unsigned int) _mm256_movemask_epi8(nl);
+        if (stop) {
+            unsigned int k = __builtin_ctz(stop);
+            scan_count_lines(nls & ((1u << k) - 1), pos, lines, line_start);
+            return pos + k;
+        }
+        scan_count_lines(nls, pos, lines, line_start);
+    }
+    return scan_space_sse2(buf, pos, len, lines, line_start);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_line_avx2(const char *buf, size_t pos, size_t len)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (buf + pos));
+        unsigned int stop = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf));
+        if (stop) {
+            return pos + __builtin_ctz(stop);
+        }
+    }
+    return scan_line_sse2(buf, pos, len);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_string_avx2(const char *buf, size_t pos, size_t len)
+{
+    const __m256i dq = _mm256_set1_epi8('"');
+    const __m256i bs = _mm256_set1_epi8('\\');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (buf + pos));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, dq),
+                                                    _mm256_cmpeq_epi8(v, bs)),
+                                    _mm256_cmpeq_epi8(v, lf));
+        unsigned int stop = (unsigned int) _mm256_movemask_epi8(m);
+        if (stop) {
+            return pos + __builtin_ctz(stop);
+        }
+    }
+    return scan_string_sse2(buf, pos, len);
+}
+
+__attribute__((target("avx2")))
+static void scan_json_block_avx2(const char *block, ScanJsonBlock *m)
+{
+    const __m256i dq = _mm256_set1_epi8('"');
+    const __m256i bs = _mm256_set1_epi8('\\');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i lbrace = _mm256_set1_epi8('{');
+    const __m256i rbrace = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i ht = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+    *m = (ScanJsonBlock) { 0, 0, 0, 0, 0 };
+    for (int i = 0; i < SCAN_JSON_BLOCK; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (block + i));
+        __m256i folded = _mm256_or_si256(v, lower);
+        __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, lbrace),
+                                                     _mm256_cmpeq_epi8(folded, rbrace)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, colon),
+                                                     _mm256_cmpeq_epi8(v, comma)));
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+                                                     _mm256_cmpeq_epi8(v, ht)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+                                                     _mm256_cmpeq_epi8(v, lf)));
+        __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl), ctl);
+        m->quote |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dq)) << i;
+        m->backslash |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bs)) << i;
+        m->op |= (uint64_t) (uint32_t) _mm256_movemask_epi8(op) << i;
+        m->space |= (uint64_t) (uint32_t) _mm256_movemask_epi8(ws) << i;
+        m->control |= (uint64_t) (uint32_t) _mm256_movemask_epi8(control) << i;
+    }
+}
+
+#endif /* SCAN_X86 */
+
+static const ScanImpl impls[] = {
+    { scan_space_scalar, scan_line_scalar, scan_string_scalar, scan_json_block_scalar },
+#ifdef SCAN_X86
+    { scan_space_sse2, scan_line_sse2, scan_string_sse2, scan_json_block_sse2 },
+    { scan_space_avx2, scan_line_avx2, scan_string_avx2, scan_json_block_avx2 },
+#endif
+};
+
+static ScanLevel level = SCAN_SCALAR;
+static bool initialized = false;
+
+static bool scan_supported(ScanLevel l)
+{
+    switch (l) {
+    case SCAN_SCALAR:
+        return true;
+#ifdef SCAN_X86
+    case SCAN_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case SCAN_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+void scan_init()
+{
+    if (initialized) {
+        return;
+    }
+    level = SCAN_AVX2;
+    while (!scan_supported(level)) {
+        level--;
+    }
+    initialized = true;
+}
+
+bool scan_select(ScanLevel l)
+{
+    if (!scan_supported(l)) {
+        return false;
+    }
+    level = l;
+    initialized = true;
+    return true;
+}
+
+ScanLevel scan_level()
+{
+    return level;
+}
+
+size_t scan_space(const char *buf, size_t pos, size_t len,
+                  size_t *lines, size_t *line_start)
+{
+    return impls[level].space(buf, pos, len, lines, line_start);
+}
+
+size_t scan_line(const char *buf, size_t pos, size_t len)
+{
+    return impls[level].line(buf, pos, len);
+}
+
+size_t scan_string(const char *buf, size_t pos, size_t len)
+{
+    return impls[level].string(buf, pos, len);
+}
+
+void scan_json_block(const char *block, ScanJsonBlock *m)
+{
+    impls[level].json_block(block, m);
+}
@@ -0,0 +1,246 @@
+#include "sort.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static unsigned threads = 0;
+
+
+void sort_set_threads(unsigned n)
+{
+    threads = n;
+}
+
+unsigned sort_threads()
+{
+    long n = threads ? (long) threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) {
+        return 1;
+    }
+    return n > SORT_MAX_THREADS ? SORT_MAX_THREADS : (unsigned) n;
+}
+
+int64_t sort_f64_key(double d)
+{
+    /* IEEE 754 doubles order like sign-magnitude integers; flipping the
+     * magnitude of the negative ones makes that two's complement */
+    if (d == 0) {
+        d = 0;
+    } else if (isnan(d)) {
+        d = NAN;
+    }
+    int64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits < 0 ? bits ^ INT64_MAX : bits;
+}
+
+/*
+ * Keys
+ */
+
+static void keys_insertion_sort(SortKey *keys, size_t n)
+{
+    for (size_t i = 1; i < n; ++i) {
+        SortKey k = keys[i];
+        size_t j = i;
+        for (; j > 0 && k.key < keys[j - 1].key; --j) {
+            keys[j] = keys[j - 1];
+        }
+        keys[j] = k;
+    }
+}
+
+static void keys_merge(SortKey *out, const SortKey *a, size_t na, const SortKey *b, size_t nb)
+{
+    /* ties go to a, which keeps the sort stable */
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        out[k++] = b[j].key < a[i].key ? b[j++] : a[i++];
+    }
+    memcpy(out + k, a + i, (na - i) * sizeof(SortKey));
+    memcpy(out + k + na - i, b + j, (nb - j) * sizeof(SortKey));
+}
+
+static void keys_sort(SortKey *keys, SortKey *tmp, size_t n)
+{
+    /* bottom up, merging back and forth between keys and tmp */
+    for (size_t i = 0; i < n; i += SORT_RUN) {
+        keys_insertion_sort(keys + i, n - i < SORT_RUN ? n - i : SORT_RUN);
+    }
+    SortKey *from = keys, *to = tmp;
+    for (size_t width = SORT_RUN; width < n; width *= 2) {
+        for (size_t i = 0; i < n; i += 2 * width) {
+            size_t na = n - i < width ? n - i : width;
+            size_t nb = n - i - na < width ? n - i - na : width;
+            keys_merge(to + i, from + i, na, from + i + na, nb);
+        }
+        SortKey *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != keys) {
+        memcpy(keys, from, n * sizeof(SortKey));
+    }
+}
+
+typedef struct SortTask {
+    SortKey *keys;
+    SortKey *tmp;
+    size_t n;
+    size_t half;   /* merge keys[0, half) and keys[half, n) into tmp */
+} SortTask;
+
+static void *keys_sort_task(void *arg)
+{
+    SortTask *t = arg;
+    keys_sort(t->keys, t->tmp, t->n);
+    return NULL;
+}
+
+static void *keys_merge_task(void *arg)
+{
+    SortTask *t = arg;
+    keys_merge(t->tmp, t->keys, t->half, t->keys + t->half, t->n - t->half);
+    return NULL;
+}
+
+static void run_tasks(void *(*fn)(void *), SortTask *tasks, size_t n)
+{
+    /* the first task runs on the calling thread */
+    pthread_t ids[SORT_MAX_THREADS];
+    bool started[SORT_MAX_THREADS];
+    for (size_t i = 1; i < n; ++i) {
+        started[i] = pthread_create(&ids[i], NULL, fn, &tasks[i]) == 0;
+        if (!started[i]) {
+            fn(&tasks[i]);
+        }
+    }
+    fn(&tasks[0]);
+    for (size_t i = 1; i < n; ++i) {
+        if (started[i]) {
+            pthread_join(ids[i], NULL);
+        }
+    }
+}
+
+static void keys_sort_parallel(SortKey *keys, SortKey *tmp, size_t n, size_t parts)
+{
+    /* sort equal parts on their own threads, then merge neighbouring
+     * parts pairwise, again in parallel, until one is left */
+    SortTask tasks[SORT_MAX_THREADS];
+    size_t bounds[SORT_MAX_THREADS + 1];
+    for (size_t i = 0; i <= parts; ++i) {
+        bounds[i] = n / parts * i + (i == parts ? n % parts : 0);
+    }
+    for (size_t i = 0; i < parts; ++i) {
+        tasks[i] = (SortTask) {
+            .keys = keys + bounds[i], .tmp = tmp + bounds[i], .n = bounds[i + 1] - bounds[i]
+        };
+    }
+    run_tasks(keys_sort_task, tasks, parts);
+    SortKey *from = keys, *to = tmp;
+    while (parts > 1) {
+        size_t merged = 0;
+        for (size_t i = 0; i < parts; i += 2) {
+            size_t end = bounds[i + 2 <= parts ? i + 2 : parts];
+            tasks[merged] = (SortTask) {
+                .keys = from + bounds[i], .tmp = to + bounds[i],
+                .n = end - bounds[i], .half = bounds[i + 1] - bounds[i]
+            };
+            bounds[merged++] = bounds[i];
+        }
+        bounds[merged] = n;
+        run_tasks(keys_merge_task, tasks, merged);
+        parts = merged;
+        SortKey *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != keys) {
+        memcpy(keys, from, n * sizeof(SortKey));
+    }
+}
+
+void sort_keys(SortKey *keys, size_t n)
+{
+    SortKey *tmp = malloc(n * sizeof(SortKey));
+    size_t parts = n < SORT_PARALLEL_MIN ? 1 : sort_threads();
+    if (parts > 1) {
+        keys_sort_parallel(keys, tmp, n, parts);
+    } else {
+        keys_sort(keys, tmp, n);
+    }
+    free(tmp);
+}
+
+/*
+ * Indices, compared by a callback
+ */
+
+static bool indices_insertion_sort(size_t *indices, size_t n, SortLess less, void *ctx)
+{
+    for (size_t i = 1; i < n; ++i) {
+        size_t x = indices[i];
+        size_t j = i;
+        for (; j > 0; --j) {
+            int lt = less(x, indices[j - 1], ctx);
+            if (lt < 0) {
+                return false;
+            }
+            if (!lt) {
+                break;
+            }
+            indices[j] = indices[j - 1];
+        }
+        indices[j] = x;
+    }
+    return true;
+}
+
+static bool indices_merge(size_t *out, const size_t *a, size_t na, const size_t *b, size_t nb,
+                          SortLess less, void *ctx)
+{
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        int lt = less(b[j], a[i], ctx);
+        if (lt < 0) {
+            return false;
+        }
+        out[k++] = lt ? b[j++] : a[i++];
+    }
+    memcpy(out + k, a + i, (na - i) * sizeof(size_t));
+    memcpy(out + k + na - i, b + j, (nb - j) * sizeof(size_t));
+    return true;
+}
+
+bool sort_indices(size_t *indices, size_t n, SortLess less, void *ctx)
+{
+    /* like keys_sort(), on the calling thread as the callback may call
+     * into the interpreter */
+    for (size_t i = 0; i < n; i += SORT_RUN) {
+        if (!indices_insertion_sort(indices + i, n - i < SORT_RUN ? n - i : SORT_RUN, less, ctx)) {
+            return false;
+        }
+    }
+    size_t *tmp = malloc(n * sizeof(size_t));
+    size_t *from = indices, *to = tmp;
+    bool ok = true;
+    for (size_t width = SORT_RUN; ok && width < n; width *= 2) {
+        for (size_t i = 0; ok && i < n; i += 2 * width) {
+            size_t na = n - i < width ? n - i : width;
+            size_t nb = n - i - na < width ? n - i - na : width;
+            ok = indices_merge(to + i, from + i, na, from + i + na, nb, less, ctx);
+        }
+        size_t *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (ok && from != indices) {
+        memcpy(indices, from, n * sizeof(size_t));
+    }
+    free(tmp);
+    return ok;
+}
@@ -1,22 +1,36 @@
 #include "value.h"
 #include <string.h>
+#include "djb2.h"
+#include "fpconv.h"
 #include "log.h"
+#include "profile.h"
 #include <assert.h>
+#include <limits.h>
 #include <stdarg.h>
 
 
 const char *value_type_names[] = {
     "VALUE_BOOL",
     "VALUE_BUILTIN_FN",
+    "VALUE_CACHE",
     "VALUE_EXCEPTION",
+    "VALUE_F64_VECTOR",
+    "VALUE_FILE",
     "VALUE_FLOAT",
     "VALUE_FN",
+    "VALUE_HASH_SET",
+    "VALUE_I64_VECTOR",
     "VALUE_INT",
+    "VALUE_LAZY_SEQ",
     "VALUE_LIST",
     "VALUE_MACRO_FN",
+    "VALUE_MATRIX",
     "VALUE_NIL",
+    "VALUE_SORTED_MAP",
+    "VALUE_SORTED_SET",
     "VALUE_STRING",
-    "VALUE_SYMBOL"
+    "VALUE_SYMBOL",
+    "VALUE_TRANSDUCER"
 };
 
 
@@ -55,8 +69,9 @@ bool is_list(const Value *value)
 
 static Value *value_new(ValueType type)
 {
-    Value *v = (Value *) gc_malloc(&gc, sizeof(Value));
+    Value *v = (Value *) heap_malloc(sizeof(Value));
     v->type = type;
+    PROFILE_ALLOC(v, sizeof(Value), value_type_names[type]);
     return v;
 }
 
@@ -80,7 +95,7 @@ Value *value_new_int(int int_)
     return v;
 }
 
-Value *value_new_float(float float_)
+Value *value_new_float(double float_)
 {
     Value *v = value_new(VALUE_FLOAT);
     v->value.float_ = float_;
@@ -97,7 +112,8 @@ Value *value_new_builtin_fn(Value * (fn)(const Value *))
 Value *value_new_fn(Value *args, Value *body, Environment *env)
 {
     Value *v = value_new(VALUE_FN);
-    v->value.fn = gc_calloc(&gc, 1, sizeof(CompositeFunction));
+    v->value.fn = heap_calloc(1, sizeof(CompositeFunction));
+    PROFILE_ALLOC(v->value.fn, sizeof(CompositeFunction), value_type_names[v->type]);
     v->value.fn->args = args;
     v->value.fn->body = body;
     v->value.fn->env = env;
@@ -107,46 +123,340 @@ Value *value_new_fn(Value *args, Value *body, Environment *env)
 Value *value_new_macro(Value *args, Value *body, Environment *env)
 {
     Value *v = value_new(VALUE_MACRO_FN);
-    v->value.fn = gc_calloc(&gc, 1, sizeof(CompositeFunction));
+    v->value.fn = heap_calloc(1, sizeof(CompositeFunction));
+    PROFILE_ALLOC(v->value.fn, sizeof(CompositeFunction), value_type_names[v->type]);
     v->value.fn->args = args;
     v->value.fn->body = body;
     v->value.fn->env = env;
     return v;
 }
 
+static String *string_new(ValueType type, const char *str, size_t len)
+{
+    /* header and bytes in one block */
+    String *s = heap_malloc(sizeof(String) + len + 1);
+    PROFILE_ALLOC(s, sizeof(String) + len + 1, value_type_names[type]);
+    s->len = len;
+    memcpy(s->data, str, len);
+    s->data[len] = '\0';
+    s->ptr = s->data;
+    s->base = NULL;
+    s->hash = 0;
+    s->terminated = true;
+    return s;
+}
+
+static String *string_new_slice(ValueType type, const void *base,
+                                const char *ptr, size_t len, bool terminated)
+{
+    String *s = heap_malloc(sizeof(String));
+    PROFILE_ALLOC(s, sizeof(String), value_type_names[type]);
+    s->len = len;
+    s->ptr = ptr;
+    s->base = base;
+    s->hash = 0;
+    s->terminated = terminated;
+    return s;
+}
+
 Value *value_new_string(const char *str)
 {
+    return value_new_string_len(str, strlen(str));
+}
+
+Value *value_new_string_len(const char *str, size_t len)
+{
+    Value *v = value_new(VALUE_STRING);
+    v->value.str = string_new(VALUE_STRING, str, len);
+    return v;
+}
+
+Value *value_new_string_slice(const void *base, const char *ptr, size_t len)
+{
+    /* base must be the start of the managed buffer ptr points into */
+    Value *v = value_new(VALUE_STRING);
+    v->value.str = string_new_slice(VALUE_STRING, base, ptr, len, false);
+    return v;
+}
+
+Value *value_new_string_owned(char *buf, size_t len)
+{
+    /* takes over a managed buffer of at least len + 1 bytes */
+    buf[len] = '\0';
     Value *v = value_new(VALUE_STRING);
-    v->value.str = gc_strdup(&gc, str);
+    v->value.str = string_new_slice(VALUE_STRING, buf, buf, len, true);
+    return v;
+}
+
+Value *value_new_string_terminated(const void *base, const char *ptr, size_t len)
+{
+    /* a slice of base (which may be read-only) with ptr[len] == '\0' */
+    Value *v = value_new(VALUE_STRING);
+    v->value.str = string_new_slice(VALUE_STRING, base, ptr, len, true);
     return v;
 }
 
 Value *value_new_exception(const char *str)
 {
     Value *v = value_new(VALUE_EXCEPTION);
-    v->value.str = gc_strdup(&gc, str);
+    v->value.str = string_new(VALUE_EXCEPTION, str, strlen(str));
     return v;
 }
 
+static Value *string_builder_take(StringBuilder *sb, ValueType type);
+
 Value *value_make_exception(const char *fmt, ...)
 {
+    StringBuilder sb;
+    string_builder_init(&sb);
     va_list args;
     va_start(args, fmt);
-    char *message = NULL;
-    vasprintf(&message, fmt, args);
+    string_builder_vprintf(&sb, fmt, args);
     va_end(args);
-    Value *ex = value_new_exception(message);
-    free(message);
-    return ex;
+    return string_builder_take(&sb, VALUE_EXCEPTION);
 }
 
 Value *value_new_symbol(const char *str)
 {
     Value *v = value_new(VALUE_SYMBOL);
-    v->value.str = gc_strdup(&gc, str);
+    v->value.str = string_new(VALUE_SYMBOL, str, strlen(str));
     return v;
 }
 
+char *value_cstr(const Value *v)
+{
+    String *s = v->value.str;
+    if (!s->terminated) {
+        /* a slice is copied once, the first time a C string is needed */
+        unsigned long hash = s->hash;
+        s = string_new(v->type, s->ptr, s->len);
+        s->hash = hash;
+        ((Value *) v)->value.str = s;
+    }
+    return (char *) s->ptr;
+}
+
+const void *value_string_base(const Value *v)
+{
+    /* the managed block holding the bytes of a string */
+    return v->value.str->base ? v->value.str->base : v->value.str;
+}
+
+unsigned long value_string_hash(const Value *v)
+{
+    /* strings are immutable, so the hash is computed at most once */
+    String *s = v->value.str;
+    if (!s->hash) {
+        s->hash = djb2_n(s->ptr, s->len);
+    }
+    return s->hash;
+}
+
+static unsigned long hash_mix(uint64_t x)
+{
+    /* the splitmix64 finalizer */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return (unsigned long) (x ^ (x >> 31));
+}
+
+static unsigned long hash_nonzero(unsigned long h)
+{
+    /* 0 marks hashes that are not cached yet */
+    return h ? h : 1;
+}
+
+static unsigned long hash_i64(int64_t i)
+{
+    return hash_nonzero(hash_mix((uint64_t) i));
+}
+
+static unsigned long hash_f64(double d)
+{
+    /* whole numbers hash like ints, as 1 = 1.0 (and 0.0 = -0.0) */
+    if (d >= -0x1p63 && d < 0x1p63 && d == (double) (int64_t) d) {
+        return hash_i64((int64_t) d);
+    }
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return hash_nonzero(hash_mix(bits));
+}
+
+/* ordered hashes of the elements of a sequence, whatever its type */
+#define HASH_SEQ_SEED 0x2545f4914f6cdd1dul
+#define hash_seq_add(h, x) ((h) * 31 + (x))
+
+static unsigned long hash_seq_finish(unsigned long h, size_t n)
+{
+    return hash_nonzero(hash_mix(h ^ n));
+}
+
+static unsigned long hash_list(const List *l)
+{
+    if (!l->hash) {
+        unsigned long h = HASH_SEQ_SEED;
+        for (const ListItem *i = l->begin; i != NULL; i = i->next) {
+            h = hash_seq_add(h, value_hash(i->p));
+        }
+        ((List *) l)->hash = hash_seq_finish(h, l->size);
+    }
+    return l->hash;
+}
+
+static unsigned long hash_vector(const Value *v)
+{
+    NumVec *vec = NUMVEC(v);
+    if (!vec->hash) {
+        unsigned long h = HASH_SEQ_SEED;
+        for (size_t i = 0; i < vec->size; ++i) {
+            h = hash_seq_add(h, v->type == VALUE_F64_VECTOR ? hash_f64(vec->data.f64[i])
+                                                            : hash_i64(vec->data.i64[i]));
+        }
+        vec->hash = hash_seq_finish(h, vec->size);
+    }
+    return vec->hash;
+}
+
+static unsigned long hash_matrix(const Matrix *m)
+{
+    if (!m->hash) {
+        unsigned long h = hash_mix(m->rows * 0x9e3779b97f4a7c15ull + m->cols);
+        for (size_t i = 0; i < m->rows * m->cols; ++i) {
+            h = hash_seq_add(h, hash_f64(m->data[i]));
+        }
+        ((Matrix *) m)->hash = hash_nonzero(hash_mix(h));
+    }
+    return m->hash;
+}
+
+static unsigned long hash_lazy_seq(const Value *v)
+{
+    /* not cached, a lazy sequence is a position that is cheap to copy */
+    unsigned long h = HASH_SEQ_SEED;
+    size_t n = 0;
+    SeqIter it;
+    value_seq_iter_init(&it, v);
+    for (Value *x; (x = value_seq_iter_next(&it)) != NULL; ++n) {
+        h = hash_seq_add(h, value_hash(x));
+    }
+    return hash_seq_finish(h, n);
+}
+
+/* unordered hashes of the elements of a set, whatever its type */
+#define HASH_SET_SEED 0x5be0cd19137e2179ul
+
+static unsigned long hash_hamt(const Hamt *h)
+{
+    if (!h->hash) {
+        unsigned long sum = HASH_SET_SEED;
+        HamtIter it;
+        hamt_iter_init(&it, h);
+        for (const Value *x; (x = hamt_iter_next(&it)) != NULL; ) {
+            sum += hash_mix(value_hash(x));
+        }
+        ((Hamt *) h)->hash = hash_nonzero(hash_mix(sum ^ h->size));
+    }
+    return h->hash;
+}
+
+static unsigned long hash_btree(const BTree *t, bool map)
+{
+    /* sets hash like hash sets, maps mix in the values */
+    if (!t->hash) {
+        unsigned long sum = map ? ~HASH_SET_SEED : HASH_SET_SEED;
+        BTreeIter it;
+        btree_iter_init(&it, t, NULL);
+        for (const BTreeEntry *e; (e = btree_iter_next(&it)) != NULL; ) {
+            unsigned long h = value_hash(e->key);
+            sum += hash_mix(map ? hash_seq_add(h, value_hash(e->value)) : h);
+        }
+        ((BTree *) t)->hash = hash_nonzero(hash_mix(sum ^ t->size));
+    }
+    return t->hash;
+}
+
+static unsigned long hash_pointer(const void *p)
+{
+    return hash_nonzero(hash_mix((uintptr_t) p));
+}
+
+unsigned long value_hash(const Value *v)
+{
+    switch (v->type) {
+    case VALUE_NIL:
+        return 0x6e696cul;
+    case VALUE_BOOL:
+        return BOOL(v) ? 0x74727565ul : 0x66616c7365ul;
+    case VALUE_INT:
+        return hash_i64(INT(v));
+    case VALUE_FLOAT:
+        return hash_f64(FLOAT(v));
+    case VALUE_STRING:
+    case VALUE_SYMBOL:
+    case VALUE_EXCEPTION:
+        /* symbols and strings never compare equal, keep them apart */
+        return hash_nonzero(value_string_hash(v) * 31 + v->type);
+    case VALUE_LIST:
+        return hash_list(LIST(v));
+    case VALUE_LAZY_SEQ:
+        return hash_lazy_seq(v);
+    case VALUE_F64_VECTOR:
+    case VALUE_I64_VECTOR:
+        return hash_vector(v);
+    case VALUE_MATRIX:
+        return hash_matrix(MATRIX(v));
+    case VALUE_BUILTIN_FN:
+        /* through an integer, ISO C doesn't convert function pointers
+         * to object pointers */
+        return hash_nonzero(hash_mix((uintptr_t) BUILTIN_FN(v)));
+    case VALUE_FN:
+    case VALUE_MACRO_FN:
+        return hash_pointer(FN(v));
+    case VALUE_FILE:
+        return hash_pointer(FILE_HANDLE(v));
+    case VALUE_TRANSDUCER:
+        return hash_pointer(XFORM(v));
+    case VALUE_CACHE:
+        return hash_pointer(MEMO(v));
+    case VALUE_HASH_SET:
+        return hash_hamt(HAMT(v));
+    case VALUE_SORTED_MAP:
+    case VALUE_SORTED_SET:
+        return hash_btree(BTREE(v), v->type == VALUE_SORTED_MAP);
+    }
+    return 1;
+}
+
+bool value_string_eq(const Value *a, const Value *b)
+{
+    const String *sa = a->value.str;
+    const String *sb = b->value.str;
+    if (sa == sb) {
+        return true;
+    }
+    if (sa->len != sb->len) {
+        return false;
+    }
+    if (value_string_hash(a) != value_string_hash(b)) {
+        return false;
+    }
+    return memcmp(sa->ptr, sb->ptr, sa->len) == 0;
+}
+
+int value_string_cmp(const Value *a, const Value *b)
+{
+    const String *sa = a->value.str;
+    const String *sb = b->value.str;
+    size_t n = sa->len < sb->len ? sa->len : sb->len;
+    int c = memcmp(sa->ptr, sb->ptr, n);
+    if (c != 0) {
+        return c;
+    }
+    return (sa->len > sb->len) - (sa->len < sb->len);
+}
+
 Value *value_new_list(const List *l)
 {
     Value *v = value_new(VALUE_LIST);
@@ -165,6 +475,329 @@ Value *value_make_list(Value *v)
     return r;
 }
 
+Value *value_new_file(struct File *file, void (*finalize)(void *cell))
+{
+    /* values get copied, e.g. into environments, so the handle is kept in
+     * a managed cell that all copies share and that releases it */
+    Value *v = value_new(VALUE_FILE);
+    v->value.file = heap_malloc_dtor(sizeof(struct File *), finalize);
+    *v->value.file = file;
+    return v;
+}
+
+static double *value_new_numbers(ValueType type, size_t size, const void **base)
+{
+    /* the elements live in a block of their own, which is the base of
+     * the vector or matrix and all views of it */
+    assert(size <= VALUE_NUMBERS_MAX);
+    char *buf = heap_try_malloc(size * sizeof(double) + NUMVEC_ALIGN);
+    if (!buf) {
+        return NULL;
+    }
+    PROFILE_ALLOC(buf, size * sizeof(double) + NUMVEC_ALIGN, value_type_names[type]);
+    *base = buf;
+    return (double *) (((uintptr_t) buf + NUMVEC_ALIGN - 1) & ~(uintptr_t) (NUMVEC_ALIGN - 1));
+}
+
+static Value *value_new_vector(ValueType type, size_t size)
+{
+    Value *v = value_new(type);
+    v->value.numvec = heap_malloc(sizeof(NumVec));
+    PROFILE_ALLOC(v->value.numvec, sizeof(NumVec), value_type_names[type]);
+    v->value.numvec->size = size;
+    v->value.numvec->data.f64 = value_new_numbers(type, size, &v->value.numvec->base);
+    v->value.numvec->hash = 0;
+    return v->value.numvec->data.f64 ? v : NULL;
+}
+
+Value *value_new_f64_vector(size_t size)
+{
+    return value_new_vector(VALUE_F64_VECTOR, size);
+}
+
+Value *value_new_i64_vector(size_t size)
+{
+    return value_new_vector(VALUE_I64_VECTOR, size);
+}
+
+Value *value_new_vector_view(const Value *v, size_t start, size_t end)
+{
+    Value *view = value_new(v->type);
+    view->value.numvec = heap_malloc(sizeof(NumVec));
+    PROFILE_ALLOC(view->value.numvec, sizeof(NumVec), value_type_names[v->type]);
+    *view->value.numvec = *NUMVEC(v);
+    view->value.numvec->size = end - start;
+    view->value.numvec->hash = 0;
+    /* both element types are 8 bytes wide */
+    view->value.numvec->data.f64 += start;
+    return view;
+}
+
+bool value_is_vector(const Value *v)
+{
+    return v->type == VALUE_F64_VECTOR || v->type == VALUE_I64_VECTOR;
+}
+
+Value *value_from_i64(int64_t i)
+{
+    return i >= INT_MIN && i <= INT_MAX ? value_new_int((int) i) : value_new_float((double) i);
+}
+
+Value *value_new_matrix(size_t rows, size_t cols)
+{
+    Value *v = value_new(VALUE_MATRIX);
+    v->value.matrix = heap_malloc(sizeof(Matrix));
+    PROFILE_ALLOC(v->value.matrix, sizeof(Matrix), value_type_names[VALUE_MATRIX]);
+    v->value.matrix->rows = rows;
+    v->value.matrix->cols = cols;
+    v->value.matrix->data = value_new_numbers(VALUE_MATRIX, rows * cols, &v->value.matrix->base);
+    v->value.matrix->hash = 0;
+    return v->value.matrix->data ? v : NULL;
+}
+
+Value *value_new_matrix_view(const Value *m, size_t start, size_t end)
+{
+    Value *view = value_new(VALUE_MATRIX);
+    view->value.matrix = heap_malloc(sizeof(Matrix));
+    PROFILE_ALLOC(view->value.matrix, sizeof(Matrix), value_type_names[VALUE_MATRIX]);
+    *view->value.matrix = *MATRIX(m);
+    view->value.matrix->rows = end - start;
+    view->value.matrix->hash = 0;
+    view->value.matrix->data += start * MATRIX(m)->cols;
+    return view;
+}
+
+Value *value_matrix_row(const Value *m, size_t i)
+{
+    Value *row = value_new(VALUE_F64_VECTOR);
+    row->value.numvec = heap_malloc(sizeof(NumVec));
+    PROFILE_ALLOC(row->value.numvec, sizeof(NumVec), value_type_names[VALUE_F64_VECTOR]);
+    row->value.numvec->size = MATRIX(m)->cols;
+    row->value.numvec->data.f64 = MATRIX(m)->data + i * MATRIX(m)->cols;
+    row->value.numvec->base = MATRIX(m)->base;
+    row->value.numvec->hash = 0;
+    return row;
+}
+
+Value *value_vector_nth(const Value *v, size_t i)
+{
+    return v->type == VALUE_F64_VECTOR ? value_new_float(NUMVEC(v)->data.f64[i])
+                                       : value_from_i64(NUMVEC(v)->data.i64[i]);
+}
+
+static SeqBlock *seq_block_new(size_t capacity, Value *(*next)(void *state, Value **rest),
+                               void *state)
+{
+    SeqBlock *b = heap_calloc(1, sizeof(SeqBlock) + capacity * sizeof(Value *));
+    PROFILE_ALLOC(b, sizeof(SeqBlock) + capacity * sizeof(Value *), value_type_names[VALUE_LAZY_SEQ]);
+    b->capacity = capacity;
+    b->next = next;
+    b->state = state;
+    return b;
+}
+
+static Value *value_new_seq_at(SeqBlock *block, size_t index)
+{
+    Value *v = value_new(VALUE_LAZY_SEQ);
+    v->value.seq = heap_malloc(sizeof(LazySeq));
+    PROFILE_ALLOC(v->value.seq, sizeof(LazySeq), value_type_names[v->type]);
+    v->value.seq->block = block;
+    v->value.seq->index = index;
+    return v;
+}
+
+Value *value_new_lazy_seq(Value *(*next)(void *state, Value **rest), void *state)
+{
+    /* the first block holds one element: many sequences, e.g. those of
+     * lazy-seq, never get further than that */
+    return value_new_seq_at(seq_block_new(1, next, state), 0);
+}
+
+Value *value_new_seq_cell(Value *first, Value *rest)
+{
+    SeqBlock *b = seq_block_new(1, NULL, NULL);
+    b->size = 1;
+    b->items[0] = first;
+    b->rest = rest;
+    return value_new_seq_at(b, 0);
+}
+
+Value *value_new_transducer(size_t size)
+{
+    Value *v = value_new(VALUE_TRANSDUCER);
+    v->value.xform = heap_malloc(sizeof(Xform) + size * sizeof(XformStep));
+    PROFILE_ALLOC(v->value.xform, sizeof(Xform) + size * sizeof(XformStep), value_type_names[v->type]);
+    v->value.xform->size = size;
+    return v;
+}
+
+Value *value_new_hash_set(const Hamt *h)
+{
+    Value *v = value_new(VALUE_HASH_SET);
+    v->value.hamt = h;
+    return v;
+}
+
+Value *value_new_sorted(ValueType type, const BTree *t)
+{
+    assert((type == VALUE_SORTED_MAP || type == VALUE_SORTED_SET) && "Invalid argument: require a sorted type");
+    Value *v = value_new(type);
+    v->value.btree = t;
+    return v;
+}
+
+Value *value_new_cache(size_t capacity, CacheEq eq, Value *fn)
+{
+    Value *v = value_new(VALUE_CACHE);
+    v->value.memo = heap_malloc(sizeof(Memo));
+    PROFILE_ALLOC(v->value.memo, sizeof(Memo), value_type_names[v->type]);
+    v->value.memo->cache = cache_new(capacity, eq);
+    v->value.memo->fn = fn;
+    return v;
+}
+
+static Value *seq_block_nth(SeqBlock *b, size_t i)
+{
+    /* element i <= b->size of the block, realizing it if necessary; past
+     * the elements of a complete block, the first element of its rest */
+    if (i < b->size) {
+        return b->items[i];
+    }
+    if (!b->next) {
+        return b->rest ? value_seq_first(b->rest) : NULL;
+    }
+    if (b->realizing) {
+        /* a sequence that depends on its own next element ends there */
+        return NULL;
+    }
+    b->realizing = true;
+    Value *rest = NULL;
+    Value *x = b->next(b->state, &rest);
+    b->realizing = false;
+    if (x) {
+        b->items[b->size++] = x;
+        if (!rest && b->size == b->capacity) {
+            /* the generator continues in a new block */
+            rest = value_new_seq_at(seq_block_new(SEQ_BLOCK_SIZE, b->next, b->state), 0);
+        }
+    }
+    if (!x || rest) {
+        b->next = NULL;
+        b->state = NULL;
+        b->rest = rest;
+    }
+    return x;
+}
+
+bool value_is_seq(const Value *v)
+{
+    return v->type == VALUE_LIST || v->type == VALUE_LAZY_SEQ || v->type == VALUE_NIL
+           || value_is_vector(v);
+}
+
+Value *value_seq_first(const Value *v)
+{
+    switch (v->type) {
+    case VALUE_LIST:
+        return list_head(LIST(v));
+    case VALUE_LAZY_SEQ:
+        return seq_block_nth(SEQ(v)->block, SEQ(v)->index);
+    case VALUE_F64_VECTOR:
+    case VALUE_I64_VECTOR:
+        return NUMVEC(v)->size ? value_vector_nth(v, 0) : NULL;
+    default:
+        return NULL;
+    }
+}
+
+Value *value_seq_rest(const Value *v)
+{
+    switch (v->type) {
+    case VALUE_LIST:
+        return list_size(LIST(v)) ? value_new_list(list_tail(LIST(v))) : (Value *) v;
+    case VALUE_LAZY_SEQ: {
+        SeqBlock *b = SEQ(v)->block;
+        size_t i = SEQ(v)->index;
+        if (!seq_block_nth(b, i)) {
+            return (Value *) v;
+        }
+        if (i == b->size) {
+            /* the block was completed by a rest after this position */
+            return value_seq_rest(b->rest);
+        }
+        if (i + 1 == b->size && !b->next && b->rest) {
+            return b->rest;
+        }
+        return value_new_seq_at(b, i + 1);
+    }
+    case VALUE_F64_VECTOR:
+    case VALUE_I64_VECTOR:
+        return NUMVEC(v)->size ? value_new_vector_view(v, 1, NUMVEC(v)->size) : (Value *) v;
+    default:
+        return (Value *) v;
+    }
+}
+
+void *value_seq_unrealized(const Value *v, Value *(*next)(void *state, Value **rest))
+{
+    if (v->type != VALUE_LAZY_SEQ) {
+        return NULL;
+    }
+    SeqBlock *b = SEQ(v)->block;
+    return SEQ(v)->index == 0 && b->size == 0 && b->next == next && !b->realizing ? b->state : NULL;
+}
+
+void value_seq_iter_init(SeqIter *it, const Value *v)
+{
+    *it = (SeqIter) { .list = NULL, .item = NULL, .vector = NULL, .block = NULL, .index = 0 };
+    if (v->type == VALUE_LIST) {
+        it->list = v;
+        it->item = LIST(v)->begin;
+    } else if (value_is_vector(v)) {
+        it->vector = v;
+    } else if (v->type == VALUE_LAZY_SEQ) {
+        it->block = SEQ(v)->block;
+        it->index = SEQ(v)->index;
+    }
+}
+
+Value *value_seq_iter_next(SeqIter *it)
+{
+    while (true) {
+        if (it->list) {
+            if (!it->item) {
+                return NULL;
+            }
+            Value *x = it->item->p;
+            it->item = it->item->next;
+            return x;
+        }
+        if (it->vector) {
+            return it->index < NUMVEC(it->vector)->size ? value_vector_nth(it->vector, it->index++) : NULL;
+        }
+        SeqBlock *b = it->block;
+        Value *x = b ? seq_block_nth(b, it->index) : NULL;
+        if (!x) {
+            it->block = NULL;
+            return NULL;
+        }
+        if (it->index == b->size) {
+            /* the block was completed by a rest after this position */
+            value_seq_iter_init(it, b->rest);
+            continue;
+        }
+        if (++it->index == b->size && !b->next) {
+            /* continue with what follows the block */
+            if (b->rest) {
+                value_seq_iter_init(it, b->rest);
+            } else {
+                it->block = NULL;
+            }
+        }
+        return x;
+    }
+}
+
 void value_print(const Value *v)
 {
     if (!v) return;
@@ -179,12 +812,15 @@ void value_print(const Value *v)
         fprintf(stderr, "%d", v->value.int_);
         break;
     case VALUE_FLOAT:
-        fprintf(stderr, "%f", v->value.float_);
+        {
+            char digits[FPCONV_MAXLEN];
+            fprintf(stderr, "%.*s", (int) fpconv_dtoa(v->value.float_, digits), digits);
+        }
         break;
     case VALUE_EXCEPTION:
     case VALUE_STRING:
     case VALUE_SYMBOL:
-        fprintf(stderr, "%s", v->value.str);
+        fprintf(stderr, "%.*s", (int) STRING_LEN(v), STRING_PTR(v));
         break;
     case VALUE_LIST:
         fprintf(stderr, "( ");
@@ -210,6 +846,32 @@ void value_print(const Value *v)
     case VALUE_BUILTIN_FN:
         fprintf(stderr, "#<@%p>", (void *) v->value.builtin_fn);
         break;
+    case VALUE_FILE:
+        fprintf(stderr, "#<file@%p>", (void *) FILE_HANDLE(v));
+        break;
+    case VALUE_LAZY_SEQ:
+        fprintf(stderr, "#<lazy-seq@%p>", (void *) v->value.seq->block);
+        break;
+    case VALUE_TRANSDUCER:
+        fprintf(stderr, "#<transducer@%p>", (void *) v->value.xform);
+        break;
+    case VALUE_CACHE:
+        fprintf(stderr, "#<cache@%p>", (void *) v->value.memo);
+        break;
+    case VALUE_HASH_SET:
+        fprintf(stderr, "#<hash-set@%p>", (void *) v->value.hamt);
+        break;
+    case VALUE_SORTED_MAP:
+    case VALUE_SORTED_SET:
+        fprintf(stderr, "#<sorted@%p>", (void *) v->value.btree);
+        break;
+    case VALUE_F64_VECTOR:
+    case VALUE_I64_VECTOR:
+        fprintf(stderr, "#<vector@%p>", (void *) v->value.numvec);
+        break;
+    case VALUE_MATRIX:
+        fprintf(stderr, "#<matrix@%p>", (void *) v->value.matrix);
+        break;
     }
 
 }
@@ -226,3 +888,109 @@ Value *value_tail(const Value *v)
     return value_new_list(list_tail(LIST(v)));
 }
 
+
+/*
+ * StringBuilder
+ */
+
+void string_builder_init(StringBuilder *sb)
+{
+    *sb = (StringBuilder) { .buf = NULL, .len = 0, .capacity = 0 };
+}
+
+static void string_builder_reserve(StringBuilder *sb, size_t n)
+{
+    /* makes room for n more bytes plus the terminating NUL */
+    if (sb->len + n < sb->capacity) {
+        return;
+    }
+    size_t capacity = sb->capacity ? sb->capacity : 64;
+    while (sb->len + n >= capacity) {
+        capacity *= 2;
+    }
+    char *buf = heap_malloc(capacity);
+    PROFILE_ALLOC(buf, capacity, value_type_names[VALUE_STRING]);
+    if (sb->len) {
+        memcpy(buf, sb->buf, sb->len);
+    }
+    heap_free(sb->buf, sb->capacity);
+    sb->buf = buf;
+    sb->capacity = capacity;
+}
+
+void string_builder_append(StringBuilder *sb, const char *str, size_t len)
+{
+    string_builder_reserve(sb, len);
+    memcpy(sb->buf + sb->len, str, len);
+    sb->len += len;
+}
+
+void string_builder_append_char(StringBuilder *sb, char c)
+{
+    string_builder_reserve(sb, 1);
+    sb->buf[sb->len++] = c;
+}
+
+void string_builder_append_int(StringBuilder *sb, long n)
+{
+    /* digits are produced backwards, then copied in one go */
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long u = n < 0 ? -(unsigned long) n : (unsigned long) n;
+    do {
+        *--p = (char) ('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (n < 0) {
+        *--p = '-';
+    }
+    string_builder_append(sb, p, digits + sizeof(digits) - p);
+}
+
+void string_builder_vprintf(StringBuilder *sb, const char *fmt, va_list args)
+{
+    /* format straight into the spare capacity, retry once if it is short */
+    va_list retry;
+    va_copy(retry, args);
+    string_builder_reserve(sb, 0);
+    size_t avail = sb->capacity - sb->len;
+    int n = vsnprintf(sb->buf + sb->len, avail, fmt, args);
+    if (n >= 0 && (size_t) n >= avail) {
+        string_builder_reserve(sb, n);
+        vsnprintf(sb->buf + sb->len, n + 1, fmt, retry);
+    }
+    va_end(retry);
+    if (n > 0) {
+        sb->len += n;
+    }
+}
+
+void string_builder_printf(StringBuilder *sb, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    string_builder_vprintf(sb, fmt, args);
+    va_end(args);
+}
+
+static Value *string_builder_take(StringBuilder *sb, ValueType type)
+{
+    /* the value takes over the buffer, no copy */
+    string_builder_reserve(sb, 0);
+    sb->buf[sb->len] = '\0';
+    Value *v = value_new(type);
+    v->value.str = string_new_slice(type, sb->buf, sb->buf, sb->len, true);
+    string_builder_init(sb);
+    return v;
+}
+
+Value *string_builder_finish(StringBuilder *sb)
+{
+    return string_builder_take(sb, VALUE_STRING);
+}
+
+void string_builder_discard(StringBuilder *sb)
+{
+    heap_free(sb->buf, sb->capacity);
+    string_builder_init(sb);
+}
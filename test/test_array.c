@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "minunit.h"
@@ -98,11 +99,79 @@ static char *test_array()
     return 0;
 }
 
+static char *test_both_ends()
+{
+    /* the buffer only grows when the items don't fit, and the items
+     * stay in order however they were pushed */
+    Array *a = array_new(sizeof(int));
+    size_t grown = 0, capacity = 0;
+    for (int i = 1; i <= 10000; ++i) {
+        if (i % 3) {
+            array_push_back(a, &i, 1);
+        } else {
+            int j = -i;
+            array_push_front(a, &j, 1);
+        }
+        if (array_capacity(a) != capacity) {
+            capacity = array_capacity(a);
+            grown++;
+        }
+    }
+    mu_assert(array_size(a) == 10000, "Wrong size after pushing at both ends");
+    mu_assert(grown <= 15, "Buffer grew too often");
+    mu_assert(array_capacity(a) <= 4 * 10000, "Buffer grew too much");
+    int last = INT32_MIN;
+    for (size_t i = 0; i < array_size(a); ++i) {
+        int x = *array_typed_at(a, i, int);
+        mu_assert(x < 0 ? x > last : last < 0 || x > last, "Items out of order");
+        last = x;
+    }
+    /* a queue reuses the room that popping frees */
+    for (int i = 0; i < 100000; ++i) {
+        array_push_back(a, &i, 1);
+        array_pop_front(a);
+    }
+    mu_assert(array_size(a) == 10000 && array_capacity(a) == capacity, "Queue grew the buffer");
+    array_shrink(a);
+    mu_assert(array_capacity(a) == 16384, "Wrong capacity after shrinking");
+    mu_assert(*array_typed_at(a, 9999, int) == 99999, "Wrong item after shrinking");
+    array_delete(a);
+    return 0;
+}
+
+static Array *array_of_blocks(size_t n)
+{
+    Array *a = array_new(sizeof(void *));
+    for (size_t i = 0; i < n; ++i) {
+        char *block = heap_malloc(64);
+        memset(block, (int) i, 64);
+        array_push_back(a, &block, 1);
+    }
+    return a;
+}
+
+static char *test_traced()
+{
+    /* blocks only the array points to survive a collection */
+    Array *a = array_of_blocks(1000);
+    heap_collect();
+    for (size_t i = 0; i < 1000; ++i) {
+        char *block = *array_typed_at(a, i, char *);
+        mu_assert(block[0] == (char) i && block[63] == (char) i, "Block lost by the collector");
+    }
+    return 0;
+}
+
 int tests_run = 0;
 
 static char *test_suite()
 {
+    int bos;
+    heap_start(NULL, &bos);
     mu_run_test(test_array);
+    mu_run_test(test_both_ends);
+    mu_run_test(test_traced);
+    heap_stop();
     return 0;
 }
 
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "minunit.h"
+#include "heap.h"
+
+#include "../src/btree.c"
+
+
+#define N_KEYS 20000
+
+static int keys[N_KEYS];
+
+static int cmp_int(const void *a, const void *b)
+{
+    /* -1 marks a key that fails to compare */
+    int x = *(const int *) a, y = *(const int *) b;
+    if (x < 0 || y < 0) {
+        return BTREE_ERROR;
+    }
+    return (x > y) - (x < y);
+}
+
+static int check_node(const BTreeNode *node, bool root, int depth, int *leaf_depth)
+{
+    /* the number of keys under node, or -1 if it breaks the invariants */
+    if (node->n > BTREE_MAX || (!root && node->n < BTREE_MIN) || node->n == 0) {
+        return -1;
+    }
+    for (unsigned i = 1; i < node->n; ++i) {
+        if (cmp_int(node->entries[i - 1].key, node->entries[i].key) >= 0) {
+            return -1;
+        }
+    }
+    if (node->leaf) {
+        if (*leaf_depth < 0) {
+            *leaf_depth = depth;
+        }
+        return depth == *leaf_depth ? (int) node->n : -1;
+    }
+    int n = node->n;
+    for (unsigned i = 0; i <= node->n; ++i) {
+        int k = check_node(btree_children(node)[i], false, depth + 1, leaf_depth);
+        if (k < 0) {
+            return -1;
+        }
+        n += k;
+    }
+    return n;
+}
+
+static bool check_tree(const BTree *t, const char *present)
+{
+    /* invariants, size and, in order, exactly the keys in present */
+    int leaf_depth = -1;
+    if (t->root && check_node(t->root, true, 0, &leaf_depth) != (int) t->size) {
+        return false;
+    }
+    BTreeIter it;
+    btree_iter_init(&it, t, NULL);
+    const BTreeEntry *e = btree_iter_next(&it);
+    for (int i = 0; i < N_KEYS; ++i) {
+        if (present[i]) {
+            if (!e || *(int *) e->key != i) {
+                return false;
+            }
+            e = btree_iter_next(&it);
+        }
+    }
+    return e == NULL;
+}
+
+static char *test_updates()
+{
+    char *present = calloc(N_KEYS, 1);
+    const BTree *empty = btree_new(cmp_int);
+    const BTree *t = empty;
+    srand(7);
+    for (int i = 0; i < N_KEYS; ++i) {
+        keys[i] = i;
+    }
+    /* a random half in random order, then random removals and re-adds */
+    for (int i = 0; i < N_KEYS / 2; ++i) {
+        int k = rand() % N_KEYS;
+        t = btree_insert(t, &keys[k], NULL);
+        present[k] = 1;
+    }
+    mu_assert(check_tree(t, present), "Broken tree after adding keys");
+    const BTree *before = t;
+    char *present_before = malloc(N_KEYS);
+    memcpy(present_before, present, N_KEYS);
+    for (int i = 0; i < 2 * N_KEYS; ++i) {
+        int k = rand() % N_KEYS;
+        if (rand() % 2) {
+            t = btree_remove(t, &keys[k]);
+            present[k] = 0;
+        } else {
+            t = btree_insert(t, &keys[k], NULL);
+            present[k] = 1;
+        }
+    }
+    mu_assert(check_tree(t, present), "Broken tree after removing keys");
+    mu_assert(check_tree(before, present_before), "Updates must not change the original tree");
+    mu_assert(check_tree(empty, calloc(N_KEYS, 1)), "Updates must not change the empty tree");
+    for (int i = 0; i < N_KEYS; ++i) {
+        if (present[i]) {
+            t = btree_remove(t, &keys[i]);
+        }
+    }
+    mu_assert(t->size == 0 && t->root == NULL, "Removing every key must leave an empty tree");
+    free(present);
+    free(present_before);
+    return 0;
+}
+
+static char *test_lookups()
+{
+    const BTree *t = btree_new(cmp_int);
+    for (int i = 0; i < N_KEYS; i += 2) {
+        keys[i] = i;
+        t = btree_insert(t, &keys[i], &keys[i]);
+    }
+    mu_assert(btree_insert(t, &keys[0], &keys[0]) == t, "Adding an entry twice must not change the tree");
+    for (int i = 0; i < N_KEYS; ++i) {
+        const BTreeEntry *e;
+        int key = i;
+        int found = btree_get(t, &key, &e);
+        mu_assert(found == (i % 2 == 0), "Wrong lookup result");
+        mu_assert(!found || e->value == &keys[i], "Wrong value");
+    }
+    int other = 0;
+    const BTree *changed = btree_insert(t, &keys[4], &other);
+    const BTreeEntry *e;
+    mu_assert(changed->size == t->size, "Replacing a value must not add a key");
+    mu_assert(btree_get(changed, &keys[4], &e) == 1 && e->value == &other, "Failed to replace a value");
+    mu_assert(*(int *) btree_first(t)->key == 0, "Wrong first key");
+    mu_assert(*(int *) btree_last(t)->key == N_KEYS - 2, "Wrong last key");
+
+    /* from a key that is there, one that isn't and one past the end */
+    int from[] = { 1000, 1001, N_KEYS };
+    for (size_t i = 0; i < sizeof(from) / sizeof(from[0]); ++i) {
+        BTreeIter it;
+        mu_assert(btree_iter_init(&it, t, &from[i]), "Failed to start iterating");
+        int expected = (from[i] + 1) / 2 * 2;
+        for (; (e = btree_iter_next(&it)) != NULL; expected += 2) {
+            mu_assert(*(int *) e->key == expected, "Wrong key in a range");
+        }
+        mu_assert(expected >= N_KEYS, "Range ended early");
+    }
+    return 0;
+}
+
+static char *test_errors()
+{
+    const BTree *t = btree_new(cmp_int);
+    int bad = -1;
+    const BTreeEntry *e;
+    BTreeIter it;
+    t = btree_insert(t, &keys[0], NULL);
+    mu_assert(btree_get(t, &bad, &e) < 0, "Failing comparison must fail the lookup");
+    mu_assert(btree_insert(t, &bad, NULL) == NULL, "Failing comparison must fail adding");
+    mu_assert(btree_remove(t, &bad) == NULL, "Failing comparison must fail removing");
+    mu_assert(!btree_iter_init(&it, t, &bad), "Failing comparison must fail iterating");
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    int bos;
+    heap_start(NULL, &bos);
+    mu_run_test(test_updates);
+    mu_run_test(test_lookups);
+    mu_run_test(test_errors);
+    heap_stop();
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ B-tree tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "minunit.h"
+#include "heap.h"
+
+#include "../src/cache.c"
+
+
+static int keys[20000];
+
+static int eq_int(const void *a, const void *b)
+{
+    /* -1 marks a key that fails to compare */
+    int x = *(const int *) a, y = *(const int *) b;
+    if (x < 0 || y < 0) {
+        return -1;
+    }
+    return x == y;
+}
+
+static void *get(Cache *c, int key, unsigned long hash)
+{
+    void *value = NULL;
+    return cache_get(c, &key, hash, &value) > 0 ? value : NULL;
+}
+
+static char *test_unbounded()
+{
+    size_t n = sizeof(keys) / sizeof(keys[0]);
+    Cache *c = cache_new(0, eq_int);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = i;
+        mu_assert(cache_put(c, &keys[i], i, &keys[i]) == 0, "Failed to put a key");
+    }
+    mu_assert(c->size == n, "Unbounded caches must keep everything");
+    for (size_t i = 0; i < n; ++i) {
+        mu_assert(get(c, i, i) == &keys[i], "Failed to get a key");
+    }
+    mu_assert(get(c, n, n) == NULL, "Found a key that was never put");
+    mu_assert(c->hits == n && c->misses == 1, "Wrong hit and miss counts");
+    int other = 7;
+    mu_assert(cache_put(c, &other, 7, &other) == 0, "Failed to replace a value");
+    mu_assert(c->size == n && get(c, 7, 7) == &other, "Equal keys must replace values");
+    return 0;
+}
+
+static char *test_lru()
+{
+    /* colliding hashes, so evictions shift probe sequences */
+    Cache *c = cache_new(3, eq_int);
+    for (int i = 0; i < 10; ++i) {
+        keys[i] = i;
+    }
+    cache_put(c, &keys[1], 1, &keys[1]);
+    cache_put(c, &keys[2], 1, &keys[2]);
+    cache_put(c, &keys[3], 1, &keys[3]);
+    mu_assert(get(c, 1, 1) == &keys[1], "Failed to get the oldest key");
+    cache_put(c, &keys[4], 2, &keys[4]);
+    mu_assert(c->size == 3, "Bounded caches must not grow past their capacity");
+    mu_assert(get(c, 2, 1) == NULL, "The least recently used key must go first");
+    mu_assert(get(c, 3, 1) && get(c, 1, 1) && get(c, 4, 2), "Evicted the wrong key");
+    cache_put(c, &keys[5], 1, &keys[5]);
+    mu_assert(get(c, 3, 1) == NULL, "Gets must count as uses");
+    for (int i = 6; i < 10; ++i) {
+        cache_put(c, &keys[i], i % 2, &keys[i]);
+    }
+    mu_assert(get(c, 7, 1) && get(c, 8, 0) && get(c, 9, 1), "Lost a key to eviction");
+    mu_assert(!get(c, 1, 1) && !get(c, 4, 2) && !get(c, 5, 1) && !get(c, 6, 0), "Kept an old key");
+    return 0;
+}
+
+static char *test_errors()
+{
+    Cache *c = cache_new(2, eq_int);
+    keys[0] = 1;
+    keys[1] = -1;
+    void *value;
+    mu_assert(cache_put(c, &keys[0], 0, &keys[0]) == 0, "Failed to put a key");
+    mu_assert(cache_get(c, &keys[1], 0, &value) < 0, "Failing comparison must fail the get");
+    mu_assert(cache_put(c, &keys[1], 0, &keys[1]) < 0, "Failing comparison must fail the put");
+    mu_assert(c->size == 1 && c->misses == 0, "Failed gets must not count");
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    int bos;
+    heap_start(NULL, &bos);
+    mu_run_test(test_unbounded);
+    mu_run_test(test_lru);
+    mu_run_test(test_errors);
+    heap_stop();
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ Cache tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
@@ -38,9 +38,9 @@ int tests_run = 0;
 static char *test_suite()
 {
     int bos;
-    gc_start(&gc, &bos);
+    heap_start(NULL, &bos);
     mu_run_test(test_env);
-    gc_stop(&gc);
+    heap_stop();
     return 0;
 }
 
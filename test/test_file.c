@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "../src/file.c"
+
+
+static File *file_with(const char *content, size_t len)
+{
+    FILE *fp = tmpfile();
+    fwrite(content, 1, len, fp);
+    rewind(fp);
+    return file_new(fp, FILE_READ, true);
+}
+
+static char *test_read_line()
+{
+    const char content[] = "first\r\n\nthird\nlast";
+    File *f = file_with(content, sizeof(content) - 1);
+    const char *lines[] = { "first", "", "third", "last" };
+    Value *line;
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        mu_assert(file_read_line(f, &line) && line, "Failed to read a line");
+        mu_assert(strcmp(STRING(line), lines[i]) == 0, "Wrong line");
+    }
+    mu_assert(file_read_line(f, &line) && line == NULL, "Expected the end of the file");
+    file_delete(f);
+    return 0;
+}
+
+static char *test_long_lines()
+{
+    /* lines that straddle refills of the buffer, one longer than it */
+    size_t n = 2 * FILE_BUFSIZE + 100;
+    char *content = malloc(n);
+    memset(content, 'a', n);
+    content[10] = '\n';
+    content[FILE_BUFSIZE + 5] = '\n';
+    content[n - 1] = '\n';
+    File *f = file_with(content, n);
+    size_t expected[] = { 10, FILE_BUFSIZE - 6, n - FILE_BUFSIZE - 7 };
+    Value *line;
+    for (size_t i = 0; i < 3; ++i) {
+        mu_assert(file_read_line(f, &line) && line, "Failed to read a long line");
+        mu_assert(STRING_LEN(line) == expected[i], "Long line has the wrong length");
+    }
+    mu_assert(file_read_line(f, &line) && line == NULL, "Expected the end of the file");
+    file_delete(f);
+    free(content);
+    return 0;
+}
+
+static char *test_read_bytes()
+{
+    size_t n = FILE_BUFSIZE + 1000;
+    char *content = malloc(n);
+    for (size_t i = 0; i < n; ++i) {
+        content[i] = 'a' + i % 26;
+    }
+    File *f = file_with(content, n);
+    Value *bytes, *line;
+    mu_assert(file_read_bytes(f, 3, &bytes) && strcmp(STRING(bytes), "abc") == 0,
+              "Failed to read from the buffer");
+    mu_assert(file_read_bytes(f, FILE_BUFSIZE, &bytes) && STRING_LEN(bytes) == FILE_BUFSIZE
+              && memcmp(STRING(bytes), content + 3, FILE_BUFSIZE) == 0,
+              "Failed to read past the buffer");
+    mu_assert(file_read_line(f, &line) && STRING_LEN(line) == n - FILE_BUFSIZE - 3,
+              "Failed to read a line after the bytes");
+    mu_assert(file_read_bytes(f, 1, &bytes) && bytes == NULL, "Expected the end of the file");
+    file_delete(f);
+    free(content);
+    return 0;
+}
+
+static char *test_write()
+{
+    FILE *fp = tmpfile();
+    File *f = file_new(fp, FILE_WRITE, false);
+    for (int i = 0; i < 100000; ++i) {
+        printer_write_int(file_printer(f), i);
+        printer_write_char(file_printer(f), '\n');
+    }
+    mu_assert(file_close(f), "Failed to close a file");
+    mu_assert(open_files != f, "Closed file is still registered");
+    file_delete(f);
+    rewind(fp);
+    f = file_new(fp, FILE_READ, true);
+    Value *line;
+    int i = 0;
+    while (file_read_line(f, &line) && line) {
+        mu_assert(atoi(STRING(line)) == i++, "Wrong line written");
+    }
+    mu_assert(i == 100000, "Wrong number of lines written");
+    file_delete(f);
+    mu_assert(open_files == NULL, "Deleted files are still registered");
+    return 0;
+}
+
+static char *test_map()
+{
+    /* a whole number of pages, so the terminating NUL is past the file */
+    size_t n = 4 * sysconf(_SC_PAGESIZE);
+    FILE *fp = tmpfile();
+    for (size_t i = 0; i < n; ++i) {
+        fputc('a' + i % 26, fp);
+    }
+    fflush(fp);
+    Value *v = file_map(fileno(fp), n);
+    fclose(fp);
+    mu_assert(v != NULL, "Failed to map a file");
+    mu_assert(STRING_LEN(v) == n && STRING(v) == STRING_PTR(v) && STRING(v)[n] == '\0',
+              "Mapped string isn't terminated in place");
+    mu_assert(STRING(v)[n - 1] == (char) ('a' + (n - 1) % 26), "Wrong mapped content");
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    int bos;
+    heap_start(NULL, &bos);
+    mu_run_test(test_read_line);
+    mu_run_test(test_long_lines);
+    mu_run_test(test_read_bytes);
+    mu_run_test(test_write);
+    mu_run_test(test_map);
+    heap_stop();
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ File tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
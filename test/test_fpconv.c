@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "minunit.h"
+
+#include "../src/fpconv.c"
+
+
+static uint64_t rand64()
+{
+    return ((uint64_t) rand() << 62) ^ ((uint64_t) rand() << 31) ^ (uint64_t) rand();
+}
+
+static char *test_dtoa()
+{
+    struct { double d; const char *s; } cases[] = {
+        { 0.0, "0.0" }, { -0.0, "-0.0" }, { 1.0, "1.0" }, { -1.5, "-1.5" },
+        { 0.1, "0.1" }, { 100.0, "100.0" }, { 1e20, "100000000000000000000.0" },
+        { 1e22, "1e22" }, { 0.000001, "0.000001" }, { 1e-7, "1e-7" },
+        { 5e-324, "5e-324" }, { 1.7976931348623157e308, "1.7976931348623157e308" },
+        { 1.0 / 3, "0.3333333333333333" }
+    };
+    char buf[FPCONV_MAXLEN + 1];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        size_t n = fpconv_dtoa(cases[i].d, buf);
+        buf[n] = '\0';
+        mu_assert(strcmp(buf, cases[i].s) == 0, "Unexpected float formatting");
+    }
+    return 0;
+}
+
+static char *test_roundtrip()
+{
+    /* random bit patterns, including subnormals, have to read back
+     * bit-identically, both through strtod() and fpconv_strtod() */
+    char buf[FPCONV_MAXLEN + 1];
+    srand(42);
+    for (int i = 0; i < 200000; ++i) {
+        uint64_t u = rand64();
+        if (i % 2) {
+            u &= DP_SIGN_BIT | DP_SIGNIFICAND_MASK;
+        }
+        double d = bits_double(u);
+        if ((u & DP_EXPONENT_MASK) == DP_EXPONENT_MASK) {
+            continue;
+        }
+        size_t n = fpconv_dtoa(d, buf);
+        mu_assert(n <= FPCONV_MAXLEN, "Formatted float is too long");
+        buf[n] = '\0';
+        double ref = strtod(buf, NULL);
+        mu_assert(double_bits(ref) == u, "Formatted float must read back identically");
+        double back;
+        mu_assert(fpconv_strtod(buf, n, &back), "Formatted float must parse");
+        mu_assert(double_bits(back) == u, "Parsed float must be identical");
+    }
+    return 0;
+}
+
+static char *test_strtod()
+{
+    /* fpconv_strtod() has to agree with strtod() */
+    const char *cases[] = {
+        "0", "-0", ".7", "-.7", "1.", "00012.5000", "1e+5", "1E-5",
+        "1e308", "1.7976931348623159e308", "2e308", "1e-400",
+        "2.4703282292062327e-324", "2.4703282292062328e-324",
+        "2.2250738585072011e-308", "9007199254740993",
+        "9007199254740993.0000000001", "123456789012345678901234567890",
+        "1e23", "7.2057594037927933e16"
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        double d;
+        mu_assert(fpconv_strtod(cases[i], strlen(cases[i]), &d), "Valid number rejected");
+        double ref = strtod(cases[i], NULL);
+        mu_assert(double_bits(d) == double_bits(ref), "fpconv_strtod disagrees with strtod");
+    }
+    char buf[64];
+    srand(7);
+    for (int i = 0; i < 200000; ++i) {
+        double d = bits_double(rand64() & ~DP_SIGN_BIT);
+        if (d != d || d > 1.7976931348623157e308) {
+            continue;
+        }
+        int n = snprintf(buf, sizeof(buf), "%.*e", rand() % 19, d);
+        double parsed;
+        mu_assert(fpconv_strtod(buf, n, &parsed), "Valid number rejected");
+        mu_assert(double_bits(parsed) == double_bits(strtod(buf, NULL)),
+                  "fpconv_strtod disagrees with strtod");
+    }
+    const char *invalid[] = { "", "-", ".", "1e", "1e+", "1.2.3", "1x", "e5" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        double d;
+        mu_assert(!fpconv_strtod(invalid[i], strlen(invalid[i]), &d), "Invalid number accepted");
+    }
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    mu_run_test(test_dtoa);
+    mu_run_test(test_roundtrip);
+    mu_run_test(test_strtod);
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ Float conversion tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "heap.h"
+
+#include "../src/hamt.c"
+
+
+#define N_KEYS 20000
+
+static int keys[N_KEYS];
+
+static int eq_int(const void *a, const void *b)
+{
+    /* -1 marks a key that fails to compare */
+    int x = *(const int *) a, y = *(const int *) b;
+    if (x < 0 || y < 0) {
+        return -1;
+    }
+    return x == y;
+}
+
+static unsigned long spread(int i)
+{
+    return (unsigned long) i * 0x9e3779b97f4a7c15ul;
+}
+
+static unsigned long collide(int i)
+{
+    /* few distinct hashes, so all keys end up in collision nodes */
+    return spread(i % 7);
+}
+
+static char *check_set(unsigned long (*hash)(int), int n_keys)
+{
+    const Hamt *empty = hamt_new(eq_int);
+    const Hamt *h = empty;
+    for (int i = 0; i < n_keys; ++i) {
+        keys[i] = i;
+        h = hamt_insert(h, &keys[i], hash(i));
+        mu_assert(h != NULL && h->size == (size_t) i + 1, "Failed to add a key");
+    }
+    mu_assert(hamt_insert(h, &keys[3], hash(3)) == h, "Adding a key twice must not change the set");
+    for (int i = 0; i < n_keys; ++i) {
+        int key = i;
+        mu_assert(hamt_contains(h, &key, hash(i)) == 1, "Failed to find a key");
+    }
+    int missing = n_keys;
+    mu_assert(hamt_contains(h, &missing, hash(missing)) == 0, "Found a key that was never added");
+    mu_assert(empty->size == 0 && hamt_contains(empty, &keys[0], hash(0)) == 0, "Adding must not change the original set");
+
+    /* every key exactly once */
+    char *seen = calloc(n_keys, 1);
+    HamtIter it;
+    hamt_iter_init(&it, h);
+    size_t n = 0;
+    for (int *key; (key = hamt_iter_next(&it)) != NULL; ++n) {
+        mu_assert(!seen[*key], "Iterated over a key twice");
+        seen[*key] = 1;
+    }
+    free(seen);
+    mu_assert(n == (size_t) n_keys, "Iteration missed keys");
+
+    const Hamt *odd = h;
+    for (int i = 0; i < n_keys; i += 2) {
+        odd = hamt_remove(odd, &keys[i], hash(i));
+    }
+    mu_assert(odd->size == (size_t) n_keys / 2, "Failed to remove keys");
+    mu_assert(hamt_remove(odd, &keys[0], hash(0)) == odd, "Removing a missing key must not change the set");
+    for (int i = 0; i < n_keys; ++i) {
+        mu_assert(hamt_contains(odd, &keys[i], hash(i)) == i % 2, "Removed the wrong keys");
+        mu_assert(hamt_contains(h, &keys[i], hash(i)) == 1, "Removing must not change the original set");
+    }
+    for (int i = 1; i < n_keys; i += 2) {
+        odd = hamt_remove(odd, &keys[i], hash(i));
+    }
+    mu_assert(odd->size == 0 && odd->root == NULL, "Removing every key must leave an empty set");
+    return 0;
+}
+
+static char *test_spread()
+{
+    return check_set(spread, N_KEYS);
+}
+
+static char *test_collisions()
+{
+    return check_set(collide, 700);
+}
+
+static char *test_errors()
+{
+    const Hamt *h = hamt_new(eq_int);
+    int bad = -1;
+    h = hamt_insert(h, &keys[0], 0);
+    mu_assert(hamt_contains(h, &bad, 0) < 0, "Failing comparison must fail the lookup");
+    mu_assert(hamt_insert(h, &bad, 0) == NULL, "Failing comparison must fail adding");
+    mu_assert(hamt_remove(h, &bad, 0) == NULL, "Failing comparison must fail removing");
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    int bos;
+    heap_start(NULL, &bos);
+    mu_run_test(test_spread);
+    mu_run_test(test_collisions);
+    mu_run_test(test_errors);
+    heap_stop();
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ HAMT tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "../src/json.c"
+
+
+static bool is_scalar_byte(char c)
+{
+    return !strchr(" \t\r\n{}[]:,\"", c);
+}
+
+static char *test_index()
+{
+    /* the structural index has to match a byte-at-a-time scan for every
+     * implementation, in particular for escapes across block boundaries */
+    const char alphabet[] = "\"\\\\\\ab1,:[]{} ";
+    size_t n = 300;
+    char *buf = malloc(n);
+    uint32_t *ref = malloc(n * sizeof(uint32_t));
+    srand(42);
+    for (int round = 0; round < 200; ++round) {
+        for (size_t i = 0; i < n; ++i) {
+            buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        size_t len = rand() % (n + 1);
+        size_t ref_size = 0;
+        bool in_string = false, escaped = false;
+        for (size_t i = 0; i < len; ++i) {
+            /* like stage 1, a backslash escapes the next byte even outside
+             * of strings, where it is invalid anyway */
+            char c = buf[i];
+            bool quote = c == '"' && !escaped;
+            escaped = c == '\\' && !escaped;
+            if (quote) {
+                in_string = !in_string;
+                ref[ref_size++] = i;
+            } else if (in_string) {
+                continue;
+            } else if (strchr("{}[]:,", c)
+                       || (is_scalar_byte(c) && (i == 0 || !is_scalar_byte(buf[i - 1])))) {
+                ref[ref_size++] = i;
+            }
+        }
+        for (ScanLevel l = SCAN_SCALAR; l <= SCAN_AVX2; ++l) {
+            if (!scan_select(l)) {
+                continue;
+            }
+            JsonParser p;
+            json_parser_init(&p, buf, len, NULL, false);
+            mu_assert(json_index(&p) == JSON_STEP_DONE, "json_index failed");
+            mu_assert(p.ix.size == ref_size
+                      && memcmp(p.ix.pos, ref, ref_size * sizeof(uint32_t)) == 0,
+                      "json_index disagrees with the reference");
+            free(p.ix.pos);
+        }
+    }
+    scan_init();
+    free(ref);
+    free(buf);
+    return 0;
+}
+
+static char *write_json(const Value *v)
+{
+    Printer p;
+    printer_init_string(&p);
+    if (!json_write(&p, v)) {
+        return NULL;
+    }
+    return STRING(printer_finish(&p));
+}
+
+static char *test_read()
+{
+    /* documents read back and written out in canonical form */
+    char *docs[][2] = {
+        { "null", "null" },
+        { " true ", "true" },
+        { "[]", "[]" },
+        { "[[[]]]", "[[[]]]" },
+        { "{ \"a\" : 1 , \"b\" : [ false , null ] }", "{\"a\":1,\"b\":[false,null]}" },
+        { "{\"a\": {\"b\": {\"c\": \"d\"}}}", "{\"a\":{\"b\":{\"c\":\"d\"}}}" },
+        { "[0, -0, 2147483647, -2147483648, 2147483648]", "[0,0,2147483647,-2147483648,2147483648.0]" },
+        { "[1.5, -0.25, 1e3, 1E-7, 0.1]", "[1.5,-0.25,1000.0,1e-7,0.1]" },
+        { "\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "\"\\\"\\\\/\\u0008\\u000c\\n\\r\\t\"" },
+        { "\"\\u00e9\\u20AC\\ud83d\\ude00\"", "\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"" },
+        { "\"a\\\\\"", "\"a\\\\\"" },
+        { "[\"x\",1]", "[\"x\",1]" },
+        /* objects and arrays stay apart, members are written in key order */
+        { "{}", "{}" },
+        { "[[\"a\",1]]", "[[\"a\",1]]" },
+        { "{\"b\":1,\"a\":[],\"b\":2}", "{\"a\":[],\"b\":2}" }
+    };
+    for (size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); ++i) {
+        Value *v = json_read(docs[i][0], strlen(docs[i][0]), NULL);
+        mu_assert(v != NULL, "Failed to read a valid document");
+        char *out = write_json(v);
+        mu_assert(out && strcmp(out, docs[i][1]) == 0, "Document doesn't read back");
+    }
+
+    char *invalid[] = {
+        "", " ", "[", "[1,", "[1,]", "[1 2]", "{\"a\"}", "{\"a\":}", "{1:2}",
+        "{\"a\":1,}", "]", "01", "1.", ".5", "-", "1e", "+1", "tru", "nul",
+        "\"abc", "\"a\\x\"", "\"\\u12\"", "\"\\udc00\"", "\"\\ud800\"",
+        "\"a\nb\"", "[1] 2", "[1]]", "truex"
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        exc_clear();
+        mu_assert(json_read(invalid[i], strlen(invalid[i]), NULL) == NULL,
+                  "Invalid document was accepted");
+        mu_assert(exc_is_pending(), "No exception for an invalid document");
+    }
+    exc_clear();
+    return 0;
+}
+
+static char *test_large()
+{
+    /* long arrays and deep nesting */
+    size_t n = 100000;
+    char *doc = malloc(2 * n + 2);
+    for (size_t i = 0; i < n; ++i) {
+        doc[i] = '[';
+        doc[2 * n - i - 1] = ']';
+    }
+    doc[2 * n] = '\0';
+    Value *v = json_read(doc, 2 * n, NULL);
+    mu_assert(v != NULL && list_size(LIST(v)) == 1, "Failed to read nested arrays");
+
+    char *p = doc;
+    *p++ = '[';
+    for (size_t i = 0; i < n / 2; ++i) {
+        p += sprintf(p, "%lu,", i % 10);
+    }
+    p[-1] = ']';
+    v = json_read(doc, p - doc, NULL);
+    mu_assert(v != NULL && list_size(LIST(v)) == n / 2, "Failed to read a long array");
+    Value *item = list_nth(LIST(v), 12345);
+    mu_assert(INT(item) == 5, "Wrong array element");
+    free(doc);
+    return 0;
+}
+
+static char *test_reader()
+{
+    /* documents that straddle the blocks the reader reads in */
+    FILE *f = tmpfile();
+    mu_assert(f != NULL, "Failed to create a temporary file");
+    size_t n = 60000;
+    for (size_t i = 0; i < n; ++i) {
+        fprintf(f, "{\"id\": %lu, \"name\": \"item \\\"%lu\\\"\"}\n", i, i);
+    }
+    /* one document bigger than a block */
+    fputc('[', f);
+    for (size_t i = 0; i < JSON_READER_BLOCK / 4; ++i) {
+        fputs(i ? ",123" : "123", f);
+    }
+    fputs("] 42", f);
+    rewind(f);
+
+    JsonReader *r = json_reader_new(f);
+    Value *v;
+    size_t docs = 0;
+    while (docs < n && json_reader_next(r, &v) == JSON_OK) {
+        /* "id" orders before "name" */
+        Value *id = btree_first(BTREE(v))->value;
+        Value *name = btree_last(BTREE(v))->value;
+        char expected[64];
+        sprintf(expected, "item \"%lu\"", docs);
+        mu_assert((size_t) INT(id) == docs && strcmp(STRING(name), expected) == 0,
+                  "Wrong document read from the stream");
+        docs++;
+    }
+    mu_assert(docs == n, "Failed to read all documents");
+    mu_assert(json_reader_next(r, &v) == JSON_OK
+              && list_size(LIST(v)) == JSON_READER_BLOCK / 4, "Failed to read a large document");
+    mu_assert(json_reader_next(r, &v) == JSON_OK && INT(v) == 42,
+              "Failed to read a number at the end of the stream");
+    mu_assert(json_reader_next(r, &v) == JSON_EOF, "Expected the end of the stream");
+    json_reader_delete(r);
+    fclose(f);
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    int bos;
+    heap_start(NULL, &bos);
+    mu_run_test(test_index);
+    mu_run_test(test_read);
+    mu_run_test(test_large);
+    mu_run_test(test_reader);
+    heap_stop();
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ JSON tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
@@ -13,25 +13,25 @@ static char *type_names[] = {
 static char *input[] = {"12 ( 34.5 ) \"Hello World!\" abc 23.b (12(23))) \n"
                         "\"this is a string\" vEryC0mplicated->NamE 'symbol ",
                         "x ",
-                        "\"Testing \\\"n escapes\" "
+                        "\"Testing \\\"n escapes\" ",
+                        "1e5 -2.5E-3 (1.e+7) -.5e1 1e 1ex "
                        };
 
-static size_t n_inputs = 3;
+static size_t n_inputs = 4;
 
 static char *expected[] = {"INT LPAREN FLOAT RPAREN STRING SYMBOL ERROR LPAREN "
                            "INT LPAREN INT RPAREN RPAREN RPAREN STRING SYMBOL "
                            "QUOTE SYMBOL ",
                            "SYMBOL ",
-                           "STRING "
+                           "STRING ",
+                           "FLOAT FLOAT LPAREN FLOAT RPAREN FLOAT ERROR ERROR "
                           };
 
 static char *eval_lexer(char *input, char *expected)
 {
-    /* set up lexer to read from input file */
+    /* set up lexer to read from the input buffer */
     size_t n = strlen(input);
-    FILE *in_fd = fmemopen(input, n, "r");
-    mu_assert(in_fd != NULL, "Failed to open lexer test file");
-    Lexer *lexer = lexer_new(in_fd);
+    Lexer *lexer = lexer_new(input, n);
     mu_assert(lexer != NULL, "Failed to create a lexer object");
 
     /* at the same time, we'll read the expected symbols
@@ -42,43 +42,119 @@ static char *eval_lexer(char *input, char *expected)
     char *ref_line = NULL;
     size_t linecap = 0;
     ssize_t linelen;
-    LexerToken *tok = lexer_get_token(lexer);
+    LexerToken tok = lexer_get_token(lexer);
     linelen = getdelim(&ref_line, &linecap, ' ', ref_fd);
-    while (tok != NULL && tok->type != LEXER_TOK_EOF && linelen > 0) {
+    while (tok.type != LEXER_TOK_EOF && linelen > 0) {
         ref_line[linelen - 1] = '\0';
-        // printf("'%s' =?= '%s'\n", type_names[tok->type], ref_line);
-        mu_assert(strcmp(type_names[tok->type], ref_line) == 0,
+        // printf("'%s' =?= '%s'\n", type_names[tok.type], ref_line);
+        mu_assert(strcmp(type_names[tok.type], ref_line) == 0,
                   "Unexpected symbol");
-        lexer_delete_token(tok);
         tok = lexer_get_token(lexer);
         linelen = getdelim(&ref_line, &linecap, ' ', ref_fd);
     }
-    mu_assert(tok != NULL && tok->type == LEXER_TOK_EOF
-              && linelen == -1, "Incorrect number of symbols");
+    mu_assert(tok.type == LEXER_TOK_EOF && linelen == -1,
+              "Incorrect number of symbols");
     lexer_delete(lexer);
     fclose(ref_fd);
-    fclose(in_fd);
     return 0;
 }
 
 static char *test_escapes()
 {
-    /* set up lexer to read from input file */
+    /* set up lexer to read from the input buffer */
     char* input = "\"This \\n is a \\t \\\"string\"";
     char* result = "This \n is a \t \"string";
     size_t n = strlen(input);
-    FILE *in_fd = fmemopen(input, n, "r");
-    mu_assert(in_fd != NULL, "Failed to open lexer test file");
-    Lexer *lexer = lexer_new(in_fd);
+    Lexer *lexer = lexer_new(input, n);
     mu_assert(lexer != NULL, "Failed to create a lexer object");
 
-    LexerToken *tok = lexer_get_token(lexer);
-    mu_assert(tok != NULL && tok->type == LEXER_TOK_STRING,
+    LexerToken tok = lexer_get_token(lexer);
+    mu_assert(tok.type == LEXER_TOK_STRING,
               "Expect a string token for escape strings");
-    mu_assert(strncmp(tok->as.str, result, n) == 0,
-              "Expect strings to be equal");
+    char str[64];
+    lexer_token_copy(lexer, &tok, str);
+    mu_assert(strcmp(str, result) == 0, "Expect strings to be equal");
     lexer_delete(lexer);
-    fclose(in_fd);
+    return 0;
+}
+
+static char *test_floats()
+{
+    char *input = "0.1 -2.5e-3 1e308 4.9e-324 -.5 9007199254740993.0";
+    double expected[] = { 0.1, -2.5e-3, 1e308, 4.9e-324, -0.5, 9007199254740992.0 };
+    Lexer *lexer = lexer_new(input, strlen(input));
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        LexerToken tok = lexer_get_token(lexer);
+        mu_assert(tok.type == LEXER_TOK_FLOAT, "Expect a float token");
+        mu_assert(lexer_token_float(lexer, &tok) == expected[i],
+                  "Float tokens must be read correctly rounded");
+    }
+    lexer_delete(lexer);
+    return 0;
+}
+
+static char *test_long_tokens()
+{
+    /* tokens are slices of the input, there is no size limit */
+    size_t n = 1 << 16;
+    char *input = malloc(n + 3);
+    input[0] = '"';
+    memset(input + 1, 'x', n);
+    input[n + 1] = '"';
+    input[n + 2] = '\0';
+    Lexer *lexer = lexer_new(input, n + 2);
+    LexerToken tok = lexer_get_token(lexer);
+    mu_assert(tok.type == LEXER_TOK_STRING && tok.length == n,
+              "Expect a single long string token");
+    tok = lexer_get_token(lexer);
+    mu_assert(tok.type == LEXER_TOK_EOF, "Expect EOF after a long string");
+    lexer_delete(lexer);
+    free(input);
+    return 0;
+}
+
+static char *test_streams()
+{
+    /* a stream is read in blocks: tokens that straddle a block boundary,
+     * or are longer than a block, must come out as from a buffer */
+    size_t n = 4 * LEXER_STREAM_BLOCK;
+    char *input = malloc(n + 1);
+    size_t len = 0;
+    for (size_t i = 0; len + 64 < n / 2; ++i) {
+        len += sprintf(input + len, "(sym%lu %lu \"s\\\"%lu\" %lu.5)\n", i, i, i, i % 7);
+    }
+    input[len++] = '"';
+    memset(input + len, 'x', LEXER_STREAM_BLOCK + 3);
+    len += LEXER_STREAM_BLOCK + 3;
+    len += sprintf(input + len, "\" tail");
+    FILE *f = fmemopen(input, len, "r");
+    Lexer *stream = lexer_new_file(f);
+    mu_assert(stream->stream != NULL, "Expect a memory stream to be read in blocks");
+    Lexer *lexer = lexer_new(input, len);
+    char *a = malloc(len);
+    char *b = malloc(len);
+    while (true) {
+        LexerToken expect = lexer_get_token(lexer);
+        LexerToken tok = lexer_get_token(stream);
+        mu_assert(tok.type == expect.type && tok.length == expect.length,
+                  "Expect the same tokens from a stream as from a buffer");
+        mu_assert(tok.line == expect.line && tok.column == expect.column,
+                  "Expect the same token positions from a stream");
+        if (tok.type == LEXER_TOK_EOF) {
+            break;
+        }
+        size_t na = lexer_token_copy(stream, &tok, a);
+        size_t nb = lexer_token_copy(lexer, &expect, b);
+        mu_assert(na == nb && memcmp(a, b, na) == 0,
+                  "Expect the same token text from a stream");
+    }
+    mu_assert(stream->capacity < n, "Expect a stream to be read in blocks");
+    lexer_delete(lexer);
+    lexer_delete(stream);
+    fclose(f);
+    free(a);
+    free(b);
+    free(input);
     return 0;
 }
 
@@ -99,6 +175,9 @@ static char *test_suite()
 {
     mu_run_test(test_lexer);
     mu_run_test(test_escapes);
+    mu_run_test(test_floats);
+    mu_run_test(test_long_tokens);
+    mu_run_test(test_streams);
     return 0;
 }
 
@@ -1,7 +1,7 @@
 #include "minunit.h"
 
 #include <string.h>
-#include "gc.h"
+#include "heap.h"
 #include "log.h"
 
 #include "../src/map.c"
@@ -33,14 +33,42 @@ static char *test_map()
     return 0;
 }
 
+static char *test_map_hashed()
+{
+    Map *ht = map_new(3);
+    map_put_hashed(ht, "key", djb2("key"), "value", strlen("value") + 1);
+    char *value = (char *) map_get(ht, "key");
+    mu_assert(value != NULL, "Plain query must find key inserted with its hash");
+    mu_assert(strcmp(value, "value") == 0, "Query must return inserted value");
+    value = (char *) map_get_hashed(ht, "key", djb2("key"));
+    mu_assert(value != NULL, "Hashed query must find key");
+    mu_assert(map_get(ht, "keys") == NULL, "Query must not match on a prefix");
+    mu_assert(map_get(ht, "ke") == NULL, "Query must not match on a prefix");
+
+    // keys survive resizing without being rehashed
+    char key[16];
+    for (int i = 0; i < 100; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        map_put(ht, key, &i, sizeof(int));
+    }
+    for (int i = 0; i < 100; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        int *n = (int *) map_get(ht, key);
+        mu_assert(n != NULL && *n == i, "Query must find every key after resizing");
+    }
+    map_delete(ht);
+    return 0;
+}
+
 int tests_run = 0;
 
 static char *test_suite()
 {
     void *bos = NULL;
-    gc_start(&gc, &bos);
+    heap_start(NULL, &bos);
     mu_run_test(test_map);
-    gc_stop(&gc);
+    mu_run_test(test_map_hashed);
+    heap_stop();
     return 0;
 }
 
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+#include "../src/matrix.c"
+
+
+static double *random_matrix(size_t m, size_t n)
+{
+    /* small integers, so every order of adding up products is exact */
+    double *a = malloc(m * n * sizeof(double));
+    for (size_t i = 0; i < m * n; ++i) {
+        a[i] = rand() % 19 - 9;
+    }
+    return a;
+}
+
+static char *test_mul()
+{
+    /* sizes that are and aren't multiples of the blocks */
+    size_t sizes[][3] = {
+        { 1, 1, 1 }, { 3, 5, 7 }, { 17, MATRIX_BLOCK_K + 3, MATRIX_BLOCK_N + 9 },
+        { 2, 2 * MATRIX_BLOCK_K, 2 * MATRIX_BLOCK_N }
+    };
+    srand(42);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t m = sizes[s][0], k = sizes[s][1], n = sizes[s][2];
+        double *a = random_matrix(m, k), *b = random_matrix(k, n), *c = random_matrix(m, n);
+        for (NumvecLevel l = NUMVEC_SCALAR; l <= NUMVEC_AVX2; ++l) {
+            if (!numvec_select(l)) {
+                continue;
+            }
+            matrix_mul(c, a, b, m, k, n);
+            for (size_t i = 0; i < m; ++i) {
+                for (size_t j = 0; j < n; ++j) {
+                    double dot = 0;
+                    for (size_t p = 0; p < k; ++p) {
+                        dot += a[i * k + p] * b[p * n + j];
+                    }
+                    mu_assert(c[i * n + j] == dot, "Wrong element of a product");
+                }
+            }
+        }
+        free(a);
+        free(b);
+        free(c);
+    }
+    return 0;
+}
+
+static char *test_transpose()
+{
+    size_t sizes[][2] = { { 1, 1 }, { 1, 5 }, { MATRIX_TILE + 1, 3 * MATRIX_TILE - 1 } };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t m = sizes[s][0], n = sizes[s][1];
+        double *a = random_matrix(m, n), *t = random_matrix(n, m);
+        matrix_transpose(t, a, m, n);
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                mu_assert(t[j * m + i] == a[i * n + j], "Wrong element of a transposition");
+            }
+        }
+        free(a);
+        free(t);
+    }
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    mu_run_test(test_mul);
+    mu_run_test(test_transpose);
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ Matrix tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
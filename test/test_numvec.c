@@ -0,0 +1,146 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+
+#include "../src/numvec.c"
+
+#define N 259   /* not a multiple of any vector width, so tails are covered */
+
+static double f64[N], f64_b[N], f64_out[N], f64_ref[N];
+static int64_t i64[N], i64_b[N], i64_out[N], i64_ref[N];
+static int64_t mask[N], mask_ref[N];
+
+static void fill()
+{
+    /* small integers in the floats, so some of them compare equal */
+    for (size_t i = 0; i < N; ++i) {
+        f64[i] = (double) (rand() % 21 - 10) / 4;
+        f64_b[i] = (double) (rand() % 21 - 10) / 4;
+        i64[i] = (int64_t) rand() * (rand() % 2 ? 1 : -1) * (1ll << (rand() % 32));
+        i64_b[i] = rand() % 2 ? rand() % 7 - 3 : (int64_t) rand() << 31;
+    }
+}
+
+static bool same(const void *a, const void *b, size_t n)
+{
+    return memcmp(a, b, n * 8) == 0;
+}
+
+static char *test_arith()
+{
+    srand(42);
+    for (int round = 0; round < 20; ++round) {
+        fill();
+        for (NumvecOp op = NUMVEC_ADD; op <= NUMVEC_DIV; ++op) {
+            for (size_t bstep = 0; bstep <= 1; ++bstep) {
+                f64_arith_scalar(op, f64_ref, f64, f64_b, bstep, N);
+                i64_arith_scalar(op, i64_ref, i64, i64_b, bstep, N);
+                for (NumvecLevel l = NUMVEC_SCALAR; l <= NUMVEC_AVX2; ++l) {
+                    if (!numvec_select(l)) {
+                        continue;
+                    }
+                    numvec_f64_arith(op, f64_out, f64, f64_b, bstep, N);
+                    mu_assert(same(f64_out, f64_ref, N), "f64 arithmetic disagrees with the scalar version");
+                    if (op != NUMVEC_DIV) {
+                        numvec_i64_arith(op, i64_out, i64, i64_b, bstep, N);
+                        mu_assert(same(i64_out, i64_ref, N), "i64 arithmetic disagrees with the scalar version");
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static char *test_div()
+{
+    int64_t a[] = { 7, -7, INT64_MIN, 9 };
+    int64_t b[] = { 2, 2, -1, 0 };
+    mu_assert(!numvec_i64_arith(NUMVEC_DIV, i64_out, a, b, 1, 4), "Division by zero succeeded");
+    mu_assert(i64_out[0] == 3 && i64_out[1] == -3 && i64_out[2] == INT64_MIN,
+              "Integer division doesn't truncate or wrap");
+    return 0;
+}
+
+static char *test_cmp()
+{
+    srand(42);
+    for (int round = 0; round < 20; ++round) {
+        fill();
+        f64[0] = NAN;
+        for (NumvecCmp cmp = NUMVEC_LT; cmp <= NUMVEC_EQ; ++cmp) {
+            for (size_t bstep = 0; bstep <= 1; ++bstep) {
+                for (NumvecLevel l = NUMVEC_SCALAR; l <= NUMVEC_AVX2; ++l) {
+                    if (!numvec_select(l)) {
+                        continue;
+                    }
+                    f64_cmp_scalar(cmp, mask_ref, f64, f64_b, bstep, N);
+                    numvec_f64_cmp(cmp, mask, f64, f64_b, bstep, N);
+                    mu_assert(same(mask, mask_ref, N), "f64 comparison disagrees with the scalar version");
+                    i64_cmp_scalar(cmp, mask_ref, i64, i64_b, bstep, N);
+                    numvec_i64_cmp(cmp, mask, i64, i64_b, bstep, N);
+                    mu_assert(same(mask, mask_ref, N), "i64 comparison disagrees with the scalar version");
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static char *test_reduce()
+{
+    srand(42);
+    for (int round = 0; round < 20; ++round) {
+        fill();
+        for (size_t n = 1; n <= N; n += 17) {
+            double sum = f64_sum_scalar(f64, n), dot = f64_dot_scalar(f64, f64_b, n);
+            double min, max, ref_min, ref_max;
+            int64_t imin, imax, ref_imin, ref_imax;
+            f64_min_max_first(f64, n, &ref_min, &ref_max);
+            i64_min_max_first(i64, n, &ref_imin, &ref_imax);
+            for (NumvecLevel l = NUMVEC_SCALAR; l <= NUMVEC_AVX2; ++l) {
+                if (!numvec_select(l)) {
+                    continue;
+                }
+                /* quarters add up exactly, the order doesn't matter */
+                mu_assert(numvec_f64_sum(f64, n) == sum, "f64 sum disagrees with the scalar version");
+                mu_assert(numvec_f64_dot(f64, f64_b, n) == dot, "f64 dot disagrees with the scalar version");
+                mu_assert(numvec_i64_sum(i64, n) == i64_sum_scalar(i64, n),
+                          "i64 sum disagrees with the scalar version");
+                mu_assert(numvec_i64_dot(i64, i64_b, n) == i64_dot_scalar(i64, i64_b, n),
+                          "i64 dot disagrees with the scalar version");
+                numvec_f64_min_max(f64, n, &min, &max);
+                mu_assert(min == ref_min && max == ref_max, "f64 min/max disagrees with the scalar version");
+                numvec_i64_min_max(i64, n, &imin, &imax);
+                mu_assert(imin == ref_imin && imax == ref_imax, "i64 min/max disagrees with the scalar version");
+            }
+        }
+    }
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    mu_run_test(test_arith);
+    mu_run_test(test_div);
+    mu_run_test(test_cmp);
+    mu_run_test(test_reduce);
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ Numeric vector tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
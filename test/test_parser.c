@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "minunit.h"
 #include "parser.h"
@@ -27,14 +28,60 @@ static char *test_parser()
     return 0;
 }
 
+static char *test_parser_large()
+{
+    /* long lists are linear, deep nesting doesn't use the C stack and is
+     * bounded so that collections can mark the result */
+    size_t n = 100000;
+    char *source = malloc(4 * n + 3);
+    char *p = source;
+    *p++ = '(';
+    for (size_t i = 0; i < n; ++i) {
+        p += sprintf(p, "%lu ", i % 10);
+    }
+    *p++ = ')';
+    Value *ast = NULL;
+    ParseResult success = parser_parse_buffer(source, p - source, &ast);
+    mu_assert(success == PARSER_SUCCESS, "Failed to parse a long list");
+    mu_assert(list_size(LIST(ast)) == n, "Wrong length of a long list");
+
+    n = PARSER_MAX_DEPTH;
+    memset(source, '(', n);
+    memset(source + n, ')', n);
+    success = parser_parse_buffer(source, 2 * n, &ast);
+    mu_assert(success == PARSER_SUCCESS, "Failed to parse a deeply nested list");
+    /* rooted, so the collection has to mark every level */
+    heap_make_static(ast);
+    heap_collect();
+    size_t depth = 1;
+    for (Value *v = ast; list_size(LIST(v)) > 0; v = list_head(LIST(v))) {
+        ++depth;
+    }
+    mu_assert(depth == n, "Wrong depth of a deeply nested list");
+    success = parser_parse_buffer(source, 2 * n - 1, &ast);
+    mu_assert(success == PARSER_FAIL, "Expect unbalanced parens to fail");
+
+    memset(source, '\'', n + 1);
+    source[n + 1] = 'a';
+    success = parser_parse_buffer(source, n + 2, &ast);
+    mu_assert(success == PARSER_FAIL, "Expect nesting past the limit to fail");
+    success = parser_parse_buffer(source + 1, n + 1, &ast);
+    mu_assert(success == PARSER_SUCCESS, "Failed to parse deeply nested quotes");
+    heap_make_static(ast);
+    heap_collect();
+    free(source);
+    return 0;
+}
+
 int tests_run = 0;
 
 static char *test_suite()
 {
     int bos;
-    gc_start(&gc, &bos);
+    heap_start(NULL, &bos);
     mu_run_test(test_parser);
-    gc_stop(&gc);
+    mu_run_test(test_parser_large);
+    heap_stop();
     return 0;
 }
 
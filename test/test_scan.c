@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "minunit.h"
+
+#include "../src/scan.c"
+
+
+static char *test_scan()
+{
+    /* every implementation has to agree with the scalar one, for all
+     * offsets and including the unaligned tails */
+    const char alphabet[] = "  \t\r\n\"\\ab;(";
+    size_t n = 257;
+    char *buf = malloc(n);
+    srand(42);
+    for (int round = 0; round < 50; ++round) {
+        for (size_t i = 0; i < n; ++i) {
+            buf[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        for (ScanLevel l = SCAN_SCALAR; l <= SCAN_AVX2; ++l) {
+            if (!scan_select(l)) {
+                continue;
+            }
+            for (size_t pos = 0; pos <= n; ++pos) {
+                size_t lines = 0, line_start = 0;
+                size_t ref_lines = 0, ref_line_start = 0;
+                size_t end = scan_space(buf, pos, n, &lines, &line_start);
+                mu_assert(end == scan_space_scalar(buf, pos, n, &ref_lines, &ref_line_start)
+                          && lines == ref_lines && line_start == ref_line_start,
+                          "scan_space disagrees with the scalar version");
+                mu_assert(scan_line(buf, pos, n) == scan_line_scalar(buf, pos, n),
+                          "scan_line disagrees with the scalar version");
+                mu_assert(scan_string(buf, pos, n) == scan_string_scalar(buf, pos, n),
+                          "scan_string disagrees with the scalar version");
+            }
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+static char *test_scan_json()
+{
+    /* all bytes, so the sign of the vector compares is covered too */
+    char block[SCAN_JSON_BLOCK];
+    srand(42);
+    for (int round = 0; round < 1000; ++round) {
+        for (size_t i = 0; i < sizeof(block); ++i) {
+            block[i] = (char) (rand() % 3 ? "{}[]:,\"\\ \t\r\n\x01\x1f\x7f" "a"[rand() % 16] : rand());
+        }
+        ScanJsonBlock ref;
+        scan_json_block_scalar(block, &ref);
+        for (ScanLevel l = SCAN_SCALAR; l <= SCAN_AVX2; ++l) {
+            if (!scan_select(l)) {
+                continue;
+            }
+            ScanJsonBlock m;
+            scan_json_block(block, &m);
+            mu_assert(memcmp(&m, &ref, sizeof(m)) == 0,
+                      "scan_json_block disagrees with the scalar version");
+        }
+    }
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    mu_run_test(test_scan);
+    mu_run_test(test_scan_json);
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ Scan tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}
@@ -0,0 +1,115 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minunit.h"
+
+#include "../src/sort.c"
+
+
+static int cmp_key_index(const void *a, const void *b)
+{
+    /* the stable order, for qsort */
+    const SortKey *x = a, *y = b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static char *test_keys()
+{
+    /* few distinct keys, so stability matters; sizes around the runs
+     * and the parallel threshold */
+    size_t sizes[] = { 0, 1, SORT_RUN - 1, SORT_RUN + 1, 1000, SORT_PARALLEL_MIN + 7, 300000 };
+    unsigned threads[] = { 1, 3, 4 };
+    srand(42);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t n = sizes[s];
+        SortKey *keys = malloc((n + 1) * sizeof(SortKey));
+        SortKey *expected = malloc((n + 1) * sizeof(SortKey));
+        for (size_t i = 0; i < n; ++i) {
+            expected[i] = (SortKey) { .key = rand() % 1000 - 500, .index = i };
+        }
+        SortKey *input = malloc((n + 1) * sizeof(SortKey));
+        memcpy(input, expected, n * sizeof(SortKey));
+        qsort(expected, n, sizeof(SortKey), cmp_key_index);
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+            sort_set_threads(threads[t]);
+            memcpy(keys, input, n * sizeof(SortKey));
+            sort_keys(keys, n);
+            mu_assert(memcmp(keys, expected, n * sizeof(SortKey)) == 0, "Keys sorted wrongly");
+        }
+        free(keys);
+        free(expected);
+        free(input);
+    }
+    sort_set_threads(0);
+    return 0;
+}
+
+static char *test_f64_key()
+{
+    double ordered[] = { -INFINITY, -1e300, -2.5, -1e-300, 0, 1e-300, 1, 2.5, 1e300, INFINITY, NAN };
+    size_t n = sizeof(ordered) / sizeof(ordered[0]);
+    for (size_t i = 1; i < n; ++i) {
+        mu_assert(sort_f64_key(ordered[i - 1]) < sort_f64_key(ordered[i]), "Float keys out of order");
+    }
+    mu_assert(sort_f64_key(-0.0) == sort_f64_key(0.0), "-0.0 and 0.0 must be equal");
+    mu_assert(sort_f64_key(-NAN) == sort_f64_key(NAN), "NaNs must be equal");
+    return 0;
+}
+
+static int less_mod(size_t a, size_t b, void *ctx)
+{
+    /* by a % 10, failing once *ctx comparisons have been made */
+    size_t *budget = ctx;
+    if (*budget == 0) {
+        return -1;
+    }
+    --*budget;
+    return a % 10 < b % 10;
+}
+
+static char *test_indices()
+{
+    size_t n = 1000;
+    size_t *indices = malloc(n * sizeof(size_t));
+    for (size_t i = 0; i < n; ++i) {
+        indices[i] = n - 1 - i;
+    }
+    size_t budget = SIZE_MAX;
+    mu_assert(sort_indices(indices, n, less_mod, &budget), "Failed to sort indices");
+    for (size_t i = 1; i < n; ++i) {
+        mu_assert(indices[i - 1] % 10 < indices[i] % 10
+                  || (indices[i - 1] % 10 == indices[i] % 10 && indices[i - 1] > indices[i]),
+                  "Indices sorted wrongly or not stably");
+    }
+    budget = 100;
+    mu_assert(!sort_indices(indices, n, less_mod, &budget), "Failing comparison must fail the sort");
+    free(indices);
+    return 0;
+}
+
+int tests_run = 0;
+
+static char *test_suite()
+{
+    mu_run_test(test_keys);
+    mu_run_test(test_f64_key);
+    mu_run_test(test_indices);
+    return 0;
+}
+
+int main()
+{
+    printf("---=[ Sort tests\n");
+    char *result = test_suite();
+    if (result != 0) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}